@@ -0,0 +1,335 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+
+// 批量装载用的大页 arena：装载后基本只读的专利记录、标题和容器存储从几块大的连续区域里顺序切出来，
+// 查找时少跨页、少 TLB 缺失。区域优先用 MAP_HUGETLB（需要系统预留大页），
+// 拿不到就按 2MB 对齐映射普通匿名内存并 madvise(MADV_HUGEPAGE) 交给透明大页。
+// 单个块不单独归还，只记账；整个 arena 在最后一次 munmap 里一起释放
+class HugePageArena {
+public:
+    static const size_t kHugePage = 2 * 1024 * 1024;
+
+    struct Stats {
+        size_t reserved;      // 映射的总字节数
+        size_t used;          // 已经切出去的字节数（含对齐填充）
+        size_t released;      // 容器在 arena 里释放掉、等整体回收的字节数
+        size_t chunks;
+        size_t hugetlbBytes;  // 其中用 MAP_HUGETLB 映射的字节数
+
+        Stats() : reserved(0), used(0), released(0), chunks(0), hugetlbBytes(0) {}
+    };
+
+private:
+    struct Chunk {
+        char* base;
+        size_t size;
+        bool hugetlb;
+    };
+
+    // 全局的 2MB 帧号 -> arena 表（开放寻址、只增不删，删除时留墓碑），释放内存时不用加锁就能认出 arena 的块；
+    // 最多登记 kFrames 个帧，即 128GB
+    enum { kFrameBits = 16, kFrames = 1 << kFrameBits };
+    static const uintptr_t kTombstone = 1;
+    // 登记中的槽：先占住槽再写 owner，最后才发布帧号，查找方看到帧号时 owner 一定已经写好
+    static const uintptr_t kReserved = ~static_cast<uintptr_t>(0);
+
+    struct FrameTable {
+        std::atomic<uintptr_t> frame[kFrames];
+        std::atomic<HugePageArena*> owner[kFrames];
+        FrameTable() {
+            for (size_t i = 0; i < kFrames; ++i) {
+                frame[i].store(0, std::memory_order_relaxed);
+                owner[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    static FrameTable& frames() {
+        static FrameTable table;
+        return table;
+    }
+
+    static size_t slotOf(uintptr_t frame) {
+        return static_cast<size_t>((frame * 0x9E3779B97F4A7C15ULL) >> (64 - kFrameBits));
+    }
+
+    static void registerFrames(const Chunk& chunk, HugePageArena* arena) {
+        FrameTable& t = frames();
+        uintptr_t first = reinterpret_cast<uintptr_t>(chunk.base) / kHugePage;
+        for (uintptr_t f = first; f < first + chunk.size / kHugePage; ++f) {
+            size_t i = slotOf(f);
+            for (size_t probe = 0;; ++probe, i = (i + 1) & (kFrames - 1)) {
+                if (probe == kFrames) throw std::bad_alloc();
+                uintptr_t current = t.frame[i].load(std::memory_order_relaxed);
+                if (current != 0 && current != kTombstone) continue;
+                if (!t.frame[i].compare_exchange_strong(current, kReserved, std::memory_order_acquire)) continue;
+                t.owner[i].store(arena, std::memory_order_relaxed);
+                t.frame[i].store(f, std::memory_order_release);
+                break;
+            }
+        }
+    }
+
+    static void unregisterFrames(const Chunk& chunk) {
+        FrameTable& t = frames();
+        uintptr_t first = reinterpret_cast<uintptr_t>(chunk.base) / kHugePage;
+        for (uintptr_t f = first; f < first + chunk.size / kHugePage; ++f) {
+            size_t i = slotOf(f);
+            for (size_t probe = 0; probe < kFrames; ++probe, i = (i + 1) & (kFrames - 1)) {
+                uintptr_t current = t.frame[i].load(std::memory_order_relaxed);
+                if (current == 0) break;
+                if (current == f) {
+                    t.owner[i].store(nullptr, std::memory_order_relaxed);
+                    t.frame[i].store(kTombstone, std::memory_order_release);
+                    break;
+                }
+            }
+        }
+    }
+
+    static HugePageArena* ownerOf(const void* p) {
+        FrameTable& t = frames();
+        uintptr_t f = reinterpret_cast<uintptr_t>(p) / kHugePage;
+        size_t i = slotOf(f);
+        for (size_t probe = 0; probe < kFrames; ++probe, i = (i + 1) & (kFrames - 1)) {
+            uintptr_t current = t.frame[i].load(std::memory_order_acquire);
+            if (current == 0) return nullptr;
+            if (current == f) return t.owner[i].load(std::memory_order_relaxed);
+        }
+        return nullptr;
+    }
+
+    static std::atomic<size_t>& arenaCount() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+
+    mutable std::mutex mtx;
+    std::vector<Chunk> chunks;
+    char* cursor;
+    char* limit;
+    size_t chunkBytes;
+    bool tryHugeTLB;
+    size_t used;
+    std::atomic<size_t> released;
+    std::atomic<size_t> liveBlocks;  // 经 allocate 切出、还没归还的块
+    std::atomic<bool> retired;
+    // 退役后还有存活块时由 arena 自己持有自己，最后一块归还时放开
+    std::shared_ptr<HugePageArena> self;
+
+    HugePageArena(size_t chunkBytes, bool tryHugeTLB)
+        : cursor(nullptr), limit(nullptr), chunkBytes(roundUp(chunkBytes < kHugePage ? kHugePage : chunkBytes, kHugePage)),
+          tryHugeTLB(tryHugeTLB), used(0), released(0), liveBlocks(0), retired(false) {}
+
+    static size_t roundUp(size_t n, size_t align) {
+        return (n + align - 1) / align * align;
+    }
+
+    // 多映射一个大页的长度再裁掉头尾，保证区域按 2MB 对齐，透明大页才能整页铺上
+    Chunk mapChunk(size_t bytes) {
+        bytes = roundUp(bytes, kHugePage);
+#ifdef MAP_HUGETLB
+        if (tryHugeTLB) {
+            void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                Chunk chunk = {static_cast<char*>(p), bytes, true};
+                return chunk;
+            }
+            tryHugeTLB = false;  // 没有预留大页，之后不再试
+        }
+#endif
+        size_t span = bytes + kHugePage;
+        void* raw = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        char* begin = static_cast<char*>(raw);
+        char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(begin), kHugePage));
+        if (aligned > begin) ::munmap(begin, aligned - begin);
+        char* end = aligned + bytes;
+        if (begin + span > end) ::munmap(end, begin + span - end);
+#ifdef MADV_HUGEPAGE
+        ::madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+        Chunk chunk = {aligned, bytes, false};
+        return chunk;
+    }
+
+    Chunk addChunk(size_t bytes) {
+        Chunk chunk = mapChunk(bytes);
+        try {
+            registerFrames(chunk, this);
+        } catch (...) {
+            unregisterFrames(chunk);
+            ::munmap(chunk.base, chunk.size);
+            throw;
+        }
+        chunks.push_back(chunk);
+        return chunk;
+    }
+
+    void* bump(size_t bytes, size_t align) {
+        if (align == 0) align = 1;
+        char* p = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(cursor), align));
+        if (!cursor || p + bytes > limit) {
+            // 放不下时开新区域；特别大的块单独一块区域，不打断当前区域
+            if (bytes + align > chunkBytes) {
+                used += bytes;
+                return addChunk(bytes).base;
+            }
+            Chunk chunk = addChunk(chunkBytes);
+            cursor = chunk.base;
+            limit = chunk.base + chunk.size;
+            p = cursor;
+        }
+        used += static_cast<size_t>(p + bytes - cursor);
+        cursor = p + bytes;
+        return p;
+    }
+
+    void dropSelf() {
+        std::shared_ptr<HugePageArena> keep;  // 在锁外放开，可能就此析构
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            keep.swap(self);
+        }
+    }
+
+public:
+    // chunkBytes 为每块区域的大小，向上取整到 2MB；所有者用完后要调用 retire
+    static std::shared_ptr<HugePageArena> create(size_t chunkBytes = 64 * 1024 * 1024, bool tryHugeTLB = true) {
+        std::shared_ptr<HugePageArena> arena(new HugePageArena(chunkBytes, tryHugeTLB));
+        arena->self = arena;
+        arenaCount().fetch_add(1, std::memory_order_relaxed);
+        return arena;
+    }
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    ~HugePageArena() {
+        for (const auto& chunk : chunks) {
+            unregisterFrames(chunk);
+            ::munmap(chunk.base, chunk.size);
+        }
+        arenaCount().fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // 当前线程的分配目标，由 ArenaScope 设置；为 nullptr 时 TrackingAllocator 走普通的堆
+    static HugePageArena*& active() {
+        static thread_local HugePageArena* current = nullptr;
+        return current;
+    }
+
+    // 容器用的块：计入存活块数，之后经 releaseOwned 归还
+    void* allocate(size_t bytes, size_t align) {
+        std::lock_guard<std::mutex> lock(mtx);
+        void* p = bump(bytes, align);
+        liveBlocks.fetch_add(1, std::memory_order_relaxed);
+        return p;
+    }
+
+    // 不单独归还的字节（比如标题），生命周期跟着持有 arena 的对象
+    void* allocateBytes(size_t bytes, size_t align = 1) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return bump(bytes, align);
+    }
+
+    // p 属于某个 arena 时只记账并返回 true，不加锁；进程里没有 arena 时只读一次原子计数
+    static bool releaseOwned(void* p, size_t bytes) {
+        if (arenaCount().load(std::memory_order_relaxed) == 0) return false;
+        HugePageArena* owner = ownerOf(p);
+        if (!owner) return false;
+        owner->released.fetch_add(bytes, std::memory_order_relaxed);
+        if (owner->liveBlocks.fetch_sub(1, std::memory_order_acq_rel) == 1 && owner->retired.load()) owner->dropSelf();
+        return true;
+    }
+
+    // 所有者不再往里分配：容器块都归还之后，最后一个持有者放手时整块 munmap
+    void retire() {
+        retired.store(true);
+        if (liveBlocks.load(std::memory_order_acquire) == 0) dropSelf();
+    }
+
+    bool owns(const void* p) const {
+        return ownerOf(p) == this;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        Stats s;
+        for (const auto& chunk : chunks) {
+            s.reserved += chunk.size;
+            if (chunk.hugetlb) s.hugetlbBytes += chunk.size;
+        }
+        s.used = used;
+        s.released = released.load(std::memory_order_relaxed);
+        s.chunks = chunks.size();
+        return s;
+    }
+
+    // 实际由透明大页铺上的字节数，读 /proc/self/smaps 里落在各区域内的映射的 AnonHugePages
+    size_t transparentHugeBytes() const {
+        std::vector<Chunk> copy;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            copy = chunks;
+        }
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        size_t overlap = 0;  // 当前映射和各区域重叠的字节数；相邻的区域可能被内核合并成一个映射
+        size_t bytes = 0;
+        while (std::getline(smaps, line)) {
+            size_t dash = line.find('-');
+            size_t space = line.find(' ');
+            if (dash != std::string::npos && space != std::string::npos && dash < space &&
+                line.find_first_not_of("0123456789abcdef") == dash) {
+                uintptr_t begin = std::stoull(line.substr(0, dash), nullptr, 16);
+                uintptr_t end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+                overlap = 0;
+                for (const auto& chunk : copy) {
+                    uintptr_t base = reinterpret_cast<uintptr_t>(chunk.base);
+                    uintptr_t lo = std::max(begin, base), hi = std::min(end, base + chunk.size);
+                    if (lo < hi) overlap += hi - lo;
+                }
+            } else if (overlap > 0 && line.compare(0, 14, "AnonHugePages:") == 0) {
+                std::istringstream in(line.substr(14));
+                size_t kb = 0;
+                in >> kb;
+                bytes += std::min(kb * 1024, overlap);
+            }
+        }
+        return bytes;
+    }
+};
+
+// 在作用域内把当前线程经 TrackingAllocator 的分配导向 arena，可以嵌套
+class ArenaScope {
+private:
+    HugePageArena* previous;
+
+public:
+    explicit ArenaScope(HugePageArena* arena) : previous(HugePageArena::active()) {
+        HugePageArena::active() = arena;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    ~ArenaScope() {
+        HugePageArena::active() = previous;
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef BATCH_LOOKUP_HPP
+#define BATCH_LOOKUP_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+
+// 批量查找的公共部分：逐个查找时每个键都要等一次缓存缺失，批量时把互不依赖的访存排在一起发出，让延迟重叠
+
+inline void prefetchRead(const void* p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+// 分组预取：每组 kGroup 个键
+//   1. 先把整组的哈希和桶号算完（只读键本身）；
+//   2. 再取各桶的首节点并预取，这一步各个键之间没有依赖，缺失可以同时在途；
+//   3. 最后在桶内逐个比较，这时节点多半已经在缓存里。
+// 对每个键调用 fn(i, value)，value 指向 map 里的 mapped_type，找不到为 nullptr
+template <class Map, class Fn>
+inline void groupProbe(const Map& map, const std::vector<std::string>& keys, Fn fn) {
+    const size_t kGroup = 16;
+    if (map.empty()) {
+        for (size_t i = 0; i < keys.size(); ++i) fn(i, static_cast<const typename Map::mapped_type*>(nullptr));
+        return;
+    }
+    size_t buckets[kGroup];
+    for (size_t base = 0; base < keys.size(); base += kGroup) {
+        size_t n = std::min(kGroup, keys.size() - base);
+        for (size_t g = 0; g < n; ++g) {
+            buckets[g] = map.bucket(keys[base + g]);
+        }
+        for (size_t g = 0; g < n; ++g) {
+            auto it = map.begin(buckets[g]);
+            if (it != map.end(buckets[g])) prefetchRead(&*it);
+        }
+        for (size_t g = 0; g < n; ++g) {
+            const std::string& key = keys[base + g];
+            const typename Map::mapped_type* value = nullptr;
+            for (auto it = map.begin(buckets[g]); it != map.end(buckets[g]); ++it) {
+                if (it->first == key) {
+                    value = &it->second;
+                    break;
+                }
+            }
+            fn(base + g, value);
+        }
+    }
+}
+
+// 无序容器（数组、链表）的批量查找：把要找的键放进哈希表，容器只扫一遍，O(容器大小 + 批大小)
+// 批里重复的键只记第一次出现的位置，最后再补上
+class KeySet {
+private:
+    std::unordered_map<std::string, size_t> first;  // 键 -> 在批里第一次出现的下标
+    std::vector<size_t> duplicateOf;                // 重复键 -> 第一次出现的下标，不重复时为自身
+    size_t remaining;
+
+public:
+    explicit KeySet(const std::vector<std::string>& keys) : duplicateOf(keys.size()), remaining(0) {
+        first.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto inserted = first.insert(std::make_pair(keys[i], i));
+            duplicateOf[i] = inserted.first->second;
+            if (inserted.second) remaining++;
+        }
+    }
+
+    // key 在批里时返回第一次出现的下标并把它划掉（之后同一个键不再命中），否则返回 -1
+    size_t take(const std::string& key) {
+        auto it = first.find(key);
+        if (it == first.end()) return static_cast<size_t>(-1);
+        size_t index = it->second;
+        first.erase(it);
+        remaining--;
+        return index;
+    }
+
+    // 全部找到后可以提前结束扫描
+    bool done() const {
+        return remaining == 0;
+    }
+
+    template <class T>
+    void fillDuplicates(std::vector<T>& out) const {
+        for (size_t i = 0; i < duplicateOf.size(); ++i) {
+            if (duplicateOf[i] != i) out[i] = out[duplicateOf[i]];
+        }
+    }
+};
+
+#endif
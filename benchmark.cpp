@@ -0,0 +1,2285 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <cstdint>
+#include <cmath>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <thread>
+#include <atomic>
+#include "ownership_history.hpp"
+#include "transfer_graph.hpp"
+#include "prefix_index.hpp"
+#include "leaderboard.hpp"
+#include "patent_filter.hpp"
+#include "title_codec.hpp"
+#include "mvcc.hpp"
+#include "workload_trace.hpp"
+#include "export.hpp"
+#include "entity_resolution.hpp"
+#include "query.hpp"
+#include "external_sort.hpp"
+#include "sketches.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "firmSys.hpp"
+
+// 性能基准测试
+// 用法: patent_bench <benchmark> [--option value]...
+//       patent_bench list
+
+typedef std::map<std::string, std::string> Options;
+
+size_t optSize(const Options& opts, const std::string& name, size_t defaultValue) {
+    auto it = opts.find(name);
+    return it == opts.end() ? defaultValue : static_cast<size_t>(std::stoull(it->second));
+}
+
+std::string optString(const Options& opts, const std::string& name, const std::string& defaultValue) {
+    auto it = opts.find(name);
+    return it == opts.end() ? defaultValue : it->second;
+}
+
+class Timer {
+private:
+    std::chrono::steady_clock::time_point start;
+public:
+    Timer() : start(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+void report(const std::string& name, double value, const std::string& unit) {
+    std::cout << std::left << std::setw(36) << name << std::right << std::setw(16) << std::fixed
+              << std::setprecision(2) << value << " " << unit << std::endl;
+}
+
+// 合成日期：每月按 28 天算，保证递增且格式合法
+uint32_t syntheticDate(size_t day) {
+    size_t year = 2000 + day / 336;
+    size_t month = (day % 336) / 28 + 1;
+    size_t dom = day % 28 + 1;
+    return static_cast<uint32_t>(year * 10000 + month * 100 + dom);
+}
+
+// 转让历史：N 个转让事件写入 OwnershipHistory，再做随机时间点查询
+int benchHistory(const Options& opts) {
+    size_t events = optSize(opts, "--events", 10000000);
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 10000);
+    size_t queries = optSize(opts, "--queries", 1000000);
+    size_t budgetMB = optSize(opts, "--budget-mb", 1024);
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> patentIDs(patents);
+    std::vector<std::string> firmIDs(firms);
+    for (size_t i = 0; i < patents; ++i) patentIDs[i] = std::to_string(8000000 + i);
+    for (size_t i = 0; i < firms; ++i) firmIDs[i] = std::to_string(100000 + i);
+
+    OwnershipHistory history;
+    Timer load;
+    for (size_t i = 0; i < patents; ++i) {
+        history.record(patentIDs[i], firmIDs[rng() % firms], syntheticDate(0));
+    }
+    double loadSeconds = load.seconds();
+
+    // 每天 events/3650 个转让，跨度约十年
+    size_t perDay = events / 3650 + 1;
+    Timer ingest;
+    for (size_t i = 0; i < events; ++i) {
+        history.record(patentIDs[rng() % patents], firmIDs[rng() % firms], syntheticDate(1 + i / perDay));
+    }
+    double ingestSeconds = ingest.seconds();
+    uint32_t lastDay = static_cast<uint32_t>(events / perDay + 1);
+
+    Timer ownerTimer;
+    size_t found = 0;
+    for (size_t i = 0; i < queries; ++i) {
+        if (!history.ownerAt(patentIDs[rng() % patents], syntheticDate(rng() % lastDay)).empty()) found++;
+    }
+    double ownerSeconds = ownerTimer.seconds();
+
+    Timer sizeTimer;
+    size_t total = 0;
+    for (size_t i = 0; i < queries; ++i) {
+        total += history.portfolioSizeAt(firmIDs[rng() % firms], syntheticDate(rng() % lastDay));
+    }
+    double sizeSeconds = sizeTimer.seconds();
+
+    size_t portfolioQueries = std::min<size_t>(queries, 1000);
+    Timer portfolioTimer;
+    for (size_t i = 0; i < portfolioQueries; ++i) {
+        total += history.portfolioAt(firmIDs[rng() % firms], syntheticDate(rng() % lastDay)).size();
+    }
+    double portfolioSeconds = portfolioTimer.seconds();
+
+    size_t bytes = history.memoryUsage();
+    size_t recorded = history.getEventCount();
+    report("initial grants loaded", patents / loadSeconds, "events/s");
+    report("transfer ingest", events / ingestSeconds, "events/s");
+    report("ownerAt", ownerSeconds / queries * 1e9, "ns/query");
+    report("portfolioSizeAt", sizeSeconds / queries * 1e9, "ns/query");
+    report("portfolioAt", portfolioSeconds / portfolioQueries * 1e6, "us/query");
+    report("log bytes per event", static_cast<double>(history.logBytes()) / recorded, "B");
+    report("total memory", bytes / 1048576.0, "MB");
+    std::cout << "(checksum " << found + total << ")" << std::endl;
+
+    if (bytes > budgetMB * 1048576) {
+        std::cerr << "Error: memory " << bytes / 1048576 << " MB exceeds budget of " << budgetMB << " MB" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// "1,2,4" 形式的线程数列表
+std::vector<size_t> optThreadList(const Options& opts) {
+    std::vector<size_t> result;
+    std::stringstream ss(optString(opts, "--threads", std::to_string(defaultThreadCount())));
+    std::string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) result.push_back(static_cast<size_t>(std::stoul(item)));
+    }
+    return result;
+}
+
+// 转让图：构建 CSR，并在不同线程数下跑 PageRank / 连通分量 / top-k
+int benchGraph(const Options& opts) {
+    size_t edgeCount = optSize(opts, "--edges", 10000000);
+    size_t firms = optSize(opts, "--firms", 1000000);
+    size_t iterations = optSize(opts, "--iterations", 10);
+    std::vector<size_t> threadList = optThreadList(opts);
+
+    TransferGraph graph;
+    for (size_t i = 0; i < firms; ++i) graph.vertexOf(std::to_string(100000 + i));
+
+    // 偏斜分布：少数大企业参与了大部分转让
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    graph.reserveEdges(EdgeKind::Transfer, edgeCount);
+    Timer gen;
+    for (size_t i = 0; i < edgeCount; ++i) {
+        double a = uniform(rng), b = uniform(rng);
+        uint32_t from = static_cast<uint32_t>(firms * a * a * a) % firms;
+        uint32_t to = static_cast<uint32_t>(firms * b * b) % firms;
+        graph.addEdge(from, to, EdgeKind::Transfer);
+    }
+    report("edge generation", edgeCount / gen.seconds() / 1e6, "M edges/s");
+
+    for (size_t threads : threadList) {
+        std::cout << "--- threads: " << threads << std::endl;
+        Timer build;
+        graph.build(EdgeKind::Transfer, threads);
+        double buildSeconds = build.seconds();
+        report("CSR build", edgeCount / buildSeconds / 1e6, "M edges/s");
+        report("unique edges", static_cast<double>(graph.outEdges().edgeCount()), "");
+
+        Timer pr;
+        std::vector<double> rank = graph.pageRank(0.85, iterations, 0.0, threads);
+        report("PageRank per iteration", pr.seconds() / iterations * 1e3, "ms");
+
+        Timer cc;
+        std::vector<uint32_t> label = graph.connectedComponents(threads);
+        report("connected components", cc.seconds() * 1e3, "ms");
+        report("components", static_cast<double>(TransferGraph::componentCount(label)), "");
+
+        Timer top;
+        std::vector<TransferGraph::FirmPair> pairs = graph.topPairs(100, threads);
+        report("top-100 pairs", top.seconds() * 1e3, "ms");
+
+        Timer src;
+        size_t found = 0;
+        for (size_t i = 0; i < 10000; ++i) {
+            found += graph.topSources(graph.firmOf(static_cast<uint32_t>(rng() % firms)), 10).size();
+        }
+        report("top-10 sources of a firm", src.seconds() / 10000 * 1e6, "us/query");
+
+        // 加边之后不调用 build()，下一次分析自动重建快照
+        for (size_t i = 0; i < 1000; ++i) {
+            graph.addEdge(static_cast<uint32_t>(rng() % firms), static_cast<uint32_t>(rng() % firms), EdgeKind::Transfer);
+        }
+        Timer again;
+        rank = graph.pageRank(0.85, iterations, 0.0, threads);
+        report("PageRank after 1000 adds (rebuild)", again.seconds() * 1e3, "ms");
+        (void)rank;
+        (void)found;
+    }
+    report("graph memory", graph.memoryUsage() / 1048576.0, "MB");
+    return 0;
+}
+
+// 合成专利：标题从常见短语里拼出来，长度和真实数据接近
+Patent makeSyntheticPatent(size_t i, const std::string& firmID, std::mt19937_64& rng) {
+    static const char* words[] = {"Semiconductor", "device", "Methods", "and", "systems", "for", "processing",
+                                  "image", "data", "wireless", "communication", "network", "memory", "controller",
+                                  "vehicle", "display", "apparatus", "optical", "signal", "power"};
+    std::string title;
+    size_t n = 3 + rng() % 8;
+    for (size_t w = 0; w < n; ++w) {
+        if (w) title += ' ';
+        title += words[rng() % 20];
+    }
+    static const char* countries[] = {"US", "JP", "KR", "CN", "DE"};
+    std::string date = std::to_string(syntheticDate(rng() % 6000));
+    return Patent(std::to_string(8000000 + i), date, date, title, countries[rng() % 5], firmID);
+}
+
+std::shared_ptr<IFirmSystem> makeFirmSystem(FirmType firmType, bool mapSystem) {
+    if (mapSystem) {
+        return std::make_shared<FirmSystemUnorderedMap>(firmType);
+    }
+    return std::make_shared<FirmSystemVector>(firmType);
+}
+
+// 按企业分批把 N 个合成专利装进系统；专利数量按企业编号呈偏斜分布
+void populate(IFirmSystem& system, size_t patents, size_t firms, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::vector<Patent>> byFirm(firms);
+    for (size_t f = 0; f < firms; ++f) {
+        system.addFirm(std::to_string(100000 + f), "Firm " + std::to_string(f));
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (size_t i = 0; i < patents; ++i) {
+        double u = uniform(rng);
+        size_t f = static_cast<size_t>(firms * u * u) % firms;
+        byFirm[f].push_back(makeSyntheticPatent(i, std::to_string(100000 + f), rng));
+    }
+    for (size_t f = 0; f < firms; ++f) {
+        if (!byFirm[f].empty()) {
+            system.addPatentsFirm(std::to_string(100000 + f), byFirm[f]);
+        }
+    }
+}
+
+const char* firmTypeName(FirmType type) {
+    switch (type) {
+        case FirmType::LinkedList: return "LinkedList";
+        case FirmType::Vector: return "Vector";
+        case FirmType::UnorderedMap: return "UnorderedMap";
+        case FirmType::BTree: return "BTree";
+    }
+    return "?";
+}
+
+// 每种组合装入 N 个专利，报告每百万专利的内存和分类明细
+int benchMemory(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    const double perMillion = 1e6 / patents / 1048576.0;
+    FirmType types[] = {FirmType::LinkedList, FirmType::Vector, FirmType::UnorderedMap};
+
+    std::cout << std::left << std::setw(32) << "configuration (MB / 1M patents)" << std::right
+              << std::setw(10) << "objects" << std::setw(10) << "contain" << std::setw(10) << "nodes"
+              << std::setw(10) << "strings" << std::setw(10) << "spare" << std::setw(10) << "total"
+              << std::setw(10) << "tracked" << std::endl;
+    for (int sys = 0; sys < 2; ++sys) {
+        for (FirmType type : types) {
+            int64_t before = allocationCounter<PatentStorageTag>().liveBytes.load()
+                           + allocationCounter<FirmStorageTag>().liveBytes.load();
+            std::shared_ptr<IFirmSystem> system = makeFirmSystem(type, sys == 1);
+            populate(*system, patents, firms, 11);
+            int64_t tracked = allocationCounter<PatentStorageTag>().liveBytes.load()
+                            + allocationCounter<FirmStorageTag>().liveBytes.load() - before;
+            MemoryStats m = system->memoryUsage();
+
+            std::string name = std::string(sys == 1 ? "Map" : "Vector") + "/" + firmTypeName(type);
+            std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(10) << m.objectBytes * perMillion << std::setw(10) << m.containerBytes * perMillion
+                      << std::setw(10) << m.nodeOverhead * perMillion << std::setw(10) << m.stringPayload * perMillion
+                      << std::setw(10) << m.spareCapacity * perMillion << std::setw(10) << m.total() * perMillion
+                      << std::setw(10) << tracked * perMillion << std::endl;
+        }
+    }
+    std::cout << "(tracked = bytes measured by TrackingAllocator in patent/firm containers, excluding string payload)"
+              << std::endl;
+    return 0;
+}
+
+// 前缀补全：索引随加载原地建好的额外开销、之后转让和删除的原地更新速度，以及精确和模糊前缀的 top-k 查询延迟
+int benchAutocomplete(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 100000);
+    size_t updates = optSize(opts, "--updates", 100000);
+    size_t queries = optSize(opts, "--queries", 100000);
+    size_t k = optSize(opts, "--k", 10);
+
+    static const char* syllables[] = {"tech", "sun", "nova", "gen", "micro", "data", "labs", "ion",
+                                      "corp", "net", "bio", "max", "star", "link", "soft", "tron"};
+    std::mt19937_64 rng(5);
+    std::vector<std::string> names;
+    for (size_t f = 0; f < firms; ++f) {
+        std::string name;
+        size_t n = 2 + rng() % 3;
+        for (size_t w = 0; w < n; ++w) name += syllables[rng() % 16];
+        name += " " + std::to_string(f % 1000);
+        names.push_back(name);
+    }
+
+    double plainSeconds;
+    {
+        FirmSystemUnorderedMap plain(FirmType::Vector);
+        Timer timer;
+        populate(plain, patents, firms, 3);
+        plainSeconds = timer.seconds();
+    }
+    std::shared_ptr<AutocompleteIndex> index = std::make_shared<AutocompleteIndex>();
+    FirmSystemUnorderedMap system(FirmType::Vector);
+    system.addObserver(index);
+    Timer loadTimer;
+    populate(system, patents, firms, 3);
+    double indexSeconds = loadTimer.seconds();
+    report("load without index", plainSeconds * 1e3, "ms");
+    report("load with index", indexSeconds * 1e3, "ms");
+    report("  overhead per patent", (indexSeconds - plainSeconds) / patents * 1e9, "ns");
+    // populate 用 "Firm N" 作为名称，这里把索引里的名称原地换成合成名称
+    Timer renameTimer;
+    for (size_t f = 0; f < firms; ++f) index->onFirmAdded(std::to_string(100000 + f), names[f]);
+    report("rename firms", renameTimer.seconds() / firms * 1e6, "us/firm");
+    report("index memory", index->memoryUsage() / 1048576.0, "MB");
+
+    // 转让和删除各一半：企业数量变化只改企业条目的得分，专利 ID 原地改所属企业或删掉
+    std::vector<std::pair<std::string, std::string>> all;
+    all.reserve(patents);
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) { all.push_back(std::make_pair(p.firmIDRef(), p.patentIDRef())); });
+    });
+    std::shuffle(all.begin(), all.end(), rng);
+    updates = std::min(updates, all.size());
+    Timer updateTimer;
+    for (size_t i = 0; i < updates; ++i) {
+        if (i % 2 == 0) {
+            system.removePatentFirm(all[i].first, all[i].second);
+        } else {
+            std::string to = std::to_string(100000 + rng() % firms);
+            if (to != all[i].first) system.transferPatent(all[i].first, to, all[i].second);
+        }
+    }
+    report("removes + transfers", updates / updateTimer.seconds() / 1e3, "K ops/s");
+
+    // 查询前缀取自真实键，长度 2~6；模糊查询再随机改掉一个字符
+    std::vector<std::string> prefixes;
+    for (size_t i = 0; i < queries; ++i) {
+        const std::string& name = names[rng() % firms];
+        prefixes.push_back(name.substr(0, 2 + rng() % 5));
+    }
+    size_t found = 0;
+    Timer exact;
+    for (const auto& p : prefixes) found += index->complete(AutocompleteIndex::Field::FirmName, p, k).size();
+    report("firm name top-" + std::to_string(k), exact.seconds() / queries * 1e6, "us/query");
+
+    Timer ids;
+    for (size_t i = 0; i < queries; ++i) {
+        std::string p = std::to_string(8000000 + rng() % patents).substr(0, 3 + rng() % 4);
+        found += index->complete(AutocompleteIndex::Field::PatentID, p, k).size();
+    }
+    report("patent ID top-" + std::to_string(k), ids.seconds() / queries * 1e6, "us/query");
+
+    for (auto& p : prefixes) p[rng() % p.size()] = 'x';
+    Timer fuzzy;
+    for (const auto& p : prefixes) found += index->complete(AutocompleteIndex::Field::FirmName, p, k, 1).size();
+    report("fuzzy (1 edit) top-" + std::to_string(k), fuzzy.seconds() / queries * 1e6, "us/query");
+    report("avg results", static_cast<double>(found) / (3 * queries), "");
+    return 0;
+}
+
+// 原来的逐字段解析：stringstream 切分，trim 先复制再 erase，作为清洗流水线的对照
+Patent legacyParsePatentLine(const std::string& line) {
+    auto trim = [](const std::string& input) {
+        std::string cleaned = input;
+        cleaned.erase(cleaned.begin(), std::find_if(cleaned.begin(), cleaned.end(), [](unsigned char c) {
+            return !std::isspace(c);
+        }));
+        cleaned.erase(std::find_if(cleaned.rbegin(), cleaned.rend(), [](unsigned char c) {
+            return !std::isspace(c);
+        }).base(), cleaned.end());
+        return cleaned;
+    };
+    std::string patentID, grantdate, appldate, title, country, firmID;
+    std::stringstream ss(line);
+    std::getline(ss, patentID, ',');
+    std::getline(ss, grantdate, ',');
+    std::getline(ss, appldate, ',');
+    if (line.find('"') != std::string::npos) {
+        std::getline(ss, title, '"');
+        std::getline(ss, title, '"');
+        ss.ignore();
+    } else {
+        std::getline(ss, title, ',');
+    }
+    std::getline(ss, country, ',');
+    std::getline(ss, firmID, ',');
+    return Patent(trim(patentID), trim(grantdate), trim(appldate), trim(title), trim(country), trim(firmID));
+}
+
+// 清洗流水线：合成 CSV（--dirty 百分比的行带有空白、控制字符、小写国家代码、错误日期等），
+// 对比原来的逐行解析和分块并行清洗的吞吐
+int benchNormalize(const Options& opts) {
+    size_t rows = optSize(opts, "--rows", 2000000);
+    size_t dirty = optSize(opts, "--dirty", 5);
+    std::vector<size_t> threadList = optThreadList(opts);
+
+    std::mt19937_64 rng(17);
+    std::string text = "patentID,grantdate,appldate,patent_title,country,firmID\r\n";
+    for (size_t i = 0; i < rows; ++i) {
+        Patent p = makeSyntheticPatent(i, std::to_string(100000 + rng() % 1000), rng);
+        std::string title = p.getTitle();
+        std::string country = p.getCountry();
+        std::string grant = p.getGrantdate();
+        std::string firmID = p.getFirmID();
+        if (rng() % 10 == 0) title = "\"" + title + ", with comma\"";
+        if (rng() % 100 < dirty) {
+            switch (rng() % 5) {
+                case 0: firmID = "  " + firmID + " "; break;
+                case 1: title += '\x01'; break;
+                case 2: country[0] = static_cast<char>(country[0] + 32); break;
+                case 3: grant = grant.substr(0, 4) + "-" + grant.substr(4, 2) + "-" + grant.substr(6, 2); break;
+                case 4: grant = "2015023" + std::to_string(rng() % 2); break;
+            }
+        }
+        text += p.getPatentID() + "," + grant + "," + p.getAppldate() + "," + title + "," + country + "," + firmID + "\r\n";
+    }
+    const double mb = text.size() / 1048576.0;
+    report("input size", mb, "MB");
+
+    Timer legacy;
+    size_t kept = 0;
+    {
+        std::stringstream ss(text);
+        std::string line;
+        std::getline(ss, line);
+        while (std::getline(ss, line)) {
+            Patent p = legacyParsePatentLine(line);
+            kept += p.getPatentID().empty() ? 0 : 1;
+        }
+    }
+    double legacySeconds = legacy.seconds();
+    report("legacy parse", mb / legacySeconds, "MB/s");
+    report("legacy rows/s", kept / legacySeconds / 1e6, "M rows/s");
+
+    NormalizeReport last;
+    for (size_t threads : threadList) {
+        NormalizeReport r;
+        Timer t;
+        std::vector<Patent> patents = normalizeLines<Patent>(text, threads, normalizePatentLine, r);
+        double seconds = t.seconds();
+        report("normalize (threads=" + std::to_string(threads) + ")", mb / seconds, "MB/s");
+        report("  rows/s", patents.size() / seconds / 1e6, "M rows/s");
+        last = r;
+    }
+    displayNormalizeReport(last);
+    return 0;
+}
+
+// 排行榜：增量维护的更新代价，以及 top-100 / 名次查询和每次全量排序的对比
+int benchLeaderboard(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 100000);
+    size_t transfers = optSize(opts, "--transfers", 200000);
+    size_t queries = optSize(opts, "--queries", 10000);
+
+    std::shared_ptr<Leaderboard> board = std::make_shared<Leaderboard>();
+    FirmSystemUnorderedMap system(FirmType::UnorderedMap);
+    system.addObserver(board);
+    Timer load;
+    populate(system, patents, firms, 21);
+    report("load with leaderboard", load.seconds() * 1e3, "ms");
+
+    // 直接把转让事件喂给排行榜，只测它自己的更新代价
+    std::mt19937_64 rng(4);
+    std::vector<std::pair<std::string, std::string>> owners;
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) {
+            owners.push_back(std::make_pair(p.getPatentID(), firm->getFirmID()));
+        });
+    });
+    Timer update;
+    for (size_t i = 0; i < transfers; ++i) {
+        auto& owner = owners[rng() % owners.size()];
+        std::string to = std::to_string(100000 + rng() % firms);
+        board->onPatentTransferred(owner.second, to, owner.first);
+        owner.second = to;
+    }
+    report("transfer update", update.seconds() / transfers * 1e9, "ns/op");
+
+    size_t sink = 0;
+    Timer top;
+    for (size_t i = 0; i < queries; ++i) {
+        sink += board->top(Leaderboard::Scope::Overall, "", 100).size();
+    }
+    report("top-100 overall", top.seconds() / queries * 1e6, "us/query");
+
+    Timer topCountry;
+    for (size_t i = 0; i < queries; ++i) {
+        sink += board->top(Leaderboard::Scope::Country, "US", 100).size();
+    }
+    report("top-100 by country", topCountry.seconds() / queries * 1e6, "us/query");
+
+    Timer rank;
+    for (size_t i = 0; i < queries; ++i) {
+        sink += board->rankOf(Leaderboard::Scope::GrantYear, "2010", std::to_string(100000 + rng() % firms));
+    }
+    report("rank of firm by year", rank.seconds() / queries * 1e6, "us/query");
+
+    // 对照：每次查询都把所有企业按专利数量排序
+    size_t rescans = std::max<size_t>(1, queries / 100);
+    Timer scan;
+    for (size_t i = 0; i < rescans; ++i) {
+        std::vector<std::pair<int, std::string>> all;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            all.push_back(std::make_pair(-firm->getPatentCount(), firm->getFirmID()));
+        });
+        std::partial_sort(all.begin(), all.begin() + std::min<size_t>(100, all.size()), all.end());
+        sink += all.size();
+    }
+    report("top-100 by rescanning firms", scan.seconds() / rescans * 1e6, "us/query");
+    (void)sink;
+    return 0;
+}
+
+// 存在性过滤：不同目标误判率下的内存、插入/查询耗时和实测误判率，对照不用过滤器时的全量扫描
+int benchFilter(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 10000);
+    size_t queries = optSize(opts, "--queries", 1000000);
+    size_t scans = optSize(opts, "--scans", 20);
+    std::vector<double> rates;
+    std::stringstream ss(optString(opts, "--rates", "0.01,0.001,0.0001"));
+    std::string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) rates.push_back(std::stod(item));
+    }
+
+    std::shared_ptr<IFirmSystem> system = makeFirmSystem(FirmType::LinkedList, false);
+    populate(*system, patents, firms, 35);
+    std::vector<std::string> present;
+    system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) {
+            present.push_back(p.getPatentID());
+        });
+    });
+    // 合成专利号从 8000000 起连续分配，20000000 以后的一定不存在
+    std::vector<std::string> absent(queries);
+    for (size_t i = 0; i < queries; ++i) absent[i] = std::to_string(20000000 + i);
+
+    size_t sink = 0;
+    for (double rate : rates) {
+        report("target false positive rate", rate * 100, "%");
+        PatentExistenceFilter filter(patents, rate);
+        Timer insert;
+        for (const auto& id : present) {
+            filter.onPatentAdded("", Patent(id, "", "", "", "", ""));
+        }
+        report("insert", insert.seconds() / present.size() * 1e9, "ns/key");
+        const CuckooFilter& stats = filter.stats();
+        report("fingerprint bits", stats.fingerprintBits(), "bits");
+        report("load factor", stats.loadFactor() * 100, "%");
+        report("memory", static_cast<double>(stats.memoryUsage()) * 8 / present.size(), "bits/key");
+
+        size_t falsePositives = 0;
+        Timer miss;
+        for (const auto& id : absent) {
+            falsePositives += filter.mayContain(id);
+        }
+        report("negative lookup", miss.seconds() / absent.size() * 1e9, "ns/query");
+        Timer hit;
+        for (size_t i = 0; i < queries; ++i) {
+            sink += filter.mayContain(present[i % present.size()]);
+        }
+        report("positive lookup", hit.seconds() / queries * 1e9, "ns/query");
+        report("measured false positive rate", 100.0 * falsePositives / absent.size(), "%");
+        report("expected false positive rate", 100.0 * stats.expectedFalsePositiveRate(), "%");
+    }
+
+    // 对照：不经过滤器，每次否定查询都要走遍所有企业的链表
+    PatentExistenceFilter filter(patents, rates.empty() ? 0.001 : rates.back());
+    for (const auto& id : present) filter.onPatentAdded("", Patent(id, "", "", "", "", ""));
+    Timer scan;
+    for (size_t i = 0; i < scans; ++i) {
+        sink += scanForPatent(*system, absent[i % absent.size()]);
+    }
+    report("miss by scanning all firms", scan.seconds() / scans * 1e6, "us/query");
+    Timer guarded;
+    for (size_t i = 0; i < queries; ++i) {
+        sink += patentExists(*system, filter, absent[i]);
+    }
+    report("miss through patentExists", guarded.seconds() / queries * 1e6, "us/query");
+    (void)sink;
+    return 0;
+}
+
+// 进程常驻内存中的匿名部分（resident - shared），映射的文件页不计入
+double anonymousResidentMB() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0, shared = 0;
+    statm >> size >> resident >> shared;
+    return static_cast<double>(resident - shared) * sysconf(_SC_PAGESIZE) / 1048576.0;
+}
+
+// 标题懒加载：同一个 CSV 分别全量装载和懒加载，比较装载时间、内存和取标题的代价
+// 每种模式在单独的子进程里跑，常驻内存互不影响
+int benchLazy(const Options& opts) {
+    size_t rows = optSize(opts, "--rows", 2000000);
+    size_t firms = optSize(opts, "--firms", 10000);
+    size_t cache = optSize(opts, "--cache", 4096);
+    size_t queries = optSize(opts, "--queries", 200000);
+    std::string path = optString(opts, "--file", "/tmp/patent_bench_lazy.csv");
+
+    {
+        std::mt19937_64 rng(36);
+        std::ofstream out(path, std::ios::binary);
+        out << "patentID,grantdate,appldate,patent_title,country,firmID\n";
+        for (size_t i = 0; i < rows; ++i) {
+            Patent p = makeSyntheticPatent(i, std::to_string(100000 + rng() % firms), rng);
+            out << p.getPatentID() << ',' << p.getGrantdate() << ',' << p.getAppldate() << ',' << p.getTitle() << ','
+                << p.getCountry() << ',' << p.getFirmID() << '\n';
+        }
+    }
+
+    for (int lazy = 0; lazy < 2; ++lazy) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "fork failed" << std::endl;
+            return 1;
+        }
+        if (pid > 0) {
+            waitpid(pid, nullptr, 0);
+            continue;
+        }
+
+        std::cout << (lazy ? "lazy titles (cache " + std::to_string(cache) + ")" : std::string("eager titles")) << std::endl;
+        FirmSystemUnorderedMap system(FirmType::Vector);
+        system.setLazyTitles(lazy != 0, cache);
+        for (size_t f = 0; f < firms; ++f) system.addFirm(std::to_string(100000 + f), "Firm " + std::to_string(f));
+        double before = anonymousResidentMB();
+        Timer load;
+        system.loadPatentsFromCSV(path);
+        report("load", load.seconds() * 1e3, "ms");
+        report("anonymous RSS growth", anonymousResidentMB() - before, "MB");
+        report("accounted memory", system.memoryUsage().total() / 1048576.0, "MB");
+
+        std::vector<std::shared_ptr<IFirm>> all;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) { all.push_back(firm); });
+        std::vector<Patent> sample;
+        std::mt19937_64 rng(7);
+        while (sample.size() < queries) {
+            const auto& firm = all[rng() % all.size()];
+            size_t pick = rng() % static_cast<size_t>(std::max(1, firm->getPatentCount())), i = 0;
+            firm->forEachPatent([&](const Patent& p) {
+                if (i++ == pick) sample.push_back(p);
+            });
+        }
+        size_t sink = 0;
+        Timer cold;
+        for (const auto& p : sample) sink += p.getTitle().size();
+        report("getTitle, random patents", cold.seconds() / sample.size() * 1e9, "ns/call");
+        Timer hot;
+        for (size_t i = 0; i < queries; ++i) sink += sample[i % std::min<size_t>(sample.size(), cache / 2 + 1)].getTitle().size();
+        report("getTitle, recently used", hot.seconds() / queries * 1e9, "ns/call");
+        (void)sink;
+        std::cout.flush();
+        _exit(0);
+    }
+    std::remove(path.c_str());
+    return 0;
+}
+
+// 标题压缩：压缩率、训练和压缩速度、随机解码单个标题、顺序扫描和子串搜索的吞吐
+// 标题取自真实数据文件（循环使用到 --rows 条），文件不存在时用合成标题
+int benchTitles(const Options& opts) {
+    size_t rows = optSize(opts, "--rows", 2000000);
+    size_t queries = optSize(opts, "--queries", 1000000);
+    std::string path = optString(opts, "--file", "../data/PatentData.csv");
+    // 标题清洗时不改大小写，关键词按原样匹配；"device" 在真实和合成标题里都常出现在句中
+    std::string keyword = optString(opts, "--keyword", "device");
+
+    std::vector<std::string> source;
+    std::string text;
+    if (readWholeFile(path, text)) {
+        NormalizeReport r;
+        for (const auto& p : normalizeLines<Patent>(text, 1, normalizePatentLine, r)) source.push_back(p.getTitle());
+    }
+    if (source.empty()) {
+        std::cout << "(" << path << " not found, using synthetic titles)" << std::endl;
+        std::mt19937_64 rng(37);
+        for (size_t i = 0; i < 10000; ++i) source.push_back(makeSyntheticPatent(i, "0", rng).getTitle());
+    }
+    std::vector<std::string> titles(rows);
+    size_t raw = 0, heap = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        titles[i] = source[i % source.size()];
+        raw += titles[i].size();
+        heap += sizeof(std::string) + stringHeapBytes(titles[i]);
+    }
+    const double mb = raw / 1048576.0;
+    report("distinct source titles", source.size(), "");
+    report("raw title bytes", mb, "MB");
+    report("as std::string", heap / 1048576.0, "MB");
+
+    CompressedTitleStore store;
+    Timer train;
+    store.train(titles);
+    report("train symbol table", train.seconds() * 1e3, "ms");
+    Timer compress;
+    for (const auto& t : titles) store.append(t);
+    report("compress", mb / compress.seconds(), "MB/s");
+    report("compressed (with offsets)", store.compressedBytes() / 1048576.0, "MB");
+    report("compression ratio", static_cast<double>(raw) / store.compressedBytes(), "x");
+
+    std::mt19937_64 rng(11);
+    std::string out;
+    size_t decoded = 0;
+    Timer random;
+    for (size_t i = 0; i < queries; ++i) {
+        store.decodeInto(static_cast<uint32_t>(rng() % rows), out);
+        decoded += out.size();
+    }
+    double randomSeconds = random.seconds();
+    report("random decode", randomSeconds / queries * 1e9, "ns/title");
+    report("random decode", decoded / 1048576.0 / randomSeconds, "MB/s");
+    Timer copy;
+    for (size_t i = 0; i < queries; ++i) {
+        out = titles[rng() % rows];
+        decoded += out.size();
+    }
+    report("random std::string copy", copy.seconds() / queries * 1e9, "ns/title");
+
+    size_t scanned = 0;
+    Timer scan;
+    store.scan([&](uint32_t, const char*, size_t len) { scanned += len; });
+    report("streamed decode", scanned / 1048576.0 / scan.seconds(), "MB/s");
+
+    size_t hits = 0;
+    Timer search;
+    store.scan([&](uint32_t, const char* p, size_t len) {
+        if (memmem(p, len, keyword.data(), keyword.size()) != nullptr) hits++;
+    });
+    report("search compressed titles", mb / search.seconds(), "MB/s");
+    size_t plainHits = 0;
+    Timer plain;
+    for (const auto& t : titles) {
+        if (t.find(keyword) != std::string::npos) plainHits++;
+    }
+    report("search std::string titles", mb / plain.seconds(), "MB/s");
+    report("matches", hits, plainHits == hits ? "(same as uncompressed)" : "(MISMATCH)");
+    if (plainHits == 0) std::cout << "(no title contains \"" << keyword << "\"; the match check proves nothing, pick another --keyword)" << std::endl;
+    return plainHits == hits ? 0 : 1;
+}
+
+// 快照读：一个写者不停提交批量转让，读者反复全量扫描并核对不变量（专利总数不变、每个专利只属于一个企业）
+// 对照组用读写锁：读者扫描时持读锁，写者每批持写锁
+int benchMvcc(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 10000);
+    size_t batch = optSize(opts, "--batch", 100);
+    size_t readers = optSize(opts, "--readers", 2);
+    double seconds = static_cast<double>(optSize(opts, "--millis", 3000)) / 1000.0;
+
+    FirmSystemUnorderedMap system(FirmType::UnorderedMap);
+    populate(system, patents, firms, 38);
+    std::vector<std::pair<std::string, std::string>> owners;
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) {
+            owners.push_back(std::make_pair(p.getPatentID(), firm->getFirmID()));
+        });
+    });
+    std::mt19937_64 rng(5);
+    auto transferOne = [&]() {
+        auto& owner = owners[rng() % owners.size()];
+        std::string to = std::to_string(100000 + rng() % firms);
+        if (to == owner.second) return;
+        system.transferPatent(owner.second, to, owner.first);
+        owner.second = to;
+    };
+    auto transferBatch = [&]() {
+        for (size_t i = 0; i < batch; ++i) transferOne();
+    };
+
+    // 每轮跑 --millis 毫秒：主线程循环提交，readers 个线程循环扫描
+    auto run = [&](const std::function<void()>& commit, const std::function<bool()>& scan, size_t& commits, size_t& scans,
+                   size_t& violations) {
+        std::atomic<size_t> scanCount(0), badCount(0);
+        std::vector<std::thread> threads;
+        Timer timer;
+        // 读者自己看时间停下：读锁偏向读者，写者可能一直拿不到锁
+        for (size_t r = 0; r < readers; ++r) {
+            threads.emplace_back([&]() {
+                while (timer.seconds() < seconds) {
+                    if (!scan()) badCount++;
+                    scanCount++;
+                }
+            });
+        }
+        commits = 0;
+        while (timer.seconds() < seconds) {
+            commit();
+            commits++;
+        }
+        for (auto& t : threads) t.join();
+        scans = scanCount;
+        violations = badCount;
+    };
+
+    std::cout << "--- read/write lock" << std::endl;
+    RWLock lock;
+    size_t commits, scans, violations;
+    run([&]() {
+            ExclusiveGuard guard(lock);
+            transferBatch();
+        },
+        [&]() {
+            SharedGuard guard(lock);
+            size_t total = 0;
+            bool ok = true;
+            system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                firm->forEachPatent([&](const Patent& p) {
+                    total++;
+                    if (p.getFirmID() != firm->getFirmID()) ok = false;
+                });
+            });
+            return ok && total == patents;
+        },
+        commits, scans, violations);
+    report("transfer batches", commits / seconds, "batches/s");
+    report("full scans", scans / seconds, "scans/s");
+    report("invariant violations", violations, "");
+
+    std::cout << "--- snapshots" << std::endl;
+    Timer build;
+    std::shared_ptr<SnapshotManager> manager = std::make_shared<SnapshotManager>(system);
+    system.addObserver(manager);
+    report("initial snapshot", build.seconds() * 1e3, "ms");
+
+    size_t pins = 1000000;
+    Timer pin;
+    for (size_t i = 0; i < pins; ++i) {
+        std::shared_ptr<const SystemSnapshot> snap = manager->snapshot();
+        (void)snap;
+    }
+    report("pin snapshot", pin.seconds() / pins * 1e9, "ns/op");
+
+    // 批外的单次转让各自发布一个版本，只复制常数大小的目录、桶和专利块
+    size_t singles = 20000;
+    Timer single;
+    for (size_t i = 0; i < singles; ++i) transferOne();
+    report("unbatched transfer", single.seconds() / singles * 1e6, "us/op");
+
+    run([&]() { manager->atomically(transferBatch); },
+        [&]() {
+            std::shared_ptr<const SystemSnapshot> snap = manager->snapshot();
+            size_t total = 0;
+            bool ok = snap->patentCount() == patents;
+            snap->forEachFirm([&](const FirmVersion& firm) {
+                for (const auto& p : firm.patents) {
+                    total++;
+                    if (p->getFirmID() != firm.firmID) ok = false;
+                }
+            });
+            return ok && total == patents;
+        },
+        commits, scans, violations);
+    report("transfer batches", commits / seconds, "batches/s");
+    report("full scans", scans / seconds, "scans/s");
+    report("invariant violations", violations, "");
+
+    // 等后台线程回收完没人持有的旧版本
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    report("versions retired", manager->versionsRetired(), "");
+    report("versions freed", manager->versionsFreed(), "");
+    return 0;
+}
+
+// 录制合成工作负载：装载后按比例混合查询、转让、增删专利和少量全量扫描，全部经过 RecordingFirmSystem 写进 trace
+int benchRecord(const Options& opts) {
+    std::string path = optString(opts, "--trace", "workload.trace");
+    size_t patents = optSize(opts, "--patents", 100000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    size_t ops = optSize(opts, "--ops", 200000);
+
+    std::shared_ptr<IFirmSystem> inner = std::make_shared<FirmSystemUnorderedMap>(FirmType::UnorderedMap);
+    std::shared_ptr<RecordingFirmSystem> recorder = std::make_shared<RecordingFirmSystem>(inner, path);
+    Timer load;
+    populate(*recorder, patents, firms, 39);
+    report("load (recorded)", load.seconds() * 1e3, "ms");
+
+    std::vector<std::pair<std::string, std::string>> owners;
+    inner->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) {
+            owners.push_back(std::make_pair(p.getPatentID(), firm->getFirmID()));
+        });
+    });
+    std::mt19937_64 rng(6);
+    size_t nextPatent = patents;
+    Timer run;
+    for (size_t i = 0; i < ops; ++i) {
+        size_t dice = rng() % 1000;
+        std::string firm = std::to_string(100000 + rng() % firms);
+        if (dice < 500) {
+            recorder->getFirm(firm);
+        } else if (dice < 800) {
+            auto& owner = owners[rng() % owners.size()];
+            if (owner.second == firm) continue;
+            recorder->transferPatent(owner.second, firm, owner.first);
+            owner.second = firm;
+        } else if (dice < 900) {
+            Patent p = makeSyntheticPatent(nextPatent++, firm, rng);
+            recorder->addPatentFirm(firm, p);
+            owners.push_back(std::make_pair(p.getPatentID(), firm));
+        } else if (dice < 950) {
+            size_t k = rng() % owners.size();
+            recorder->removePatentFirm(owners[k].second, owners[k].first);
+            owners[k] = owners.back();
+            owners.pop_back();
+        } else if (dice < 998) {
+            recorder->cleanString("  Firm " + firm + "  ");
+        } else if (dice == 998) {
+            recorder->forEachFirm([](const std::shared_ptr<IFirm>&) {});
+        } else {
+            recorder->memoryUsage();
+        }
+    }
+    report("mixed operations (recorded)", run.seconds() / ops * 1e9, "ns/op");
+    size_t events = recorder->recordedEvents();
+    recorder.reset();
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    size_t bytes = static_cast<size_t>(in.tellg());
+    report("events", events, "");
+    report("trace size", bytes / 1048576.0, "MB");
+    report("bytes per event", static_cast<double>(bytes) / events, "B");
+    return 0;
+}
+
+// 回放 trace：--backend 形如 Map/UnorderedMap、Vector/LinkedList；--pace fast|recorded
+// 报告每种操作的延迟分布，--out 存档，--baseline 给出上一版的报告时逐项对比，有回归则返回 2
+int benchReplay(const Options& opts) {
+    std::string path = optString(opts, "--trace", "workload.trace");
+    std::string backend = optString(opts, "--backend", "Map/UnorderedMap");
+    std::string pace = optString(opts, "--pace", "fast");
+    double threshold = static_cast<double>(optSize(opts, "--threshold", 10));
+
+    std::vector<TraceEvent> events;
+    std::string error;
+    Timer load;
+    if (!loadTrace(path, events, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    report("load trace", load.seconds() * 1e3, "ms");
+
+    bool mapSystem = backend.compare(0, 4, "Map/") == 0;
+    std::string typeName = backend.substr(backend.find('/') + 1);
+    FirmType type = FirmType::UnorderedMap;
+    if (typeName == "LinkedList") type = FirmType::LinkedList;
+    if (typeName == "Vector") type = FirmType::Vector;
+    if (typeName == "BTree") type = FirmType::BTree;
+
+    TraceReplayer::Options options;
+    options.pace = pace == "recorded" ? TraceReplayer::Pace::Recorded : TraceReplayer::Pace::AsFastAsPossible;
+    options.speed = std::atof(optString(opts, "--speed", "1").c_str());
+    options.replayers = optSize(opts, "--replayers", 1);
+    ReplayReport result = TraceReplayer(events).run([&]() { return makeFirmSystem(type, mapSystem); }, options);
+
+    std::cout << std::string(mapSystem ? "Map/" : "Vector/") + firmTypeName(type) << ", " << result.replayers
+              << " replayer(s), " << pace << std::endl;
+    report("replay", result.seconds * 1e3, "ms");
+    report("events", result.events / result.seconds, "events/s");
+    report("result checksum", static_cast<double>(result.checksum), "");
+    result.write(std::cout);
+
+    std::string out = optString(opts, "--out", "");
+    if (!out.empty()) {
+        std::ofstream file(out);
+        result.write(file);
+    }
+    std::string baselinePath = optString(opts, "--baseline", "");
+    if (!baselinePath.empty()) {
+        std::map<std::string, std::map<std::string, double>> baseline;
+        if (!readReport(baselinePath, baseline)) {
+            std::cerr << "Error: cannot read " << baselinePath << std::endl;
+            return 1;
+        }
+        size_t regressions = compareReports(baseline, result, threshold, std::cout);
+        report("regressions", regressions, "");
+        return regressions ? 2 : 0;
+    }
+    return 0;
+}
+
+// 导出：同一批专利分别用逐行 std::endl 的 iostream、不刷新的 iostream 和 OutputBuffer 写出，
+// 以把同样字节数的内存块直接写进文件的速度作为磁盘带宽的参照
+int benchExport(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    std::string path = optString(opts, "--file", "patents.export");
+
+    FirmSystemUnorderedMap system(FirmType::Vector);
+    populate(system, patents, firms, 40);
+
+    auto megabytes = [&]() {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        return static_cast<double>(in.tellg()) / 1048576.0;
+    };
+    auto line = [&](const std::string& name, double seconds, double mb) {
+        report(name, mb / seconds, "MB/s");
+        report("  rows", patents / seconds / 1e6, "M rows/s");
+    };
+
+    {
+        Timer t;
+        std::ofstream os(path);
+        os << "patentID,grantdate,appldate,patent_title,country,firmID" << std::endl;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firm->forEachPatent([&](const Patent& p) {
+                os << p.getPatentID() << ',' << p.getGrantdate() << ',' << p.getAppldate() << ',' << p.getTitle() << ','
+                   << p.getCountry() << ',' << p.getFirmID() << std::endl;
+            });
+        });
+        os.close();
+        line("iostream, std::endl per row", t.seconds(), megabytes());
+    }
+    {
+        Timer t;
+        std::ofstream os(path);
+        os << "patentID,grantdate,appldate,patent_title,country,firmID\n";
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firm->forEachPatent([&](const Patent& p) {
+                os << p.getPatentID() << ',' << p.getGrantdate() << ',' << p.getAppldate() << ',' << p.getTitle() << ','
+                   << p.getCountry() << ',' << p.getFirmID() << '\n';
+            });
+        });
+        os.close();
+        line("iostream, '\\n'", t.seconds(), megabytes());
+    }
+
+    const char* names[] = {"csv", "tsv", "jsonl"};
+    ExportFormat formats[] = {ExportFormat::CSV, ExportFormat::TSV, ExportFormat::JSONLines};
+    double csvMB = 0;
+    for (int f = 0; f < 3; ++f) {
+        Timer t;
+        ExportResult r = exportPatents(system, "", path, formats[f]);
+        double seconds = t.seconds();
+        if (!r.ok) {
+            std::cerr << "Error: " << r.error << std::endl;
+            return 1;
+        }
+        double mb = r.bytes / 1048576.0;
+        if (f == 0) csvMB = mb;
+        line(std::string("OutputBuffer ") + names[f], seconds, mb);
+        report("  syscalls", r.syscalls, "");
+    }
+
+    // 参照：不做任何格式化，按 1MB 一块把同样多的字节写进文件
+    {
+        std::vector<char> block(1 << 20, 'x');
+        size_t total = static_cast<size_t>(csvMB * 1048576.0);
+        Timer t;
+        OutputBuffer out(path);
+        for (size_t done = 0; done < total; done += block.size()) {
+            out.append(block.data(), std::min(block.size(), total - done));
+        }
+        out.flush();
+        report("raw write of same size", csvMB / t.seconds(), "MB/s");
+    }
+    std::remove(path.c_str());
+    return 0;
+}
+
+// 并行遍历：企业大小极度偏斜（企业 f 的专利份额按 u^skew 分布）时，按企业数静态切分和工作窃取的扩展曲线
+// 每个专利做 --work 轮标题哈希，模拟报表里的逐专利计算；加速比相对单线程顺序遍历
+int benchParallel(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 2000);
+    size_t skew = optSize(opts, "--skew", 4);
+    size_t work = optSize(opts, "--work", 8);
+    Options threadOpts = opts;
+    if (!threadOpts.count("--threads")) threadOpts["--threads"] = "1,2,4,8,16,32,64";
+    std::vector<size_t> threadList = optThreadList(threadOpts);
+
+    auto cost = [work](const Patent& p) {
+        const std::string& title = p.getTitle();
+        uint64_t h = 1469598103934665603ULL;
+        for (size_t r = 0; r < work; ++r) {
+            for (char c : title) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        return h;
+    };
+    // 每个线程补齐到一条缓存行，避免伪共享
+    struct Slot {
+        uint64_t hash = 0;
+        size_t patents = 0;
+        char pad[48];
+    };
+
+    FirmType types[] = {FirmType::Vector, FirmType::UnorderedMap};
+    for (FirmType type : types) {
+        std::shared_ptr<IFirmSystem> system = makeFirmSystem(type, true);
+        std::mt19937_64 rng(23);
+        std::vector<std::vector<Patent>> byFirm(firms);
+        for (size_t f = 0; f < firms; ++f) system->addFirm(std::to_string(100000 + f), "Firm " + std::to_string(f));
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (size_t i = 0; i < patents; ++i) {
+            size_t f = static_cast<size_t>(firms * std::pow(uniform(rng), static_cast<double>(skew))) % firms;
+            byFirm[f].push_back(makeSyntheticPatent(i, std::to_string(100000 + f), rng));
+        }
+        for (size_t f = 0; f < firms; ++f) {
+            if (!byFirm[f].empty()) system->addPatentsFirm(std::to_string(100000 + f), byFirm[f]);
+        }
+        std::vector<std::shared_ptr<IFirm>> list;
+        system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) { list.push_back(firm); });
+
+        std::cout << "== Map/" << firmTypeName(type) << " (largest firm: " << byFirm[0].size() * 100.0 / patents
+                  << "% of patents)" << std::endl;
+        byFirm.clear();
+
+        uint64_t expected = 0;
+        Timer seq;
+        system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firm->forEachPatent([&](const Patent& p) { expected ^= cost(p); });
+        });
+        double sequential = seq.seconds();
+        report("sequential", sequential * 1e3, "ms");
+
+        std::cout << std::left << std::setw(10) << "threads" << std::right << std::setw(14) << "static ms"
+                  << std::setw(10) << "speedup" << std::setw(10) << "busiest" << std::setw(14) << "stealing ms"
+                  << std::setw(10) << "speedup" << std::setw(10) << "busiest" << std::endl;
+        for (size_t threads : threadList) {
+            // busiest = 处理专利最多的线程占平均值的倍数，1.00 表示完全均衡
+            auto busiest = [&](const std::vector<Slot>& slots) {
+                size_t most = 0;
+                for (const auto& s : slots) most = std::max(most, s.patents);
+                return most * static_cast<double>(threads) / patents;
+            };
+            auto check = [&](const std::vector<Slot>& slots) {
+                uint64_t h = 0;
+                for (const auto& s : slots) h ^= s.hash;
+                if (h != expected) std::cerr << "Error: parallel result differs from sequential" << std::endl;
+            };
+
+            std::vector<Slot> fixed(threads);
+            Timer st;
+            parallelFor(list.size(), threads, [&](size_t b, size_t e, size_t tid) {
+                Slot& slot = fixed[tid];
+                for (size_t i = b; i < e; ++i) {
+                    list[i]->forEachPatent([&](const Patent& p) {
+                        slot.hash ^= cost(p);
+                        slot.patents++;
+                    });
+                }
+            });
+            double staticSeconds = st.seconds();
+            check(fixed);
+
+            std::vector<Slot> stolen(threads);
+            Timer ws;
+            system->parallelForEachPatent([&](const Patent& p, size_t worker) {
+                stolen[worker].hash ^= cost(p);
+                stolen[worker].patents++;
+            }, threads);
+            double stealingSeconds = ws.seconds();
+            check(stolen);
+
+            std::cout << std::left << std::setw(10) << threads << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(14) << staticSeconds * 1e3 << std::setw(10) << sequential / staticSeconds
+                      << std::setw(10) << busiest(fixed) << std::setw(14) << stealingSeconds * 1e3
+                      << std::setw(10) << sequential / stealingSeconds << std::setw(10) << busiest(stolen) << std::endl;
+        }
+    }
+    return 0;
+}
+
+// 实体消解：合成带名称变体（后缀、大小写、拼写错误、附加词）的企业，报告建索引和全量配对的耗时、
+// 合并建议的精确率/召回率，并与前 --brute 个企业上的两两比较对照；再比较整体合并和逐个 transferPatent
+int benchResolve(const Options& opts) {
+    size_t firms = optSize(opts, "--firms", 100000);
+    size_t brute = optSize(opts, "--brute", 3000);
+    size_t patents = optSize(opts, "--patents", 200000);
+    double threshold = std::stod(optString(opts, "--threshold", "0.75"));
+
+    static const char* industries[] = {"Technology", "Systems", "Electronics", "Pharmaceuticals", "Motors",
+                                       "Chemical", "Instruments", "Networks", "Semiconductor", "Medical"};
+    static const char* suffixes[] = {"Inc.", "Corp.", "Corporation", "Co., Ltd.", "GmbH", "LLC", "Ltd", "AG"};
+    std::mt19937_64 rng(31);
+    // 音节 = 声母（含辅音丛）+ 元音 + 可选韵尾，2-3 个音节一个词；三元组种类和真实名称一样多，倒排表不会都很长
+    auto word = [&]() {
+        static const char* onsets[] = {"b", "c", "d", "f", "g", "h", "j", "k", "l", "m", "n", "p", "r", "s", "t",
+                                       "v", "w", "z", "br", "ch", "cr", "dr", "fl", "gr", "kl", "pr", "sh", "st",
+                                       "th", "tr", "qu", "sk", "sp", "wh", "x", "y"};
+        static const char* nuclei[] = {"a", "e", "i", "o", "u", "ai", "ea", "ou", "oo", "ie", "y"};
+        static const char* codas[] = {"", "", "", "n", "r", "s", "t", "x", "ng", "ck", "l", "m", "nd", "rt", "sk"};
+        std::string w;
+        for (size_t k = 2 + rng() % 2; k > 0; --k) {
+            w += onsets[rng() % 36];
+            w += nuclei[rng() % 11];
+            w += codas[rng() % 15];
+        }
+        w[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(w[0])));
+        return w;
+    };
+    // 约 30% 的实体有 2-4 个名称变体
+    std::vector<std::string> names;
+    std::vector<size_t> entity;
+    size_t entities = 0;
+    while (names.size() < firms) {
+        std::string base = word();
+        if (rng() % 2) base += " " + word();
+        if (rng() % 3 == 0) base += std::string(" ") + industries[rng() % 10];
+        size_t variants = rng() % 10 < 3 ? 2 + rng() % 3 : 1;
+        for (size_t v = 0; v < variants && names.size() < firms; ++v) {
+            std::string name = base;
+            if (v > 0) {
+                switch (rng() % 4) {
+                    case 0: name += std::string(" ") + suffixes[rng() % 8]; break;
+                    case 1:
+                        for (auto& c : name) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                        break;
+                    case 2: {
+                        size_t i = 1 + rng() % (name.size() - 2);
+                        std::swap(name[i], name[i + 1]);
+                        break;
+                    }
+                    case 3: name += " Technology Licensing"; break;
+                }
+            }
+            names.push_back(name);
+            entity.push_back(entities);
+        }
+        entities++;
+    }
+
+    FirmSystemUnorderedMap system(FirmType::Vector);
+    std::shared_ptr<EntityResolver> resolver = std::make_shared<EntityResolver>();
+    system.addObserver(resolver);
+    Timer build;
+    for (size_t f = 0; f < firms; ++f) system.addFirm(std::to_string(100000 + f), names[f]);
+    report("index build (with addFirm)", build.seconds() * 1e3, "ms");
+
+    Timer lookup;
+    size_t found = 0;
+    for (size_t i = 0; i < 1000; ++i) found += resolver->similarFirms(names[rng() % firms] + " Inc", threshold).size();
+    report("similarFirms", lookup.seconds() * 1e6 / 1000, "us/query");
+
+    Timer propose;
+    std::vector<EntityResolver::MergeProposal> proposals = resolver->proposeMerges(system, threshold);
+    double proposeSeconds = propose.seconds();
+    report("proposeMerges", proposeSeconds * 1e3, "ms");
+    size_t correct = 0;
+    for (const auto& p : proposals) {
+        if (entity[std::stoul(p.intoFirmID) - 100000] == entity[std::stoul(p.fromFirmID) - 100000]) correct++;
+    }
+    report("proposals", static_cast<double>(proposals.size()), "merges");
+    report("precision", proposals.empty() ? 0.0 : 100.0 * correct / proposals.size(), "%");
+    report("recall", 100.0 * correct / (firms - entities), "%");
+
+    brute = std::min(brute, firms);
+    Timer pairs;
+    size_t bruteMatches = 0;
+    for (size_t i = 0; i < brute; ++i) {
+        for (size_t j = i + 1; j < brute; ++j) {
+            if (FirmNameIndex::compare(names[i], names[j]) >= threshold) bruteMatches++;
+        }
+    }
+    double bruteSeconds = pairs.seconds();
+    report("all-pairs (n=" + std::to_string(brute) + ")", bruteSeconds * 1e3, "ms");
+    report("  extrapolated to all firms", bruteSeconds * (static_cast<double>(firms) / brute) * (static_cast<double>(firms) / brute), "s");
+    size_t indexMatches = 0;
+    {
+        FirmNameIndex small;
+        for (size_t i = 0; i < brute; ++i) small.add(std::to_string(i), names[i]);
+        small.forEachSimilarPair(threshold, [&](const std::string&, const std::string&, double) { indexMatches++; });
+    }
+    report("  pairs found (all-pairs / index)", static_cast<double>(bruteMatches), std::to_string(indexMatches));
+
+    // 整体合并：企业 f + n/2 并入企业 f
+    size_t mergeFirms = 1000;
+    FirmType types[] = {FirmType::LinkedList, FirmType::Vector, FirmType::UnorderedMap};
+    for (FirmType type : types) {
+        std::shared_ptr<IFirmSystem> bulk = makeFirmSystem(type, true);
+        std::shared_ptr<IFirmSystem> single = makeFirmSystem(type, true);
+        populate(*bulk, patents, mergeFirms, 5);
+        populate(*single, patents, mergeFirms, 5);
+        size_t moved = 0;
+        std::vector<std::pair<std::string, std::vector<std::string>>> plan;
+        for (size_t f = 0; f < mergeFirms / 2; ++f) {
+            std::string from = std::to_string(100000 + mergeFirms / 2 + f);
+            std::vector<std::string> ids;
+            bulk->getFirm(from)->forEachPatent([&](const Patent& p) { ids.push_back(p.getPatentID()); });
+            moved += ids.size();
+            plan.push_back(std::make_pair(from, ids));
+        }
+        std::streambuf* saved = std::cout.rdbuf();
+        NullBuffer discard;
+        std::cout.rdbuf(&discard);
+        Timer b;
+        for (size_t f = 0; f < mergeFirms / 2; ++f) bulk->mergeFirms(std::to_string(100000 + f), plan[f].first);
+        double bulkSeconds = b.seconds();
+        Timer t;
+        for (size_t f = 0; f < mergeFirms / 2; ++f) {
+            for (const auto& id : plan[f].second) single->transferPatent(plan[f].first, std::to_string(100000 + f), id);
+        }
+        double singleSeconds = t.seconds();
+        std::cout.rdbuf(saved);
+        size_t bulkPatents = 0, singlePatents = 0, bulkFirms = 0;
+        bulk->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            bulkFirms++;
+            firm->forEachPatent([&](const Patent& p) {
+                if (p.getFirmID() == firm->getFirmID()) bulkPatents++;
+            });
+        });
+        single->forEachFirm([&](const std::shared_ptr<IFirm>& firm) { singlePatents += firm->getPatentCount(); });
+        if (bulkPatents != patents || singlePatents != patents || bulkFirms != mergeFirms - mergeFirms / 2) {
+            std::cerr << "Error: merged systems disagree" << std::endl;
+        }
+        std::string name = std::string("Map/") + firmTypeName(type);
+        report(name + " mergeFirms", moved / bulkSeconds / 1e6, "M patents/s");
+        report(name + " transferPatent loop", moved / singleSeconds / 1e6, "M patents/s");
+    }
+    return 0;
+}
+
+// 批量查找：随机 (firmID, patentID) 键，比较逐个 getFirm + getPatent、每次一个键的 lookupMany 和按 --batch 分批的 lookupMany
+// 数组企业逐个查找是线性扫描，只取 1/100 的键；--miss 是不存在的键所占的百分比
+int benchLookup(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    size_t keyCount = optSize(opts, "--keys", 1000000);
+    size_t batch = std::max<size_t>(1, optSize(opts, "--batch", 1024));
+    size_t missPercent = std::min<size_t>(100, optSize(opts, "--miss", 10));
+
+    FirmType types[] = {FirmType::UnorderedMap, FirmType::Vector};
+    for (FirmType type : types) {
+        std::shared_ptr<IFirmSystem> system = makeFirmSystem(type, true);
+        populate(*system, patents, firms, 43);
+        std::vector<std::pair<std::string, std::string>> all;
+        all.reserve(patents);
+        system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firm->forEachPatent([&](const Patent& p) { all.push_back(std::make_pair(p.firmIDRef(), p.patentIDRef())); });
+        });
+
+        size_t n = type == FirmType::Vector ? std::max<size_t>(1, keyCount / 100) : keyCount;
+        std::mt19937_64 rng(44);
+        std::vector<std::pair<std::string, std::string>> keys(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = all[rng() % all.size()];
+            if (rng() % 100 < missPercent) keys[i].second = "X" + keys[i].second;
+        }
+        std::string name = std::string("Map/") + firmTypeName(type);
+
+        size_t singleFound = 0;
+        Timer single;
+        for (const auto& key : keys) {
+            std::shared_ptr<IFirm> firm = system->getFirm(key.first);
+            try {
+                singleFound += firm->getPatent(key.second).patentIDRef().size() > 0;
+            } catch (const std::invalid_argument&) {
+            }
+        }
+        double singleSeconds = single.seconds();
+
+        // 每批一次 lookupMany，返回命中数
+        auto batched = [&](size_t size) {
+            size_t found = 0;
+            std::vector<std::pair<std::string, std::string>> part;
+            std::vector<const Patent*> out;
+            for (size_t b = 0; b < n; b += size) {
+                part.assign(keys.begin() + b, keys.begin() + std::min(n, b + size));
+                system->lookupMany(part, out);
+                for (const Patent* p : out) found += p != nullptr;
+            }
+            return found;
+        };
+        Timer one;
+        size_t oneFound = batched(1);
+        double oneSeconds = one.seconds();
+        Timer many;
+        size_t manyFound = batched(batch);
+        double manySeconds = many.seconds();
+        if (oneFound != singleFound || manyFound != singleFound) {
+            std::cerr << "Error: batched lookup disagrees with getPatent" << std::endl;
+        }
+
+        report(name + " keys", static_cast<double>(n), "");
+        report(name + " getPatent loop", n / singleSeconds / 1e6, "M keys/s");
+        report(name + " lookupMany x1", n / oneSeconds / 1e6, "M keys/s");
+        report(name + " lookupMany x" + std::to_string(batch), n / manySeconds / 1e6, "M keys/s");
+    }
+
+    // 企业层：企业表要大到放不进缓存预取才有意义（--lookup-firms）；getFirm 找不到会打印提示，这里只用存在的企业
+    bool mapSystems[] = {true, false};
+    for (bool mapSystem : mapSystems) {
+        firms = optSize(opts, "--lookup-firms", mapSystem ? 1000000 : 10000);
+        std::shared_ptr<IFirmSystem> system = makeFirmSystem(FirmType::UnorderedMap, mapSystem);
+        for (size_t f = 0; f < firms; ++f) system->addFirm(std::to_string(100000 + f), "Firm " + std::to_string(f));
+        size_t n = mapSystem ? keyCount : std::max<size_t>(1, keyCount / 100);
+        std::mt19937_64 rng(45);
+        std::vector<std::string> firmIDs(n);
+        for (size_t i = 0; i < n; ++i) firmIDs[i] = std::to_string(100000 + rng() % firms);
+
+        size_t singleFound = 0;
+        Timer single;
+        for (const auto& id : firmIDs) singleFound += system->getFirm(id) != nullptr;
+        double singleSeconds = single.seconds();
+
+        size_t batchFound = 0;
+        std::vector<std::string> part;
+        std::vector<std::shared_ptr<IFirm>> out;
+        Timer many;
+        for (size_t b = 0; b < n; b += batch) {
+            part.assign(firmIDs.begin() + b, firmIDs.begin() + std::min(n, b + batch));
+            system->lookupMany(part, out);
+            for (const auto& firm : out) batchFound += firm != nullptr;
+        }
+        double manySeconds = many.seconds();
+        if (batchFound != singleFound) std::cerr << "Error: batched firm lookup disagrees with getFirm" << std::endl;
+
+        std::string name = mapSystem ? "firms/UnorderedMap" : "firms/Vector";
+        report(name + " getFirm loop", n / singleSeconds / 1e6, "M keys/s");
+        report(name + " lookupMany x" + std::to_string(batch), n / manySeconds / 1e6, "M keys/s");
+    }
+    return 0;
+}
+
+// 查询规划：同一组查询分别在有二级索引（按代价选访问路径）和没有索引（只能查企业或全表扫描）时的耗时，
+// 再比较缓存的编译结果和每次重新解析、规划
+int benchQuery(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    size_t repeat = optSize(opts, "--repeat", 20);
+    size_t threads = optSize(opts, "--threads", 0);
+
+    FirmSystemUnorderedMap system(FirmType::UnorderedMap);
+    std::shared_ptr<QueryIndex> index = std::make_shared<QueryIndex>();
+    system.addObserver(index);
+    Timer load;
+    populate(system, patents, firms, 47);
+    report("load with query index", load.seconds() * 1e3, "ms");
+
+    QueryEngine planned(system, index, threads);
+    QueryEngine unindexed(system, nullptr, threads);
+    std::vector<std::string> queries = {
+        "patent = 8000123",
+        "firm = 100000 AND title CONTAINS 'optical' AND appldate = 2005",
+        "appldate = 200703 AND country = KR",
+        "firm = 100900 AND country = US",
+        "title CONTAINS 'wireless optical memory' AND grantdate >= 2015",
+        "country = US AND grantdate BETWEEN 2001 AND 2003",
+    };
+    std::cout << std::left << std::setw(64) << "query" << std::setw(30) << "path" << std::right << std::setw(10)
+              << "rows" << std::setw(12) << "planned ms" << std::setw(12) << "no-index ms" << std::endl;
+    for (const auto& text : queries) {
+        QueryResult a, b;
+        std::string error;
+        Timer pt;
+        for (size_t r = 0; r < repeat; ++r) {
+            a = QueryResult();
+            planned.run(text, a, error);
+        }
+        double plannedSeconds = pt.seconds() / repeat;
+        Timer ut;
+        for (size_t r = 0; r < repeat; ++r) {
+            b = QueryResult();
+            unindexed.run(text, b, error);
+        }
+        double unindexedSeconds = ut.seconds() / repeat;
+        if (a.rows.size() != b.rows.size()) std::cerr << "Error: plans disagree on " << text << std::endl;
+        std::cout << std::left << std::setw(64) << text.substr(0, 62) << std::setw(30) << a.path << std::right
+                  << std::setw(10) << a.rows.size() << std::fixed << std::setprecision(3) << std::setw(12)
+                  << plannedSeconds * 1e3 << std::setw(12) << unindexedSeconds * 1e3 << std::endl;
+    }
+    std::string plan, error;
+    planned.explain(queries[1], plan, error);
+    std::cout << plan;
+
+    // 点查询的执行很便宜，解析和规划的开销才看得出来
+    size_t lookups = optSize(opts, "--lookups", 100000);
+    std::mt19937_64 rng(48);
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < 1000; ++i) texts.push_back("patent = " + std::to_string(8000000 + rng() % patents));
+    size_t found = 0;
+    Timer cachedTimer;
+    for (size_t i = 0; i < lookups; ++i) {
+        QueryResult r;
+        planned.run(texts[i % texts.size()], r, error);
+        found += r.rows.size();
+    }
+    double cachedSeconds = cachedTimer.seconds();
+    Timer freshTimer;
+    for (size_t i = 0; i < lookups; ++i) {
+        QueryResult r;
+        planned.runUncached(texts[i % texts.size()], r, error);
+        found -= r.rows.size();
+    }
+    double freshSeconds = freshTimer.seconds();
+    if (found != 0) std::cerr << "Error: cached and uncached results differ" << std::endl;
+    report("point query, cached plan", cachedSeconds / lookups * 1e6, "us/query");
+    report("point query, parse + plan each time", freshSeconds / lookups * 1e6, "us/query");
+    report("plan cache hits", static_cast<double>(planned.cacheHits()), "");
+    return 0;
+}
+
+// 排序导出：先比较排序单元上的并行基数排序和 std::sort，再比较全内存排序导出和限制内存（--budget-mb）后的外部排序导出，
+// 两种方式的输出应当逐字节相同
+int benchSort(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    size_t budgetMB = optSize(opts, "--budget-mb", 32);
+    size_t fanIn = optSize(opts, "--fan-in", 128);
+    std::string path = optString(opts, "--file", "patents.sorted");
+    std::string tempDir = optString(opts, "--temp", "/tmp");
+    std::vector<size_t> threadList = optThreadList(opts);
+
+    std::mt19937_64 rng(49);
+    std::vector<SortItem> keys(patents);
+    for (size_t i = 0; i < patents; ++i) {
+        keys[i].key = static_cast<uint64_t>(syntheticDate(rng() % 6000)) << 32 | static_cast<uint32_t>(8000000 + rng() % patents);
+        keys[i].tie = 0;
+        keys[i].source = 0;
+        keys[i].offset = i;
+    }
+    {
+        std::vector<SortItem> copy = keys;
+        Timer t;
+        std::sort(copy.begin(), copy.end(), sortItemLess);
+        report("std::sort", patents / t.seconds() / 1e6, "M keys/s");
+    }
+    for (size_t threads : threadList) {
+        std::vector<SortItem> copy = keys;
+        Timer t;
+        parallelRadixSort(copy, threads);
+        double seconds = t.seconds();
+        if (!std::is_sorted(copy.begin(), copy.end(), sortItemLess)) std::cerr << "Error: radix sort out of order" << std::endl;
+        report("radix sort, threads " + std::to_string(threads), patents / seconds / 1e6, "M keys/s");
+    }
+    keys.clear();
+    keys.shrink_to_fit();
+
+    FirmSystemUnorderedMap system(FirmType::Vector);
+    populate(system, patents, firms, 50);
+    SortKey sortKeys[] = {SortKey::GrantDate, SortKey::FirmAppldate};
+    for (SortKey key : sortKeys) {
+        const char* name = key == SortKey::GrantDate ? "grantdate" : "firm-appldate";
+        std::string checksums[2];
+        for (int external = 0; external < 2; ++external) {
+            SortedExportOptions options;
+            options.key = key;
+            options.threads = threadList.back();
+            options.tempDir = tempDir;
+            options.fanIn = fanIn;
+            options.memoryBudget = external ? budgetMB << 20 : static_cast<size_t>(1) << 40;
+            Timer t;
+            ExportResult result = exportSorted(system, path, options);
+            double seconds = t.seconds();
+            if (!result.ok) {
+                std::cerr << "Error: " << result.error << std::endl;
+                return 1;
+            }
+            std::ifstream in(path, std::ios::binary);
+            std::ostringstream content;
+            content << in.rdbuf();
+            checksums[external] = std::to_string(std::hash<std::string>()(content.str()));
+            std::string label = std::string(name) + (external ? ", external" : ", in memory");
+            report(label, result.bytes / seconds / 1048576.0, "MB/s");
+            report("  rows", result.rows / seconds / 1e6, "M rows/s");
+            if (external) {
+                report("  runs", static_cast<double>(result.runs), "");
+                report("  merge passes", static_cast<double>(result.mergePasses), "");
+                report("  spilled", result.spilledBytes / 1048576.0, "MB");
+            }
+        }
+        if (checksums[0] != checksums[1]) std::cerr << "Error: external sort output differs from in-memory sort" << std::endl;
+    }
+    std::remove(path.c_str());
+    return 0;
+}
+
+// 磁盘 B+ 树企业：一个企业流式批量装载 --patents 件专利（缓冲池 --pool-mb，远小于数据量），
+// 然后比较热点集合（--hot 件）上的 getPatent 和同一批专利放在 FirmUnorderedMap 里的速度，
+// 再测冷启动查找、顺序扫描、lookupMany、逐条插入和多个读线程并发查找
+int benchBTree(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 2000000);
+    size_t poolMB = optSize(opts, "--pool-mb", 64);
+    size_t hot = std::max<size_t>(1, std::min(patents, optSize(opts, "--hot", 10000)));
+    size_t lookups = optSize(opts, "--lookups", 1000000);
+    size_t inserts = optSize(opts, "--inserts", 100000);
+    std::string tempDir = optString(opts, "--temp", "/tmp");
+    std::vector<size_t> threadList = optThreadList(opts);
+
+    std::shared_ptr<DiskStore> store = std::make_shared<DiskStore>(poolMB << 20, tempDir);
+    FirmBTree firm("100000", "Firm 0", store);
+    std::mt19937_64 rng(51);
+    size_t next = 0;
+    Timer load;
+    firm.loadSorted([&](Patent& patent) {
+        if (next == patents) return false;
+        patent = makeSyntheticPatent(next++, "100000", rng);
+        return true;
+    });
+    double loadSeconds = load.seconds();
+    store->flush();
+    report("bulk load", patents / loadSeconds / 1e6, "M patents/s");
+    report("  tree height", static_cast<double>(firm.index().height()), "");
+    report("  page file", store->fileBytes() / 1048576.0, "MB");
+    report("  buffer pool", store->capacity() * DiskStore::kPageSize / 1048576.0, "MB");
+
+    // 热点集合：键空间中间一段连续的专利（比如最近授权的一批）
+    std::vector<std::string> hotKeys(hot);
+    for (size_t i = 0; i < hot; ++i) hotKeys[i] = std::to_string(8000000 + (patents - hot) / 2 + i);
+    FirmUnorderedMap reference("100000", "Firm 0");
+    for (const auto& key : hotKeys) {
+        Patent p = firm.getPatent(key);
+        reference.addPatent(p);
+    }
+    std::vector<size_t> picks(lookups);
+    for (auto& pick : picks) pick = rng() % hot;
+
+    auto lookupLoop = [&](const IFirm& target) {
+        size_t bytes = 0;
+        for (size_t pick : picks) bytes += target.getPatent(hotKeys[pick]).getTitle().size();
+        return bytes;
+    };
+    lookupLoop(firm);
+    store->resetStats();
+    Timer hotTimer;
+    size_t hotBytes = lookupLoop(firm);
+    double hotSeconds = hotTimer.seconds();
+    BufferPoolStats hotStats = store->stats();
+    Timer mapTimer;
+    size_t mapBytes = lookupLoop(reference);
+    double mapSeconds = mapTimer.seconds();
+    if (hotBytes != mapBytes) std::cerr << "Error: B+-tree and in-memory lookups disagree" << std::endl;
+    report("hot getPatent, B+-tree", lookups / hotSeconds / 1e6, "M ops/s");
+    report("hot getPatent, UnorderedMap", lookups / mapSeconds / 1e6, "M ops/s");
+    report("  pool hit rate", hotStats.hitRate() * 100, "%");
+
+    // 冷查找：清空缓冲池和页文件的系统缓存，随机键落在整个键空间
+    size_t coldLookups = std::min<size_t>(lookups, 20000);
+    store->dropCache();
+    store->resetStats();
+    Timer coldTimer;
+    for (size_t i = 0; i < coldLookups; ++i) firm.getPatent(std::to_string(8000000 + rng() % patents));
+    double coldSeconds = coldTimer.seconds();
+    BufferPoolStats coldStats = store->stats();
+    report("cold getPatent", coldSeconds / coldLookups * 1e6, "us/op");
+    report("  page reads per lookup", static_cast<double>(coldStats.misses) / coldLookups, "");
+
+    store->resetStats();
+    size_t scanned = 0;
+    Timer scan;
+    firm.forEachPatent([&](const Patent&) { scanned++; });
+    double scanSeconds = scan.seconds();
+    if (scanned != patents) std::cerr << "Error: scan saw " << scanned << " patents" << std::endl;
+    report("full scan", scanned / scanSeconds / 1e6, "M patents/s");
+    report("  evictions", static_cast<double>(store->stats().evictions), "");
+
+    std::vector<std::string> batch;
+    std::vector<const Patent*> out;
+    size_t found = 0;
+    Timer many;
+    for (size_t b = 0; b < lookups; b += 1024) {
+        batch.clear();
+        for (size_t i = b; i < std::min(lookups, b + 1024); ++i) batch.push_back(hotKeys[picks[i]]);
+        firm.lookupMany(batch, out);
+        for (const Patent* p : out) found += p != nullptr;
+    }
+    double manySeconds = many.seconds();
+    if (found != lookups) std::cerr << "Error: lookupMany missed hot keys" << std::endl;
+    report("hot lookupMany x1024", lookups / manySeconds / 1e6, "M keys/s");
+
+    // 逐条插入：新键散在整棵树里，会引起叶子分裂
+    Timer insertTimer;
+    for (size_t i = 0; i < inserts; ++i) {
+        Patent p = makeSyntheticPatent(rng() % patents, "100000", rng);
+        Patent fresh(p.patentIDRef() + "-" + std::to_string(i), p.grantdateRef(), p.appldateRef(), p.getTitle(),
+                     p.countryRef(), "100000");
+        firm.addPatent(fresh);
+    }
+    double insertSeconds = insertTimer.seconds();
+    if (static_cast<size_t>(firm.getPatentCount()) != patents + inserts) std::cerr << "Error: insert count mismatch" << std::endl;
+    report("random insert", inserts / insertSeconds / 1e3, "K ops/s");
+
+    for (size_t threads : threadList) {
+        std::vector<std::thread> readers;
+        std::atomic<size_t> total(0);
+        size_t perThread = lookups / threads;
+        Timer concurrent;
+        for (size_t t = 0; t < threads; ++t) {
+            readers.emplace_back([&, t]() {
+                size_t bytes = 0;
+                for (size_t i = 0; i < perThread; ++i) bytes += firm.getPatent(hotKeys[picks[(i * threads + t) % lookups]]).getTitle().size();
+                total += bytes;
+            });
+        }
+        for (auto& reader : readers) reader.join();
+        report(std::to_string(threads) + " reader thread(s)", perThread * threads / concurrent.seconds() / 1e6, "M ops/s");
+    }
+
+    // 企业数多于缓冲池帧数：每个企业的根页都要经缓冲池取用，不能常驻
+    size_t manyFirms = optSize(opts, "--firms", 20000);
+    FirmSystemUnorderedMap system(FirmType::BTree);
+    std::shared_ptr<DiskStore> shared = std::make_shared<DiskStore>(poolMB << 20, tempDir);
+    system.setDiskStore(shared);
+    Timer manyLoad;
+    populate(system, manyFirms * 10, manyFirms, 53);
+    report(std::to_string(manyFirms) + " firms, load", manyFirms * 10 / manyLoad.seconds() / 1e6, "M patents/s");
+    std::vector<std::pair<std::string, std::string>> keys;
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& f) {
+        f->forEachPatent([&](const Patent& p) { keys.push_back(std::make_pair(f->getFirmID(), p.patentIDRef())); });
+    });
+    shared->resetStats();
+    size_t manyFound = 0, manyLookups = std::min<size_t>(lookups, 200000);
+    Timer manyTimer;
+    for (size_t i = 0; i < manyLookups; ++i) {
+        const auto& key = keys[rng() % keys.size()];
+        manyFound += system.getFirm(key.first)->getPatent(key.second).patentIDRef() == key.second;
+    }
+    double manySecondsAll = manyTimer.seconds();
+    if (manyFound != manyLookups) std::cerr << "Error: many-firm lookups missed " << manyLookups - manyFound << " keys" << std::endl;
+    report("  random getPatent", manyLookups / manySecondsAll / 1e6, "M ops/s");
+    report("  pool hit rate", shared->stats().hitRate() * 100, "%");
+
+    // 企业的专利全部删掉后再批量添加：删除不合并节点，要先把树清空才能再走批量装载
+    FirmBTree refill("200000", "Refill", store);
+    std::vector<Patent> refillBatch;
+    for (size_t i = 0; i < 2000; ++i) refillBatch.push_back(makeSyntheticPatent(i, "200000", rng));
+    Timer refillTimer;
+    refill.addPatents(refillBatch);
+    for (const auto& p : refillBatch) refill.removePatent(p.patentIDRef());
+    refillBatch.resize(100);
+    refill.addPatents(refillBatch);
+    double refillSeconds = refillTimer.seconds();
+    if (refill.getPatentCount() != 100) std::cerr << "Error: refilled firm holds " << refill.getPatentCount() << " patents" << std::endl;
+    report("add 2000, remove all, add 100", refillSeconds * 1e3, "ms");
+    return 0;
+}
+
+// 数据 TLB 读缺失计数（perf_event_open，只计用户态）；内核或权限不允许时 available() 为 false
+class DtlbMissCounter {
+private:
+    int fd;
+
+public:
+    DtlbMissCounter() : fd(-1) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    DtlbMissCounter(const DtlbMissCounter&) = delete;
+    DtlbMissCounter& operator=(const DtlbMissCounter&) = delete;
+
+    ~DtlbMissCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool available() const {
+        return fd >= 0;
+    }
+
+    void start() {
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count))) return 0;
+        return count;
+    }
+};
+
+// 大页 arena：同样的数据分别装进普通堆和 arena，比较装载、随机查找、全量扫描的速度和 dTLB 缺失，以及整体释放的耗时
+int benchArena(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 1000);
+    size_t keyCount = optSize(opts, "--keys", 1000000);
+    size_t chunkMB = std::max<size_t>(2, optSize(opts, "--chunk-mb", 64));
+
+    DtlbMissCounter tlb;
+    if (!tlb.available()) std::cout << "(dTLB counters unavailable: perf_event_open failed, misses reported as n/a)" << std::endl;
+    auto reportMisses = [&](const std::string& name, uint64_t misses, size_t ops) {
+        if (tlb.available()) {
+            report(name, static_cast<double>(misses) / ops, "misses/op");
+        } else {
+            std::cout << std::left << std::setw(36) << name << std::right << std::setw(16) << "n/a" << std::endl;
+        }
+    };
+
+    FirmType types[] = {FirmType::UnorderedMap, FirmType::Vector, FirmType::LinkedList};
+    for (FirmType type : types) {
+        for (int useArena = 0; useArena < 2; ++useArena) {
+            std::string name = std::string(firmTypeName(type)) + (useArena ? "/arena" : "/heap");
+            std::shared_ptr<FirmSystemUnorderedMap> system = std::make_shared<FirmSystemUnorderedMap>(type);
+            system->setHugePageArena(useArena == 1, chunkMB << 20);
+            Timer load;
+            populate(*system, patents, firms, 61);
+            report(name + " load", patents / load.seconds() / 1e6, "M patents/s");
+
+            std::vector<std::pair<std::string, std::string>> all;
+            all.reserve(patents);
+            system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                firm->forEachPatent([&](const Patent& p) { all.push_back(std::make_pair(p.firmIDRef(), p.patentIDRef())); });
+            });
+            // 向量和链表企业里的查找是线性的，少查一些
+            size_t n = type == FirmType::UnorderedMap ? keyCount : std::max<size_t>(1, keyCount / 100);
+            std::mt19937_64 rng(62);
+            std::vector<std::pair<std::string, std::string>> keys(n);
+            for (auto& key : keys) key = all[rng() % all.size()];
+
+            size_t found = 0;
+            std::vector<std::pair<std::string, std::string>> part;
+            std::vector<const Patent*> out;
+            tlb.start();
+            Timer lookup;
+            for (size_t b = 0; b < n; b += 1024) {
+                part.assign(keys.begin() + b, keys.begin() + std::min(n, b + 1024));
+                system->lookupMany(part, out);
+                for (const Patent* p : out) found += p != nullptr && p->grantdateRef().size() > 0;
+            }
+            double lookupSeconds = lookup.seconds();
+            uint64_t lookupMisses = tlb.stop();
+            if (found != n) std::cerr << "Error: lookup missed " << n - found << " keys" << std::endl;
+            report(name + " lookupMany", n / lookupSeconds / 1e6, "M keys/s");
+            reportMisses(name + "   dTLB", lookupMisses, n);
+
+            size_t scanned = 0, bytes = 0;
+            tlb.start();
+            Timer scan;
+            system->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                firm->forEachPatent([&](const Patent& p) {
+                    scanned++;
+                    bytes += p.patentIDRef().size() + p.countryRef().size();
+                });
+            });
+            double scanSeconds = scan.seconds();
+            uint64_t scanMisses = tlb.stop();
+            if (scanned != patents || bytes == 0) std::cerr << "Error: scan saw " << scanned << " patents" << std::endl;
+            report(name + " full scan", scanned / scanSeconds / 1e6, "M patents/s");
+            reportMisses(name + "   dTLB", scanMisses, scanned);
+
+            if (useArena) {
+                std::shared_ptr<HugePageArena> arena = system->hugePageArena();
+                HugePageArena::Stats st = arena->stats();
+                report(name + "   reserved", st.reserved / 1048576.0, "MB");
+                report(name + "   used", st.used / 1048576.0, "MB");
+                report(name + "   MAP_HUGETLB", st.hugetlbBytes / 1048576.0, "MB");
+                report(name + "   transparent huge", arena->transparentHugeBytes() / 1048576.0, "MB");
+            }
+            all.clear();
+            keys.clear();
+            Timer teardown;
+            system.reset();
+            report(name + " teardown", teardown.seconds() * 1e3, "ms");
+        }
+    }
+    return 0;
+}
+
+// 看板摘要：装载时增量维护的开销，删除和转让之后的查询延迟、误差，和每次全量遍历求精确值比较；再看按线程建摘要再合并
+int benchSketch(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 1000000);
+    size_t firms = optSize(opts, "--firms", 100000);
+    size_t updates = optSize(opts, "--updates", 100000);
+    size_t queries = optSize(opts, "--queries", 10000);
+    std::vector<size_t> threadList = optThreadList(opts);
+
+    // 国家按 1/rank 偏斜，专利数按企业编号偏斜（同 populate）
+    static const char* countries[] = {"US", "JP", "CN", "KR", "DE", "FR", "GB", "TW", "CH", "NL", "SE", "IT", "CA", "FI",
+                                      "IL", "AT", "DK", "BE", "AU", "IN", "ES", "SG", "NO", "IE", "BR", "RU", "NZ", "MX"};
+    const size_t countryCount = sizeof(countries) / sizeof(countries[0]);
+    std::vector<double> cumulative(countryCount);
+    for (size_t c = 0; c < countryCount; ++c) cumulative[c] = (c ? cumulative[c - 1] : 0) + 1.0 / (c + 1);
+    std::mt19937_64 rng(71);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<std::vector<Patent>> byFirm(firms);
+    for (size_t i = 0; i < patents; ++i) {
+        double u = uniform(rng);
+        size_t f = static_cast<size_t>(firms * u * u) % firms;
+        Patent p = makeSyntheticPatent(i, std::to_string(100000 + f), rng);
+        size_t c = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng) * cumulative.back()) - cumulative.begin();
+        byFirm[f].push_back(Patent(p.patentIDRef(), p.grantdateRef(), p.appldateRef(), p.getTitle(),
+                                   countries[std::min(c, countryCount - 1)], p.firmIDRef()));
+    }
+    auto load = [&](IFirmSystem& system) {
+        for (size_t f = 0; f < firms; ++f) system.addFirm(std::to_string(100000 + f), "Firm " + std::to_string(f));
+        for (size_t f = 0; f < firms; ++f) {
+            if (byFirm[f].empty()) continue;
+            std::vector<Patent> group(byFirm[f]);
+            system.addPatentsFirm(std::to_string(100000 + f), group);
+        }
+    };
+
+    double plainSeconds;
+    {
+        FirmSystemUnorderedMap plain(FirmType::UnorderedMap);
+        Timer timer;
+        load(plain);
+        plainSeconds = timer.seconds();
+    }
+    FirmSystemUnorderedMap system(FirmType::UnorderedMap);
+    std::shared_ptr<PatentSketches> sketches = std::make_shared<PatentSketches>();
+    system.addObserver(sketches);
+    Timer loadTimer;
+    load(system);
+    double sketchSeconds = loadTimer.seconds();
+    report("load without sketches", patents / plainSeconds / 1e6, "M patents/s");
+    report("load with sketches", patents / sketchSeconds / 1e6, "M patents/s");
+    report("  overhead per patent", (sketchSeconds - plainSeconds) / patents * 1e9, "ns");
+
+    // 删除和转让各一半
+    std::vector<std::pair<std::string, std::string>> all;
+    all.reserve(patents);
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        firm->forEachPatent([&](const Patent& p) { all.push_back(std::make_pair(p.firmIDRef(), p.patentIDRef())); });
+    });
+    std::shuffle(all.begin(), all.end(), rng);
+    updates = std::min(updates, all.size());
+    Timer updateTimer;
+    for (size_t i = 0; i < updates; ++i) {
+        if (i % 2 == 0) {
+            system.removePatentFirm(all[i].first, all[i].second);
+        } else {
+            system.transferPatent(all[i].first, std::to_string(100000 + rng() % firms), all[i].second);
+        }
+    }
+    report("removes + transfers", updates / updateTimer.seconds() / 1e3, "K ops/s");
+
+    // 精确值：每个问题一次全量遍历
+    std::string year = "2010";
+    Timer exactTimer;
+    std::unordered_set<std::string> titles;
+    std::unordered_map<std::string, uint64_t> yearCounts;
+    uint64_t yearTotal = 0;
+    std::vector<uint32_t> counts;
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        counts.push_back(static_cast<uint32_t>(firm->getPatentCount()));
+        firm->forEachPatent([&](const Patent& p) {
+            titles.insert(p.getTitle());
+            if (p.grantdateRef().compare(0, 4, year) == 0) {
+                yearCounts[p.countryRef()]++;
+                yearTotal++;
+            }
+        });
+    });
+    std::sort(counts.begin(), counts.end());
+    double exactSeconds = exactTimer.seconds();
+    report("exact answers (one full pass)", exactSeconds * 1e3, "ms");
+
+    double estimate = 0;
+    std::vector<PatentSketches::HeavyHitter> top;
+    double quantiles[3] = {0, 0, 0};
+    const double qs[3] = {0.5, 0.9, 0.99};
+    Timer queryTimer;
+    for (size_t i = 0; i < queries; ++i) {
+        estimate = sketches->distinctTitles();
+        top = sketches->topCountries(year, 5);
+        for (int q = 0; q < 3; ++q) quantiles[q] = sketches->firmCountQuantile(qs[q]);
+    }
+    report("sketch answers", queryTimer.seconds() / queries * 1e6, "us");
+
+    report("distinct titles, exact", static_cast<double>(titles.size()), "");
+    report("distinct titles, HLL", estimate, "");
+    report("  error (removed titles kept)", (estimate - titles.size()) / titles.size() * 100, "%");
+    report("  standard error", sketches->titleRelativeError() * 100, "%");
+    double worstCount = 0;
+    for (const auto& h : top) worstCount = std::max(worstCount, std::fabs(static_cast<double>(h.estimate) - yearCounts[h.country]));
+    std::vector<std::pair<uint64_t, std::string>> exactTop;
+    for (const auto& entry : yearCounts) exactTop.push_back(std::make_pair(entry.second, entry.first));
+    std::sort(exactTop.rbegin(), exactTop.rend());
+    size_t agree = 0;
+    for (size_t i = 0; i < top.size() && i < exactTop.size(); ++i) agree += top[i].country == exactTop[i].second;
+    report("top-5 countries matching exact order", static_cast<double>(agree), "of 5");
+    report("  worst count error / year total", yearTotal ? worstCount / yearTotal * 100 : 0, "%");
+    report("  Count-Min bound / year total", yearTotal ? sketches->countErrorBound() / yearTotal * 100 : 0, "%");
+    double worstRank = 0;
+    for (int q = 0; q < 3; ++q) {
+        double lo = static_cast<double>(std::lower_bound(counts.begin(), counts.end(), static_cast<uint32_t>(quantiles[q])) - counts.begin());
+        double hi = static_cast<double>(std::upper_bound(counts.begin(), counts.end(), static_cast<uint32_t>(quantiles[q])) - counts.begin());
+        double target = qs[q] * counts.size();
+        double miss = target < lo ? lo - target : (target > hi ? target - hi : 0);
+        worstRank = std::max(worstRank, miss / counts.size());
+    }
+    for (int q = 0; q < 3; ++q) report("firm patent count p" + std::to_string(static_cast<int>(qs[q] * 100)), quantiles[q], "");
+    report("  worst rank error", worstRank * 100, "%");
+    report("  rank error bound", sketches->quantileRankError() * 100, "%");
+    report("sketch memory", sketches->sketchBytes() / 1024.0, "KB");
+    report("firm count tracking memory", sketches->trackingBytes() / 1048576.0, "MB");
+
+    // 每个线程建一份摘要再合并
+    for (size_t threads : threadList) {
+        Timer build;
+        SketchSet merged = SketchSet::build(system, SketchConfig(), threads);
+        double seconds = build.seconds();
+        report(std::to_string(threads) + " thread(s) build + merge", seconds * 1e3, "ms");
+        report("  distinct titles after rebuild", merged.titles.estimate(), "");
+    }
+    return 0;
+}
+
+PatentServer* shardBenchServer = nullptr;
+
+void stopShardBenchServer(int) {
+    if (shardBenchServer) shardBenchServer->stop();
+}
+
+// 分片扩展：同一份合成数据分别用 --shards 列出的分片数启动协调进程（各自 fork 出分片），
+// --clients 个连接每次流水线发 --depth 个请求：查企业、查专利、添加专利和转让，报告吞吐；
+// 再单独测逐个跨分片转让的延迟，最后核对专利总数，两阶段转让不能丢失或重复专利
+int benchShard(const Options& opts) {
+    size_t patents = optSize(opts, "--patents", 200000);
+    size_t firms = std::max<size_t>(2, optSize(opts, "--firms", 10000));
+    size_t requests = optSize(opts, "--requests", 200000);
+    size_t clients = std::max<size_t>(1, optSize(opts, "--clients", 4));
+    size_t depth = std::max<size_t>(1, optSize(opts, "--depth", 32));
+    size_t transferPercent = optSize(opts, "--transfers", 2);
+    size_t writePercent = optSize(opts, "--writes", 5);
+    size_t latencyOps = optSize(opts, "--latency-ops", 1000);
+    std::string dir = optString(opts, "--temp", "/tmp") + "/patent_bench_shard";
+    Options shardOpts = opts;
+    shardOpts["--threads"] = optString(opts, "--shards", "1,2,4");
+    std::vector<size_t> shardList = optThreadList(shardOpts);
+
+    // 专利 i 属于企业 i % firms，客户端据此知道每件专利最初的企业
+    mkdir(dir.c_str(), 0755);
+    {
+        std::ofstream firmOut(dir + "/FirmData.csv", std::ios::binary);
+        firmOut << "firmID,name\n";
+        for (size_t f = 0; f < firms; ++f) firmOut << 100000 + f << ",Firm " << f << '\n';
+        std::ofstream out(dir + "/PatentData.csv", std::ios::binary);
+        out << "patentID,grantdate,appldate,patent_title,country,firmID\n";
+        std::mt19937_64 rng(33);
+        for (size_t i = 0; i < patents; ++i) {
+            Patent p = makeSyntheticPatent(i, std::to_string(100000 + i % firms), rng);
+            out << p.getPatentID() << ',' << p.getGrantdate() << ',' << p.getAppldate() << ',' << p.getTitle() << ','
+                << p.getCountry() << ',' << p.getFirmID() << '\n';
+        }
+    }
+    auto firmID = [](size_t f) { return std::to_string(100000 + f); };
+    const std::string sock = dir + "/coordinator.sock";
+
+    int code = 0;
+    for (size_t shards : shardList) {
+        if (shards == 0) continue;
+        std::cout << shards << " shard process(es)" << std::endl;
+        std::remove(sock.c_str());
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "fork failed" << std::endl;
+            return 1;
+        }
+        if (pid == 0) {
+            int devNull = open("/dev/null", O_WRONLY);
+            if (devNull >= 0) dup2(devNull, STDOUT_FILENO);
+            _exit(runShardCluster(sock, dir, static_cast<uint32_t>(shards), shards, [](PatentServer& server) {
+                shardBenchServer = &server;
+                std::signal(SIGTERM, stopShardBenchServer);
+                try {
+                    server.run();
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    return 1;
+                }
+                return 0;
+            }));
+        }
+
+        // 协调进程连上所有分片之后才开始监听
+        Timer startup;
+        {
+            ShardConnection probe(sock);
+            if (!probe.connectTo(2400, 50)) {
+                std::cerr << "coordinator did not start" << std::endl;
+                kill(pid, SIGTERM);
+                waitpid(pid, nullptr, 0);
+                return 1;
+            }
+        }
+        report("startup (load + connect)", startup.seconds() * 1e3, "ms");
+
+        std::atomic<size_t> added(0), errors(0), transfersDone(0);
+        size_t perClient = requests / clients;
+        std::vector<std::thread> threads;
+        Timer run;
+        for (size_t c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c]() {
+                ShardConnection conn(sock);
+                if (!conn.connectTo(10, 50)) {
+                    errors += perClient;
+                    return;
+                }
+                std::mt19937_64 rng(100 + c);
+                // 本客户端只转让 i % clients == c 的专利，自己记录它们当前的企业
+                std::vector<size_t> owner;
+                for (size_t i = c; i < patents; i += clients) owner.push_back(i % firms);
+                size_t nextOwned = 0, nextNew = 0;
+                std::vector<protocol::Request> batch;
+                std::vector<std::pair<size_t, size_t>> moves;  // (批内下标, owner 下标)
+                std::vector<size_t> targets;
+                std::vector<protocol::Response> out;
+                for (size_t done = 0; done < perClient;) {
+                    batch.clear();
+                    moves.clear();
+                    targets.clear();
+                    for (size_t d = 0; d < depth && done < perClient; ++d, ++done) {
+                        size_t r = rng() % 100;
+                        if (r < transferPercent && !owner.empty()) {
+                            size_t j = nextOwned++ % owner.size();
+                            size_t to = (owner[j] + 1 + rng() % (firms - 1)) % firms;
+                            moves.push_back(std::make_pair(batch.size(), j));
+                            targets.push_back(to);
+                            batch.push_back(protocol::Request(0, protocol::OpCode::TransferPatent,
+                                                              {firmID(owner[j]), firmID(to), std::to_string(8000000 + c + j * clients)}));
+                        } else if (r < transferPercent + writePercent) {
+                            std::string id = std::to_string(30000000 + c * 10000000 + nextNew++);
+                            batch.push_back(protocol::Request(0, protocol::OpCode::AddPatent,
+                                                              {firmID(rng() % firms), id, "20200101", "20190101", "Synthetic device", "US"}));
+                        } else if (r < 50) {
+                            batch.push_back(protocol::Request(0, protocol::OpCode::GetFirm, {firmID(rng() % firms)}));
+                        } else {
+                            size_t i = rng() % patents;
+                            batch.push_back(protocol::Request(0, protocol::OpCode::GetPatent, {firmID(i % firms), std::to_string(8000000 + i)}));
+                        }
+                    }
+                    uint32_t firstID;
+                    if (!conn.sendBatch(batch, firstID) || !conn.receiveBatch(firstID, batch.size(), out)) {
+                        errors += perClient - done + batch.size();
+                        return;
+                    }
+                    for (size_t k = 0; k < out.size(); ++k) {
+                        if (out[k].status == protocol::Status::Error) errors++;
+                        if (out[k].status == protocol::Status::Ok && batch[k].op == protocol::OpCode::AddPatent) added++;
+                    }
+                    for (size_t m = 0; m < moves.size(); ++m) {
+                        if (out[moves[m].first].status == protocol::Status::Ok) {
+                            owner[moves[m].second] = targets[m];
+                            transfersDone++;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        double seconds = run.seconds();
+        report("throughput", perClient * clients / seconds, "ops/s");
+        report("  transfers committed", static_cast<double>(transfersDone.load()), "");
+        report("  errors", static_cast<double>(errors.load()), "");
+
+        // 逐个跨分片转让：先添加一件新专利，再在两个不同分片的企业之间来回转让
+        ShardConnection conn(sock);
+        conn.connectTo(10, 50);
+        size_t a = 0, b = 1;
+        while (b < firms && shardOf(firmID(a), static_cast<uint32_t>(shards)) == shardOf(firmID(b), static_cast<uint32_t>(shards))) b++;
+        if (shards > 1 && b < firms && latencyOps > 0) {
+            protocol::Response resp;
+            std::string id = "49999999";
+            conn.call(protocol::Request(0, protocol::OpCode::AddPatent, {firmID(a), id, "20200101", "20190101", "Latency probe", "US"}), resp);
+            if (resp.status == protocol::Status::Ok) added++;
+            size_t ok = 0;
+            Timer latency;
+            for (size_t k = 0; k < latencyOps; ++k) {
+                bool forward = k % 2 == 0;
+                conn.call(protocol::Request(0, protocol::OpCode::TransferPatent,
+                                            {firmID(forward ? a : b), firmID(forward ? b : a), id}), resp);
+                ok += resp.status == protocol::Status::Ok;
+            }
+            report("cross-shard transfer latency", latency.seconds() / latencyOps * 1e6, "us");
+            report("  succeeded", static_cast<double>(ok), "");
+        }
+
+        // 核对：所有企业的专利数之和应等于初始专利数加上添加成功的数量
+        size_t total = 0;
+        for (size_t f = 0; f < firms; f += 1000) {
+            std::vector<protocol::Request> batch;
+            for (size_t g = f; g < std::min(firms, f + 1000); ++g) {
+                batch.push_back(protocol::Request(0, protocol::OpCode::GetFirm, {firmID(g)}));
+            }
+            uint32_t firstID;
+            std::vector<protocol::Response> out;
+            if (!conn.sendBatch(batch, firstID) || !conn.receiveBatch(firstID, batch.size(), out)) break;
+            for (const auto& resp : out) {
+                if (resp.status == protocol::Status::Ok && resp.fields.size() == 3) total += std::stoull(resp.fields[2]);
+            }
+        }
+        report("patents after run", static_cast<double>(total), "");
+        report("  expected", static_cast<double>(patents + added.load()), "");
+        if (total != patents + added.load()) {
+            std::cerr << "patent count mismatch with " << shards << " shard(s)" << std::endl;
+            code = 1;
+        }
+
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+    std::remove((dir + "/FirmData.csv").c_str());
+    std::remove((dir + "/PatentData.csv").c_str());
+    rmdir(dir.c_str());
+    return code;
+}
+
+int main(int argc, char* argv[]) {
+    std::map<std::string, std::function<int(const Options&)>> benchmarks;
+    benchmarks["history"] = benchHistory;
+    benchmarks["graph"] = benchGraph;
+    benchmarks["memory"] = benchMemory;
+    benchmarks["autocomplete"] = benchAutocomplete;
+    benchmarks["normalize"] = benchNormalize;
+    benchmarks["leaderboard"] = benchLeaderboard;
+    benchmarks["filter"] = benchFilter;
+    benchmarks["lazy"] = benchLazy;
+    benchmarks["titles"] = benchTitles;
+    benchmarks["mvcc"] = benchMvcc;
+    benchmarks["record"] = benchRecord;
+    benchmarks["replay"] = benchReplay;
+    benchmarks["export"] = benchExport;
+    benchmarks["parallel"] = benchParallel;
+    benchmarks["resolve"] = benchResolve;
+    benchmarks["lookup"] = benchLookup;
+    benchmarks["query"] = benchQuery;
+    benchmarks["sort"] = benchSort;
+    benchmarks["btree"] = benchBTree;
+    benchmarks["arena"] = benchArena;
+    benchmarks["sketch"] = benchSketch;
+    benchmarks["shard"] = benchShard;
+
+    if (argc < 2 || std::string(argv[1]) == "list") {
+        std::cout << "Usage: patent_bench <benchmark> [--option value]..." << std::endl;
+        std::cout << "Benchmarks:";
+        for (const auto& b : benchmarks) std::cout << " " << b.first;
+        std::cout << std::endl;
+        return argc < 2 ? 1 : 0;
+    }
+
+    auto it = benchmarks.find(argv[1]);
+    if (it == benchmarks.end()) {
+        std::cerr << "Unknown benchmark: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    Options opts;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        opts[argv[i]] = argv[i + 1];
+    }
+    return it->second(opts);
+}
@@ -0,0 +1,1209 @@
+#ifndef BTREE_FIRM_HPP
+#define BTREE_FIRM_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "firm.hpp"
+
+// 放在磁盘上的企业：专利按 patentID 存进分页的 B+ 树，页面经缓冲池进出内存
+// 同一个企业系统里的 B+ 树企业共用一个页文件和一个缓冲池，内存上限对整个系统生效
+
+// 读写页闩：state > 0 为读者数，-1 为写者；临界区只是页内的几次查找或拷贝，自旋后让出 CPU
+class RWLatch {
+private:
+    std::atomic<int> state;
+
+public:
+    RWLatch() : state(0) {}
+
+    void lockShared() {
+        for (unsigned spin = 0;; ++spin) {
+            int s = state.load(std::memory_order_relaxed);
+            if (s >= 0 && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) return;
+            if (spin >= 64) std::this_thread::yield();
+        }
+    }
+
+    void unlockShared() {
+        state.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock() {
+        for (unsigned spin = 0;; ++spin) {
+            int expected = 0;
+            if (state.compare_exchange_weak(expected, -1, std::memory_order_acquire)) return;
+            if (spin >= 64) std::this_thread::yield();
+        }
+    }
+
+    void unlock() {
+        state.store(0, std::memory_order_release);
+    }
+};
+
+// 缓冲池里的一帧；pageID 为 0 表示空帧。pageID / referenced 只在缓冲池的锁下读写，
+// pins 在锁下增加、解钉时不拿锁直接减；页闩只在钉住期间持有，所以被持有页闩的帧不会被换出
+struct PageFrame {
+    uint32_t pageID;
+    std::atomic<int> pins;
+    bool referenced;
+    std::atomic<bool> dirty;
+    RWLatch latch;
+    char* data;
+
+    PageFrame() : pageID(0), pins(0), referenced(false), dirty(false), data(nullptr) {}
+};
+
+struct BufferPoolStats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t writes;
+
+    BufferPoolStats() : hits(0), misses(0), evictions(0), writes(0) {}
+
+    double hitRate() const {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+    }
+};
+
+// 页文件 + 缓冲池。页文件建在 dir 下，打开后立即 unlink，进程退出时由系统回收
+// 换出用时钟算法：指针扫过各帧，跳过被钉住的帧，引用位为 1 的清零后给第二次机会
+class DiskStore {
+public:
+    static const size_t kPageSize = 8192;
+    static const size_t kMinFrames = 64;
+
+private:
+    int fd;
+    char* memory;
+    size_t frameCount;
+    std::unique_ptr<PageFrame[]> frames;
+    mutable std::mutex mtx;
+    std::unordered_map<uint32_t, size_t> table;  // 页号 -> 帧号
+    size_t hand;
+    uint32_t nextPage;
+    std::vector<uint32_t> freePages;
+    BufferPoolStats counters;
+
+    off_t offsetOf(uint32_t pageID) const {
+        return static_cast<off_t>(pageID) * static_cast<off_t>(kPageSize);
+    }
+
+    void writeBack(PageFrame& frame) {
+        if (::pwrite(fd, frame.data, kPageSize, offsetOf(frame.pageID)) != static_cast<ssize_t>(kPageSize)) {
+            throw std::runtime_error("B+-tree page write failed");
+        }
+        frame.dirty = false;
+        counters.writes++;
+    }
+
+    // 在锁下找一帧腾出来：脏页先写回，再从页表里摘掉。转两圈都找不到说明全被钉住了
+    size_t claimFrame() {
+        for (size_t step = 0; step < 2 * frameCount + 1; ++step) {
+            size_t i = hand;
+            hand = (hand + 1) % frameCount;
+            PageFrame& frame = frames[i];
+            if (frame.pins > 0) continue;
+            if (frame.referenced) {
+                frame.referenced = false;
+                continue;
+            }
+            if (frame.pageID != 0) {
+                if (frame.dirty) writeBack(frame);
+                table.erase(frame.pageID);
+                counters.evictions++;
+            }
+            return i;
+        }
+        throw std::runtime_error("B+-tree buffer pool exhausted: all pages pinned");
+    }
+
+public:
+    // poolBytes 为缓冲池大小，至少 kMinFrames 页
+    explicit DiskStore(size_t poolBytes = 64 * 1024 * 1024, const std::string& dir = "/tmp")
+        : fd(-1), memory(nullptr), frameCount(poolBytes / kPageSize < kMinFrames ? kMinFrames : poolBytes / kPageSize),
+          frames(new PageFrame[frameCount]), hand(0), nextPage(1) {
+        std::string pattern = dir + "/patent-btree-XXXXXX";
+        std::vector<char> path(pattern.begin(), pattern.end());
+        path.push_back('\0');
+        fd = ::mkstemp(path.data());
+        if (fd < 0) throw std::runtime_error("Cannot create B+-tree page file in " + dir);
+        ::unlink(path.data());
+        void* block = nullptr;
+        if (::posix_memalign(&block, 4096, frameCount * kPageSize) != 0) {
+            ::close(fd);
+            throw std::bad_alloc();
+        }
+        memory = static_cast<char*>(block);
+        for (size_t i = 0; i < frameCount; ++i) frames[i].data = memory + i * kPageSize;
+        table.reserve(frameCount);
+    }
+
+    DiskStore(const DiskStore&) = delete;
+    DiskStore& operator=(const DiskStore&) = delete;
+
+    ~DiskStore() {
+        std::free(memory);
+        ::close(fd);
+    }
+
+    // 钉住一页并返回所在的帧。未命中时在锁外读盘：读盘期间帧上挂着写闩，
+    // 同时来要这一页的线程会钉住它然后等在页闩上，而不是再读一遍
+    PageFrame* fetch(uint32_t pageID) {
+        std::unique_lock<std::mutex> lock(mtx);
+        auto it = table.find(pageID);
+        if (it != table.end()) {
+            PageFrame& frame = frames[it->second];
+            frame.pins++;
+            frame.referenced = true;
+            counters.hits++;
+            return &frame;
+        }
+        counters.misses++;
+        size_t index = claimFrame();
+        PageFrame& frame = frames[index];
+        frame.pageID = pageID;
+        frame.pins = 1;
+        frame.referenced = true;
+        frame.dirty = false;
+        table[pageID] = index;
+        frame.latch.lock();
+        lock.unlock();
+        bool ok = ::pread(fd, frame.data, kPageSize, offsetOf(pageID)) == static_cast<ssize_t>(kPageSize);
+        if (!ok) {
+            lock.lock();
+            table.erase(pageID);
+            frame.pageID = 0;
+            frame.pins--;
+            frame.latch.unlock();
+            throw std::runtime_error("B+-tree page read failed");
+        }
+        frame.latch.unlock();
+        return &frame;
+    }
+
+    // 分配一张清零的新页（优先复用释放过的页号），返回时已钉住并标脏
+    PageFrame* create(uint32_t& pageID) {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t index = claimFrame();
+        if (freePages.empty()) {
+            pageID = nextPage++;
+        } else {
+            pageID = freePages.back();
+            freePages.pop_back();
+        }
+        PageFrame& frame = frames[index];
+        frame.pageID = pageID;
+        frame.pins = 1;
+        frame.referenced = true;
+        frame.dirty = true;
+        std::memset(frame.data, 0, kPageSize);
+        table[pageID] = index;
+        return &frame;
+    }
+
+    // 换出只挑 pins 为 0 的帧，所以解钉不用拿缓冲池的锁；脏标记在解钉之前写好
+    void release(PageFrame* frame, bool dirty) {
+        if (dirty) frame->dirty.store(true, std::memory_order_relaxed);
+        frame->pins.fetch_sub(1, std::memory_order_release);
+    }
+
+    // 调用方保证这一页已经没有人钉住；缓存的内容直接丢弃，不写回
+    void freePage(uint32_t pageID) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = table.find(pageID);
+        if (it != table.end()) {
+            PageFrame& frame = frames[it->second];
+            frame.pageID = 0;
+            frame.dirty = false;
+            frame.referenced = false;
+            table.erase(it);
+        }
+        freePages.push_back(pageID);
+    }
+
+    // 写回全部没被钉住的脏页
+    void flush() {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t i = 0; i < frameCount; ++i) {
+            if (frames[i].pageID != 0 && frames[i].pins == 0 && frames[i].dirty) writeBack(frames[i]);
+        }
+    }
+
+    // 写回并清空所有没被钉住的帧，之后的访问都要读盘（基准测冷启动用）
+    void dropCache() {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t i = 0; i < frameCount; ++i) {
+            PageFrame& frame = frames[i];
+            if (frame.pageID == 0 || frame.pins > 0) continue;
+            if (frame.dirty) writeBack(frame);
+            table.erase(frame.pageID);
+            frame.pageID = 0;
+            frame.referenced = false;
+        }
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    BufferPoolStats stats() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return counters;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(mtx);
+        counters = BufferPoolStats();
+    }
+
+    size_t capacity() const {
+        return frameCount;
+    }
+
+    // 在用的页数（不含释放后待复用的）
+    size_t pageCount() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return nextPage - 1 - freePages.size();
+    }
+
+    size_t fileBytes() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return static_cast<size_t>(nextPage) * kPageSize;
+    }
+
+    // 缓冲池的内存：帧缓冲区 + 帧描述 + 页表
+    size_t memoryUsage() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return frameCount * (kPageSize + sizeof(PageFrame)) + table.bucket_count() * sizeof(void*)
+             + table.size() * (sizeof(void*) + sizeof(std::pair<const uint32_t, size_t>))
+             + freePages.capacity() * sizeof(uint32_t);
+    }
+};
+
+// 钉住并闩住一页，析构时先放页闩再解钉
+class PageGuard {
+private:
+    DiskStore* store;
+    PageFrame* frame;
+    bool exclusive;
+    bool dirty;
+
+public:
+    PageGuard() : store(nullptr), frame(nullptr), exclusive(false), dirty(false) {}
+
+    PageGuard(DiskStore* store, PageFrame* frame, bool exclusive)
+        : store(store), frame(frame), exclusive(exclusive), dirty(false) {
+        if (exclusive) {
+            frame->latch.lock();
+        } else {
+            frame->latch.lockShared();
+        }
+    }
+
+    PageGuard(PageGuard&& other) noexcept
+        : store(other.store), frame(other.frame), exclusive(other.exclusive), dirty(other.dirty) {
+        other.frame = nullptr;
+    }
+
+    // 先接手新页再放旧页：自上而下加闩时就是先闩住子节点再放开父节点
+    PageGuard& operator=(PageGuard&& other) noexcept {
+        if (this != &other) {
+            PageGuard old(std::move(*this));
+            store = other.store;
+            frame = other.frame;
+            exclusive = other.exclusive;
+            dirty = other.dirty;
+            other.frame = nullptr;
+        }
+        return *this;
+    }
+
+    PageGuard(const PageGuard&) = delete;
+    PageGuard& operator=(const PageGuard&) = delete;
+
+    ~PageGuard() {
+        release();
+    }
+
+    void release() {
+        if (!frame) return;
+        if (exclusive) {
+            frame->latch.unlock();
+        } else {
+            frame->latch.unlockShared();
+        }
+        store->release(frame, dirty);
+        frame = nullptr;
+    }
+
+    bool valid() const { return frame != nullptr; }
+    char* data() const { return frame->data; }
+    uint32_t id() const { return frame->pageID; }
+    void markDirty() { dirty = true; }
+};
+
+namespace btree_detail {
+
+// 页头 16 字节：类型、cell 数、cell 区起点、右兄弟（叶子）或下一页（溢出页）、最左子节点（内部节点）
+// 页头之后是按键排序的 2 字节槽数组，cell 从页尾往前放
+enum PageKind : uint8_t { kLeaf = 1, kInternal = 2, kOverflow = 3 };
+
+const size_t kPageSize = DiskStore::kPageSize;
+const size_t kHeader = 16;
+const size_t kMaxKey = 256;
+// 叶子 cell 的值超过 kMaxInline 字节时整段放进溢出页链，cell 里只记首页号和长度
+const size_t kMaxInline = 1024;
+const uint16_t kOverflowFlag = 0x8000;
+const size_t kMaxInternalCell = 2 + kMaxKey + 4;
+const size_t kOverflowPayload = kPageSize - kHeader;
+
+inline uint16_t load16(const char* p) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+inline uint32_t load32(const char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline void store16(char* p, size_t v) { uint16_t x = static_cast<uint16_t>(v); std::memcpy(p, &x, 2); }
+inline void store32(char* p, size_t v) { uint32_t x = static_cast<uint32_t>(v); std::memcpy(p, &x, 4); }
+
+inline int compareKeys(const char* a, size_t alen, const char* b, size_t blen) {
+    int c = std::memcmp(a, b, std::min(alen, blen));
+    if (c != 0) return c;
+    return alen < blen ? -1 : (alen > blen ? 1 : 0);
+}
+
+inline void appendField(std::string& out, const std::string& field) {
+    char len[4];
+    store32(len, field.size());
+    out.append(len, 4);
+    out.append(field);
+}
+
+// 记录里不存 patentID（就是键）和 firmID（由所属企业决定）
+inline void encodeRecord(const Patent& patent, std::string& out, std::string& scratch) {
+    appendField(out, patent.grantdateRef());
+    appendField(out, patent.appldateRef());
+    appendField(out, patent.titleRef(scratch));
+    appendField(out, patent.countryRef());
+}
+
+// 各字段直接从页里的字节构造，不经过中间字符串
+inline Patent decodeRecord(const std::string& key, const char* value, size_t size, const std::string& firmID) {
+    const char* field[4] = {value, value, value, value};
+    size_t length[4] = {0, 0, 0, 0};
+    size_t pos = 0;
+    for (int i = 0; i < 4 && pos + 4 <= size; ++i) {
+        length[i] = std::min<size_t>(load32(value + pos), size - pos - 4);
+        field[i] = value + pos + 4;
+        pos += 4 + length[i];
+    }
+    return Patent(key, std::string(field[0], length[0]), std::string(field[1], length[1]),
+                  std::string(field[2], length[2]), std::string(field[3], length[3]), firmID);
+}
+
+inline std::string internalCell(const std::string& key, uint32_t child) {
+    std::string cell(2 + key.size() + 4, '\0');
+    store16(&cell[0], key.size());
+    std::memcpy(&cell[2], key.data(), key.size());
+    store32(&cell[2 + key.size()], child);
+    return cell;
+}
+
+// 只解释页里的字节，不拥有页
+class NodeView {
+private:
+    char* p;
+
+public:
+    explicit NodeView(char* page) : p(page) {}
+
+    uint8_t kind() const { return static_cast<uint8_t>(p[0]); }
+    size_t count() const { return load16(p + 2); }
+    size_t heapStart() const { return load16(p + 4) == 0 ? kPageSize : load16(p + 4); }
+    uint32_t next() const { return load32(p + 8); }
+    uint32_t aux() const { return load32(p + 12); }
+    void setNext(uint32_t id) { store32(p + 8, id); }
+    void setAux(uint32_t id) { store32(p + 12, id); }
+
+    // cell 区起点存 0 表示整页为空（kPageSize 放不进 16 位）
+    void init(uint8_t kind) {
+        std::memset(p, 0, kHeader);
+        p[0] = static_cast<char>(kind);
+    }
+
+    const char* cell(size_t i) const { return p + load16(p + kHeader + 2 * i); }
+
+    std::string key(size_t i) const {
+        const char* c = cell(i);
+        return std::string(c + 2, load16(c));
+    }
+
+    int compareAt(size_t i, const std::string& key) const {
+        const char* c = cell(i);
+        return compareKeys(c + 2, load16(c), key.data(), key.size());
+    }
+
+    size_t cellSize(size_t i) const {
+        const char* c = cell(i);
+        size_t k = load16(c);
+        if (kind() == kInternal) return 2 + k + 4;
+        size_t v = load16(c + 2 + k);
+        return 2 + k + 2 + ((v & kOverflowFlag) ? 8 : v);
+    }
+
+    uint32_t child(size_t i) const {
+        const char* c = cell(i);
+        return load32(c + 2 + load16(c));
+    }
+
+    // 叶子 cell 的值：溢出时返回 false，first/total 为溢出链的首页和总长度
+    bool inlineValue(size_t i, const char*& value, size_t& len, uint32_t& first) const {
+        const char* c = cell(i);
+        const char* v = c + 2 + load16(c);
+        size_t tag = load16(v);
+        if (tag & kOverflowFlag) {
+            first = load32(v + 2);
+            len = load32(v + 6);
+            return false;
+        }
+        value = v + 2;
+        len = tag;
+        return true;
+    }
+
+    uint32_t overflowPage(size_t i) const {
+        const char* value;
+        size_t len;
+        uint32_t first = 0;
+        return inlineValue(i, value, len, first) ? 0 : first;
+    }
+
+    // 第一个键 >= key 的位置
+    size_t lowerBound(const std::string& key) const {
+        size_t lo = 0, hi = count();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (compareAt(mid, key) < 0) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+
+    // 第一个键 > key 的位置
+    size_t upperBound(const std::string& key) const {
+        size_t lo = 0, hi = count();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (compareAt(mid, key) <= 0) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+
+    // 第 i 个 cell 的子树放键 >= key(i) 的记录，比 key(0) 小的在最左子节点
+    uint32_t childFor(const std::string& key) const {
+        size_t i = upperBound(key);
+        return i == 0 ? aux() : child(i - 1);
+    }
+
+    size_t contiguousFree() const { return heapStart() - (kHeader + 2 * count()); }
+
+    size_t totalFree() const {
+        size_t live = 0;
+        for (size_t i = 0; i < count(); ++i) live += cellSize(i);
+        return kPageSize - kHeader - 2 * count() - live;
+    }
+
+    // 删除留下的碎片整理到一起
+    void compact() {
+        char buffer[kPageSize];
+        size_t heap = kPageSize;
+        for (size_t i = 0; i < count(); ++i) {
+            size_t size = cellSize(i);
+            heap -= size;
+            std::memcpy(buffer + heap, cell(i), size);
+            store16(p + kHeader + 2 * i, heap);
+        }
+        std::memcpy(p + heap, buffer + heap, kPageSize - heap);
+        store16(p + 4, heap == kPageSize ? 0 : heap);
+    }
+
+    bool insertCell(size_t pos, const std::string& c) {
+        if (contiguousFree() < c.size() + 2) {
+            if (totalFree() < c.size() + 2) return false;
+            compact();
+        }
+        size_t heap = heapStart() - c.size();
+        std::memcpy(p + heap, c.data(), c.size());
+        char* slots = p + kHeader;
+        std::memmove(slots + 2 * (pos + 1), slots + 2 * pos, 2 * (count() - pos));
+        store16(slots + 2 * pos, heap);
+        store16(p + 4, heap);
+        store16(p + 2, count() + 1);
+        return true;
+    }
+
+    // 只去掉槽，cell 占的空间留作碎片，下次插入放不下时再整理
+    void eraseCell(size_t pos) {
+        char* slots = p + kHeader;
+        std::memmove(slots + 2 * pos, slots + 2 * (pos + 1), 2 * (count() - pos - 1));
+        store16(p + 2, count() - 1);
+    }
+
+    void copyCells(std::vector<std::string>& out) const {
+        out.clear();
+        for (size_t i = 0; i < count(); ++i) out.push_back(std::string(cell(i), cellSize(i)));
+    }
+
+    // 整页重写为 cells[begin, end)
+    void rebuild(uint8_t kind, const std::vector<std::string>& cells, size_t begin, size_t end) {
+        uint32_t keepNext = next(), keepAux = aux();
+        init(kind);
+        setNext(keepNext);
+        setAux(keepAux);
+        for (size_t i = begin; i < end; ++i) insertCell(i - begin, cells[i]);
+    }
+};
+
+}  // namespace btree_detail
+
+// 以 patentID 为键的分页 B+ 树
+// 读者自上而下加共享页闩，闩住子节点后才放开父节点；写者之间由 writeMtx 串行，
+// 沿路加独占页闩，子节点“安全”（再插一个 cell 也不会分裂）时放开上面所有祖先，读者只在被改的几页上等待
+// 根节点的页号固定：根分裂时把内容搬到两个新页，根页改成指向它们的内部节点，读者总从同一页进入
+// 根页和其他页一样经缓冲池取用、可以被换出，一个系统里可以有远多于缓冲池帧数的 B+ 树企业
+// 删除不合并节点，空叶子留在链上
+class PagedBTree {
+private:
+    std::shared_ptr<DiskStore> store;
+    uint32_t root;
+    std::mutex writeMtx;
+
+    typedef btree_detail::NodeView NodeView;
+
+    PageGuard shared(uint32_t id) const {
+        return PageGuard(store.get(), store->fetch(id), false);
+    }
+
+    PageGuard exclusive(uint32_t id) const {
+        return PageGuard(store.get(), store->fetch(id), true);
+    }
+
+    PageGuard createNode(uint8_t kind, uint32_t& id) {
+        PageGuard guard(store.get(), store->create(id), true);
+        guard.markDirty();
+        NodeView(guard.data()).init(kind);
+        return guard;
+    }
+
+    static void checkKey(const std::string& key) {
+        if (key.size() > btree_detail::kMaxKey) throw std::invalid_argument("B+-tree key too long");
+    }
+
+    // 找到 key 所在的叶子，返回时持有它的共享页闩
+    PageGuard descendShared(const std::string& key) const {
+        PageGuard guard = shared(root);
+        while (NodeView(guard.data()).kind() == btree_detail::kInternal) {
+            PageGuard child = shared(NodeView(guard.data()).childFor(key));
+            guard = std::move(child);
+        }
+        return guard;
+    }
+
+    // 值放不下叶子时先写溢出页链
+    std::string leafCell(const std::string& key, const std::string& value) {
+        using namespace btree_detail;
+        std::string cell(2 + key.size(), '\0');
+        store16(&cell[0], key.size());
+        std::memcpy(&cell[2], key.data(), key.size());
+        char tail[10];
+        if (value.size() <= kMaxInline) {
+            store16(tail, value.size());
+            cell.append(tail, 2);
+            cell.append(value);
+            return cell;
+        }
+        uint32_t first = 0;
+        PageGuard prev;
+        for (size_t pos = 0; pos < value.size(); pos += kOverflowPayload) {
+            uint32_t id;
+            PageGuard page = createNode(kOverflow, id);
+            size_t len = std::min(kOverflowPayload, value.size() - pos);
+            std::memcpy(page.data() + kHeader, value.data() + pos, len);
+            if (prev.valid()) {
+                NodeView(prev.data()).setNext(id);
+            } else {
+                first = id;
+            }
+            prev = std::move(page);
+        }
+        store16(tail, kOverflowFlag);
+        store32(tail + 2, first);
+        store32(tail + 6, value.size());
+        cell.append(tail, 10);
+        return cell;
+    }
+
+    // 值的字节：内联时直接指向页内，溢出时拼进 scratch
+    // 调用方持有叶子的页闩，溢出链只有这个 cell 引用，不会同时被释放
+    void valueBytes(const NodeView& leaf, size_t i, std::string& scratch, const char*& data, size_t& len) const {
+        uint32_t page;
+        if (leaf.inlineValue(i, data, len, page)) return;
+        scratch.clear();
+        scratch.reserve(len);
+        while (page != 0 && scratch.size() < len) {
+            PageGuard guard = shared(page);
+            size_t take = std::min(btree_detail::kOverflowPayload, len - scratch.size());
+            scratch.append(guard.data() + btree_detail::kHeader, take);
+            page = NodeView(guard.data()).next();
+        }
+        data = scratch.data();
+        len = scratch.size();
+    }
+
+    void readValue(const NodeView& leaf, size_t i, std::string& value) const {
+        const char* data;
+        size_t len;
+        valueBytes(leaf, i, value, data, len);
+        if (data != value.data()) value.assign(data, len);
+    }
+
+    void freeOverflow(uint32_t page) {
+        while (page != 0) {
+            uint32_t next;
+            {
+                PageGuard guard = shared(page);
+                next = NodeView(guard.data()).next();
+            }
+            store->freePage(page);
+            page = next;
+        }
+    }
+
+    // 按字节把 cells 大致对半分，返回右半第一个 cell 的下标
+    static size_t splitPoint(const std::vector<std::string>& cells) {
+        size_t total = 0;
+        for (const auto& c : cells) total += c.size() + 2;
+        size_t left = 0, m = 0;
+        while (m + 1 < cells.size() && left + cells[m].size() + 2 <= total / 2) left += cells[m++].size() + 2;
+        return std::max<size_t>(m, 1);
+    }
+
+    // 把 cells 分到 left / right 两页；内部节点的中间 cell 上移：键成为分隔键，子节点成为右页的最左子节点
+    static std::string distribute(uint8_t kind, const std::vector<std::string>& cells, NodeView left, NodeView right,
+                                  uint32_t rightID) {
+        size_t m = splitPoint(cells);
+        std::string sep(cells[m].data() + 2, btree_detail::load16(cells[m].data()));
+        if (kind == btree_detail::kLeaf) {
+            right.rebuild(kind, cells, m, cells.size());
+            right.setNext(left.next());
+            left.rebuild(kind, cells, 0, m);
+            left.setNext(rightID);
+        } else {
+            right.rebuild(kind, cells, m + 1, cells.size());
+            right.setAux(btree_detail::load32(cells[m].data() + 2 + sep.size()));
+            left.rebuild(kind, cells, 0, m);
+        }
+        return sep;
+    }
+
+    // 从 path[level] 开始往上插 cell，放不下就分裂并把分隔键插进父节点
+    // path 里留着的都是可能被改的节点：不安全的节点的父节点一定还在 path 里
+    void insertUp(std::vector<PageGuard>& path, size_t level, size_t pos, std::string cell) {
+        using namespace btree_detail;
+        std::vector<std::string> cells;
+        for (;;) {
+            PageGuard& guard = path[level];
+            guard.markDirty();
+            NodeView node(guard.data());
+            if (node.insertCell(pos, cell)) return;
+            uint8_t kind = node.kind();
+            node.copyCells(cells);
+            cells.insert(cells.begin() + pos, cell);
+            if (guard.id() == root) {
+                uint32_t leftID, rightID;
+                PageGuard left = createNode(kind, leftID);
+                PageGuard right = createNode(kind, rightID);
+                NodeView(left.data()).setAux(node.aux());
+                std::string sep = distribute(kind, cells, NodeView(left.data()), NodeView(right.data()), rightID);
+                node.init(kInternal);
+                node.setAux(leftID);
+                node.insertCell(0, internalCell(sep, rightID));
+                return;
+            }
+            uint32_t rightID;
+            PageGuard right = createNode(kind, rightID);
+            std::string sep = distribute(kind, cells, node, NodeView(right.data()), rightID);
+            if (level == 0) throw std::logic_error("B+-tree split lost its parent");
+            --level;
+            pos = NodeView(path[level].data()).upperBound(sep);
+            cell = internalCell(sep, rightID);
+        }
+    }
+
+    void collectPages(uint32_t id, std::vector<uint32_t>& out) const {
+        std::vector<uint32_t> children;
+        {
+            PageGuard guard = shared(id);
+            NodeView node(guard.data());
+            if (node.kind() == btree_detail::kInternal) {
+                children.push_back(node.aux());
+                for (size_t i = 0; i < node.count(); ++i) children.push_back(node.child(i));
+            } else {
+                for (size_t i = 0; i < node.count(); ++i) {
+                    for (uint32_t page = node.overflowPage(i); page != 0;) {
+                        out.push_back(page);
+                        PageGuard overflow = shared(page);
+                        page = NodeView(overflow.data()).next();
+                    }
+                }
+            }
+        }
+        for (uint32_t child : children) collectPages(child, out);
+        out.push_back(id);
+    }
+
+    // 释放根以外的所有页，根页重置为空叶子；调用方持有 writeMtx
+    void reset() {
+        std::vector<uint32_t> pages;
+        collectPages(root, pages);
+        pages.pop_back();
+        {
+            PageGuard guard = exclusive(root);
+            guard.markDirty();
+            NodeView(guard.data()).init(btree_detail::kLeaf);
+        }
+        for (uint32_t page : pages) store->freePage(page);
+    }
+
+public:
+    explicit PagedBTree(std::shared_ptr<DiskStore> diskStore)
+        : store(std::move(diskStore)), root(0) {
+        PageGuard guard(store.get(), store->create(root), true);
+        guard.markDirty();
+        NodeView(guard.data()).init(btree_detail::kLeaf);
+    }
+
+    PagedBTree(const PagedBTree&) = delete;
+    PagedBTree& operator=(const PagedBTree&) = delete;
+
+    ~PagedBTree() {
+        try {
+            std::vector<uint32_t> pages;
+            collectPages(root, pages);
+            for (uint32_t page : pages) store->freePage(page);
+        } catch (const std::exception&) {
+        }
+    }
+
+    const std::shared_ptr<DiskStore>& diskStore() const {
+        return store;
+    }
+
+    // 找到时对值的字节调用 fn(data, len)，不另外拷贝；回调期间持有叶子的共享页闩，不能再访问这棵树
+    template <class Fn>
+    bool find(const std::string& key, Fn fn) const {
+        PageGuard leaf = descendShared(key);
+        NodeView node(leaf.data());
+        size_t i = node.lowerBound(key);
+        if (i == node.count() || node.compareAt(i, key) != 0) return false;
+        std::string scratch;
+        const char* data;
+        size_t len;
+        valueBytes(node, i, scratch, data, len);
+        fn(data, len);
+        return true;
+    }
+
+    bool find(const std::string& key, std::string& value) const {
+        return find(key, [&](const char* data, size_t len) { value.assign(data, len); });
+    }
+
+    // keys 已按键排序：落在同一片叶子上的键不再从根往下找
+    // 对每个键调用 fn(k, data, len)，找不到时 data 为 nullptr；回调期间同样持有叶子的共享页闩
+    void findSorted(const std::vector<const std::string*>& keys,
+                    const std::function<void(size_t, const char*, size_t)>& fn) const {
+        PageGuard leaf;
+        std::string scratch;
+        const char* data;
+        size_t len;
+        for (size_t k = 0; k < keys.size(); ++k) {
+            const std::string& key = *keys[k];
+            if (leaf.valid()) {
+                NodeView node(leaf.data());
+                if (node.count() == 0 || node.compareAt(node.count() - 1, key) < 0) leaf.release();
+            }
+            if (!leaf.valid()) leaf = descendShared(key);
+            NodeView node(leaf.data());
+            size_t i = node.lowerBound(key);
+            if (i < node.count() && node.compareAt(i, key) == 0) {
+                valueBytes(node, i, scratch, data, len);
+                fn(k, data, len);
+            } else {
+                fn(k, nullptr, 0);
+            }
+        }
+    }
+
+    // 按键的顺序遍历，fn 返回 false 时停止；一次把整片叶子拷出来再回调，回调期间不持有页闩
+    void scan(const std::function<bool(const std::string&, const std::string&)>& fn) const {
+        std::vector<std::pair<std::string, std::string>> batch;
+        uint32_t id;
+        {
+            PageGuard leaf = descendShared(std::string());
+            id = leaf.id();
+        }
+        while (id != 0) {
+            {
+                PageGuard leaf = shared(id);
+                NodeView node(leaf.data());
+                batch.resize(node.count());
+                for (size_t i = 0; i < node.count(); ++i) {
+                    batch[i].first = node.key(i);
+                    readValue(node, i, batch[i].second);
+                }
+                id = node.next();
+            }
+            for (const auto& entry : batch) {
+                if (!fn(entry.first, entry.second)) return;
+            }
+        }
+    }
+
+    // 插入或覆盖，返回是否为新键
+    bool upsert(const std::string& key, const std::string& value) {
+        checkKey(key);
+        std::lock_guard<std::mutex> writer(writeMtx);
+        std::string cell = leafCell(key, value);
+        std::vector<PageGuard> path;
+        path.push_back(exclusive(root));
+        while (NodeView(path.back().data()).kind() == btree_detail::kInternal) {
+            PageGuard child = exclusive(NodeView(path.back().data()).childFor(key));
+            NodeView node(child.data());
+            size_t need = node.kind() == btree_detail::kInternal ? btree_detail::kMaxInternalCell : cell.size();
+            if (node.totalFree() >= need + 2) path.clear();
+            path.push_back(std::move(child));
+        }
+        NodeView leaf(path.back().data());
+        size_t pos = leaf.lowerBound(key);
+        bool existed = pos < leaf.count() && leaf.compareAt(pos, key) == 0;
+        uint32_t oldOverflow = 0;
+        if (existed) {
+            oldOverflow = leaf.overflowPage(pos);
+            leaf.eraseCell(pos);
+        }
+        insertUp(path, path.size() - 1, pos, cell);
+        path.clear();
+        if (oldOverflow != 0) freeOverflow(oldOverflow);
+        return !existed;
+    }
+
+    // 删除从不向上传播，闩住子节点就可以放开父节点
+    bool erase(const std::string& key) {
+        std::lock_guard<std::mutex> writer(writeMtx);
+        PageGuard guard = exclusive(root);
+        while (NodeView(guard.data()).kind() == btree_detail::kInternal) {
+            PageGuard child = exclusive(NodeView(guard.data()).childFor(key));
+            guard = std::move(child);
+        }
+        NodeView leaf(guard.data());
+        size_t pos = leaf.lowerBound(key);
+        if (pos == leaf.count() || leaf.compareAt(pos, key) != 0) return false;
+        uint32_t overflow = leaf.overflowPage(pos);
+        leaf.eraseCell(pos);
+        guard.markDirty();
+        guard.release();
+        if (overflow != 0) freeOverflow(overflow);
+        return true;
+    }
+
+    // 从按键严格递增的输入自底向上建树，只能用在空树上：叶子按顺序写到约九成满，
+    // 再一层层建内部节点，每层只钉住正在写的一页；next 返回 false 表示输入结束。返回装入的记录数
+    size_t bulkLoad(const std::function<bool(std::string&, std::string&)>& next) {
+        using namespace btree_detail;
+        std::lock_guard<std::mutex> writer(writeMtx);
+        {
+            PageGuard guard = shared(root);
+            NodeView node(guard.data());
+            if (node.kind() != kLeaf || node.count() != 0) throw std::logic_error("bulkLoad needs an empty B+-tree");
+        }
+        const size_t reserve = kPageSize / 10;
+        std::vector<std::pair<std::string, uint32_t>> level;  // 每个节点的首键和页号
+        PageGuard current;
+        std::string key, value, previous;
+        size_t loaded = 0;
+        while (next(key, value)) {
+            checkKey(key);
+            if (loaded > 0 && compareKeys(key.data(), key.size(), previous.data(), previous.size()) <= 0) {
+                throw std::invalid_argument("bulkLoad input must be sorted by unique key");
+            }
+            std::string cell = leafCell(key, value);
+            if (!current.valid() || NodeView(current.data()).contiguousFree() < cell.size() + 2 + reserve) {
+                uint32_t id;
+                PageGuard fresh = createNode(kLeaf, id);
+                if (current.valid()) NodeView(current.data()).setNext(id);
+                current = std::move(fresh);
+                level.push_back(std::make_pair(key, id));
+            }
+            NodeView node(current.data());
+            node.insertCell(node.count(), cell);
+            previous.swap(key);
+            loaded++;
+        }
+        current.release();
+        if (level.empty()) return 0;
+        while (level.size() > 1) {
+            std::vector<std::pair<std::string, uint32_t>> upper;
+            for (const auto& entry : level) {
+                std::string cell = internalCell(entry.first, entry.second);
+                if (current.valid() && NodeView(current.data()).contiguousFree() >= cell.size() + 2 + reserve) {
+                    NodeView node(current.data());
+                    node.insertCell(node.count(), cell);
+                    continue;
+                }
+                uint32_t id;
+                current = createNode(kInternal, id);
+                NodeView(current.data()).setAux(entry.second);
+                upper.push_back(std::make_pair(entry.first, id));
+            }
+            current.release();
+            level.swap(upper);
+        }
+        // 根页号固定：把顶层节点的内容搬进根页
+        uint32_t top = level[0].second;
+        {
+            PageGuard from = shared(top);
+            PageGuard to = exclusive(root);
+            std::memcpy(to.data(), from.data(), kPageSize);
+            to.markDirty();
+        }
+        store->freePage(top);
+        return loaded;
+    }
+
+    // 清空，只留下空的根页
+    void clear() {
+        std::lock_guard<std::mutex> writer(writeMtx);
+        reset();
+    }
+
+    // 同一个页文件里的两棵树交换全部内容，只换根页号；调用方保证期间没有读者
+    void swap(PagedBTree& other) {
+        if (store != other.store) throw std::invalid_argument("Cannot swap B+-trees in different page files");
+        std::lock(writeMtx, other.writeMtx);
+        std::lock_guard<std::mutex> a(writeMtx, std::adopt_lock);
+        std::lock_guard<std::mutex> b(other.writeMtx, std::adopt_lock);
+        std::swap(root, other.root);
+    }
+
+    size_t height() const {
+        size_t levels = 1;
+        PageGuard guard = shared(root);
+        while (NodeView(guard.data()).kind() == btree_detail::kInternal) {
+            PageGuard child = shared(NodeView(guard.data()).aux());
+            guard = std::move(child);
+            levels++;
+        }
+        return levels;
+    }
+};
+
+class FirmBTree : public IFirm {
+private:
+    std::string firmID;
+    std::string firmName;
+    std::atomic<int> patentCount;
+    std::unique_ptr<PagedBTree> tree;
+    // lookupMany 解码出来的专利按线程分开保存，同一线程下一次 lookupMany 或本企业被修改时作废
+    mutable std::mutex resultsMtx;
+    mutable std::unordered_map<std::thread::id, std::deque<Patent>> results;
+
+    // 空企业收到至少这么多专利时走批量装载
+    static const size_t kBulkThreshold = 64;
+
+    Patent decode(const std::string& key, const std::string& value) const {
+        return btree_detail::decodeRecord(key, value.data(), value.size(), firmID);
+    }
+
+    void invalidateResults() {
+        std::lock_guard<std::mutex> lock(resultsMtx);
+        results.clear();
+    }
+
+    // 排序后去重（同一 patentID 保留最后一条）再批量装载
+    void bulkLoad(const std::vector<Patent>& batch) {
+        std::vector<size_t> order(batch.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return batch[a].patentIDRef() < batch[b].patentIDRef();
+        });
+        size_t i = 0;
+        loadSorted([&](Patent& patent) {
+            while (i + 1 < order.size() && batch[order[i]].patentIDRef() == batch[order[i + 1]].patentIDRef()) ++i;
+            if (i >= order.size()) return false;
+            patent = batch[order[i++]];
+            return true;
+        });
+    }
+
+public:
+    FirmBTree(std::string firmID, std::string firmName, std::shared_ptr<DiskStore> store)
+        : firmID(firmID), firmName(firmName), patentCount(0), tree(new PagedBTree(std::move(store))) {}
+
+    std::string getFirmID() const override { return firmID; }
+    std::string getFirmName() const override { return firmName; }
+    int getPatentCount() const override { return patentCount; }
+
+    const PagedBTree& index() const {
+        return *tree;
+    }
+
+    // 从按 patentID 严格递增的输入流式装载，只能用在空企业上，输入不必整个放进内存；
+    // next 返回 false 表示输入结束。返回装入的专利数
+    size_t loadSorted(const std::function<bool(Patent&)>& next) {
+        Patent patent;
+        std::string scratch;
+        size_t loaded = tree->bulkLoad([&](std::string& key, std::string& value) {
+            if (!next(patent)) return false;
+            key = patent.patentIDRef();
+            value.clear();
+            btree_detail::encodeRecord(patent, value, scratch);
+            return true;
+        });
+        patentCount = static_cast<int>(loaded);
+        invalidateResults();
+        return loaded;
+    }
+
+    void displayPatents() const override {
+        displayTitle();
+        int shown = 0;
+        tree->scan([&](const std::string& key, const std::string& value) {
+            decode(key, value).display();
+            return ++shown < 10;
+        });
+        displayDots();
+    }
+
+    void addPatent(Patent& patent) override {
+        patent.setFirmID(firmID);
+        std::string value, scratch;
+        btree_detail::encodeRecord(patent, value, scratch);
+        if (tree->upsert(patent.patentIDRef(), value)) patentCount++;
+        invalidateResults();
+    }
+
+    void addPatents(std::vector<Patent>& batch) override {
+        for (auto& patent : batch) {
+            patent.setFirmID(firmID);
+        }
+        if (patentCount == 0 && batch.size() >= kBulkThreshold) {
+            bulkLoad(batch);
+        } else {
+            std::string value, scratch;
+            for (const auto& patent : batch) {
+                value.clear();
+                btree_detail::encodeRecord(patent, value, scratch);
+                if (tree->upsert(patent.patentIDRef(), value)) patentCount++;
+            }
+        }
+        invalidateResults();
+    }
+
+    void removePatent(const std::string& patentID) override {
+        if (tree->erase(patentID)) {
+            // 删除不合并节点；删空时把树收回成一片空叶子，之后的大批添加才能再走 bulkLoad
+            if (--patentCount == 0) tree->clear();
+            invalidateResults();
+        } else {
+            std::cerr << "Error: Patent not found." << std::endl;
+        }
+    }
+
+    const Patent getPatent(const std::string& patentID) const override {
+        Patent patent;
+        bool found = tree->find(patentID, [&](const char* value, size_t len) {
+            patent = btree_detail::decodeRecord(patentID, value, len, firmID);
+        });
+        if (!found) throw std::invalid_argument("Patent not found");
+        return patent;
+    }
+
+    // 键排好序后顺着叶子找，相邻的键多半落在同一片叶子上
+    void lookupMany(const std::vector<std::string>& patentIDs, std::vector<const Patent*>& out) const override {
+        out.assign(patentIDs.size(), nullptr);
+        if (patentIDs.empty()) return;
+        std::vector<size_t> order(patentIDs.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return patentIDs[a] < patentIDs[b]; });
+        std::vector<const std::string*> keys(order.size());
+        for (size_t k = 0; k < order.size(); ++k) keys[k] = &patentIDs[order[k]];
+        std::deque<Patent>* decoded;
+        {
+            std::lock_guard<std::mutex> lock(resultsMtx);
+            decoded = &results[std::this_thread::get_id()];
+        }
+        decoded->clear();
+        tree->findSorted(keys, [&](size_t k, const char* value, size_t len) {
+            if (k > 0 && *keys[k] == *keys[k - 1]) {
+                out[order[k]] = out[order[k - 1]];
+            } else if (value) {
+                decoded->push_back(btree_detail::decodeRecord(*keys[k], value, len, firmID));
+                out[order[k]] = &decoded->back();
+            }
+        });
+    }
+
+    void forEachPatent(const std::function<void(const Patent&)>& fn) const override {
+        tree->scan([&](const std::string& key, const std::string& value) {
+            fn(decode(key, value));
+            return true;
+        });
+    }
+
+    // 同一个页文件时，空的一边直接换根页号；其余情况把较小一边的记录按键的顺序插入较大一边
+    // 两边有相同 patentID 时只保留一份（mergeFirms 会先拒绝这种合并）
+    void absorb(IFirm& other) override {
+        FirmBTree* from = dynamic_cast<FirmBTree*>(&other);
+        if (!from) throw std::invalid_argument("Cannot merge firms of different types");
+        if (from == this) return;
+        bool sameStore = tree->diskStore() == from->tree->diskStore();
+        if (sameStore && from->patentCount > patentCount) {
+            tree->swap(*from->tree);
+            int count = patentCount;
+            patentCount = from->patentCount.load();
+            from->patentCount = count;
+        }
+        from->tree->scan([&](const std::string& key, const std::string& value) {
+            if (tree->upsert(key, value)) patentCount++;
+            return true;
+        });
+        from->tree->clear();
+        from->patentCount = 0;
+        invalidateResults();
+        from->invalidateResults();
+    }
+
+    // 页面在缓冲池里，由企业系统统一计入；这里只有企业对象本身和 lookupMany 的结果
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats = firmHeaderStats(sizeof(*this) + sizeof(PagedBTree), firmID, firmName);
+        std::lock_guard<std::mutex> lock(resultsMtx);
+        for (const auto& entry : results) {
+            stats.objectBytes += entry.second.size() * sizeof(Patent);
+            for (const auto& patent : entry.second) stats.stringPayload += patent.stringHeapBytes();
+        }
+        return stats;
+    }
+
+    ~FirmBTree() = default;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.hpp"
+
+// 守护进程的压测客户端：多连接并发、每个连接保持 depth 个在途请求，
+// 结束后输出 p50/p99 延迟和 QPS
+// 用法: patent_client <socket> [--requests N] [--connections C] [--depth D]
+//                              [--writes PCT] [--data <PatentData.csv>]
+
+struct PatentKey {
+    std::string patentID;
+    std::string firmID;
+};
+
+std::vector<PatentKey> loadKeys(const std::string& filename) {
+    std::vector<PatentKey> keys;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open " << filename << std::endl;
+        return keys;
+    }
+    std::string line;
+    getline(file, line);
+    while (getline(file, line)) {
+        size_t first = line.find(',');
+        size_t last = line.rfind(',');
+        if (first == std::string::npos || last == first) continue;
+        std::string firmID = line.substr(last + 1);
+        while (!firmID.empty() && std::isspace(static_cast<unsigned char>(firmID.back()))) {
+            firmID.pop_back();
+        }
+        keys.push_back(PatentKey{line.substr(0, first), firmID});
+    }
+    return keys;
+}
+
+int connectTo(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+struct WorkerResult {
+    std::vector<double> latencies; // 微秒
+    size_t errors;
+    WorkerResult() : errors(0) {}
+};
+
+void runWorker(const std::string& path, const std::vector<PatentKey>& keys, size_t requests, size_t depth,
+               int writePct, unsigned seed, WorkerResult& result) {
+    typedef std::chrono::steady_clock Clock;
+
+    int fd = connectTo(path);
+    if (fd < 0) {
+        std::cerr << "Error: Could not connect to " << path << ": " << std::strerror(errno) << std::endl;
+        result.errors = requests;
+        return;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::unordered_map<uint32_t, Clock::time_point> inflight;
+    uint32_t nextID = 1;
+    size_t issued = 0;
+    size_t done = 0;
+    bool added = false; // 写请求交替增删同一个合成专利，保持数据集不变
+    std::string syntheticID = "LG" + std::to_string(seed);
+    std::string writeFirm = keys[pick(rng)].firmID; // 增删必须作用在同一个企业上
+
+    auto makeRequest = [&]() {
+        const PatentKey& key = keys[pick(rng)];
+        int roll = percent(rng);
+        protocol::Request req;
+        req.id = nextID++;
+        if (roll < writePct) {
+            if (!added) {
+                req.op = protocol::OpCode::AddPatent;
+                req.args = {writeFirm, syntheticID, "20240923", "20240923", "Load generator patent", "CN"};
+            } else {
+                req.op = protocol::OpCode::RemovePatent;
+                req.args = {writeFirm, syntheticID};
+            }
+            added = !added;
+        } else if (roll < writePct + 5) {
+            req.op = protocol::OpCode::SearchTitle;
+            req.args = {"processing", "10"};
+        } else if (roll < writePct + 15) {
+            req.op = protocol::OpCode::GetFirm;
+            req.args = {key.firmID};
+        } else {
+            req.op = protocol::OpCode::GetPatent;
+            req.args = {key.firmID, key.patentID};
+        }
+        return req;
+    };
+
+    auto issue = [&](size_t count) {
+        std::string batch;
+        for (size_t i = 0; i < count && issued < requests; ++i, ++issued) {
+            protocol::Request req = makeRequest();
+            inflight[req.id] = Clock::now();
+            protocol::encodeRequest(req, batch);
+        }
+        return batch.empty() || sendAll(fd, batch);
+    };
+
+    if (!issue(depth)) {
+        result.errors = requests;
+        close(fd);
+        return;
+    }
+
+    std::string buf;
+    char chunk[64 * 1024];
+    while (done < requests) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            std::cerr << "Error: connection closed by server." << std::endl;
+            result.errors += requests - done;
+            break;
+        }
+        buf.append(chunk, static_cast<size_t>(n));
+
+        size_t offset = 0;
+        const char* body;
+        size_t bodyLen;
+        bool oversized;
+        size_t completedNow = 0;
+        Clock::time_point now = Clock::now();
+        while (protocol::nextFrame(buf, offset, body, bodyLen, oversized)) {
+            protocol::Response resp;
+            if (!protocol::decodeResponse(body, bodyLen, resp)) {
+                result.errors++;
+                done++;
+                completedNow++;
+                continue;
+            }
+            auto it = inflight.find(resp.id);
+            if (it != inflight.end()) {
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(now - it->second).count());
+                inflight.erase(it);
+            }
+            if (resp.status == protocol::Status::BadRequest || resp.status == protocol::Status::Error) {
+                result.errors++;
+            }
+            done++;
+            completedNow++;
+        }
+        buf.erase(0, offset);
+
+        if (completedNow > 0 && !issue(completedNow)) {
+            result.errors += requests - done;
+            break;
+        }
+    }
+    close(fd);
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: patent_client <socket> [--requests N] [--connections C] [--depth D] "
+                  << "[--writes PCT] [--data <PatentData.csv>]" << std::endl;
+        return 1;
+    }
+
+    std::string path = argv[1];
+    std::string dataFile = "../data/PatentData.csv";
+    size_t requests = 100000;
+    size_t connections = 4;
+    size_t depth = 16;
+    int writePct = 0;
+
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "--requests") {
+            requests = static_cast<size_t>(std::stoul(argv[i + 1]));
+        } else if (opt == "--connections") {
+            connections = static_cast<size_t>(std::stoul(argv[i + 1]));
+        } else if (opt == "--depth") {
+            depth = static_cast<size_t>(std::stoul(argv[i + 1]));
+        } else if (opt == "--writes") {
+            writePct = std::stoi(argv[i + 1]);
+        } else if (opt == "--data") {
+            dataFile = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+    if (connections == 0) connections = 1;
+    if (depth == 0) depth = 1;
+    writePct = std::max(0, std::min(writePct, 80));
+
+    std::vector<PatentKey> keys = loadKeys(dataFile);
+    if (keys.empty()) {
+        std::cerr << "Error: No patent keys loaded." << std::endl;
+        return 1;
+    }
+
+    std::vector<WorkerResult> results(connections);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < connections; ++i) {
+        size_t share = requests / connections + (i < requests % connections ? 1 : 0);
+        threads.emplace_back(runWorker, std::cref(path), std::cref(keys), share, depth, writePct,
+                             static_cast<unsigned>(i + 1), std::ref(results[i]));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    size_t errors = 0;
+    for (const auto& r : results) {
+        all.insert(all.end(), r.latencies.begin(), r.latencies.end());
+        errors += r.errors;
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Requests:    " << all.size() << " (" << errors << " errors)" << std::endl;
+    std::cout << "Connections: " << connections << ", pipeline depth: " << depth << std::endl;
+    std::cout << "Elapsed:     " << seconds << " s" << std::endl;
+    std::cout << "QPS:         " << (seconds > 0 ? all.size() / seconds : 0.0) << std::endl;
+    std::cout << "p50 latency: " << percentile(all, 0.50) << " us" << std::endl;
+    std::cout << "p99 latency: " << percentile(all, 0.99) << " us" << std::endl;
+    std::cout << "max latency: " << (all.empty() ? 0.0 : all.back()) << " us" << std::endl;
+    return errors == 0 ? 0 : 1;
+}
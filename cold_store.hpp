@@ -0,0 +1,181 @@
+#ifndef COLD_STORE_HPP
+#define COLD_STORE_HPP
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "normalize.hpp"
+#include "arena.hpp"
+
+// 懒加载的专利标题：PatentData.csv 整个只读映射进内存，专利里只记所在行的偏移和长度
+// getTitle 时重新清洗这一行取出标题，最近用过的标题放在一个小 LRU 里
+// 映射期间文件只能追加（CsvTailer 就是这样），不能截断或原地改写
+class MappedTitleStore : public ColdFieldSource {
+public:
+    // 行长度占引用的低 20 位，超过 kMaxLine 的行不走懒加载，标题直接留在专利里
+    enum { kLengthBits = 20, kMaxLine = (1 << kLengthBits) - 1 };
+
+private:
+    int fd;
+    const char* data;
+    size_t length;
+
+    size_t capacity;
+    mutable std::mutex lock;
+    mutable std::list<std::pair<uint64_t, std::string>> recent;  // 表头是最近访问的
+    mutable std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::string>>::iterator> cached;
+    mutable size_t hits;
+    mutable size_t misses;
+
+    MappedTitleStore(int fd, const char* data, size_t length, size_t capacity)
+        : fd(fd), data(data), length(length), capacity(capacity), hits(0), misses(0) {}
+
+    std::string decode(uint64_t ref) const {
+        size_t offset = static_cast<size_t>(ref >> kLengthBits);
+        size_t len = static_cast<size_t>(ref & ((1ULL << kLengthBits) - 1));
+        Patent full;
+        NormalizeReport ignored;
+        if (offset + len > length || !normalizePatentLine(data + offset, len, full, ignored)) {
+            return std::string();
+        }
+        return full.getTitle();
+    }
+
+public:
+    // 打开失败（文件不存在、为空、mmap 失败）返回 nullptr
+    static std::shared_ptr<MappedTitleStore> open(const std::string& filename, size_t cacheEntries) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            return nullptr;
+        }
+        ::madvise(mapped, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        return std::shared_ptr<MappedTitleStore>(
+            new MappedTitleStore(fd, static_cast<const char*>(mapped), static_cast<size_t>(st.st_size), cacheEntries));
+    }
+
+    MappedTitleStore(const MappedTitleStore&) = delete;
+    MappedTitleStore& operator=(const MappedTitleStore&) = delete;
+
+    ~MappedTitleStore() {
+        ::munmap(const_cast<char*>(data), length);
+        ::close(fd);
+    }
+
+    const char* begin() const {
+        return data;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    // line 必须指在映射区内
+    uint64_t refOf(const char* line, size_t len) const {
+        return (static_cast<uint64_t>(line - data) << kLengthBits) | static_cast<uint64_t>(len);
+    }
+
+    // 装载完成后改为随机访问，避免按顺序预读把不需要的页读进来
+    void adviseRandomAccess() const {
+        ::madvise(const_cast<char*>(data), length, MADV_RANDOM);
+    }
+
+    std::string loadTitle(uint64_t ref) const override {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = cached.find(ref);
+            if (it != cached.end()) {
+                hits++;
+                recent.splice(recent.begin(), recent, it->second);
+                return it->second->second;
+            }
+            misses++;
+        }
+        std::string title = decode(ref);
+        if (capacity == 0) return title;
+        std::lock_guard<std::mutex> guard(lock);
+        if (cached.find(ref) == cached.end()) {
+            recent.emplace_front(ref, title);
+            cached[ref] = recent.begin();
+            if (recent.size() > capacity) {
+                cached.erase(recent.back().first);
+                recent.pop_back();
+            }
+        }
+        return title;
+    }
+
+    size_t cacheHits() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return hits;
+    }
+
+    size_t cacheMisses() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return misses;
+    }
+
+    // LRU 占用的堆内存；映射的文件页属于页缓存，不算在内
+    size_t memoryUsage() const override {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t bytes = cached.bucket_count() * sizeof(void*);
+        for (const auto& entry : recent) {
+            bytes += 2 * sizeof(void*) + sizeof(entry) + stringHeapBytes(entry.second)  // 链表节点
+                   + sizeof(void*) + sizeof(uint64_t) + sizeof(void*) + sizeof(size_t);  // 哈希节点
+        }
+        return bytes;
+    }
+};
+
+// arena 模式下的标题：标题字节（前面 4 字节长度）顺序放进大页 arena，引用就是地址
+class ArenaTitleStore : public ColdFieldSource {
+private:
+    std::shared_ptr<HugePageArena> arena;
+    std::atomic<size_t> bytes;
+
+public:
+    explicit ArenaTitleStore(std::shared_ptr<HugePageArena> arena) : arena(std::move(arena)), bytes(0) {}
+
+    // 把专利的标题搬进 arena；已经是懒加载或压缩标题的不动
+    void adopt(Patent& patent) {
+        if (patent.hasColdTitle()) return;
+        std::string scratch;
+        const std::string& title = patent.titleRef(scratch);
+        uint32_t len = static_cast<uint32_t>(title.size());
+        char* p = static_cast<char*>(arena->allocateBytes(sizeof(len) + len));
+        std::memcpy(p, &len, sizeof(len));
+        std::memcpy(p + sizeof(len), title.data(), len);
+        bytes.fetch_add(sizeof(len) + len, std::memory_order_relaxed);
+        patent.setColdTitle(this, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+    }
+
+    std::string loadTitle(uint64_t ref) const override {
+        const char* p = reinterpret_cast<const char*>(static_cast<uintptr_t>(ref));
+        uint32_t len;
+        std::memcpy(&len, p, sizeof(len));
+        return std::string(p + sizeof(len), len);
+    }
+
+    // 只报标题本身；arena 里没用上的部分由系统算作空闲容量
+    size_t memoryUsage() const override {
+        return bytes.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
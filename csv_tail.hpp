@@ -0,0 +1,259 @@
+#ifndef CSV_TAIL_HPP
+#define CSV_TAIL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 增量读取 PatentData.csv：记住上次读到的字节偏移和文件指纹，
+// 每次只解析新追加的完整行并批量插入
+//
+// 除普通专利行（视为新增）外，还识别两种变更记录：
+//   @remove,<patentID>,<firmID>
+//   @transfer,<patentID>,<fromFirmID>,<toFirmID>
+//
+// 指纹是文件开头若干字节的 FNV-1a 哈希；文件被替换或截断后 poll() 不再读取，
+// 一直返回 reset = true，直到调用者全量重新加载并再次 markLoaded()
+class CsvTailer {
+public:
+    struct Stats {
+        size_t added;
+        size_t removed;
+        size_t transferred;
+        size_t rejected;
+        size_t fixed;     // 清洗时修正过的行（去空白、改日期格式等）
+        size_t bytes;
+        bool reset;
+        double milliseconds;
+
+        Stats() : added(0), removed(0), transferred(0), rejected(0), fixed(0), bytes(0), reset(false), milliseconds(0) {}
+    };
+
+private:
+    static const size_t kFingerprintBytes = 4096;
+
+    IFirmSystem& system;
+    std::string path;
+    uint64_t offset;
+    uint64_t fingerprint;
+    size_t fingerprintLen;
+    bool stale;
+
+    static uint64_t fnv1a(const char* data, size_t len) {
+        uint64_t hash = 1469598103934665603ull;
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static bool readPrefix(std::ifstream& file, size_t len, std::string& out) {
+        out.resize(len);
+        file.seekg(0);
+        file.read(&out[0], static_cast<std::streamsize>(len));
+        return static_cast<size_t>(file.gcount()) == len;
+    }
+
+    static std::vector<std::string> splitFields(const std::string& line) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (getline(ss, field, ',')) {
+            fields.push_back(trimWhitespace(field));
+        }
+        return fields;
+    }
+
+    // 按企业分组的待插入新增行，遇到变更记录前先整体提交，保证顺序语义
+    struct PendingBatch {
+        std::unordered_map<std::string, std::vector<Patent>> byFirm;
+        std::vector<std::string> order;
+
+        void add(Patent& patent) {
+            auto it = byFirm.find(patent.getFirmID());
+            if (it == byFirm.end()) {
+                order.push_back(patent.getFirmID());
+                it = byFirm.emplace(patent.getFirmID(), std::vector<Patent>()).first;
+            }
+            it->second.push_back(patent);
+        }
+
+        void flush(IFirmSystem& system, Stats& stats) {
+            for (const auto& firmID : order) {
+                std::vector<Patent>& patents = byFirm[firmID];
+                if (system.getFirm(firmID)) {
+                    system.addPatentsFirm(firmID, patents);
+                    stats.added += patents.size();
+                } else {
+                    stats.rejected += patents.size();
+                }
+            }
+            byFirm.clear();
+            order.clear();
+        }
+    };
+
+    void applyChange(const std::string& line, Stats& stats) {
+        std::vector<std::string> f = splitFields(line);
+        if (f[0] == "@remove" && f.size() == 3) {
+            auto firm = system.getFirm(f[2]);
+            if (!firm) {
+                stats.rejected++;
+                return;
+            }
+            int before = firm->getPatentCount();
+            system.removePatentFirm(f[2], f[1]);
+            if (firm->getPatentCount() < before) {
+                stats.removed++;
+            } else {
+                stats.rejected++;
+            }
+        } else if (f[0] == "@transfer" && f.size() == 4) {
+            auto from = system.getFirm(f[2]);
+            auto to = system.getFirm(f[3]);
+            if (!from || !to) {
+                stats.rejected++;
+                return;
+            }
+            int before = to->getPatentCount();
+            try {
+                system.transferPatent(f[2], f[3], f[1]);
+            } catch (const std::invalid_argument&) {
+            }
+            if (to->getPatentCount() > before) {
+                stats.transferred++;
+            } else {
+                stats.rejected++;
+            }
+        } else {
+            std::cerr << "Error: Unknown change record: " << line << std::endl;
+            stats.rejected++;
+        }
+    }
+
+public:
+    CsvTailer(IFirmSystem& system, const std::string& path)
+        : system(system), path(path), offset(0), fingerprint(0), fingerprintLen(0), stale(false) {}
+
+    uint64_t getOffset() const { return offset; }
+    const std::string& getPath() const { return path; }
+
+    // 文件已经通过 loadPatentsFromCSV 全量加载后调用，loadedBytes 取 loadReport().completeBytes：
+    // 从装载实际读到的最后一个完整行之后继续，装载期间追加的行留给下一次 poll()
+    void markLoaded(uint64_t loadedBytes) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            return;
+        }
+        file.seekg(0, std::ios::end);
+        uint64_t size = static_cast<uint64_t>(file.tellg());
+
+        // 指纹只取装载读过的部分，装载之后追加的内容不影响它
+        std::string prefix;
+        fingerprintLen = static_cast<size_t>(std::min<uint64_t>(std::min(size, loadedBytes), kFingerprintBytes));
+        readPrefix(file, fingerprintLen, prefix);
+        fingerprint = fnv1a(prefix.data(), prefix.size());
+        offset = loadedBytes;
+        // 装载之后文件已经变短，只能重新全量加载
+        stale = size < loadedBytes;
+    }
+
+    // 读取上次偏移之后新增的完整行；从偏移 0 开始时跳过表头
+    Stats poll() {
+        Stats stats;
+        auto start = std::chrono::steady_clock::now();
+        if (stale) {
+            stats.reset = true;
+            return stats;
+        }
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            return stats;
+        }
+        file.seekg(0, std::ios::end);
+        uint64_t size = static_cast<uint64_t>(file.tellg());
+
+        std::string prefix;
+        if (size < offset || (fingerprintLen > 0 && (!readPrefix(file, fingerprintLen, prefix)
+                                                      || fnv1a(prefix.data(), prefix.size()) != fingerprint))) {
+            // 文件被截断或替换，之前的偏移已经没有意义；重新全量加载后再 markLoaded()
+            stale = true;
+            stats.reset = true;
+            return stats;
+        }
+        if (size == offset) {
+            return stats;
+        }
+
+        std::string chunk(static_cast<size_t>(size - offset), '\0');
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(&chunk[0], static_cast<std::streamsize>(chunk.size()));
+        chunk.resize(static_cast<size_t>(file.gcount()));
+
+        size_t consumed = chunk.rfind('\n');
+        if (consumed == std::string::npos) {
+            return stats; // 最后一行还没写完
+        }
+        consumed += 1;
+
+        PendingBatch batch;
+        NormalizeReport report;
+        size_t pos = 0;
+        bool skipHeader = offset == 0;
+        while (pos < consumed) {
+            size_t eol = chunk.find('\n', pos);
+            std::string line = chunk.substr(pos, eol - pos);
+            pos = eol + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (skipHeader) {
+                skipHeader = false;
+                continue;
+            }
+            if (line.empty()) continue;
+
+            if (line[0] == '@') {
+                batch.flush(system, stats);
+                applyChange(line, stats);
+                continue;
+            }
+            Patent p;
+            size_t fixedBefore = report.fixed;
+            if (!normalizePatentLine(line.data(), line.size(), p, report)) {
+                stats.rejected++;
+                continue;
+            }
+            stats.fixed += report.fixed - fixedBefore;
+            batch.add(p);
+        }
+        batch.flush(system, stats);
+
+        offset += consumed;
+        stats.bytes = consumed;
+
+        if (fingerprintLen < kFingerprintBytes) {
+            std::string head;
+            fingerprintLen = static_cast<size_t>(std::min<uint64_t>(offset, kFingerprintBytes));
+            file.clear();
+            if (readPrefix(file, fingerprintLen, head)) {
+                fingerprint = fnv1a(head.data(), head.size());
+            }
+        }
+
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+};
+
+#endif
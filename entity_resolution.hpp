@@ -0,0 +1,358 @@
+#ifndef ENTITY_RESOLUTION_HPP
+#define ENTITY_RESOLUTION_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 企业名称规范化：大写，非字母数字一律当分隔符，去掉开头的 THE 和末尾的公司类型后缀（可以连着几个，如 "CO LTD"）
+// "Microsoft Corp." 和 "MICROSOFT CORPORATION" 都得到 "MICROSOFT"
+inline std::string canonicalFirmName(const std::string& name) {
+    static const std::unordered_set<std::string> suffixes = {
+        "INC", "INCORPORATED", "CORP", "CORPORATION", "CO", "COMPANY", "LTD", "LIMITED", "LLC", "LLP", "LP",
+        "PLC", "GMBH", "AG", "SA", "NV", "BV", "KK", "SPA", "SRL", "OY", "AB", "AS", "PTY", "KG", "SE"};
+    std::vector<std::string> tokens;
+    std::string token;
+    for (size_t i = 0; i <= name.size(); ++i) {
+        unsigned char c = i < name.size() ? static_cast<unsigned char>(name[i]) : ' ';
+        if (std::isalnum(c)) {
+            token.push_back(static_cast<char>(std::toupper(c)));
+        } else if (!token.empty()) {
+            tokens.push_back(token);
+            token.clear();
+        }
+    }
+    while (tokens.size() > 1 && suffixes.count(tokens.back())) tokens.pop_back();
+    if (tokens.size() > 1 && tokens.front() == "THE") tokens.erase(tokens.begin());
+    std::string result;
+    for (const auto& t : tokens) {
+        if (!result.empty()) result.push_back(' ');
+        result += t;
+    }
+    return result;
+}
+
+// 规范化名称前后各补一个空格后的字符三元组，排序去重；三个字节打包成一个整数
+inline std::vector<uint32_t> nameTrigrams(const std::string& canonical) {
+    std::vector<uint32_t> grams;
+    if (canonical.empty()) return grams;
+    std::string padded = " " + canonical + " ";
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        grams.push_back(static_cast<uint32_t>(static_cast<unsigned char>(padded[i])) << 16 |
+                        static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 1])) << 8 |
+                        static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 2])));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+// 名称索引：两条分块（blocking）通道产生候选，只和候选计算相似度
+// - Jaccard：前缀过滤。交集至少要 k 个时，查询名称按倒排表从短到长排序后的前 |q| - k + 1 个三元组里
+//   必有一个与对方相同，只查这几个倒排表，再按长度过滤（Jaccard ≥ t 要求短长之比 ≥ t），不会漏掉匹配；
+// - 包含：首词相同的名称放在同一块里逐一比较；块大于 maxBlock（"GENERAL"、"SHANGHAI" 这种常见首词）时
+//   只走 Jaccard 通道，避免块内两两比较退化成平方。
+// 全量配对时每对只从较短的一边查一次，所以 k 可以取到 2t / (1 + t) * |q|
+class FirmNameIndex {
+public:
+    struct Match {
+        std::string firmID;
+        std::string firmName;
+        double score;
+    };
+
+private:
+    struct Entry {
+        std::string firmID;
+        std::string firmName;
+        std::string canonical;
+        std::string firstToken;
+        std::vector<uint32_t> grams;
+        bool live;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, uint32_t> byID;
+    // 删除的条目留在倒排表和块里，查询时跳过
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;  // 三元组 -> 条目号
+    std::unordered_map<std::string, std::vector<uint32_t>> blocks; // 首词 -> 条目号
+    size_t maxBlock;
+    size_t live;
+
+    // 候选去重标记，查询之间复用
+    mutable std::vector<bool> seen;
+    mutable std::vector<uint32_t> touched;
+    mutable std::vector<std::pair<size_t, uint32_t>> order;
+
+    static Entry makeEntry(const std::string& firmID, const std::string& firmName) {
+        Entry e;
+        e.firmID = firmID;
+        e.firmName = firmName;
+        e.canonical = canonicalFirmName(firmName);
+        e.firstToken = e.canonical.substr(0, e.canonical.find(' '));
+        e.grams = nameTrigrams(e.canonical);
+        e.live = true;
+        return e;
+    }
+
+    static size_t intersection(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        size_t i = 0, j = 0, n = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i] < b[j]) {
+                ++i;
+            } else if (b[j] < a[i]) {
+                ++j;
+            } else {
+                ++n, ++i, ++j;
+            }
+        }
+        return n;
+    }
+
+    // 规范化后相同记 1；否则取三元组 Jaccard，首词相同时较短名称被包含的比例乘 0.9 也可以作为分数
+    // （"MICROSOFT" 与 "MICROSOFT TECHNOLOGY LICENSING" 得 0.9，"GENERAL ELECTRIC" 与 "GENERAL MOTORS" 不到 0.5）
+    static double similarity(const Entry& a, const Entry& b) {
+        if (a.canonical.empty() || b.canonical.empty()) return 0.0;
+        if (a.canonical == b.canonical) return 1.0;
+        size_t inter = intersection(a.grams, b.grams);
+        double j = static_cast<double>(inter) / (a.grams.size() + b.grams.size() - inter);
+        if (a.firstToken != b.firstToken) return j;
+        double contained = static_cast<double>(inter) / std::min(a.grams.size(), b.grams.size());
+        return std::max(j, 0.9 * contained);
+    }
+
+    // 对 q 的每个候选条目调用一次 fn(index)
+    // pairMode：只要不短于 q 的条目（等长时条目号大于 self），用于全量配对；否则任意长度，self 传 entries.size()
+    template <class Fn>
+    void forEachCandidate(const Entry& q, size_t self, double threshold, bool pairMode, Fn fn) const {
+        if (q.grams.empty()) return;
+        if (seen.size() < entries.size()) seen.resize(entries.size(), false);
+        size_t n = q.grams.size();
+        auto accept = [&](uint32_t idx) {
+            if (idx == self || seen[idx] || !entries[idx].live) return;
+            size_t m = entries[idx].grams.size();
+            if (pairMode && (m < n || (m == n && idx < self))) return;
+            seen[idx] = true;
+            touched.push_back(idx);
+        };
+
+        // Jaccard 通道：交集下界 k，只查最稀有的 n - k + 1 个三元组
+        double factor = pairMode ? 2 * threshold / (1 + threshold) : threshold;
+        size_t k = static_cast<size_t>(std::ceil(factor * n - 1e-9));
+        size_t probes = k == 0 ? n : n - std::min(k, n) + 1;
+        order.clear();
+        for (uint32_t g : q.grams) {
+            auto it = postings.find(g);
+            order.push_back(std::make_pair(it == postings.end() ? 0 : it->second.size(), g));
+        }
+        std::sort(order.begin(), order.end());
+        size_t minLen = static_cast<size_t>(std::ceil(threshold * n - 1e-9));
+        size_t maxLen = static_cast<size_t>(n / threshold + 1e-9);
+        for (size_t i = 0; i < probes && i < order.size(); ++i) {
+            if (order[i].first == 0) continue;
+            for (uint32_t idx : postings.find(order[i].second)->second) {
+                size_t m = entries[idx].grams.size();
+                if (m >= minLen && m <= maxLen) accept(idx);
+            }
+        }
+        // 包含通道
+        auto block = blocks.find(q.firstToken);
+        if (block != blocks.end() && block->second.size() <= maxBlock) {
+            for (uint32_t idx : block->second) accept(idx);
+        }
+
+        for (uint32_t idx : touched) {
+            seen[idx] = false;
+            fn(idx);
+        }
+        touched.clear();
+    }
+
+public:
+    // maxBlock：首词块超过这个大小时不再按包含关系比较
+    explicit FirmNameIndex(size_t maxBlock = 256) : maxBlock(maxBlock), live(0) {}
+
+    // 已存在的 firmID 视为改名
+    void add(const std::string& firmID, const std::string& firmName) {
+        remove(firmID);
+        uint32_t idx = static_cast<uint32_t>(entries.size());
+        entries.push_back(makeEntry(firmID, firmName));
+        for (uint32_t g : entries.back().grams) postings[g].push_back(idx);
+        if (!entries.back().grams.empty()) blocks[entries.back().firstToken].push_back(idx);
+        byID[firmID] = idx;
+        live++;
+    }
+
+    void remove(const std::string& firmID) {
+        auto it = byID.find(firmID);
+        if (it == byID.end()) return;
+        entries[it->second].live = false;
+        byID.erase(it);
+        live--;
+    }
+
+    size_t size() const {
+        return live;
+    }
+
+    // 与 firmName 相似度不低于 threshold 的已有企业，按分数从高到低，最多 limit 个；添加企业前可以先查一下
+    std::vector<Match> similar(const std::string& firmName, double threshold = 0.75, size_t limit = 10) const {
+        Entry q = makeEntry("", firmName);
+        std::vector<Match> result;
+        forEachCandidate(q, entries.size(), threshold, false, [&](uint32_t idx) {
+            double score = similarity(q, entries[idx]);
+            if (score >= threshold) result.push_back(Match{entries[idx].firmID, entries[idx].firmName, score});
+        });
+        std::sort(result.begin(), result.end(), [](const Match& a, const Match& b) {
+            return a.score != b.score ? a.score > b.score : a.firmID < b.firmID;
+        });
+        if (result.size() > limit) result.resize(limit);
+        return result;
+    }
+
+    // 每一对相似度不低于 threshold 的企业调用一次 fn(firmA, firmB, score)
+    void forEachSimilarPair(double threshold,
+                            const std::function<void(const std::string&, const std::string&, double)>& fn) const {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!entries[i].live) continue;
+            forEachCandidate(entries[i], i, threshold, true, [&](uint32_t j) {
+                double score = similarity(entries[i], entries[j]);
+                if (score >= threshold) fn(entries[i].firmID, entries[j].firmID, score);
+            });
+        }
+    }
+
+    // 任意两个名称的相似度，与索引里用的打分相同
+    static double compare(const std::string& nameA, const std::string& nameB) {
+        return similarity(makeEntry("", nameA), makeEntry("", nameB));
+    }
+
+    // 两个已索引企业的名称相似度，有一个不在索引里返回 0
+    double score(const std::string& firmA, const std::string& firmB) const {
+        auto a = byID.find(firmA);
+        auto b = byID.find(firmB);
+        if (a == byID.end() || b == byID.end()) return 0.0;
+        return similarity(entries[a->second], entries[b->second]);
+    }
+
+    std::string nameOf(const std::string& firmID) const {
+        auto it = byID.find(firmID);
+        return it == byID.end() ? std::string() : entries[it->second].firmName;
+    }
+};
+
+// 实体消解：作为观察者维护企业名称索引，把相似名称聚成簇，每簇建议并入专利最多的那个企业
+// 相似关系按传递闭包聚簇（A~B、B~C 时 A、B、C 一簇），所以 score 是成员与目标企业的直接相似度，可能低于阈值
+class EntityResolver : public IFirmSystemObserver {
+public:
+    struct MergeProposal {
+        std::string intoFirmID;
+        std::string intoName;
+        std::string fromFirmID;
+        std::string fromName;
+        double score;
+    };
+
+private:
+    FirmNameIndex index;
+
+    static size_t findRoot(std::vector<size_t>& parent, size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+public:
+    explicit EntityResolver(size_t maxBlock = 256) : index(maxBlock) {}
+
+    void onFirmAdded(const std::string& firmID, const std::string& firmName) override {
+        index.add(firmID, firmName);
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        index.remove(firm.getFirmID());
+    }
+
+    const FirmNameIndex& names() const {
+        return index;
+    }
+
+    std::vector<FirmNameIndex::Match> similarFirms(const std::string& firmName, double threshold = 0.75,
+                                                   size_t limit = 10) const {
+        return index.similar(firmName, threshold, limit);
+    }
+
+    // 专利数相同时选名称较短的，再按 firmID
+    std::vector<MergeProposal> proposeMerges(const IFirmSystem& system, double threshold = 0.75) const {
+        std::vector<std::string> ids;
+        std::unordered_map<std::string, size_t> slot;
+        std::vector<size_t> parent;
+        auto slotOf = [&](const std::string& firmID) {
+            auto it = slot.find(firmID);
+            if (it != slot.end()) return it->second;
+            slot[firmID] = ids.size();
+            ids.push_back(firmID);
+            parent.push_back(parent.size());
+            return ids.size() - 1;
+        };
+        index.forEachSimilarPair(threshold, [&](const std::string& a, const std::string& b, double) {
+            size_t ra = findRoot(parent, slotOf(a));
+            size_t rb = findRoot(parent, slotOf(b));
+            if (ra != rb) parent[ra] = rb;
+        });
+
+        std::unordered_map<std::string, size_t> patents;
+        if (!ids.empty()) {
+            system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                if (slot.count(firm->getFirmID())) patents[firm->getFirmID()] = static_cast<size_t>(firm->getPatentCount());
+            });
+        }
+        auto better = [&](size_t a, size_t b) {
+            size_t pa = patents[ids[a]], pb = patents[ids[b]];
+            if (pa != pb) return pa > pb;
+            size_t la = index.nameOf(ids[a]).size(), lb = index.nameOf(ids[b]).size();
+            return la != lb ? la < lb : ids[a] < ids[b];
+        };
+        std::vector<size_t> target(ids.size(), static_cast<size_t>(-1));
+        for (size_t i = 0; i < ids.size(); ++i) {
+            size_t& t = target[findRoot(parent, i)];
+            if (t == static_cast<size_t>(-1) || better(i, t)) t = i;
+        }
+
+        std::vector<MergeProposal> proposals;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            size_t into = target[findRoot(parent, i)];
+            if (into == i) continue;
+            proposals.push_back(MergeProposal{ids[into], index.nameOf(ids[into]), ids[i], index.nameOf(ids[i]),
+                                              index.score(ids[into], ids[i])});
+        }
+        std::sort(proposals.begin(), proposals.end(), [](const MergeProposal& a, const MergeProposal& b) {
+            return a.intoFirmID != b.intoFirmID ? a.intoFirmID < b.intoFirmID : a.fromFirmID < b.fromFirmID;
+        });
+        return proposals;
+    }
+
+    // 逐条执行 mergeFirms，返回成功的条数（两边有相同 patentID 的会被拒绝）；目标企业不会是别的建议的来源，顺序无关
+    size_t applyMerges(IFirmSystem& system, const std::vector<MergeProposal>& proposals) const {
+        size_t applied = 0;
+        std::vector<std::shared_ptr<IFirm>> left;
+        for (const auto& p : proposals) {
+            system.mergeFirms(p.intoFirmID, p.fromFirmID);
+            // getFirm 找不到时会打印错误，这里用 lookupMany 静默检查来源企业是否已被并掉
+            system.lookupMany(std::vector<std::string>(1, p.fromFirmID), left);
+            if (!left[0]) applied++;
+        }
+        return applied;
+    }
+};
+
+#endif
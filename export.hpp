@@ -0,0 +1,412 @@
+#ifndef EXPORT_HPP
+#define EXPORT_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "firmSys.hpp"
+#include "text_format.hpp"
+
+// 直接写文件描述符的大缓冲输出，攒满才发一次系统调用
+// 超过缓冲一半的大块不再复制：vectored 时和缓冲里已有的内容一起用一次 writev 写出，否则先写缓冲再直接写这一块
+// 写失败后不再写入，ok() 返回 false，error() 是对应的 errno
+class OutputBuffer {
+private:
+    int fd;
+    bool ownsFd;
+    bool vectored;
+    std::vector<char> buffer;
+    size_t used;
+    size_t written;
+    size_t calls;
+    int lastError;
+
+    // 处理 EINTR 和部分写入
+    void writeAll(struct iovec* iov, int count) {
+        while (count > 0 && lastError == 0) {
+            ssize_t n = count == 1 ? ::write(fd, iov[0].iov_base, iov[0].iov_len) : ::writev(fd, iov, count);
+            calls++;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                lastError = errno;
+                return;
+            }
+            written += static_cast<size_t>(n);
+            size_t left = static_cast<size_t>(n);
+            while (count > 0 && left >= iov[0].iov_len) {
+                left -= iov[0].iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + left;
+                iov[0].iov_len -= left;
+            }
+        }
+    }
+
+    void writeThrough(const char* data, size_t n) {
+        struct iovec iov[2];
+        int count = 0;
+        if (used > 0) {
+            iov[count].iov_base = buffer.data();
+            iov[count++].iov_len = used;
+        }
+        iov[count].iov_base = const_cast<char*>(data);
+        iov[count++].iov_len = n;
+        if (vectored) {
+            writeAll(iov, count);
+        } else {
+            for (int i = 0; i < count; ++i) writeAll(&iov[i], 1);
+        }
+        used = 0;
+    }
+
+public:
+    OutputBuffer(int fd, size_t capacity = 1 << 20, bool vectored = false)
+        : fd(fd), ownsFd(false), vectored(vectored), buffer(capacity < 4096 ? 4096 : capacity), used(0), written(0),
+          calls(0), lastError(0) {}
+
+    // 打开（截断或新建）文件；失败时 ok() 为 false
+    OutputBuffer(const std::string& path, size_t capacity = 1 << 20, bool vectored = false)
+        : OutputBuffer(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644), capacity, vectored) {
+        ownsFd = true;
+        if (fd < 0) lastError = errno;
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer() {
+        flush();
+        if (ownsFd && fd >= 0) ::close(fd);
+    }
+
+    void append(const char* data, size_t n) {
+        if (n <= buffer.size() - used) {
+            std::memcpy(buffer.data() + used, data, n);
+            used += n;
+            return;
+        }
+        if (n >= buffer.size() / 2) {
+            writeThrough(data, n);
+            return;
+        }
+        flush();
+        std::memcpy(buffer.data(), data, n);
+        used = n;
+    }
+
+    void append(size_t n, char c) {
+        while (n > 0) {
+            if (used == buffer.size()) flush();
+            size_t chunk = std::min(n, buffer.size() - used);
+            std::memset(buffer.data() + used, c, chunk);
+            used += chunk;
+            n -= chunk;
+        }
+    }
+
+    void append(const std::string& s) {
+        append(s.data(), s.size());
+    }
+
+    void push_back(char c) {
+        if (used == buffer.size()) flush();
+        buffer[used++] = c;
+    }
+
+    bool flush() {
+        if (used > 0) {
+            struct iovec iov;
+            iov.iov_base = buffer.data();
+            iov.iov_len = used;
+            writeAll(&iov, 1);
+            used = 0;
+        }
+        return lastError == 0;
+    }
+
+    bool ok() const {
+        return fd >= 0 && lastError == 0;
+    }
+
+    int error() const {
+        return lastError;
+    }
+
+    size_t bytesWritten() const {
+        return written;
+    }
+
+    size_t syscalls() const {
+        return calls;
+    }
+};
+
+enum class ExportFormat { CSV, TSV, JSONLines };
+
+inline bool parseExportFormat(const std::string& name, ExportFormat& format) {
+    if (name == "csv") {
+        format = ExportFormat::CSV;
+    } else if (name == "tsv") {
+        format = ExportFormat::TSV;
+    } else if (name == "jsonl" || name == "json") {
+        format = ExportFormat::JSONLines;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 按 PatentData.csv 的列导出专利
+// CSV 按 RFC 4180 加引号，字段里的换行换成空格（装载是按行的），能被 loadPatentsFromCSV 重新读入；
+// TSV 把字段里的制表符和换行换成空格；JSON lines 每行一个对象，键名同 CSV 表头
+class PatentExporter {
+private:
+    // 各格式下需要特殊处理的字节
+    struct SpecialBytes {
+        bool csv[256];
+        bool tsv[256];
+        bool json[256];
+
+        SpecialBytes() {
+            for (int c = 0; c < 256; ++c) {
+                csv[c] = c == ',' || c == '"' || c == '\r' || c == '\n';
+                tsv[c] = c == '\t' || c == '\r' || c == '\n';
+                json[c] = c < 0x20 || c == '"' || c == '\\';
+            }
+        }
+    };
+
+    static const SpecialBytes& specialBytes() {
+        static const SpecialBytes table;
+        return table;
+    }
+
+    OutputBuffer& out;
+    ExportFormat format;
+    bool isoDates;
+    size_t rows;
+    const SpecialBytes& special;
+    std::string scratch;
+
+    static size_t firstSpecial(const std::string& s, size_t from, const bool* table) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+        size_t n = s.size();
+        while (from < n && !table[p[from]]) ++from;
+        return from;
+    }
+
+    void csvField(const std::string& s) {
+        size_t i = firstSpecial(s, 0, special.csv);
+        if (i == s.size()) {
+            out.append(s.data(), s.size());
+            return;
+        }
+        out.push_back('"');
+        size_t from = 0;
+        for (; i < s.size(); i = firstSpecial(s, i + 1, special.csv)) {
+            if (s[i] == '"') {
+                out.append(s.data() + from, i + 1 - from);
+                out.push_back('"');
+                from = i + 1;
+            } else if (s[i] == '\r' || s[i] == '\n') {
+                out.append(s.data() + from, i - from);
+                out.push_back(' ');
+                from = i + 1;
+            }
+        }
+        out.append(s.data() + from, s.size() - from);
+        out.push_back('"');
+    }
+
+    void tsvField(const std::string& s) {
+        size_t from = 0, i;
+        while ((i = firstSpecial(s, from, special.tsv)) < s.size()) {
+            out.append(s.data() + from, i - from);
+            out.push_back(' ');
+            from = i + 1;
+        }
+        out.append(s.data() + from, s.size() - from);
+    }
+
+    void jsonString(const std::string& s) {
+        static const char hex[] = "0123456789abcdef";
+        out.push_back('"');
+        size_t from = 0, i;
+        while ((i = firstSpecial(s, from, special.json)) < s.size()) {
+            out.append(s.data() + from, i - from);
+            from = i + 1;
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            switch (c) {
+                case '"': out.append("\\\"", 2); break;
+                case '\\': out.append("\\\\", 2); break;
+                case '\n': out.append("\\n", 2); break;
+                case '\r': out.append("\\r", 2); break;
+                case '\t': out.append("\\t", 2); break;
+                default: {
+                    char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    out.append(esc, sizeof(esc));
+                }
+            }
+        }
+        out.append(s.data() + from, s.size() - from);
+        out.push_back('"');
+    }
+
+    void date(const std::string& d) {
+        if (!isoDates) {
+            out.append(d);
+        } else if (format == ExportFormat::CSV || format == ExportFormat::TSV) {
+            appendIsoDate(out, d);
+        } else {
+            // 日期只含数字，不用转义
+            out.push_back('"');
+            appendIsoDate(out, d);
+            out.push_back('"');
+        }
+    }
+
+public:
+    // isoDates 把日期写成 YYYY-MM-DD（CSV 就不能再被 loadPatentsFromCSV 读入了）
+    PatentExporter(OutputBuffer& out, ExportFormat format, bool isoDates = false)
+        : out(out), format(format), isoDates(isoDates), rows(0), special(specialBytes()) {}
+
+    // CSV / TSV 的表头行；JSON lines 没有表头
+    void writeHeader() {
+        if (format == ExportFormat::CSV) {
+            out.append(std::string("patentID,grantdate,appldate,patent_title,country,firmID\n"));
+        } else if (format == ExportFormat::TSV) {
+            out.append(std::string("patentID\tgrantdate\tappldate\tpatent_title\tcountry\tfirmID\n"));
+        }
+    }
+
+    void writePatent(const Patent& p) {
+        writeRow(p.patentIDRef(), p.grantdateRef(), p.appldateRef(), p.titleRef(scratch), p.countryRef(), p.firmIDRef());
+    }
+
+    // 按字段写一行，排序导出从临时文件读回的记录不必先还原成 Patent
+    void writeRow(const std::string& patentID, const std::string& grantdate, const std::string& appldate,
+                  const std::string& title, const std::string& country, const std::string& firmID) {
+        if (format == ExportFormat::JSONLines) {
+            out.append("{\"patentID\":", 12);
+            jsonString(patentID);
+            out.append(",\"grantdate\":", 13);
+            if (isoDates) {
+                date(grantdate);
+            } else {
+                jsonString(grantdate);
+            }
+            out.append(",\"appldate\":", 12);
+            if (isoDates) {
+                date(appldate);
+            } else {
+                jsonString(appldate);
+            }
+            out.append(",\"patent_title\":", 16);
+            jsonString(title);
+            out.append(",\"country\":", 11);
+            jsonString(country);
+            out.append(",\"firmID\":", 10);
+            jsonString(firmID);
+            out.append("}\n", 2);
+        } else if (format == ExportFormat::CSV) {
+            csvField(patentID);
+            out.push_back(',');
+            date(grantdate);
+            out.push_back(',');
+            date(appldate);
+            out.push_back(',');
+            csvField(title);
+            out.push_back(',');
+            csvField(country);
+            out.push_back(',');
+            csvField(firmID);
+            out.push_back('\n');
+        } else {
+            tsvField(patentID);
+            out.push_back('\t');
+            date(grantdate);
+            out.push_back('\t');
+            date(appldate);
+            out.push_back('\t');
+            tsvField(title);
+            out.push_back('\t');
+            tsvField(country);
+            out.push_back('\t');
+            tsvField(firmID);
+            out.push_back('\n');
+        }
+        rows++;
+    }
+
+    void writeFirm(const IFirm& firm) {
+        firm.forEachPatent([this](const Patent& p) {
+            writePatent(p);
+        });
+    }
+
+    void writeSystem(const IFirmSystem& system) {
+        system.forEachFirm([this](const std::shared_ptr<IFirm>& firm) {
+            writeFirm(*firm);
+        });
+    }
+
+    size_t rowCount() const {
+        return rows;
+    }
+};
+
+struct ExportResult {
+    bool ok = false;
+    std::string error;
+    size_t rows = 0;
+    size_t bytes = 0;
+    size_t syscalls = 0;
+    // 排序导出：写到临时文件的有序段数、溢出的字节数和合并趟数，全在内存里排完时都是 0
+    size_t runs = 0;
+    size_t spilledBytes = 0;
+    size_t mergePasses = 0;
+};
+
+// 导出一个企业（firmID 非空）或整个系统到文件
+inline ExportResult exportPatents(const IFirmSystem& system, const std::string& firmID, const std::string& path,
+                                  ExportFormat format, bool vectored = false, bool isoDates = false) {
+    ExportResult result;
+    std::shared_ptr<IFirm> firm;
+    if (!firmID.empty()) {
+        try {
+            firm = system.getFirm(firmID);
+        } catch (const std::exception&) {
+        }
+        if (!firm) {
+            result.error = "Firm not found.";
+            return result;
+        }
+    }
+    OutputBuffer out(path, 1 << 20, vectored);
+    if (!out.ok()) {
+        result.error = "Cannot open " + path + ": " + std::strerror(out.error());
+        return result;
+    }
+    PatentExporter exporter(out, format, isoDates);
+    exporter.writeHeader();
+    if (firm) {
+        exporter.writeFirm(*firm);
+    } else {
+        exporter.writeSystem(system);
+    }
+    result.ok = out.flush();
+    if (!result.ok) result.error = std::string("Write failed: ") + std::strerror(out.error());
+    result.rows = exporter.rowCount();
+    result.bytes = out.bytesWritten();
+    result.syscalls = out.syscalls();
+    return result;
+}
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include "firmSys.hpp"
+#include "export.hpp"
+#include "thread_pool.hpp"
+#include "batch_lookup.hpp"
+
+// 全库按顺序导出：每个专利编成定长的排序键加一条变长记录
+// 放得下就在内存里做并行基数排序后直接写出；放不下时各线程把自己的缓冲排好序写成临时文件里的有序段，
+// 再用败者树做 k 路归并，段数超过 fanIn 时先分组归并成更长的段
+
+enum class SortKey { GrantDate, FirmAppldate };
+
+inline bool parseSortKey(const std::string& name, SortKey& key) {
+    if (name == "grantdate" || name == "grant") {
+        key = SortKey::GrantDate;
+    } else if (name == "firm" || name == "firm-appldate") {
+        key = SortKey::FirmAppldate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 排序单元：按 (key, tie) 升序；source、offset 指向记录所在的缓冲和位置
+struct SortItem {
+    uint64_t key;
+    uint32_t tie;
+    uint32_t source;
+    uint64_t offset;
+};
+
+inline bool sortItemLess(const SortItem& a, const SortItem& b) {
+    return a.key != b.key ? a.key < b.key : a.tie < b.tie;
+}
+
+// LSD 基数排序，每趟 8 位，先 tie 后 key；某一位上所有元素都相同的趟直接跳过（日期、企业编号的高位大多如此）
+// 先读一遍算出全部 12 位的直方图，决定哪些趟要做；单线程时直接用它定位，多线程时每趟各线程再统计自己那段，
+// 算出各自的写入起点后并行分发，保持稳定
+inline void parallelRadixSort(std::vector<SortItem>& items, size_t threads) {
+    size_t n = items.size();
+    if (n < 2) return;
+    if (threads == 0) threads = defaultThreadCount();
+    if (n < threads * 4096) threads = 1;
+    auto digit = [](const SortItem& item, unsigned pass) -> unsigned {
+        return pass < 4 ? (item.tie >> (8 * pass)) & 0xff : (item.key >> (8 * (pass - 4))) & 0xff;
+    };
+    std::vector<std::vector<size_t>> all(threads, std::vector<size_t>(12 * 256));
+    parallelFor(n, threads, [&](size_t b, size_t e, size_t t) {
+        size_t* c = all[t].data();
+        for (size_t i = b; i < e; ++i) {
+            const SortItem& item = items[i];
+            for (unsigned pass = 0; pass < 4; ++pass) c[pass * 256 + ((item.tie >> (8 * pass)) & 0xff)]++;
+            for (unsigned pass = 4; pass < 12; ++pass) c[pass * 256 + ((item.key >> (8 * (pass - 4))) & 0xff)]++;
+        }
+    });
+    std::vector<size_t> total(12 * 256, 0);
+    for (size_t t = 0; t < threads; ++t) {
+        for (size_t d = 0; d < total.size(); ++d) total[d] += all[t][d];
+    }
+
+    std::vector<SortItem> scratch(n);
+    std::vector<std::vector<size_t>> counts(threads, std::vector<size_t>(256));
+    SortItem* from = items.data();
+    SortItem* to = scratch.data();
+    for (unsigned pass = 0; pass < 12; ++pass) {
+        const size_t* histogram = total.data() + pass * 256;
+        if (*std::max_element(histogram, histogram + 256) == n) continue;
+        if (threads == 1) {
+            std::copy(histogram, histogram + 256, counts[0].begin());
+        } else {
+            parallelFor(n, threads, [&](size_t b, size_t e, size_t t) {
+                std::vector<size_t>& c = counts[t];
+                std::fill(c.begin(), c.end(), 0);
+                for (size_t i = b; i < e; ++i) c[digit(from[i], pass)]++;
+            });
+        }
+        // counts[t][d] 换成线程 t 写数字 d 的起点
+        size_t base = 0;
+        for (size_t d = 0; d < 256; ++d) {
+            for (size_t t = 0; t < threads; ++t) {
+                size_t c = counts[t][d];
+                counts[t][d] = base;
+                base += c;
+            }
+        }
+        parallelFor(n, threads, [&](size_t b, size_t e, size_t t) {
+            size_t* next = counts[t].data();
+            for (size_t i = b; i < e; ++i) to[next[digit(from[i], pass)]++] = from[i];
+        });
+        std::swap(from, to);
+    }
+    if (from != items.data()) std::copy(from, from + n, items.data());
+}
+
+// 败者树：内部节点记每场比赛的败者，tree[0] 是总冠军；某一路前进后只需沿它到根的路径重赛一遍，log k 次比较
+template <class Less>
+class LoserTree {
+private:
+    std::vector<size_t> tree;
+    size_t k;
+    Less less;
+
+public:
+    LoserTree(size_t k, Less less) : tree(std::max<size_t>(k, 1)), k(k), less(less) {
+        std::vector<size_t> winner(2 * k);
+        for (size_t i = 0; i < k; ++i) winner[k + i] = i;
+        for (size_t n = k - 1; n >= 1; --n) {
+            size_t a = winner[2 * n], b = winner[2 * n + 1];
+            if (less(b, a)) {
+                winner[n] = b;
+                tree[n] = a;
+            } else {
+                winner[n] = a;
+                tree[n] = b;
+            }
+        }
+        tree[0] = k == 1 ? 0 : winner[1];
+    }
+
+    size_t top() const {
+        return tree[0];
+    }
+
+    // top() 那一路换了新的当前值（或已耗尽）后调用
+    void replay() {
+        size_t w = tree[0];
+        for (size_t n = (w + k) / 2; n >= 1; n /= 2) {
+            if (less(tree[n], w)) std::swap(tree[n], w);
+        }
+        tree[0] = w;
+    }
+};
+
+namespace external_sort_detail {
+
+inline void putU32(std::vector<char>& buf, uint32_t v) {
+    char b[4];
+    std::memcpy(b, &v, 4);
+    buf.insert(buf.end(), b, b + 4);
+}
+
+inline uint32_t getU32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t getU64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t digits(const std::string& s, uint32_t fallback) {
+    if (s.empty() || s.size() > 9) return fallback;
+    uint32_t v = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') return fallback;
+        v = v * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return v;
+}
+
+// 有序段文件里的一条记录：key(8) tie(4) 长度(4) 负载；负载是六个字段，各为 长度(4) + 字节
+const size_t kRecordHeader = 16;
+
+// 顺序读一个有序段，缓冲里至少凑够一整条记录再交出
+class RunReader {
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t pos = 0;
+    size_t end = 0;
+    bool eof = false;
+    int lastError = 0;
+
+    bool fill(size_t need) {
+        if (end - pos >= need) return true;
+        std::memmove(buffer.data(), buffer.data() + pos, end - pos);
+        end -= pos;
+        pos = 0;
+        if (buffer.size() < need) buffer.resize(need);
+        while (end < need && !eof) {
+            ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                lastError = errno;
+                eof = true;
+            } else if (n == 0) {
+                eof = true;
+            } else {
+                end += static_cast<size_t>(n);
+            }
+        }
+        return end - pos >= need;
+    }
+
+public:
+    bool valid = false;
+    uint64_t key = 0;
+    uint32_t tie = 0;
+    const char* payload = nullptr;
+    uint32_t length = 0;
+
+    // 打开后立即删除文件名，进程异常退出也不会留下临时文件
+    RunReader(const std::string& path, size_t bufferBytes) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)), buffer(bufferBytes) {
+        if (fd < 0) {
+            lastError = errno;
+        } else {
+            ::unlink(path.c_str());
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+    }
+
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+
+    ~RunReader() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool next() {
+        if (fd < 0) return valid = false;
+        pos += valid ? kRecordHeader + length : 0;
+        if (!fill(kRecordHeader)) return valid = false;
+        key = getU64(buffer.data() + pos);
+        tie = getU32(buffer.data() + pos + 8);
+        length = getU32(buffer.data() + pos + 12);
+        if (!fill(kRecordHeader + length)) {
+            if (lastError == 0) lastError = EIO;  // 段文件被截断
+            return valid = false;
+        }
+        payload = buffer.data() + pos + kRecordHeader;
+        return valid = true;
+    }
+
+    int error() const {
+        return lastError;
+    }
+};
+
+struct RunLess {
+    const std::vector<std::unique_ptr<RunReader>>* readers;
+    // 耗尽的一路视为无穷大；键相同时按段号，归并结果与段的生成顺序一致
+    bool operator()(size_t a, size_t b) const {
+        const RunReader& x = *(*readers)[a];
+        const RunReader& y = *(*readers)[b];
+        if (!x.valid) return false;
+        if (!y.valid) return true;
+        if (x.key != y.key) return x.key < y.key;
+        if (x.tie != y.tie) return x.tie < y.tie;
+        return a < b;
+    }
+};
+
+// 一个线程的记录缓冲：arena 里是 长度(4) + 负载
+struct RunBuffer {
+    std::vector<char> arena;
+    std::vector<SortItem> items;
+    int error = 0;
+};
+
+}  // namespace external_sort_detail
+
+struct SortedExportOptions {
+    SortKey key = SortKey::GrantDate;
+    ExportFormat format = ExportFormat::CSV;
+    size_t memoryBudget = static_cast<size_t>(256) << 20;  // 所有线程的排序缓冲加起来的字节数
+    size_t threads = 0;                                    // 0 表示 defaultThreadCount()
+    std::string tempDir = "/tmp";
+    size_t fanIn = 128;                                    // 一趟最多归并几个段
+    size_t ioBuffer = static_cast<size_t>(4) << 20;        // 每个段的读缓冲和输出缓冲的上限
+    bool isoDates = false;
+};
+
+// 全系统的专利按 options.key 排好序导出到 path
+// 授权日期序的次序是 (grantdate, patentID)，企业序是 (firmID, appldate, patentID)；firmID 和 patentID 按数值比较，
+// 非数字的 patentID 排在同一日期的最后，它们之间的先后不保证
+class SortedExporter {
+private:
+    typedef external_sort_detail::RunBuffer RunBuffer;
+    typedef external_sort_detail::RunReader RunReader;
+
+    const IFirmSystem& system;
+    SortedExportOptions options;
+    std::unordered_map<std::string, uint32_t> firmRank;
+    std::atomic<size_t> runCounter;
+    std::mutex runsMtx;
+    std::vector<std::string> runs;
+    std::atomic<size_t> spilled;
+    std::string error;
+
+    // firmID 按数值序（先比长度）编号，企业序的键直接比较编号
+    void rankFirms() {
+        std::vector<std::string> ids;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) { ids.push_back(firm->getFirmID()); });
+        std::sort(ids.begin(), ids.end(), [](const std::string& a, const std::string& b) {
+            return a.size() != b.size() ? a.size() < b.size() : a < b;
+        });
+        for (size_t i = 0; i < ids.size(); ++i) firmRank[ids[i]] = static_cast<uint32_t>(i);
+    }
+
+    void encode(const Patent& p, RunBuffer& buf, size_t source, std::string& scratch) const {
+        using namespace external_sort_detail;
+        uint32_t patentNum = digits(p.patentIDRef(), 0xffffffffu);
+        SortItem item;
+        if (options.key == SortKey::GrantDate) {
+            item.key = static_cast<uint64_t>(digits(p.grantdateRef(), 0xffffffffu)) << 32 | patentNum;
+            item.tie = 0;
+        } else {
+            auto it = firmRank.find(p.firmIDRef());
+            uint32_t rank = it == firmRank.end() ? 0xffffffffu : it->second;
+            item.key = static_cast<uint64_t>(rank) << 32 | digits(p.appldateRef(), 0xffffffffu);
+            item.tie = patentNum;
+        }
+        item.source = static_cast<uint32_t>(source);
+        item.offset = buf.arena.size();
+        const std::string* fields[6] = {&p.patentIDRef(), &p.grantdateRef(), &p.appldateRef(), &p.titleRef(scratch),
+                                        &p.countryRef(), &p.firmIDRef()};
+        uint32_t length = 0;
+        for (const std::string* f : fields) length += 4 + static_cast<uint32_t>(f->size());
+        putU32(buf.arena, length);
+        for (const std::string* f : fields) {
+            putU32(buf.arena, static_cast<uint32_t>(f->size()));
+            buf.arena.insert(buf.arena.end(), f->begin(), f->end());
+        }
+        buf.items.push_back(item);
+    }
+
+    std::string runPath() {
+        return options.tempDir + "/patent_sort_" + std::to_string(::getpid()) + "_" + std::to_string(runCounter++) + ".run";
+    }
+
+    static void putRecord(OutputBuffer& out, uint64_t key, uint32_t tie, const char* payload, uint32_t length) {
+        char header[external_sort_detail::kRecordHeader];
+        std::memcpy(header, &key, 8);
+        std::memcpy(header + 8, &tie, 4);
+        std::memcpy(header + 12, &length, 4);
+        out.append(header, sizeof(header));
+        out.append(payload, length);
+    }
+
+    // 排好一个线程的缓冲，写成一个有序段后清空
+    void spill(RunBuffer& buf) {
+        if (buf.items.empty() || buf.error) return;
+        parallelRadixSort(buf.items, 1);
+        std::string path = runPath();
+        {
+            OutputBuffer out(path, options.ioBuffer);
+            for (const SortItem& item : buf.items) {
+                const char* rec = buf.arena.data() + item.offset;
+                putRecord(out, item.key, item.tie, rec + 4, external_sort_detail::getU32(rec));
+            }
+            if (!out.flush()) {
+                buf.error = out.error();
+                ::unlink(path.c_str());
+                return;
+            }
+            spilled += out.bytesWritten();
+        }
+        {
+            std::lock_guard<std::mutex> lock(runsMtx);
+            runs.push_back(path);
+        }
+        buf.items.clear();
+        buf.arena.clear();
+    }
+
+    void writePayload(PatentExporter& exporter, const char* p, std::string* fields) const {
+        for (int f = 0; f < 6; ++f) {
+            uint32_t n = external_sort_detail::getU32(p);
+            fields[f].assign(p + 4, n);
+            p += 4 + n;
+        }
+        exporter.writeRow(fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+    }
+
+    size_t readBufferFor(size_t ways) const {
+        return std::max<size_t>(64 << 10, std::min(options.ioBuffer, options.memoryBudget / (ways + 1)));
+    }
+
+    // 把 group 里的段归并成一个新段
+    // 失败时删掉写了一半的 merged；group 里的段打开时已经删除了文件名
+    bool mergeRuns(const std::vector<std::string>& group, std::string& merged) {
+        using namespace external_sort_detail;
+        std::vector<std::unique_ptr<RunReader>> readers;
+        for (const auto& path : group) {
+            readers.emplace_back(new RunReader(path, readBufferFor(group.size())));
+            readers.back()->next();
+        }
+        merged = runPath();
+        OutputBuffer out(merged, options.ioBuffer);
+        LoserTree<RunLess> tree(readers.size(), RunLess{&readers});
+        while (readers[tree.top()]->valid) {
+            RunReader& r = *readers[tree.top()];
+            putRecord(out, r.key, r.tie, r.payload, r.length);
+            r.next();
+            tree.replay();
+        }
+        for (const auto& r : readers) {
+            if (r->error()) {
+                error = std::string("Cannot read sort run: ") + std::strerror(r->error());
+                ::unlink(merged.c_str());
+                return false;
+            }
+        }
+        if (!out.flush()) {
+            error = std::string("Cannot write sort run: ") + std::strerror(out.error());
+            ::unlink(merged.c_str());
+            return false;
+        }
+        spilled += out.bytesWritten();
+        return true;
+    }
+
+    bool mergeToExporter(PatentExporter& exporter, ExportResult& result) {
+        using namespace external_sort_detail;
+        // 段太多时先分组归并，每趟段数除以 fanIn
+        size_t fanIn = std::max<size_t>(2, options.fanIn);
+        while (runs.size() > fanIn) {
+            std::vector<std::string> next;
+            for (size_t b = 0; b < runs.size(); b += fanIn) {
+                std::vector<std::string> group(runs.begin() + b, runs.begin() + std::min(runs.size(), b + fanIn));
+                if (group.size() == 1) {
+                    next.push_back(group[0]);
+                    continue;
+                }
+                std::string merged;
+                if (!mergeRuns(group, merged)) {
+                    // 本趟已经归并出的段还不在 runs 里，removeRuns 删不到，这里删掉
+                    for (const auto& path : next) ::unlink(path.c_str());
+                    return false;
+                }
+                next.push_back(merged);
+            }
+            runs.swap(next);
+            result.mergePasses++;
+        }
+        std::vector<std::unique_ptr<RunReader>> readers;
+        for (const auto& path : runs) {
+            readers.emplace_back(new RunReader(path, readBufferFor(runs.size())));
+            readers.back()->next();
+        }
+        runs.clear();
+        std::string fields[6];
+        LoserTree<RunLess> tree(readers.size(), RunLess{&readers});
+        while (readers[tree.top()]->valid) {
+            RunReader& r = *readers[tree.top()];
+            writePayload(exporter, r.payload, fields);
+            r.next();
+            tree.replay();
+        }
+        result.mergePasses++;
+        for (const auto& r : readers) {
+            if (r->error()) {
+                error = std::string("Cannot read sort run: ") + std::strerror(r->error());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void removeRuns() {
+        for (const auto& path : runs) ::unlink(path.c_str());
+        runs.clear();
+    }
+
+public:
+    SortedExporter(const IFirmSystem& system, const SortedExportOptions& options)
+        : system(system), options(options), runCounter(0), spilled(0) {
+        if (this->options.threads == 0) this->options.threads = defaultThreadCount();
+    }
+
+    ExportResult run(const std::string& path) {
+        ExportResult result;
+        size_t threads = options.threads;
+        if (options.key == SortKey::FirmAppldate) rankFirms();
+
+        // 生成阶段：各线程把专利编进自己的缓冲，超出预算就排序溢出成一个段
+        size_t perThread = std::max<size_t>(1 << 20, options.memoryBudget / threads);
+        std::vector<RunBuffer> buffers(threads);
+        std::vector<std::string> scratch(threads);
+        system.parallelForEachPatent([&](const Patent& p, size_t worker) {
+            RunBuffer& buf = buffers[worker];
+            encode(p, buf, worker, scratch[worker]);
+            if (buf.arena.size() + buf.items.size() * sizeof(SortItem) > perThread) spill(buf);
+        }, threads);
+        for (const auto& buf : buffers) {
+            if (buf.error) {
+                removeRuns();
+                result.error = std::string("Cannot write sort run: ") + std::strerror(buf.error);
+                return result;
+            }
+        }
+
+        OutputBuffer out(path, options.ioBuffer);
+        if (!out.ok()) {
+            removeRuns();
+            result.error = "Cannot open " + path + ": " + std::strerror(out.error());
+            return result;
+        }
+        PatentExporter exporter(out, options.format, options.isoDates);
+        exporter.writeHeader();
+
+        if (runs.empty()) {
+            // 全部在内存里：合并各线程的排序单元，并行基数排序后直接写出
+            std::vector<SortItem> items;
+            size_t total = 0;
+            for (const auto& buf : buffers) total += buf.items.size();
+            items.reserve(total);
+            for (auto& buf : buffers) {
+                items.insert(items.end(), buf.items.begin(), buf.items.end());
+                std::vector<SortItem>().swap(buf.items);
+            }
+            parallelRadixSort(items, threads);
+            // 排好序后按序取记录是随机访存，提前几条预取
+            const size_t kAhead = 8;
+            std::string fields[6];
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (i + kAhead < items.size()) {
+                    prefetchRead(buffers[items[i + kAhead].source].arena.data() + items[i + kAhead].offset);
+                }
+                writePayload(exporter, buffers[items[i].source].arena.data() + items[i].offset + 4, fields);
+            }
+        } else {
+            for (auto& buf : buffers) {
+                spill(buf);
+                if (buf.error) {
+                    removeRuns();
+                    result.error = std::string("Cannot write sort run: ") + std::strerror(buf.error);
+                    return result;
+                }
+            }
+            buffers.clear();
+            result.runs = runs.size();
+            if (!mergeToExporter(exporter, result)) {
+                removeRuns();
+                result.error = error;
+                return result;
+            }
+        }
+
+        result.ok = out.flush();
+        if (!result.ok) result.error = std::string("Write failed: ") + std::strerror(out.error());
+        result.rows = exporter.rowCount();
+        result.bytes = out.bytesWritten();
+        result.syscalls = out.syscalls();
+        result.spilledBytes = spilled;
+        return result;
+    }
+};
+
+inline ExportResult exportSorted(const IFirmSystem& system, const std::string& path, const SortedExportOptions& options) {
+    SortedExporter exporter(system, options);
+    return exporter.run(path);
+}
+
+#endif
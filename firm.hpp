@@ -6,9 +6,14 @@
 #include <sstream>
 #include <unordered_map>
 #include <list>
+#include <functional>
+#include <vector>
+#include <algorithm>
 #include "patent.hpp"
+#include "memory_stats.hpp"
 #include "linked_list_template.hpp"
 #include "vector_template.hpp"
+#include "batch_lookup.hpp"
 
 class IFirm {
 public:
@@ -17,27 +22,52 @@ public:
     virtual int getPatentCount() const = 0;
     virtual void displayPatents() const = 0;
     virtual void addPatent(Patent& patent) = 0;
+    virtual void addPatents(std::vector<Patent>& patents) = 0;
     virtual void removePatent(const std::string& patentID) = 0;
     virtual const Patent getPatent(const std::string& patentID) const = 0;
+    // 批量按 patentID 查找：out[i] 指向 patentIDs[i] 对应的专利，找不到为 nullptr；指针在企业被修改前有效
+    virtual void lookupMany(const std::vector<std::string>& patentIDs, std::vector<const Patent*>& out) const = 0;
+    virtual void forEachPatent(const std::function<void(const Patent&)>& fn) const = 0;
+    // 专利容器可以切成 patentSlots() 个槽（数组下标、哈希桶），forEachPatentInSlots 只遍历 [begin, end) 内的槽，
+    // 用来把大企业拆给多个线程；默认整个企业只有一个槽，不可拆分（链表就是这样）
+    virtual size_t patentSlots() const { return 1; }
+    virtual void forEachPatentInSlots(size_t begin, size_t end, const std::function<void(const Patent&)>& fn) const {
+        if (begin == 0 && end > 0) forEachPatent(fn);
+    }
+    virtual MemoryStats memoryUsage() const = 0;
+    // 把 other 的全部专利并入本企业，other 变空：同类型的企业整体移交容器里的节点或缓冲区，不逐个复制专利；
+    // 类型不同时抛 std::invalid_argument
+    virtual void absorb(IFirm& other) = 0;
     virtual ~IFirm() {}
 };
 
 enum class FirmType {
     LinkedList,
     Vector,
-    UnorderedMap
+    UnorderedMap,
+    BTree  // 磁盘上的 B+ 树，见 btree_firm.hpp
 };
 
 class BaseFirm : public IFirm {
 // 这里可以抽象出来，减少重复代码 
 };
 
+typedef TrackingAllocator<Patent, PatentStorageTag> PatentAllocator;
+
+// 企业对象本身和 ID、名称字符串
+inline MemoryStats firmHeaderStats(size_t objectSize, const std::string& firmID, const std::string& firmName) {
+    MemoryStats stats;
+    stats.objectBytes = objectSize;
+    stats.stringPayload = stringHeapBytes(firmID) + stringHeapBytes(firmName);
+    return stats;
+}
+
 class FirmLinkedList : public IFirm {
 private:
     std::string firmID;
     std::string firmName;
     int patentCount;
-    SinglyLinkedList<Patent> patents;
+    SinglyLinkedList<Patent, PatentAllocator> patents;
 
 public:
     FirmLinkedList() : patentCount(0) {}
@@ -66,6 +96,12 @@ public:
         patentCount++;
     }
 
+    void addPatents(std::vector<Patent>& batch) override {
+        for (auto& patent : batch) {
+            addPatent(patent);
+        }
+    }
+
     void removePatent(const std::string& patentID) override {
         Patent tempPatent(patentID, "", "", "", "", "");
         try {
@@ -81,6 +117,48 @@ public:
         return patents.find_and_return(tempPatent);
     }
 
+    // 整条链只走一遍，处理当前节点时预取下一个
+    void lookupMany(const std::vector<std::string>& patentIDs, std::vector<const Patent*>& out) const override {
+        out.assign(patentIDs.size(), nullptr);
+        if (patentIDs.empty()) return;
+        KeySet wanted(patentIDs);
+        for (auto current = patents.getHead(); current != nullptr && !wanted.done(); current = current->next) {
+            if (current->next) prefetchRead(current->next);
+            size_t i = wanted.take(current->data.patentIDRef());
+            if (i != static_cast<size_t>(-1)) out[i] = &current->data;
+        }
+        wanted.fillDuplicates(out);
+    }
+
+    void forEachPatent(const std::function<void(const Patent&)>& fn) const override {
+        for (auto current = patents.getHead(); current != nullptr; current = current->next) {
+            fn(current->data);
+        }
+    }
+
+    // 改写 other 各节点的 firmID 后整条接过来
+    void absorb(IFirm& other) override {
+        FirmLinkedList* from = dynamic_cast<FirmLinkedList*>(&other);
+        if (!from) throw std::invalid_argument("Cannot merge firms of different types");
+        if (from == this) return;
+        for (auto current = from->patents.getHead(); current != nullptr; current = current->next) {
+            current->data.setFirmID(firmID);
+        }
+        patents.splice(from->patents);
+        patentCount += from->patentCount;
+        from->patentCount = 0;
+    }
+
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats = firmHeaderStats(sizeof(*this), firmID, firmName);
+        for (auto current = patents.getHead(); current != nullptr; current = current->next) {
+            stats.objectBytes += sizeof(Patent);
+            stats.nodeOverhead += SinglyLinkedList<Patent, PatentAllocator>::nodeSize() - sizeof(Patent);
+            stats.stringPayload += current->data.stringHeapBytes();
+        }
+        return stats;
+    }
+
     ~FirmLinkedList() = default;
 };
 
@@ -89,7 +167,7 @@ private:
     std::string firmID;
     std::string firmName;
     int patentCount;
-    myVector<Patent> patents;
+    myVector<Patent, PatentAllocator> patents;
 
 public:
     FirmVector() : patentCount(0) {}
@@ -114,6 +192,18 @@ public:
         patentCount++;
     }
 
+    // 按倍数预留：只按本批大小精确预留的话，每次小批量追加（比如 CsvTailer）都要搬动整个企业
+    void addPatents(std::vector<Patent>& batch) override {
+        if (patents.size() + batch.size() > patents.capacity()) {
+            patents.reserve(std::max(2 * patents.capacity(), patents.size() + batch.size()));
+        }
+        for (auto& patent : batch) {
+            patent.setFirmID(firmID);
+            patents.push_back(patent);
+        }
+        patentCount += static_cast<int>(batch.size());
+    }
+
     void removePatent(const std::string& patentID) override {
         for (size_t i = 0; i < patents.size(); ++i) {
             if (patents[i].getPatentID() == patentID) {
@@ -134,6 +224,62 @@ public:
         throw std::invalid_argument("Patent not found");
     }
 
+    // 数组只扫一遍，每个元素查一次要找的键
+    void lookupMany(const std::vector<std::string>& patentIDs, std::vector<const Patent*>& out) const override {
+        out.assign(patentIDs.size(), nullptr);
+        if (patentIDs.empty()) return;
+        KeySet wanted(patentIDs);
+        for (size_t j = 0; j < patents.size() && !wanted.done(); ++j) {
+            size_t i = wanted.take(patents[j].patentIDRef());
+            if (i != static_cast<size_t>(-1)) out[i] = &patents[j];
+        }
+        wanted.fillDuplicates(out);
+    }
+
+    void forEachPatent(const std::function<void(const Patent&)>& fn) const override {
+        for (const auto& patent : patents) {
+            fn(patent);
+        }
+    }
+
+    size_t patentSlots() const override {
+        return patents.size();
+    }
+
+    void forEachPatentInSlots(size_t begin, size_t end, const std::function<void(const Patent&)>& fn) const override {
+        for (size_t i = begin; i < end && i < patents.size(); ++i) {
+            fn(patents[i]);
+        }
+    }
+
+    // 留下较大的那块缓冲区，只把较小一边的专利移动（不是复制）过去
+    void absorb(IFirm& other) override {
+        FirmVector* from = dynamic_cast<FirmVector*>(&other);
+        if (!from) throw std::invalid_argument("Cannot merge firms of different types");
+        if (from == this) return;
+        if (from->patents.size() > patents.size()) patents.swap(from->patents);
+        patents.reserve(patents.size() + from->patents.size());
+        for (auto& patent : from->patents) {
+            patents.push_back(std::move(patent));
+        }
+        from->patents.clear();
+        for (auto& patent : patents) {
+            patent.setFirmID(firmID);
+        }
+        patentCount += from->patentCount;
+        from->patentCount = 0;
+    }
+
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats = firmHeaderStats(sizeof(*this), firmID, firmName);
+        stats.objectBytes += patents.size() * sizeof(Patent);
+        stats.spareCapacity += (patents.capacity() - patents.size()) * sizeof(Patent);
+        for (const auto& patent : patents) {
+            stats.stringPayload += patent.stringHeapBytes();
+        }
+        return stats;
+    }
+
     ~FirmVector() = default;
 };
 
@@ -142,7 +288,9 @@ private:
     std::string firmID;
     std::string firmName;
     int patentCount;
-    std::unordered_map<std::string, Patent> patents;
+    typedef std::unordered_map<std::string, Patent, std::hash<std::string>, std::equal_to<std::string>,
+                               TrackingAllocator<std::pair<const std::string, Patent>, PatentStorageTag>> PatentMap;
+    PatentMap patents;
 
 public:
     FirmUnorderedMap() : patentCount(0) {}
@@ -171,6 +319,16 @@ public:
         patentCount++;
     }
 
+    void addPatents(std::vector<Patent>& batch) override {
+        size_t needed = patents.size() + batch.size();
+        if (needed > patents.bucket_count() * patents.max_load_factor()) {
+            patents.reserve(std::max(2 * patents.size(), needed));
+        }
+        for (auto& patent : batch) {
+            addPatent(patent);
+        }
+    }
+
     void removePatent(const std::string& patentID) override {
         auto it = patents.find(patentID);
         if (it != patents.end()) {
@@ -189,6 +347,64 @@ public:
         throw std::invalid_argument("Patent not found");
     }
 
+    void lookupMany(const std::vector<std::string>& patentIDs, std::vector<const Patent*>& out) const override {
+        out.assign(patentIDs.size(), nullptr);
+        groupProbe(patents, patentIDs, [&](size_t i, const Patent* patent) {
+            out[i] = patent;
+        });
+    }
+
+    void forEachPatent(const std::function<void(const Patent&)>& fn) const override {
+        for (const auto& pair : patents) {
+            fn(pair.second);
+        }
+    }
+
+    // 按哈希桶切分，用桶内的局部迭代器遍历
+    size_t patentSlots() const override {
+        return patents.bucket_count();
+    }
+
+    void forEachPatentInSlots(size_t begin, size_t end, const std::function<void(const Patent&)>& fn) const override {
+        for (size_t b = begin; b < end && b < patents.bucket_count(); ++b) {
+            for (auto it = patents.begin(b); it != patents.end(b); ++it) {
+                fn(it->second);
+            }
+        }
+    }
+
+    // 留下较大的那张表，较小一边的专利移动过去（C++11 没有 extract，键和节点要重建）
+    // 两边有相同 patentID 时只保留一份（mergeFirms 会先拒绝这种合并）
+    void absorb(IFirm& other) override {
+        FirmUnorderedMap* from = dynamic_cast<FirmUnorderedMap*>(&other);
+        if (!from) throw std::invalid_argument("Cannot merge firms of different types");
+        if (from == this) return;
+        if (from->patents.size() > patents.size()) patents.swap(from->patents);
+        patents.reserve(patents.size() + from->patents.size());
+        for (auto& pair : from->patents) {
+            patents.emplace(pair.first, std::move(pair.second));
+        }
+        from->patents.clear();
+        for (auto& pair : patents) {
+            pair.second.setFirmID(firmID);
+        }
+        patentCount = static_cast<int>(patents.size());
+        from->patentCount = 0;
+    }
+
+    // libstdc++ 的哈希节点：next 指针 + 键值对 + 缓存的哈希值；键是 patentID 的第二份拷贝
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats = firmHeaderStats(sizeof(*this), firmID, firmName);
+        stats.objectBytes += patents.size() * sizeof(Patent);
+        stats.nodeOverhead += patents.size() * (sizeof(void*) + sizeof(std::string) + sizeof(size_t));
+        stats.containerBytes += patents.size() * sizeof(void*);
+        stats.spareCapacity += (patents.bucket_count() - std::min(patents.bucket_count(), patents.size())) * sizeof(void*);
+        for (const auto& pair : patents) {
+            stats.stringPayload += stringHeapBytes(pair.first) + pair.second.stringHeapBytes();
+        }
+        return stats;
+    }
+
     ~FirmUnorderedMap() = default;
 };
 
@@ -5,114 +5,459 @@
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
+#include <memory>
+#include <functional>
+#include <mutex>
 #include "firm.hpp"
+#include "btree_firm.hpp"
 #include "linked_list_template.hpp"
 #include "vector_template.hpp"
+#include "normalize.hpp"
+#include "cold_store.hpp"
+#include "title_codec.hpp"
+#include "work_stealing.hpp"
+
+// 企业/专利变更的监听接口，附加索引（历史、统计等）通过它保持同步
+class IFirmSystemObserver {
+public:
+    virtual void onFirmAdded(const std::string& firmID, const std::string& firmName) {}
+    virtual void onFirmRemoved(const IFirm& firm) {}
+    virtual void onPatentAdded(const std::string& firmID, const Patent& patent) {}
+    // patent 是删除前的专利内容，观察者不必为删除自己再按专利号记一份国家、年份等属性
+    virtual void onPatentRemoved(const std::string& firmID, const Patent& patent) {}
+    virtual void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) {}
+    // fromFirmID 的全部专利（patentIDs）并入了 intoFirmID；默认逐个按转让处理。随后还会收到 from 的 onFirmRemoved，那时它已经没有专利
+    virtual void onFirmsMerged(const std::string& intoFirmID, const std::string& fromFirmID,
+                               const std::vector<std::string>& patentIDs) {
+        for (const auto& patentID : patentIDs) onPatentTransferred(fromFirmID, intoFirmID, patentID);
+    }
+    virtual ~IFirmSystemObserver() {}
+};
 
 class IFirmSystem {
 public:
     virtual void addFirm(const std::string& firmID, const std::string& firmName) = 0;
     virtual void removeFirm(const std::string& firmID) = 0;
     virtual std::shared_ptr<IFirm> getFirm(const std::string& firmID) const = 0;
+    // 批量查找企业，out[i] 对应 firmIDs[i]，找不到为 nullptr（不输出提示）
+    virtual void lookupMany(const std::vector<std::string>& firmIDs, std::vector<std::shared_ptr<IFirm>>& out) const = 0;
+    // 批量按 (firmID, patentID) 查找专利，找不到为 nullptr；指针在对应企业被修改前有效
+    virtual void lookupMany(const std::vector<std::pair<std::string, std::string>>& keys,
+                            std::vector<const Patent*>& out) const = 0;
     virtual std::string cleanString(const std::string& input) = 0;
     virtual void loadFirms(const std::string& filename) = 0;
     virtual void loadPatentsFromCSV(const std::string& filename) = 0;
     virtual void addPatentFirm(const std::string& firmID, Patent& patent) = 0;
+    virtual void addPatentsFirm(const std::string& firmID, std::vector<Patent>& patents) = 0;
     virtual void removePatentFirm(const std::string& firmID, const std::string& patentID) = 0;
     virtual void transferPatent(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) = 0;
+    // 把 fromFirmID 的整个专利组合并入 intoFirmID 并删除 fromFirmID
+    virtual void mergeFirms(const std::string& intoFirmID, const std::string& fromFirmID) = 0;
     virtual void displayFirm(const std::string& firmID) const = 0;
     virtual void displayFirms() const = 0;
     virtual void displayFirmsID() const = 0;
+    virtual void forEachFirm(const std::function<void(const std::shared_ptr<IFirm>&)>& fn) const = 0;
+    // 在 threads 个工作线程上并行遍历（0 表示 defaultThreadCount()），fn 会被并发调用，
+    // 第二个参数是工作线程编号（小于线程数），可以用来索引按线程分开的累加器；遍历期间不能修改系统
+    virtual void parallelForEachFirm(const std::function<void(const std::shared_ptr<IFirm>&, size_t)>& fn,
+                                     size_t threads = 0) const = 0;
+    // 大企业会按容器的槽拆成多个任务，同一企业的专利可能同时在几个线程上处理
+    virtual void parallelForEachPatent(const std::function<void(const Patent&, size_t)>& fn, size_t threads = 0) const = 0;
+    virtual void addObserver(std::shared_ptr<IFirmSystemObserver> observer) = 0;
+    virtual MemoryStats memoryUsage() const = 0;
+    virtual const NormalizeReport& loadReport() const = 0;  // 最近一次 loadFirms / loadPatentsFromCSV 的清洗统计
+    // 之后的 loadPatentsFromCSV 把标题留在映射的文件里，用到时再解码；cacheEntries 为最近标题 LRU 的条数
+    virtual void setLazyTitles(bool lazy, size_t cacheEntries = 4096) = 0;
+    // 之后的 loadPatentsFromCSV 把标题压缩进共享符号表的标题块；和懒加载同时打开时以懒加载为准
+    virtual void setCompressedTitles(bool compressed) = 0;
     virtual ~IFirmSystem() {}
     // 可以加查找；按id；按title-关键词、tf-idf
 };
 
+// 只构造一次结果字符串，不再先复制再 erase
+inline std::string trimWhitespace(const std::string& input) {
+    size_t b = 0, e = input.size();
+    while (b < e && std::isspace(static_cast<unsigned char>(input[b]))) ++b;
+    while (e > b && std::isspace(static_cast<unsigned char>(input[e - 1]))) --e;
+    return input.substr(b, e - b);
+}
+
+// make_shared 的控制块（两个引用计数 + 虚表指针）
+const size_t kSharedControlBlockBytes = 2 * sizeof(int) + sizeof(void*);
+
 class BaseFirmSystem : public IFirmSystem {
-public:
+protected:
+    myVector<std::shared_ptr<IFirmSystemObserver>> observers;
+    NormalizeReport lastLoad;
+    bool lazyTitles = false;
+    size_t titleCacheEntries = 4096;
+    bool compressedTitles = false;
+    // 懒加载或压缩的专利标题引用这些存储，和系统同生命周期
+    std::vector<std::shared_ptr<ColdFieldSource>> titleStores;
+    // 并行遍历用的执行器，第一次用到时按线程数创建；换线程数时替换，正在用旧执行器的调用不受影响
+    mutable std::mutex executorMtx;
+    mutable std::shared_ptr<WorkStealingExecutor> executor;
+    // B+ 树企业共用的页文件和缓冲池，第一次建 B+ 树企业时按默认大小创建
+    std::shared_ptr<DiskStore> diskStore;
+    // 大页 arena 模式：批量插入的专利和容器存储、标题都从 arena 里切
+    std::shared_ptr<HugePageArena> arena;
+    std::shared_ptr<ArenaTitleStore> arenaTitles;
+    bool arenaMode = false;
+
+    // 一个任务大约处理这么多专利
+    static const size_t kParallelGrain = 2048;
+
+    void notifyFirmAdded(const std::string& firmID, const std::string& firmName) {
+        for (auto& o : observers) o->onFirmAdded(firmID, firmName);
+    }
 
-    std::string cleanString(const std::string& input) override {
-        std::string cleaned = input;
+    void notifyFirmRemoved(const IFirm& firm) {
+        for (auto& o : observers) o->onFirmRemoved(firm);
+    }
 
-        cleaned.erase(cleaned.begin(), std::find_if(cleaned.begin(), cleaned.end(), [](unsigned char c) {
-            return !std::isspace(c);
-        }));
+    void notifyPatentAdded(const std::string& firmID, const Patent& patent) {
+        for (auto& o : observers) o->onPatentAdded(firmID, patent);
+    }
 
-        cleaned.erase(std::find_if(cleaned.rbegin(), cleaned.rend(), [](unsigned char c) {
-            return !std::isspace(c);
-        }).base(), cleaned.end());
+    void notifyPatentRemoved(const std::string& firmID, const Patent& patent) {
+        for (auto& o : observers) o->onPatentRemoved(firmID, patent);
+    }
 
-        return cleaned;
+    void notifyPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) {
+        for (auto& o : observers) o->onPatentTransferred(fromFirmID, toFirmID, patentID);
     }
- 
-    void loadFirms(const std::string& filename) override {
-        
-        std::ifstream file(filename);
-        std::string line, firmID, firmName;
 
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open FirmData.csv" << std::endl;
-            file.close();
+    void notifyFirmsMerged(const std::string& intoFirmID, const std::string& fromFirmID, const std::vector<std::string>& patentIDs) {
+        for (auto& o : observers) o->onFirmsMerged(intoFirmID, fromFirmID, patentIDs);
+    }
+
+    // 删除前先复制出专利内容，删掉之后带着它通知观察者；没有观察者时直接删
+    void removePatentAndNotify(IFirm& firm, const std::string& firmID, const std::string& patentID) {
+        if (observers.size() == 0) {
+            firm.removePatent(patentID);
+            return;
         }
+        std::vector<const Patent*> found;
+        firm.lookupMany(std::vector<std::string>(1, patentID), found);
+        if (found[0] == nullptr) {
+            firm.removePatent(patentID);  // 由各实现输出自己的“找不到”信息
+            return;
+        }
+        Patent removed = *found[0];
+        int before = firm.getPatentCount();
+        firm.removePatent(patentID);
+        if (firm.getPatentCount() < before) notifyPatentRemoved(firmID, removed);
+    }
+
+    // 从容器里摘掉企业但不通知、不输出，找不到返回 nullptr
+    virtual std::shared_ptr<IFirm> detachFirm(const std::string& firmID) = 0;
+
+    // 逐个企业统计要遍历全部专利，并行做，每个线程一份小计
+    MemoryStats firmsMemoryUsage() const {
+        size_t threads = defaultThreadCount();
+        std::vector<MemoryStats> partial(threads);
+        parallelForEachFirm([&](const std::shared_ptr<IFirm>& firm, size_t worker) {
+            partial[worker] += firm->memoryUsage();
+        }, threads);
+        MemoryStats stats;
+        for (const auto& p : partial) stats += p;
+        return stats;
+    }
+
+    std::shared_ptr<DiskStore> diskStoreFor() {
+        if (!diskStore) diskStore = std::make_shared<DiskStore>();
+        return diskStore;
+    }
+
+    size_t diskStoreBytes() const {
+        return diskStore ? diskStore->memoryUsage() : 0;
+    }
 
-        getline(file, line);
-        
-        while (getline(file, line)) {
-            std::stringstream ss(line);
-            getline(ss, firmID, ',');
-            getline(ss, firmName, ',');
+    // arena 里映射了但没切出去的部分，加上容器释放掉、要等整体回收的部分
+    size_t arenaSpareBytes() const {
+        if (!arena) return 0;
+        HugePageArena::Stats s = arena->stats();
+        return s.reserved - s.used + s.released;
+    }
 
-            firmName = cleanString(firmName);
-            firmID = cleanString(firmID);
+    size_t titleStoreBytes() const {
+        size_t bytes = 0;
+        for (const auto& store : titleStores) bytes += store->memoryUsage();
+        return bytes;
+    }
 
-            addFirm(firmID, firmName);
+    // 懒加载：直接在映射的文件上清洗，专利只记行位置；标题照常清洗计数，只是不保留
+    bool normalizeMappedPatents(const std::string& filename, std::vector<Patent>& patents) {
+        std::shared_ptr<MappedTitleStore> store = MappedTitleStore::open(filename, titleCacheEntries);
+        if (!store) {
+            return false;
         }
+        const MappedTitleStore* source = store.get();
+        patents = normalizeLines<Patent>(store->begin(), store->size(), defaultThreadCount(),
+            [source](const char* line, size_t len, Patent& out, NormalizeReport& report) {
+                bool cold = len <= MappedTitleStore::kMaxLine;
+                if (!normalizePatentRow(line, len, out, report, !cold)) return false;
+                if (cold) out.setColdTitle(source, source->refOf(line, len));
+                return true;
+            }, lastLoad);
+        store->adviseRandomAccess();
+        titleStores.push_back(store);
+        return true;
+    }
+
+    std::shared_ptr<WorkStealingExecutor> executorFor(size_t threads) const {
+        if (threads == 0) threads = defaultThreadCount();
+        std::lock_guard<std::mutex> lock(executorMtx);
+        if (!executor || executor->size() != threads) executor = std::make_shared<WorkStealingExecutor>(threads);
+        return executor;
+    }
 
-        file.close();
+    // 企业列表和按专利数（每个企业至少算 1）的权重前缀和
+    void weighFirms(std::vector<std::shared_ptr<IFirm>>& firms, std::vector<size_t>& prefix) const {
+        forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firms.push_back(firm);
+        });
+        prefix.assign(1, 0);
+        prefix.reserve(firms.size() + 1);
+        for (const auto& firm : firms) prefix.push_back(prefix.back() + static_cast<size_t>(firm->getPatentCount()) + 1);
+    }
+
+public:
+
+    ~BaseFirmSystem() {
+        if (arena) arena->retire();
+    }
+
+    using IFirmSystem::lookupMany;
+
+    // 先批量找出涉及的企业，再按企业分组，每个企业一次 lookupMany
+    void lookupMany(const std::vector<std::pair<std::string, std::string>>& keys,
+                    std::vector<const Patent*>& out) const override {
+        out.assign(keys.size(), nullptr);
+        std::vector<std::string> firmIDs;
+        std::unordered_map<std::string, size_t> group;  // firmID -> 组号
+        std::vector<size_t> groupOf(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto inserted = group.insert(std::make_pair(keys[i].first, firmIDs.size()));
+            if (inserted.second) firmIDs.push_back(keys[i].first);
+            groupOf[i] = inserted.first->second;
+        }
+        std::vector<std::shared_ptr<IFirm>> firms;
+        lookupMany(firmIDs, firms);
+        // 计数排序：members[start[g], start[g + 1]) 是第 g 组的键下标
+        std::vector<size_t> start(firmIDs.size() + 1, 0);
+        for (size_t g : groupOf) start[g + 1]++;
+        for (size_t g = 0; g < firmIDs.size(); ++g) start[g + 1] += start[g];
+        std::vector<size_t> members(keys.size());
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < keys.size(); ++i) members[fill[groupOf[i]]++] = i;
+        std::vector<std::string> patentIDs;
+        std::vector<const Patent*> found;
+        for (size_t g = 0; g < firmIDs.size(); ++g) {
+            if (!firms[g]) continue;
+            patentIDs.clear();
+            for (size_t k = start[g]; k < start[g + 1]; ++k) patentIDs.push_back(keys[members[k]].second);
+            firms[g]->lookupMany(patentIDs, found);
+            for (size_t k = start[g]; k < start[g + 1]; ++k) out[members[k]] = found[k - start[g]];
+        }
+    }
+
+    // 专利由 IFirm::absorb 整体移交。两边有相同 patentID 时拒绝合并：absorb 只会留下一份，
+    // 而观察者收到的是全部 patentID，看板、摘要和历史的计数会多出重复的那几件
+    void mergeFirms(const std::string& intoFirmID, const std::string& fromFirmID) override {
+        if (intoFirmID == fromFirmID) {
+            std::cerr << "Error: Cannot merge a firm into itself." << std::endl;
+            return;
+        }
+        std::shared_ptr<IFirm> into = getFirm(intoFirmID);
+        std::shared_ptr<IFirm> from = getFirm(fromFirmID);
+        if (!into || !from) {
+            std::cerr << "Error: One or both firms not found." << std::endl;
+            return;
+        }
+        std::vector<std::string> moved;
+        moved.reserve(static_cast<size_t>(from->getPatentCount()));
+        from->forEachPatent([&](const Patent& p) {
+            moved.push_back(p.getPatentID());
+        });
+        std::vector<const Patent*> shared;
+        into->lookupMany(moved, shared);
+        for (size_t i = 0; i < shared.size(); ++i) {
+            if (shared[i]) {
+                std::cerr << "Error: Both firms hold patent " << moved[i] << "; cannot merge." << std::endl;
+                return;
+            }
+        }
+        into->absorb(*from);
+        notifyFirmsMerged(intoFirmID, fromFirmID, moved);
+        detachFirm(fromFirmID);
+        notifyFirmRemoved(*from);
+    }
+
+    // 企业是最小单位：按权重二分后，专利特别多的企业各自成为一个任务，被空闲线程偷走
+    void parallelForEachFirm(const std::function<void(const std::shared_ptr<IFirm>&, size_t)>& fn,
+                             size_t threads = 0) const override {
+        std::vector<std::shared_ptr<IFirm>> firms;
+        std::vector<size_t> prefix;
+        weighFirms(firms, prefix);
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        parallelForWeighted(*ex, prefix, kParallelGrain, [&](size_t i, size_t worker) {
+            fn(firms[i], worker);
+        });
+    }
+
+    // 在企业粒度之上再把大企业按槽（数组下标、哈希桶）二分，每段大约 kParallelGrain 个专利
+    void parallelForEachPatent(const std::function<void(const Patent&, size_t)>& fn, size_t threads = 0) const override {
+        std::vector<std::shared_ptr<IFirm>> firms;
+        std::vector<size_t> prefix;
+        weighFirms(firms, prefix);
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        WorkStealingExecutor* exec = ex.get();
+        parallelForWeighted(*ex, prefix, kParallelGrain, [&](size_t i, size_t worker) {
+            const IFirm* firm = firms[i].get();
+            size_t count = static_cast<size_t>(firm->getPatentCount());
+            size_t slots = firm->patentSlots();
+            if (count <= kParallelGrain || slots <= 1) {
+                firm->forEachPatent([&](const Patent& p) { fn(p, worker); });
+                return;
+            }
+            const std::function<void(const Patent&, size_t)>* visit = &fn;
+            splitRange(*exec, 0, slots, std::max<size_t>(1, slots * kParallelGrain / count),
+                [firm, visit](size_t b, size_t e, size_t w) {
+                    firm->forEachPatentInSlots(b, e, [&](const Patent& p) { (*visit)(p, w); });
+                }, worker);
+        });
+    }
+
+    void addObserver(std::shared_ptr<IFirmSystemObserver> observer) override {
+        observers.push_back(observer);
+    }
+
+    std::string cleanString(const std::string& input) override {
+        return trimWhitespace(input);
+    }
+ 
+    // 整个文件读入内存，按行分块并行清洗，再按原始顺序插入
+    void loadFirms(const std::string& filename) override {
+        std::string text;
+        lastLoad = NormalizeReport();
+        if (!readWholeFile(filename, text)) {
+            std::cerr << "Error: Could not open FirmData.csv" << std::endl;
+            return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> firms =
+            normalizeLines<std::pair<std::string, std::string>>(text, defaultThreadCount(), normalizeFirmLine, lastLoad);
+        for (const auto& firm : firms) {
+            addFirm(firm.first, firm.second);
+        }
     }
-    
+
+    // 清洗后的专利按企业分组，每个企业只查找一次、批量插入
     void loadPatentsFromCSV(const std::string& filename) override {
-        std::ifstream file(filename);
-        std::string line, patentID, grantdate, appldate, patent_title, country, firmID;
-
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open PatentData.csv" << std::endl;
-            file.close();
-        }
-
-        getline(file, line);
-        while (getline(file, line)) {
-            std::stringstream ss(line);
-            std::getline(ss, patentID, ',');
-            std::getline(ss, grantdate, ',');
-            std::getline(ss, appldate, ',');
-
-            if (line.find('"') != std::string::npos) {
-                getline(ss, patent_title, '"');
-                getline(ss, patent_title, '"');
-                ss.ignore();
-            } else {
-                getline(ss, patent_title, ',');
+        std::vector<Patent> patents;
+        lastLoad = NormalizeReport();
+        if (lazyTitles) {
+            if (!normalizeMappedPatents(filename, patents)) {
+                std::cerr << "Error: Could not open PatentData.csv" << std::endl;
+                return;
+            }
+        } else {
+            std::string text;
+            if (!readWholeFile(filename, text)) {
+                std::cerr << "Error: Could not open PatentData.csv" << std::endl;
+                return;
             }
+            patents = normalizeLines<Patent>(text, defaultThreadCount(), normalizePatentLine, lastLoad);
+            if (compressedTitles) {
+                std::shared_ptr<CompressedTitleStore> store = std::make_shared<CompressedTitleStore>();
+                store->compressTitles(patents, defaultThreadCount());
+                titleStores.push_back(store);
+            }
+        }
+        std::vector<std::string> order;
+        std::unordered_map<std::string, std::vector<Patent>> byFirm;
+        for (auto& p : patents) {
+            std::vector<Patent>& group = byFirm[p.getFirmID()];
+            if (group.empty()) order.push_back(p.getFirmID());
+            group.push_back(std::move(p));
+        }
+        std::unordered_set<std::string> known;
+        forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            known.insert(firm->getFirmID());
+        });
+        for (const auto& firmID : order) {
+            std::vector<Patent>& group = byFirm[firmID];
+            if (known.count(firmID) == 0) {
+                // 行本身合法，但企业不存在；和原来的逐行插入一样丢弃，单独计数
+                lastLoad.unknownFirm += group.size();
+                continue;
+            }
+            addPatentsFirm(firmID, group);
+        }
+    }
 
-            getline(ss, country, ',');
-            getline(ss, firmID, ',');
+    const NormalizeReport& loadReport() const override {
+        return lastLoad;
+    }
 
-            firmID = cleanString(firmID);
-            Patent p(patentID, grantdate, appldate, patent_title, country, firmID);
-            addPatentFirm(firmID, p);
+    void setLazyTitles(bool lazy, size_t cacheEntries = 4096) override {
+        lazyTitles = lazy;
+        titleCacheEntries = cacheEntries;
+    }
+
+    void setCompressedTitles(bool compressed) override {
+        compressedTitles = compressed;
+    }
+
+    // 换用指定的页文件和缓冲池（大小、目录），只影响之后新建的 B+ 树企业
+    void setDiskStore(std::shared_ptr<DiskStore> store) {
+        diskStore = std::move(store);
+    }
+
+    // 打开后批量插入走大页 arena，chunkBytes 为每块区域的大小；关掉只影响之后的插入，已在 arena 里的数据跟系统一起释放
+    void setHugePageArena(bool enabled, size_t chunkBytes = 64 * 1024 * 1024) {
+        arenaMode = enabled;
+        if (enabled && !arena) {
+            arena = HugePageArena::create(chunkBytes);
+            arenaTitles = std::make_shared<ArenaTitleStore>(arena);
+            titleStores.push_back(arenaTitles);
         }
+    }
 
-        file.close();
+    std::shared_ptr<HugePageArena> hugePageArena() const {
+        return arena;
+    }
+
+    // 批量插入：只查找一次企业，容器可以一次性预留空间
+    void addPatentsFirm(const std::string& firmID, std::vector<Patent>& patents) override {
+        auto firm = getFirm(firmID);
+        if (!firm) {
+            return;
+        }
+        if (arenaMode) {
+            for (auto& p : patents) arenaTitles->adopt(p);
+            ArenaScope scope(arena.get());
+            firm->addPatents(patents);
+        } else {
+            firm->addPatents(patents);
+        }
+        for (const auto& p : patents) {
+            notifyPatentAdded(firmID, p);
+        }
     }
 
     void displayFirm(const std::string& firmID) const override {
         auto firm = getFirm(firmID);
         if (firm) {
-            std::cout << "Firm ID: " << firm->getFirmID() << ", Firm Name: " << firm->getFirmName() << std::endl;
-            std::cout << "Number of Patents: " << firm->getPatentCount() << std::endl;
+            std::string header = "Firm ID: " + firm->getFirmID() + ", Firm Name: " + firm->getFirmName() + "\nNumber of Patents: ";
+            appendSigned(header, firm->getPatentCount());
+            header.push_back('\n');
+            std::cout << header;
             firm->displayPatents();
-            std::cout << "-----------------------------------" << std::endl;
+            std::cout << "-----------------------------------\n";
         }
     }
 
@@ -120,7 +465,7 @@ public:
 
 class FirmSystemVector : public BaseFirmSystem {
 private:
-    myVector<std::shared_ptr<IFirm>> fs;
+    myVector<std::shared_ptr<IFirm>, TrackingAllocator<std::shared_ptr<IFirm>, FirmStorageTag>> fs;
     FirmType firmType;
 public:
     FirmSystemVector(FirmType type) : firmType(type) {}
@@ -137,16 +482,30 @@ public:
             case FirmType::UnorderedMap:
                 firm = std::make_shared<FirmUnorderedMap>(firmID, firmName);
                 break;
+            case FirmType::BTree:
+                firm = std::make_shared<FirmBTree>(firmID, firmName, diskStoreFor());
+                break;
         }
         fs.push_back(firm);
+        notifyFirmAdded(firmID, firmName);
     }
 
-    void removeFirm(const std::string& firmID) override {
+    std::shared_ptr<IFirm> detachFirm(const std::string& firmID) override {
         auto it = std::find_if(fs.begin(), fs.end(), [&](const std::shared_ptr<IFirm>& f) {
             return f->getFirmID() == firmID;
         });
-        if (it != fs.end()) {
-            fs.remove_at(it - fs.begin());
+        if (it == fs.end()) {
+            return nullptr;
+        }
+        std::shared_ptr<IFirm> removed = *it;
+        fs.remove_at(it - fs.begin());
+        return removed;
+    }
+
+    void removeFirm(const std::string& firmID) override {
+        std::shared_ptr<IFirm> removed = detachFirm(firmID);
+        if (removed) {
+            notifyFirmRemoved(*removed);
             std::cout << "Firm removed successfully." << std::endl;
         } else {
             std::cerr << "Firm not found." << std::endl;
@@ -159,6 +518,7 @@ public:
         });
         if (it != fs.end()) {
             (*it)->addPatent(patent);
+            notifyPatentAdded(firmID, patent);
         }
     }
 
@@ -167,7 +527,7 @@ public:
             return f->getFirmID() == firmID;
         });
         if (it != fs.end()) {
-            (*it)->removePatent(patentID);
+            removePatentAndNotify(**it, firmID, patentID);
         }
     }
 
@@ -185,8 +545,13 @@ public:
 
         if (fromFirm && toFirm) {
             Patent p = fromFirm->getPatent(patentID);
+            if (p.getPatentID().empty()) {
+                std::cerr << "Error: Patent not found." << std::endl;
+                return;
+            }
             toFirm->addPatent(p);
             fromFirm->removePatent(patentID);
+            notifyPatentTransferred(fromFirmID, toFirmID, patentID);
         } else {
             std::cerr << "Error: One or both firms not found." << std::endl;
         }
@@ -203,6 +568,20 @@ public:
         return nullptr;
     }
 
+    using BaseFirmSystem::lookupMany;
+
+    // 企业数组只扫一遍
+    void lookupMany(const std::vector<std::string>& firmIDs, std::vector<std::shared_ptr<IFirm>>& out) const override {
+        out.assign(firmIDs.size(), nullptr);
+        if (firmIDs.empty()) return;
+        KeySet wanted(firmIDs);
+        for (size_t j = 0; j < fs.size() && !wanted.done(); ++j) {
+            size_t i = wanted.take(fs[j]->getFirmID());
+            if (i != static_cast<size_t>(-1)) out[i] = fs[j];
+        }
+        wanted.fillDuplicates(out);
+    }
+
     void displayFirmsID() const override {
         if (fs.size() == 0) {
             std::cout << "No firms available." << std::endl;
@@ -225,12 +604,32 @@ public:
         for (const auto& firm : fs) {
             displayFirm(firm->getFirmID());
         }
+        std::cout.flush();
+    }
+
+    void forEachFirm(const std::function<void(const std::shared_ptr<IFirm>&)>& fn) const override {
+        for (const auto& firm : fs) {
+            fn(firm);
+        }
+    }
+
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats;
+        stats.containerBytes += fs.size() * sizeof(std::shared_ptr<IFirm>);
+        stats.spareCapacity += (fs.capacity() - fs.size()) * sizeof(std::shared_ptr<IFirm>);
+        stats.nodeOverhead += fs.size() * kSharedControlBlockBytes;
+        stats += firmsMemoryUsage();
+        stats.stringPayload += titleStoreBytes();
+        stats.containerBytes += diskStoreBytes();
+        stats.spareCapacity += arenaSpareBytes();
+        return stats;
     }
 };
 
 class FirmSystemUnorderedMap : public BaseFirmSystem {
 private:
-    std::unordered_map<std::string, std::shared_ptr<IFirm>> fs;
+    std::unordered_map<std::string, std::shared_ptr<IFirm>, std::hash<std::string>, std::equal_to<std::string>,
+                       TrackingAllocator<std::pair<const std::string, std::shared_ptr<IFirm>>, FirmStorageTag>> fs;
     FirmType firmType;
 public:
     FirmSystemUnorderedMap(FirmType type) : firmType(type) {}
@@ -247,14 +646,28 @@ public:
             case FirmType::UnorderedMap:
                 firm = std::make_shared<FirmUnorderedMap>(firmID, firmName);
                 break;
+            case FirmType::BTree:
+                firm = std::make_shared<FirmBTree>(firmID, firmName, diskStoreFor());
+                break;
         }
         fs[firmID] = firm;
+        notifyFirmAdded(firmID, firmName);
     }
 
-    void removeFirm(const std::string& firmID) override {
+    std::shared_ptr<IFirm> detachFirm(const std::string& firmID) override {
         auto it = fs.find(firmID);
-        if (it != fs.end()) {
-            fs.erase(it);
+        if (it == fs.end()) {
+            return nullptr;
+        }
+        std::shared_ptr<IFirm> removed = it->second;
+        fs.erase(it);
+        return removed;
+    }
+
+    void removeFirm(const std::string& firmID) override {
+        std::shared_ptr<IFirm> removed = detachFirm(firmID);
+        if (removed) {
+            notifyFirmRemoved(*removed);
             std::cout << "Firm removed successfully." << std::endl;
         } else {
             std::cerr << "Firm not found." << std::endl;
@@ -265,6 +678,7 @@ public:
         auto it = fs.find(firmID);
         if (it != fs.end()) {
             it->second->addPatent(patent);
+            notifyPatentAdded(firmID, patent);
         } else {
             std::cerr << "Firm not found." << std::endl;
         }
@@ -273,7 +687,7 @@ public:
     void removePatentFirm(const std::string& firmID, const std::string& patentID) override {
         auto it = fs.find(firmID);
         if (it != fs.end()) {
-            it->second->removePatent(patentID);
+            removePatentAndNotify(*it->second, firmID, patentID);
         } else {
             std::cerr << "Firm not found." << std::endl;
         }
@@ -285,8 +699,13 @@ public:
 
         if (fromIt != fs.end() && toIt != fs.end()) {
             Patent p = fromIt->second->getPatent(patentID);
+            if (p.getPatentID().empty()) {
+                std::cerr << "Error: Patent not found." << std::endl;
+                return;
+            }
             toIt->second->addPatent(p);
             fromIt->second->removePatent(patentID);
+            notifyPatentTransferred(fromFirmID, toFirmID, patentID);
         } else {
             std::cerr << "Error: One or both firms not found." << std::endl;
         }
@@ -301,21 +720,30 @@ public:
         return nullptr;
     }
 
+    using BaseFirmSystem::lookupMany;
+
+    // 找到的企业顺便预取对象本身，调用方接下来多半要用它
+    void lookupMany(const std::vector<std::string>& firmIDs, std::vector<std::shared_ptr<IFirm>>& out) const override {
+        out.assign(firmIDs.size(), nullptr);
+        groupProbe(fs, firmIDs, [&](size_t i, const std::shared_ptr<IFirm>* firm) {
+            if (firm) {
+                prefetchRead(firm->get());
+                out[i] = *firm;
+            }
+        });
+    }
+
     void displayFirmsID() const override {
-        if (fs.empty() == 0) {
+        if (fs.empty()) {
             std::cout << "No firms available." << std::endl;
             return;
         }
 
         for (const auto& pair : fs) {
             std::cout << pair.second->getFirmName() << "  ";
+            std::cout << pair.first << "\n";
         }
         std::cout << std::endl;
-        for (const auto& pair : fs) {
-            std::cout << pair.first << "  ";
-        }
-        std::cout << std::endl;
-
     }
 
     void displayFirms() const override {
@@ -327,6 +755,28 @@ public:
         for (const auto& pair : fs) {
             displayFirm(pair.first);
         }
+        std::cout.flush();
+    }
+
+    void forEachFirm(const std::function<void(const std::shared_ptr<IFirm>&)>& fn) const override {
+        for (const auto& pair : fs) {
+            fn(pair.second);
+        }
+    }
+
+    MemoryStats memoryUsage() const override {
+        MemoryStats stats;
+        stats.containerBytes += fs.size() * (sizeof(void*) + sizeof(std::shared_ptr<IFirm>));
+        stats.spareCapacity += (fs.bucket_count() - std::min(fs.bucket_count(), fs.size())) * sizeof(void*);
+        for (const auto& pair : fs) {
+            stats.nodeOverhead += kSharedControlBlockBytes + sizeof(void*) + sizeof(std::string) + sizeof(size_t);
+            stats.stringPayload += stringHeapBytes(pair.first);
+        }
+        stats += firmsMemoryUsage();
+        stats.stringPayload += titleStoreBytes();
+        stats.containerBytes += diskStoreBytes();
+        stats.spareCapacity += arenaSpareBytes();
+        return stats;
     }
 };
 
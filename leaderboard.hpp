@@ -0,0 +1,398 @@
+#ifndef LEADERBOARD_HPP
+#define LEADERBOARD_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <memory>
+#include <new>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 带跨度（span）的跳表，支持按名次访问：插入、删除、求名次、取第 r 名都是期望 O(log n)
+// 每条前向指针记录它跨过了多少个节点，从头节点一路累加就是名次
+template <typename Key, typename Less>
+class IndexedSkipList {
+private:
+    enum { kMaxLevel = 32 };
+
+    struct Node;
+
+    struct Link {
+        Node* next;
+        size_t span;
+    };
+
+    // 前向指针数组和节点放在同一块内存里（变长结构），沿链表走时每个节点只有一次缓存未命中
+    struct Node {
+        Key key;
+        int level;
+        Link links[1];
+    };
+
+    static Node* createNode(const Key& key, int level) {
+        void* mem = ::operator new(sizeof(Node) + static_cast<size_t>(level - 1) * sizeof(Link));
+        Node* node = static_cast<Node*>(mem);
+        new (&node->key) Key(key);
+        node->level = level;
+        for (int i = 0; i < level; ++i) {
+            node->links[i].next = nullptr;
+            node->links[i].span = 0;
+        }
+        return node;
+    }
+
+    static void destroyNode(Node* node) {
+        node->key.~Key();
+        ::operator delete(node);
+    }
+
+    Node* head;
+    int level;
+    size_t length;
+    Less less;
+    std::mt19937 rng;
+
+    int randomLevel() {
+        int lvl = 1;
+        while (lvl < kMaxLevel && (rng() & 3) == 0) ++lvl;  // p = 1/4
+        return lvl;
+    }
+
+    bool equal(const Key& a, const Key& b) const {
+        return !less(a, b) && !less(b, a);
+    }
+
+    // 按 node->key 找到位置挂入，node 的层数已定
+    void link(Node* node) {
+        const Key& key = node->key;
+        Node* update[kMaxLevel];
+        size_t rankAt[kMaxLevel];
+        Node* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            rankAt[i] = i == level - 1 ? 0 : rankAt[i + 1];
+            while (x->links[i].next && less(x->links[i].next->key, key)) {
+                rankAt[i] += x->links[i].span;
+                x = x->links[i].next;
+            }
+            update[i] = x;
+        }
+
+        int lvl = node->level;
+        if (lvl > level) {
+            for (int i = level; i < lvl; ++i) {
+                rankAt[i] = 0;
+                update[i] = head;
+                head->links[i].span = length;
+            }
+            level = lvl;
+        }
+
+        for (int i = 0; i < lvl; ++i) {
+            node->links[i].next = update[i]->links[i].next;
+            update[i]->links[i].next = node;
+            node->links[i].span = update[i]->links[i].span - (rankAt[0] - rankAt[i]);
+            update[i]->links[i].span = rankAt[0] - rankAt[i] + 1;
+        }
+        for (int i = lvl; i < level; ++i) {
+            update[i]->links[i].span++;
+        }
+        length++;
+    }
+
+    // 找到等于 key 的节点并摘下（不释放），没有返回 nullptr
+    Node* unlink(const Key& key) {
+        Node* update[kMaxLevel];
+        Node* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->links[i].next && less(x->links[i].next->key, key)) {
+                x = x->links[i].next;
+            }
+            update[i] = x;
+        }
+        x = x->links[0].next;
+        if (!x || !equal(x->key, key)) {
+            return nullptr;
+        }
+        for (int i = 0; i < level; ++i) {
+            if (update[i]->links[i].next == x) {
+                update[i]->links[i].span += x->links[i].span - 1;
+                update[i]->links[i].next = x->links[i].next;
+            } else {
+                update[i]->links[i].span--;
+            }
+        }
+        while (level > 1 && head->links[level - 1].next == nullptr) {
+            level--;
+        }
+        length--;
+        return x;
+    }
+
+public:
+    IndexedSkipList() : head(createNode(Key(), kMaxLevel)), level(1), length(0), rng(12345) {}
+
+    IndexedSkipList(const IndexedSkipList&) = delete;
+    IndexedSkipList& operator=(const IndexedSkipList&) = delete;
+
+    ~IndexedSkipList() {
+        Node* x = head;
+        while (x) {
+            Node* next = x->links[0].next;
+            destroyNode(x);
+            x = next;
+        }
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    void insert(const Key& key) {
+        link(createNode(key, randomLevel()));
+    }
+
+    bool erase(const Key& key) {
+        Node* x = unlink(key);
+        if (!x) return false;
+        destroyNode(x);
+        return true;
+    }
+
+    // 把 from 改成 to：节点摘下来改完键再挂回去，沿用原来的层数，省掉一次释放和分配
+    bool reposition(const Key& from, const Key& to) {
+        Node* x = unlink(from);
+        if (!x) return false;
+        x->key = to;
+        link(x);
+        return true;
+    }
+
+    // 从 1 开始的名次，不存在时返回 0
+    size_t rank(const Key& key) const {
+        size_t r = 0;
+        Node* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->links[i].next && !less(key, x->links[i].next->key)) {
+                r += x->links[i].span;
+                x = x->links[i].next;
+            }
+            if (x != head && equal(x->key, key)) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    // 从第 first 名（从 1 开始）起按顺序取最多 count 个
+    std::vector<Key> range(size_t first, size_t count) const {
+        std::vector<Key> out;
+        if (first == 0 || first > length) return out;
+        size_t traversed = 0;
+        Node* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->links[i].next && traversed + x->links[i].span <= first) {
+                traversed += x->links[i].span;
+                x = x->links[i].next;
+            }
+            if (traversed == first) break;
+        }
+        while (x && out.size() < count) {
+            out.push_back(x->key);
+            x = x->links[0].next;
+        }
+        return out;
+    }
+};
+
+// 企业专利数量排行榜：总榜、按国家、按授权年份，作为观察者随增删/转让增量更新
+// 每次变化只把企业的跳表节点摘下、改数量后重新挂入，O(log n)，查询 top-k 和名次都不需要重新排序
+class Leaderboard : public IFirmSystemObserver {
+public:
+    enum class Scope {
+        Overall,
+        Country,
+        GrantYear
+    };
+
+    struct Entry {
+        std::string firmID;
+        uint32_t count;
+        size_t rank;
+    };
+
+private:
+    struct RankKey {
+        uint32_t count;
+        std::string firmID;
+    };
+
+    // 数量多的在前，数量相同按 firmID 排
+    struct ByCountDesc {
+        bool operator()(const RankKey& a, const RankKey& b) const {
+            if (a.count != b.count) return a.count > b.count;
+            return a.firmID < b.firmID;
+        }
+    };
+
+    struct Board {
+        std::unordered_map<std::string, uint32_t> counts;
+        IndexedSkipList<RankKey, ByCountDesc> ranking;
+    };
+
+    // 每个专利只记国家编号和年份，删除/转让时据此找到对应的榜单
+    struct PatentTag {
+        uint16_t country;
+        uint16_t year;
+    };
+
+    Board overall;
+    std::unordered_map<std::string, std::unique_ptr<Board>> byCountry;
+    std::unordered_map<uint16_t, std::unique_ptr<Board>> byYear;
+    std::unordered_map<std::string, uint16_t> countryIndex;
+    std::vector<std::string> countries;
+    std::unordered_map<std::string, PatentTag> patents;
+
+    static void adjust(Board& board, const std::string& firmID, int delta, bool keepZero) {
+        auto it = board.counts.find(firmID);
+        if (it == board.counts.end()) {
+            if (delta <= 0 && !keepZero) return;
+            uint32_t initial = static_cast<uint32_t>(delta < 0 ? 0 : delta);
+            board.counts.emplace(firmID, initial);
+            board.ranking.insert(RankKey{initial, firmID});
+            return;
+        }
+        uint32_t old = it->second;
+        uint32_t updated = static_cast<uint32_t>(static_cast<int64_t>(old) + delta < 0 ? 0 : static_cast<int64_t>(old) + delta);
+        if (updated == 0 && !keepZero) {
+            board.ranking.erase(RankKey{old, firmID});
+            board.counts.erase(it);
+            return;
+        }
+        if (updated != old) {
+            board.ranking.reposition(RankKey{old, firmID}, RankKey{updated, firmID});
+            it->second = updated;
+        }
+    }
+
+    static uint16_t yearOf(const std::string& grantdate) {
+        if (grantdate.size() < 4) return 0;
+        uint16_t year = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            char c = grantdate[i];
+            if (c < '0' || c > '9') return 0;
+            year = static_cast<uint16_t>(year * 10 + (c - '0'));
+        }
+        return year;
+    }
+
+    uint16_t countryOf(const std::string& country) {
+        auto it = countryIndex.find(country);
+        if (it != countryIndex.end()) return it->second;
+        uint16_t id = static_cast<uint16_t>(countries.size());
+        countries.push_back(country);
+        countryIndex[country] = id;
+        return id;
+    }
+
+    template <typename K>
+    static Board& boardFor(std::unordered_map<K, std::unique_ptr<Board>>& boards, const K& key) {
+        std::unique_ptr<Board>& board = boards[key];
+        if (!board) board.reset(new Board());
+        return *board;
+    }
+
+    void apply(const std::string& firmID, const PatentTag& tag, int delta) {
+        adjust(overall, firmID, delta, true);
+        adjust(boardFor(byCountry, countries[tag.country]), firmID, delta, false);
+        adjust(boardFor(byYear, tag.year), firmID, delta, false);
+    }
+
+    const Board* find(Scope scope, const std::string& key) const {
+        if (scope == Scope::Overall) return &overall;
+        if (scope == Scope::Country) {
+            auto it = byCountry.find(key);
+            return it == byCountry.end() ? nullptr : it->second.get();
+        }
+        auto it = byYear.find(yearOf(key));
+        return it == byYear.end() ? nullptr : it->second.get();
+    }
+
+public:
+    void onFirmAdded(const std::string& firmID, const std::string&) override {
+        if (overall.counts.find(firmID) == overall.counts.end()) {
+            adjust(overall, firmID, 0, true);
+        }
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        firm.forEachPatent([&](const Patent& p) {
+            auto it = patents.find(p.getPatentID());
+            if (it != patents.end()) {
+                apply(firm.getFirmID(), it->second, -1);
+                patents.erase(it);
+            }
+        });
+        auto it = overall.counts.find(firm.getFirmID());
+        if (it != overall.counts.end()) {
+            overall.ranking.erase(RankKey{it->second, it->first});
+            overall.counts.erase(it);
+        }
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        PatentTag tag{countryOf(patent.getCountry()), yearOf(patent.getGrantdate())};
+        patents[patent.getPatentID()] = tag;
+        apply(firmID, tag, 1);
+    }
+
+    void onPatentRemoved(const std::string& firmID, const Patent& patent) override {
+        auto it = patents.find(patent.patentIDRef());
+        if (it == patents.end()) return;
+        apply(firmID, it->second, -1);
+        patents.erase(it);
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        auto it = patents.find(patentID);
+        if (it == patents.end()) return;
+        apply(fromFirmID, it->second, -1);
+        apply(toFirmID, it->second, 1);
+    }
+
+    // key：Country 时为国家代码，GrantYear 时为年份（如 "2015"），Overall 时忽略
+    std::vector<Entry> top(Scope scope, const std::string& key, size_t k) const {
+        std::vector<Entry> result;
+        const Board* board = find(scope, key);
+        if (!board) return result;
+        size_t rank = 1;
+        for (const auto& rk : board->ranking.range(1, k)) {
+            result.push_back(Entry{rk.firmID, rk.count, rank++});
+        }
+        return result;
+    }
+
+    // 企业在榜单中的名次（从 1 开始），不在榜上返回 0
+    size_t rankOf(Scope scope, const std::string& key, const std::string& firmID) const {
+        const Board* board = find(scope, key);
+        if (!board) return 0;
+        auto it = board->counts.find(firmID);
+        if (it == board->counts.end()) return 0;
+        return board->ranking.rank(RankKey{it->second, firmID});
+    }
+
+    uint32_t countOf(Scope scope, const std::string& key, const std::string& firmID) const {
+        const Board* board = find(scope, key);
+        if (!board) return 0;
+        auto it = board->counts.find(firmID);
+        return it == board->counts.end() ? 0 : it->second;
+    }
+
+    size_t boardSize(Scope scope, const std::string& key) const {
+        const Board* board = find(scope, key);
+        return board ? board->ranking.size() : 0;
+    }
+};
+
+#endif
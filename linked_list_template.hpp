@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <memory>
+#include <utility>
 
 template <typename T>
 class LinkedList {
@@ -15,7 +17,7 @@ public:
     virtual ~LinkedList() {}
 };
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 class SinglyLinkedList: public LinkedList<T> {
 private:
     struct Node {
@@ -25,13 +27,46 @@ private:
     };
     Node* head;
 
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef std::allocator_traits<NodeAlloc> NodeTraits;
+    NodeAlloc nodeAlloc;
+
+    Node* createNode(const T& data) {
+        Node* node = NodeTraits::allocate(nodeAlloc, 1);
+        NodeTraits::construct(nodeAlloc, node, data);
+        return node;
+    }
+
+    void destroyNode(Node* node) {
+        NodeTraits::destroy(nodeAlloc, node);
+        NodeTraits::deallocate(nodeAlloc, node, 1);
+    }
+
 public:
     SinglyLinkedList() : head(nullptr) {}
 
     Node* getHead() const { return head; }
 
+    // 单个节点的大小，用于内存统计
+    static size_t nodeSize() { return sizeof(Node); }
+
+    // 把 other 的节点整体接到本链表前面，不复制元素，other 变空；要走一遍 other 找尾节点
+    // 两边的节点由同一种分配器分配，要求分配器无状态
+    void splice(SinglyLinkedList& other) {
+        if (!other.head) return;
+        Node* tail = other.head;
+        while (tail->next) tail = tail->next;
+        tail->next = head;
+        head = other.head;
+        other.head = nullptr;
+    }
+
+    void swap(SinglyLinkedList& other) {
+        std::swap(head, other.head);
+    }
+
     void insert(const T& data) override {
-        Node* newNode = new Node(data);
+        Node* newNode = createNode(data);
         newNode->next = head;
         head = newNode;
     }
@@ -42,7 +77,7 @@ public:
         Node* temp = head;
         if (head->data == data) {
             head = head->next;
-            delete temp;
+            destroyNode(temp);
             return;
         } // 这里就不额外创造哨兵节点了
 
@@ -57,7 +92,7 @@ public:
         }
 
         prev->next = temp->next;
-        delete temp;
+        destroyNode(temp);
     }
 
     bool find(const T& data) const override {
@@ -99,12 +134,12 @@ public:
         while (head) {
             Node* temp = head;
             head = head->next;
-            delete temp;
+            destroyNode(temp);
         }
     }
 };
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 class DoublyLinkedList : public LinkedList<T> {
 private:
     struct Node {
@@ -115,11 +150,26 @@ private:
     };
     Node* head;
 
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef std::allocator_traits<NodeAlloc> NodeTraits;
+    NodeAlloc nodeAlloc;
+
+    Node* createNode(const T& data) {
+        Node* node = NodeTraits::allocate(nodeAlloc, 1);
+        NodeTraits::construct(nodeAlloc, node, data);
+        return node;
+    }
+
+    void destroyNode(Node* node) {
+        NodeTraits::destroy(nodeAlloc, node);
+        NodeTraits::deallocate(nodeAlloc, node, 1);
+    }
+
 public:
     DoublyLinkedList() : head(nullptr) {}
 
     void insert(const T& data) override {
-        Node* newNode = new Node(data);
+        Node* newNode = createNode(data);
         if (head) {
             head->prev = newNode;
             newNode->next = head;
@@ -144,7 +194,7 @@ public:
             if (temp->next) {
                 temp->next->prev = temp->prev;
             }
-            delete temp;
+            destroyNode(temp);
         }
     }
 
@@ -176,12 +226,12 @@ public:
         while (head) {
             Node* temp = head;
             head = head->next;
-            delete temp;
+            destroyNode(temp);
         }
     }
 };
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 class CircularLinkedList : public LinkedList<T> {
 private:
     struct Node {
@@ -191,11 +241,26 @@ private:
     };
     Node* tail;
 
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef std::allocator_traits<NodeAlloc> NodeTraits;
+    NodeAlloc nodeAlloc;
+
+    Node* createNode(const T& data) {
+        Node* node = NodeTraits::allocate(nodeAlloc, 1);
+        NodeTraits::construct(nodeAlloc, node, data);
+        return node;
+    }
+
+    void destroyNode(Node* node) {
+        NodeTraits::destroy(nodeAlloc, node);
+        NodeTraits::deallocate(nodeAlloc, node, 1);
+    }
+
 public:
     CircularLinkedList() : tail(nullptr) {}
 
     void insert(const T& data) override {
-        Node* newNode = new Node(data);
+        Node* newNode = createNode(data);
         if (!tail) {
             tail = newNode;
             tail->next = tail;
@@ -214,16 +279,16 @@ public:
             if (curr->data == data) {
                 if (curr == tail) {
                     if (tail == tail->next) {
-                        delete tail;
+                        destroyNode(tail);
                         tail = nullptr;
                     } else {
                         prev->next = curr->next;
-                        delete tail;
+                        destroyNode(tail);
                         tail = prev;
                     }
                 } else {
                     prev->next = curr->next;
-                    delete curr;
+                    destroyNode(curr);
                 }
                 return;
                 prev = curr;
@@ -263,7 +328,7 @@ public:
         tail->next = nullptr; // 打破循环链
         while (curr) {
             Node* next = curr->next;
-            delete curr;
+            destroyNode(curr);
             curr = next;
         }
 
@@ -3,8 +3,26 @@
 #include <sstream>
 #include <memory>
 #include <limits>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <chrono>
 #include "firm.hpp"
 #include "firmSys.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "ownership_history.hpp"
+#include "prefix_index.hpp"
+#include "leaderboard.hpp"
+#include "sketches.hpp"
+#include "patent_filter.hpp"
+#include "workload_trace.hpp"
+#include "export.hpp"
+#include "entity_resolution.hpp"
+#include "query.hpp"
+#include "external_sort.hpp"
+#include "csv_tail.hpp"
+#include "transfer_graph.hpp"
 #include "linked_list_template.hpp"
 #include "vector_template.hpp"
 
@@ -24,12 +42,201 @@ void printMenu() {
     std::cout << "6. Add Firm" << std::endl;
     std::cout << "7. Remove Firm" << std::endl;
     std::cout << "-------------------------------------" << std::endl;
+    std::cout << "           HISTORY OPERATIONS           " << std::endl;
+    std::cout << "8. Patent Ownership History" << std::endl;
+    std::cout << "9. Firm Portfolio at Date" << std::endl;
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "10. Ingest New CSV Rows" << std::endl;
+    std::cout << "11. Transfer Graph Report" << std::endl;
+    std::cout << "12. Memory Report" << std::endl;
+    std::cout << "13. Search Firms/Patents by Prefix" << std::endl;
+    std::cout << "14. Firm Leaderboard" << std::endl;
+    std::cout << "15. Export Patents (CSV/TSV/JSONL)" << std::endl;
+    std::cout << "16. Resolve Firm Name Variants" << std::endl;
+    std::cout << "17. Query Patents" << std::endl;
+    std::cout << "18. Approximate Dashboard Statistics" << std::endl;
+    std::cout << "-------------------------------------" << std::endl;
     std::cout << "0. Exit" << std::endl;
     std::cout << "=====================================" << std::endl;
     std::cout << "Select an option: ";
 }
 
-int main() {
+void displayCompletions(const std::vector<PrefixIndex::Completion>& completions) {
+    if (completions.empty()) {
+        std::cout << "No matches." << std::endl;
+        return;
+    }
+    for (const auto& c : completions) {
+        std::cout << "  " << std::left << std::setw(40) << c.text << c.value << "  (" << c.score << " patents)";
+        if (c.edits > 0) {
+            std::cout << "  ~" << c.edits;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// 输入以 ? 结尾时按前缀列出候选企业，没有精确前缀时再尝试一次编辑距离的模糊匹配
+std::string promptFirmID(AutocompleteIndex& index, const std::string& prompt) {
+    std::string input;
+    while (true) {
+        std::cout << prompt << " (end with ? to search): ";
+        std::cin >> input;
+        if (input.empty() || input.back() != '?') {
+            return input;
+        }
+        std::string prefix = input.substr(0, input.size() - 1);
+        std::vector<PrefixIndex::Completion> found = index.suggestFirms(prefix, 10);
+        if (found.empty()) {
+            found = index.suggestFirms(prefix, 10, 1);
+        }
+        displayCompletions(found);
+    }
+}
+
+PatentServer* activeServer = nullptr;
+
+void handleStopSignal(int) {
+    if (activeServer) {
+        activeServer->stop();
+    }
+}
+
+int serveUntilStopped(PatentServer& server) {
+    activeServer = &server;
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+    try {
+        server.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        activeServer = nullptr;
+        return 1;
+    }
+    activeServer = nullptr;
+    return 0;
+}
+
+// 守护进程模式：只加载一次数据，然后通过 Unix 域套接字提供服务
+// 用法: patent_system --serve <socket> [--workers N] [--data <dir>] [--follow <seconds>] [--shards N]
+//                                       [--lazy-titles <cache entries>] [--compressed-titles] [--snapshots] [--arena]
+int runServer(int argc, char* argv[]) {
+    std::string socketPath = argv[2];
+    std::string dataDir = "../data";
+    size_t workers = std::thread::hardware_concurrency();
+    int followSeconds = 0;
+    uint32_t shards = 0;
+    bool lazyTitles = false;
+    size_t titleCache = 0;
+
+    bool compressedTitles = false;
+    bool snapshots = false;
+    bool hugePageArena = false;
+
+    for (int i = 3; i < argc; i += 2) {
+        if (std::strcmp(argv[i], "--compressed-titles") == 0) {
+            compressedTitles = true;
+            i--;  // 不带参数
+        } else if (std::strcmp(argv[i], "--snapshots") == 0) {
+            snapshots = true;
+            i--;
+        } else if (std::strcmp(argv[i], "--arena") == 0) {
+            hugePageArena = true;
+            i--;
+        } else if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argv[i] << std::endl;
+            return 1;
+        } else if (std::strcmp(argv[i], "--workers") == 0) {
+            workers = static_cast<size_t>(std::stoul(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--data") == 0) {
+            dataDir = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--follow") == 0) {
+            followSeconds = std::stoi(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--shards") == 0) {
+            shards = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--lazy-titles") == 0) {
+            lazyTitles = true;
+            titleCache = static_cast<size_t>(std::stoul(argv[i + 1]));
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (shards > 0) {
+        if (followSeconds > 0) {
+            std::cerr << "Error: --follow is not supported with --shards." << std::endl;
+            return 1;
+        }
+        if (lazyTitles || compressedTitles || snapshots || hugePageArena) {
+            std::cerr << "Error: --lazy-titles, --compressed-titles, --snapshots and --arena are not supported with --shards." << std::endl;
+            return 1;
+        }
+        return runShardCluster(socketPath, dataDir, shards, workers, serveUntilStopped);
+    }
+    // 懒加载的标题直接从映射的 PatentData.csv 里解码；--follow 要应对文件被截断或改写，那时读标题会 SIGBUS 或读错
+    if (lazyTitles && followSeconds > 0) {
+        std::cerr << "Error: --lazy-titles is not supported with --follow." << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<FirmSystemUnorderedMap> base = std::make_shared<FirmSystemUnorderedMap>(FirmType::UnorderedMap);
+    base->setHugePageArena(hugePageArena);
+    std::shared_ptr<IFirmSystem> firmSystem = base;
+    firmSystem->setLazyTitles(lazyTitles, titleCache);
+    firmSystem->setCompressedTitles(compressedTitles);
+    firmSystem->loadFirms(dataDir + "/FirmData.csv");
+    firmSystem->loadPatentsFromCSV(dataDir + "/PatentData.csv");
+    displayNormalizeReport(firmSystem->loadReport());
+
+    PatentServer server(firmSystem, socketPath, workers);
+    if (snapshots) {
+        std::shared_ptr<SnapshotManager> manager = std::make_shared<SnapshotManager>(*firmSystem);
+        firmSystem->addObserver(manager);
+        server.setSnapshots(manager);
+    }
+    CsvTailer tailer(*firmSystem, dataDir + "/PatentData.csv");
+    if (followSeconds > 0) {
+        tailer.markLoaded(firmSystem->loadReport().completeBytes);
+        server.setPeriodicTask(followSeconds * 1000, [&tailer]() {
+            CsvTailer::Stats stats = tailer.poll();
+            if (stats.reset) {
+                std::cerr << "Warning: " << tailer.getPath() << " was replaced or truncated; restart to reload." << std::endl;
+            } else if (stats.bytes > 0) {
+                std::cout << "Ingested " << stats.added << " added, " << stats.removed << " removed, "
+                          << stats.transferred << " transferred, " << stats.fixed << " fixed, " << stats.rejected << " rejected in "
+                          << stats.milliseconds << " ms" << std::endl;
+            }
+        });
+    }
+    return serveUntilStopped(server);
+}
+
+// 用法: patent_system [--lazy-titles <cache entries>] [--compressed-titles] [--arena] [--record <trace file>]
+int main(int argc, char* argv[]) {
+    if (argc >= 3 && std::strcmp(argv[1], "--serve") == 0) {
+        return runServer(argc, argv);
+    }
+    bool lazyTitles = false;
+    bool compressedTitles = false;
+    bool hugePageArena = false;
+    size_t titleCache = 0;
+    std::string tracePath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--lazy-titles") == 0 && i + 1 < argc) {
+            lazyTitles = true;
+            titleCache = static_cast<size_t>(std::stoul(argv[++i]));
+        } else if (std::strcmp(argv[i], "--compressed-titles") == 0) {
+            compressedTitles = true;
+        } else if (std::strcmp(argv[i], "--arena") == 0) {
+            hugePageArena = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
     FirmType firmType;
     int typeChoice;
 
@@ -37,6 +244,7 @@ int main() {
     std::cout << "1. LinkedList" << std::endl;
     std::cout << "2. Vector" << std::endl;
     std::cout << "3. UnorderedMap" << std::endl;
+    std::cout << "4. B+-tree (disk)" << std::endl;
     std::cout << "Enter choice: ";
     std::cin >> typeChoice;
 
@@ -50,6 +258,9 @@ int main() {
         case 3:
             firmType = FirmType::UnorderedMap;
             break;
+        case 4:
+            firmType = FirmType::BTree;
+            break;
         default:
             std::cerr << "Invalid choice. Defaulting to UnorderedMap." << std::endl;
             firmType = FirmType::UnorderedMap;
@@ -75,11 +286,51 @@ int main() {
             firmSystem = std::make_shared<FirmSystemUnorderedMap>(firmType);
     }
     system("clear");
+    // arena 是具体系统上的开关，要在包上录制层之前设置
+    std::static_pointer_cast<BaseFirmSystem>(firmSystem)->setHugePageArena(hugePageArena);
+    if (!tracePath.empty()) {
+        // 本次会话对系统的所有调用都录进 trace，之后可以用 patent_bench replay 回放
+        try {
+            firmSystem = std::make_shared<RecordingFirmSystem>(firmSystem, tracePath);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    firmSystem->setLazyTitles(lazyTitles, titleCache);
+    firmSystem->setCompressedTitles(compressedTitles);
+
+    std::shared_ptr<OwnershipHistory> history = std::make_shared<OwnershipHistory>();
+    firmSystem->addObserver(history);
+    std::shared_ptr<TransferGraph> graph = std::make_shared<TransferGraph>();
+    firmSystem->addObserver(graph);
+    std::shared_ptr<AutocompleteIndex> autocomplete = std::make_shared<AutocompleteIndex>();
+    firmSystem->addObserver(autocomplete);
+    std::shared_ptr<Leaderboard> leaderboard = std::make_shared<Leaderboard>();
+    firmSystem->addObserver(leaderboard);
+    std::shared_ptr<PatentExistenceFilter> existence = std::make_shared<PatentExistenceFilter>();
+    firmSystem->addObserver(existence);
+    std::shared_ptr<EntityResolver> resolver = std::make_shared<EntityResolver>();
+    firmSystem->addObserver(resolver);
+    std::shared_ptr<QueryIndex> queryIndex = std::make_shared<QueryIndex>();
+    firmSystem->addObserver(queryIndex);
+    std::shared_ptr<PatentSketches> sketches = std::make_shared<PatentSketches>();
+    firmSystem->addObserver(sketches);
+    QueryEngine queryEngine(*firmSystem, queryIndex);
 
     std::string filename="../data/FirmData.csv";
     firmSystem->loadFirms(filename);
+    std::cout << "FirmData.csv: ";
+    displayNormalizeReport(firmSystem->loadReport());
     filename="../data/PatentData.csv";
     firmSystem->loadPatentsFromCSV(filename);
+    std::cout << "PatentData.csv: ";
+    displayNormalizeReport(firmSystem->loadReport());
+    CsvTailer tailer(*firmSystem, filename);
+    tailer.markLoaded(firmSystem->loadReport().completeBytes);
+    if (existence->needsRebuild()) {
+        existence->rebuild(*firmSystem);
+    }
 
     int choice;
     do {
@@ -90,11 +341,13 @@ int main() {
             case 1: {
                 system("clear");
                 std::string firmID, patentID, grantdate, appldate, title, country;
-                firmSystem->displayFirmsID();
-                std::cout << "Enter Firm ID to add Patent to: ";
-                std::cin >> firmID;
+                firmID = promptFirmID(*autocomplete, "Enter Firm ID to add Patent to");
                 std::cout << "Enter Patent ID: ";
                 std::cin >> patentID;
+                if (patentExists(*firmSystem, *existence, patentID)) {
+                    std::cerr << "Error: Patent ID already exists." << std::endl;
+                    break;
+                }
                 std::cout << "Enter Grant Date: ";
                 std::cin >> grantdate;
                 std::cout << "Enter Application Date: ";
@@ -135,10 +388,7 @@ int main() {
             }
             case 4: {
                 system("clear");
-                firmSystem->displayFirmsID();
-                std::string firmID;
-                std::cout << "Enter Firm ID to display: ";
-                std::cin >> firmID;
+                std::string firmID = promptFirmID(*autocomplete, "Enter Firm ID to display");
                 firmSystem->displayFirm(firmID);
                 break;
             }
@@ -154,6 +404,10 @@ int main() {
                 std::cin >> firmID;
                 std::cout << "Enter Firm Name: ";
                 std::cin >> firmName;
+                for (const auto& m : resolver->similarFirms(firmName, 0.75, 5)) {
+                    std::cout << "Note: similar existing firm " << m.firmID << " (" << m.firmName << "), score "
+                              << std::fixed << std::setprecision(2) << m.score << std::endl;
+                }
                 firmSystem->addFirm(firmID, firmName);
                 break;
             }
@@ -165,6 +419,289 @@ int main() {
                 firmSystem->removeFirm(firmID);
                 break;
             }
+            case 8: {
+                system("clear");
+                std::string patentID, date;
+                std::cout << "Enter Patent ID: ";
+                std::cin >> patentID;
+                std::cout << "Enter Date (YYYYMMDD, or 0 for full history): ";
+                std::cin >> date;
+                if (date == "0") {
+                    for (const auto& e : history->history(patentID)) {
+                        std::cout << formatDate(e.date) << "  "
+                                  << (e.firmID.empty() ? "(removed)" : e.firmID) << std::endl;
+                    }
+                } else {
+                    try {
+                        std::string owner = history->ownerAt(patentID, parseDate(date));
+                        std::cout << "Owner: " << (owner.empty() ? "(none)" : owner) << std::endl;
+                    } catch (const std::invalid_argument& e) {
+                        std::cerr << "Error: " << e.what() << std::endl;
+                    }
+                }
+                break;
+            }
+            case 9: {
+                system("clear");
+                std::string firmID, date;
+                std::cout << "Enter Firm ID: ";
+                std::cin >> firmID;
+                std::cout << "Enter Date (YYYYMMDD): ";
+                std::cin >> date;
+                try {
+                    uint32_t when = parseDate(date);
+                    std::vector<std::string> portfolio = history->portfolioAt(firmID, when);
+                    std::cout << "Patents held on " << formatDate(when) << ": " << portfolio.size() << std::endl;
+                    for (size_t i = 0; i < portfolio.size() && i < 10; ++i) {
+                        std::cout << portfolio[i] << std::endl;
+                    }
+                    if (portfolio.size() > 10) {
+                        std::cout << "..." << std::endl;
+                    }
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+                break;
+            }
+            case 10: {
+                system("clear");
+                // 与守护进程拒绝 --lazy-titles + --follow 同理：懒加载的标题读自映射的 CSV，追加读取要应对文件被截断或改写
+                if (lazyTitles) {
+                    std::cerr << "Error: ingesting new rows is not supported with --lazy-titles." << std::endl;
+                    break;
+                }
+                CsvTailer::Stats stats = tailer.poll();
+                if (stats.reset) {
+                    std::cerr << "Error: " << tailer.getPath() << " was replaced or truncated; restart to reload." << std::endl;
+                    break;
+                }
+                std::cout << "Added: " << stats.added << ", Removed: " << stats.removed
+                          << ", Transferred: " << stats.transferred << ", Fixed: " << stats.fixed
+                          << ", Rejected: " << stats.rejected << std::endl;
+                std::cout << "Read " << stats.bytes << " bytes in " << stats.milliseconds << " ms" << std::endl;
+                break;
+            }
+            case 11: {
+                system("clear");
+                graph->build();
+                std::cout << "Firms: " << graph->vertexCount()
+                          << ", Transfers: " << graph->rawEdgeCount(EdgeKind::Transfer)
+                          << ", Components: " << TransferGraph::componentCount(graph->connectedComponents()) << std::endl;
+                std::cout << "Top firms by PageRank:" << std::endl;
+                for (const auto& r : graph->topByPageRank(5)) {
+                    std::cout << "  " << std::left << std::setw(10) << r.firmID << r.score << std::endl;
+                }
+                std::cout << "Most frequent transfers (from -> to):" << std::endl;
+                for (const auto& p : graph->topPairs(5)) {
+                    std::cout << "  " << p.fromFirmID << " -> " << p.toFirmID << "  x" << p.count << std::endl;
+                }
+                break;
+            }
+            case 12: {
+                system("clear");
+                size_t patentCount = 0;
+                firmSystem->forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                    patentCount += static_cast<size_t>(firm->getPatentCount());
+                });
+                std::cout << "Estimated usage for " << patentCount << " patents:" << std::endl;
+                displayMemoryStats(firmSystem->memoryUsage(), patentCount);
+                std::cout << "Tracked container allocations: patents "
+                          << allocationCounter<PatentStorageTag>().liveBytes.load() << " bytes, firms "
+                          << allocationCounter<FirmStorageTag>().liveBytes.load() << " bytes" << std::endl;
+                break;
+            }
+            case 13: {
+                system("clear");
+                std::string field, prefix;
+                int edits;
+                std::cout << "Search (firm/patent): ";
+                std::cin >> field;
+                std::cout << "Enter Prefix: ";
+                std::cin >> prefix;
+                std::cout << "Allowed typos (0-2): ";
+                std::cin >> edits;
+                if (field == "patent") {
+                    displayCompletions(autocomplete->complete(AutocompleteIndex::Field::PatentID, prefix, 10, edits));
+                } else {
+                    displayCompletions(autocomplete->suggestFirms(prefix, 10, edits));
+                }
+                break;
+            }
+            case 14: {
+                system("clear");
+                std::string scopeName, key, firmID;
+                size_t k;
+                std::cout << "Leaderboard (all/country/year): ";
+                std::cin >> scopeName;
+                Leaderboard::Scope scope = Leaderboard::Scope::Overall;
+                if (scopeName == "country" || scopeName == "year") {
+                    scope = scopeName == "country" ? Leaderboard::Scope::Country : Leaderboard::Scope::GrantYear;
+                    std::cout << (scopeName == "country" ? "Enter Country Code: " : "Enter Grant Year: ");
+                    std::cin >> key;
+                }
+                std::cout << "How many firms: ";
+                std::cin >> k;
+                std::vector<Leaderboard::Entry> entries = leaderboard->top(scope, key, k);
+                if (entries.empty()) {
+                    std::cout << "No firms ranked." << std::endl;
+                }
+                for (const auto& e : entries) {
+                    std::cout << std::right << std::setw(4) << e.rank << ". " << std::left << std::setw(10) << e.firmID
+                              << e.count << " patents" << std::endl;
+                }
+                std::cout << "Enter Firm ID to look up its rank (or - to skip): ";
+                std::cin >> firmID;
+                if (firmID != "-") {
+                    size_t rank = leaderboard->rankOf(scope, key, firmID);
+                    if (rank == 0) {
+                        std::cout << "Firm is not ranked on this board." << std::endl;
+                    } else {
+                        std::cout << "Rank " << rank << " of " << leaderboard->boardSize(scope, key) << " with "
+                                  << leaderboard->countOf(scope, key, firmID) << " patents." << std::endl;
+                    }
+                }
+                break;
+            }
+            case 15: {
+                system("clear");
+                std::string formatName, firmID, path;
+                ExportFormat format;
+                std::cout << "Format (csv/tsv/jsonl): ";
+                std::cin >> formatName;
+                if (!parseExportFormat(formatName, format)) {
+                    std::cerr << "Error: Unknown format." << std::endl;
+                    break;
+                }
+                std::cout << "Enter Firm ID (or all): ";
+                std::cin >> firmID;
+                std::string sortName = "none";
+                SortKey sortKey = SortKey::GrantDate;
+                if (firmID == "all") {
+                    std::cout << "Sort by (none/grantdate/firm): ";
+                    std::cin >> sortName;
+                    if (sortName != "none" && !parseSortKey(sortName, sortKey)) {
+                        std::cerr << "Error: Unknown sort order." << std::endl;
+                        break;
+                    }
+                }
+                std::cout << "Output file: ";
+                std::cin >> path;
+                auto start = std::chrono::steady_clock::now();
+                ExportResult result;
+                if (sortName != "none") {
+                    SortedExportOptions options;
+                    options.key = sortKey;
+                    options.format = format;
+                    result = exportSorted(*firmSystem, path, options);
+                } else {
+                    result = exportPatents(*firmSystem, firmID == "all" ? "" : firmID, path, format);
+                }
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (!result.ok) {
+                    std::cerr << "Error: " << result.error << std::endl;
+                    break;
+                }
+                std::cout << "Exported " << result.rows << " patents (" << result.bytes << " bytes) to " << path << " in "
+                          << ms << " ms" << std::endl;
+                break;
+            }
+            case 16: {
+                system("clear");
+                double threshold;
+                std::cout << "Similarity threshold (0-1, e.g. 0.75): ";
+                std::cin >> threshold;
+                auto start = std::chrono::steady_clock::now();
+                std::vector<EntityResolver::MergeProposal> proposals = resolver->proposeMerges(*firmSystem, threshold);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                std::cout << proposals.size() << " proposed merges among " << resolver->names().size() << " firms ("
+                          << ms << " ms)" << std::endl;
+                for (size_t i = 0; i < proposals.size() && i < 20; ++i) {
+                    const auto& p = proposals[i];
+                    std::cout << p.fromFirmID << " (" << p.fromName << ") -> " << p.intoFirmID << " (" << p.intoName
+                              << "), score " << std::fixed << std::setprecision(2) << p.score << std::endl;
+                }
+                if (proposals.size() > 20) {
+                    std::cout << "..." << std::endl;
+                }
+                if (proposals.empty()) {
+                    break;
+                }
+                std::string answer;
+                std::cout << "Apply all merges? (y/n): ";
+                std::cin >> answer;
+                if (answer == "y") {
+                    size_t merged = resolver->applyMerges(*firmSystem, proposals);
+                    std::cout << "Merged " << merged << " firms." << std::endl;
+                }
+                break;
+            }
+            case 17: {
+                system("clear");
+                std::string text, error;
+                std::cout << "e.g. firm = 6066 AND country = US AND appldate = 2012 AND title CONTAINS processor LIMIT 20" << std::endl;
+                std::cout << "Prefix with EXPLAIN to show the plan only." << std::endl;
+                std::cout << "Query: ";
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                std::getline(std::cin, text);
+                if (text.size() > 8 && query_detail::upper(text.substr(0, 8)) == "EXPLAIN ") {
+                    std::string plan;
+                    if (!queryEngine.explain(text.substr(8), plan, error)) {
+                        std::cerr << "Error: " << error << std::endl;
+                    } else {
+                        std::cout << plan;
+                    }
+                    break;
+                }
+                QueryResult result;
+                auto start = std::chrono::steady_clock::now();
+                if (!queryEngine.run(text, result, error)) {
+                    std::cerr << "Error: " << error << std::endl;
+                    break;
+                }
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (!result.rows.empty()) {
+                    displayTitle();
+                    for (size_t i = 0; i < result.rows.size() && i < 50; ++i) result.rows[i].display();
+                    if (result.rows.size() > 50) displayDots();
+                }
+                std::cout << result.rows.size() << " patents via " << result.path << ", " << result.examined
+                          << " examined, " << ms << " ms" << (result.cached ? " (cached plan)" : "") << std::endl;
+                break;
+            }
+            case 18: {
+                system("clear");
+                std::string year;
+                size_t k;
+                std::cout << "Enter Grant Year for top countries: ";
+                std::cin >> year;
+                std::cout << "How many countries: ";
+                std::cin >> k;
+                auto start = std::chrono::steady_clock::now();
+                double titles = sketches->distinctTitles();
+                std::vector<PatentSketches::HeavyHitter> top = sketches->topCountries(year, k);
+                double p50 = sketches->firmCountQuantile(0.5);
+                double p90 = sketches->firmCountQuantile(0.9);
+                double p99 = sketches->firmCountQuantile(0.99);
+                double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                std::cout << std::fixed << std::setprecision(0) << "Distinct titles: ~" << titles << " (+/- "
+                          << std::setprecision(2) << sketches->titleRelativeError() * 100 << "%)" << std::endl;
+                std::cout << "Top countries in " << year << " (counts over by at most "
+                          << std::setprecision(0) << sketches->countErrorBound() << "):" << std::endl;
+                if (top.empty()) {
+                    std::cout << "  No patents granted that year." << std::endl;
+                }
+                for (const auto& h : top) {
+                    std::cout << "  " << std::left << std::setw(6) << h.country << std::right << std::setw(10) << h.estimate
+                              << std::setw(8) << std::setprecision(1) << h.share * 100 << "%" << std::endl;
+                }
+                std::cout << std::setprecision(0) << "Patents per firm: p50 " << p50 << ", p90 " << p90 << ", p99 " << p99
+                          << " (rank error " << std::setprecision(2) << sketches->quantileRankError() * 100 << "%)" << std::endl;
+                std::cout << "Answered in " << us << " us from " << sketches->sketchBytes() / 1024 << " KB of sketches."
+                          << std::endl;
+                std::cout.unsetf(std::ios::fixed);
+                std::cout.precision(6);
+                break;
+            }
             case 0: {
                 std::cout << "Exiting..." << std::endl;
                 break;
@@ -0,0 +1,118 @@
+#ifndef MEMORY_STATS_HPP
+#define MEMORY_STATS_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include "arena.hpp"
+
+// 内存占用的分类统计
+struct MemoryStats {
+    size_t objectBytes;     // Patent / 企业对象本身
+    size_t containerBytes;  // 容器的管理结构：哈希桶数组、指针数组
+    size_t nodeOverhead;    // 链表/哈希节点里的指针、缓存的哈希值、重复保存的键
+    size_t stringPayload;   // 超出短字符串优化（SSO）部分的字符串堆内存
+    size_t spareCapacity;   // 已分配但未使用的容量
+
+    MemoryStats() : objectBytes(0), containerBytes(0), nodeOverhead(0), stringPayload(0), spareCapacity(0) {}
+
+    size_t total() const {
+        return objectBytes + containerBytes + nodeOverhead + stringPayload + spareCapacity;
+    }
+
+    MemoryStats& operator+=(const MemoryStats& other) {
+        objectBytes += other.objectBytes;
+        containerBytes += other.containerBytes;
+        nodeOverhead += other.nodeOverhead;
+        stringPayload += other.stringPayload;
+        spareCapacity += other.spareCapacity;
+        return *this;
+    }
+};
+
+inline void displayMemoryStats(const MemoryStats& stats, size_t patentCount) {
+    const double mb = 1024.0 * 1024.0;
+    std::cout << std::left << std::fixed << std::setprecision(2);
+    std::cout << std::setw(20) << "Objects" << stats.objectBytes / mb << " MB" << std::endl;
+    std::cout << std::setw(20) << "Containers" << stats.containerBytes / mb << " MB" << std::endl;
+    std::cout << std::setw(20) << "Node overhead" << stats.nodeOverhead / mb << " MB" << std::endl;
+    std::cout << std::setw(20) << "String payload" << stats.stringPayload / mb << " MB" << std::endl;
+    std::cout << std::setw(20) << "Spare capacity" << stats.spareCapacity / mb << " MB" << std::endl;
+    std::cout << std::setw(20) << "Total" << stats.total() / mb << " MB" << std::endl;
+    if (patentCount > 0) {
+        std::cout << std::setw(20) << "Bytes per patent" << static_cast<double>(stats.total()) / patentCount << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+// 字符串在对象之外占用的堆内存；数据指针落在对象内部说明用的是 SSO 缓冲区
+inline size_t stringHeapBytes(const std::string& s) {
+    const char* p = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (p >= self && p < self + sizeof(std::string)) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+// 按 Tag 区分的分配计数，记录当前存活的字节数和累计分配次数
+struct AllocationCounter {
+    std::atomic<int64_t> liveBytes;
+    std::atomic<uint64_t> allocations;
+};
+
+template <typename Tag>
+AllocationCounter& allocationCounter() {
+    static AllocationCounter counter;
+    return counter;
+}
+
+struct PatentStorageTag {};  // 企业内部保存专利的容器
+struct FirmStorageTag {};    // 企业系统保存企业的容器
+
+// 带计数的分配器，可以传给 myVector、链表模板和 std::unordered_map
+// 当前线程处在 ArenaScope 里时从大页 arena 分配，释放时认出属于 arena 的块只记账
+template <typename T, typename Tag = PatentStorageTag>
+class TrackingAllocator {
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef TrackingAllocator<U, Tag> other;
+    };
+
+    TrackingAllocator() {}
+
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U, Tag>&) {}
+
+    T* allocate(size_t n) {
+        AllocationCounter& c = allocationCounter<Tag>();
+        c.liveBytes.fetch_add(static_cast<int64_t>(n * sizeof(T)), std::memory_order_relaxed);
+        c.allocations.fetch_add(1, std::memory_order_relaxed);
+        if (HugePageArena* arena = HugePageArena::active()) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        allocationCounter<Tag>().liveBytes.fetch_sub(static_cast<int64_t>(n * sizeof(T)), std::memory_order_relaxed);
+        if (HugePageArena::releaseOwned(p, n * sizeof(T))) return;
+        ::operator delete(p);
+    }
+};
+
+template <typename T, typename U, typename Tag>
+bool operator==(const TrackingAllocator<T, Tag>&, const TrackingAllocator<U, Tag>&) { return true; }
+
+template <typename T, typename U, typename Tag>
+bool operator!=(const TrackingAllocator<T, Tag>&, const TrackingAllocator<U, Tag>&) { return false; }
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef MVCC_HPP
+#define MVCC_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <iterator>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 一个企业的专利列表：按专利号排序后切成不超过 2*kChunk 个的块，块在版本之间按指针共享
+// 复制列表只复制块指针；增删只复制一个块（块已被本版本独占时直接修改），按专利号查找是两次二分
+class PatentList {
+public:
+    typedef std::shared_ptr<const Patent> Ptr;
+    enum { kChunk = 64 };
+
+private:
+    typedef std::vector<Ptr> Chunk;
+
+    // 读者只能通过 const 接口看到块；use_count 为 1 说明没有别的版本引用，可以就地修改
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    size_t count;
+
+    static bool idLess(const Ptr& p, const std::string& id) {
+        return p->getPatentID() < id;
+    }
+
+    // 第一个末尾专利号不小于 id 的块，都小于时取最后一块；调用方保证列表非空
+    size_t chunkFor(const std::string& id) const {
+        auto it = std::lower_bound(chunks.begin(), chunks.end(), id, [](const std::shared_ptr<Chunk>& c, const std::string& key) {
+            return c->back()->getPatentID() < key;
+        });
+        return it == chunks.end() ? chunks.size() - 1 : static_cast<size_t>(it - chunks.begin());
+    }
+
+    Chunk& own(size_t c) {
+        if (chunks[c].use_count() != 1) chunks[c] = std::make_shared<Chunk>(*chunks[c]);
+        return *chunks[c];
+    }
+
+public:
+    class const_iterator {
+    private:
+        const std::vector<std::shared_ptr<Chunk>>* chunks;
+        size_t c;
+        size_t i;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Ptr value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Ptr* pointer;
+        typedef const Ptr& reference;
+
+        const_iterator(const std::vector<std::shared_ptr<Chunk>>* list, size_t chunk, size_t index)
+            : chunks(list), c(chunk), i(index) {}
+
+        reference operator*() const { return (*(*chunks)[c])[i]; }
+        pointer operator->() const { return &(*(*chunks)[c])[i]; }
+
+        const_iterator& operator++() {
+            if (++i == (*chunks)[c]->size()) {
+                ++c;
+                i = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return c == other.c && i == other.i; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+
+    PatentList() : count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const_iterator begin() const { return const_iterator(&chunks, 0, 0); }
+    const_iterator end() const { return const_iterator(&chunks, chunks.size(), 0); }
+
+    // 找不到返回 nullptr
+    const Patent* find(const std::string& patentID) const {
+        if (chunks.empty()) return nullptr;
+        const Chunk& chunk = *chunks[chunkFor(patentID)];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), patentID, idLess);
+        return it != chunk.end() && (*it)->getPatentID() == patentID ? it->get() : nullptr;
+    }
+
+    void insert(Ptr patent) {
+        count++;
+        if (chunks.empty()) {
+            chunks.push_back(std::make_shared<Chunk>(1, std::move(patent)));
+            return;
+        }
+        size_t c = chunkFor(patent->getPatentID());
+        Chunk& chunk = own(c);
+        auto pos = std::lower_bound(chunk.begin(), chunk.end(), patent->getPatentID(), idLess);
+        chunk.insert(pos, std::move(patent));
+        if (chunk.size() > 2 * kChunk) {
+            std::shared_ptr<Chunk> tail = std::make_shared<Chunk>(chunk.begin() + kChunk, chunk.end());
+            chunk.resize(kChunk);
+            chunks.insert(chunks.begin() + c + 1, tail);
+        }
+    }
+
+    // 取出并删除；out 为空时只删除
+    bool take(const std::string& patentID, Ptr* out) {
+        if (chunks.empty()) return false;
+        size_t c = chunkFor(patentID);
+        const Chunk& shared = *chunks[c];
+        auto pos = std::lower_bound(shared.begin(), shared.end(), patentID, idLess);
+        if (pos == shared.end() || (*pos)->getPatentID() != patentID) return false;
+        size_t index = static_cast<size_t>(pos - shared.begin());
+        Chunk& chunk = own(c);
+        if (out) *out = chunk[index];
+        chunk.erase(chunk.begin() + index);
+        if (chunk.empty()) chunks.erase(chunks.begin() + c);
+        count--;
+        return true;
+    }
+
+    // 整体替换，用于初始装载和合并企业
+    void assign(std::vector<Ptr> patents) {
+        std::sort(patents.begin(), patents.end(), [](const Ptr& x, const Ptr& y) {
+            return x->getPatentID() < y->getPatentID();
+        });
+        chunks.clear();
+        for (size_t i = 0; i < patents.size(); i += kChunk) {
+            size_t end = std::min<size_t>(patents.size(), i + kChunk);
+            chunks.push_back(std::make_shared<Chunk>(patents.begin() + i, patents.begin() + end));
+        }
+        count = patents.size();
+    }
+
+    void clear() {
+        chunks.clear();
+        count = 0;
+    }
+};
+
+// 快照里的一个企业，发布后不再修改；复制企业只复制块指针
+struct FirmVersion {
+    std::string firmID;
+    std::string firmName;
+    PatentList patents;
+};
+
+// 某个提交版本下全系统的只读视图
+// 企业按 firmID 的哈希分到 64 x 64 个桶，每个桶是按 firmID 排序的企业指针数组，每 64 个桶组成一个目录；
+// 提交时只复制改动过的目录、桶和企业，其余部分与上一个版本共享，所以拿快照不需要复制数据，
+// 单次变更也只复制常数大小的几块，持有快照期间不会阻塞写者
+class SystemSnapshot {
+public:
+    enum { kDirectories = 64, kBucketsPerDirectory = 64 };
+    typedef std::vector<std::shared_ptr<const FirmVersion>> Bucket;
+    typedef std::vector<std::shared_ptr<const Bucket>> Directory;
+
+private:
+    friend class SnapshotManager;
+
+    uint64_t versionNumber;
+    size_t firms;
+    size_t patents;
+    std::vector<std::shared_ptr<const Directory>> directories;
+
+    static size_t bucketOf(const std::string& firmID) {
+        return std::hash<std::string>()(firmID) & (kDirectories * kBucketsPerDirectory - 1);
+    }
+
+    const Bucket& bucketAt(size_t b) const {
+        return *(*directories[b / kBucketsPerDirectory])[b % kBucketsPerDirectory];
+    }
+
+    static bool firmLess(const std::shared_ptr<const FirmVersion>& firm, const std::string& firmID) {
+        return firm->firmID < firmID;
+    }
+
+    // 空版本的所有目录共享同一个全空目录
+    static std::shared_ptr<const Directory> emptyDirectory() {
+        return std::make_shared<const Directory>(kBucketsPerDirectory, std::make_shared<const Bucket>());
+    }
+
+public:
+    SystemSnapshot() : versionNumber(0), firms(0), patents(0), directories(kDirectories, emptyDirectory()) {}
+
+    uint64_t version() const {
+        return versionNumber;
+    }
+
+    size_t firmCount() const {
+        return firms;
+    }
+
+    size_t patentCount() const {
+        return patents;
+    }
+
+    // 返回的指针在快照存活期间有效，不存在返回 nullptr
+    const FirmVersion* findFirm(const std::string& firmID) const {
+        const Bucket& bucket = bucketAt(bucketOf(firmID));
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), firmID, firmLess);
+        return it != bucket.end() && (*it)->firmID == firmID ? it->get() : nullptr;
+    }
+
+    void forEachFirm(const std::function<void(const FirmVersion&)>& fn) const {
+        for (const auto& directory : directories) {
+            for (const auto& bucket : *directory) {
+                for (const auto& firm : *bucket) fn(*firm);
+            }
+        }
+    }
+
+    void forEachPatent(const std::function<void(const Patent&)>& fn) const {
+        forEachFirm([&](const FirmVersion& firm) {
+            for (const auto& p : firm.patents) fn(*p);
+        });
+    }
+};
+
+// 多版本快照：作为观察者把企业系统的每次变更写进一个草稿版本，提交时原子地发布
+// - 读者 snapshot() 取得当前已提交版本，之后随意遍历，看到的始终是同一个一致的状态；
+// - 写者用 beginBatch/commitBatch（或 atomically）把多次操作合成一个版本，批外的单次变更各自成为一个版本；
+// - 被替换的旧版本交给后台线程，等没有读者持有后再释放。
+// 写入本身仍要求调用方串行化（和 IFirmSystem 一样），读者不受此限制
+class SnapshotManager : public IFirmSystemObserver {
+private:
+    typedef SystemSnapshot::Bucket Bucket;
+    typedef SystemSnapshot::Directory Directory;
+
+    std::shared_ptr<const SystemSnapshot> current;
+    uint64_t nextVersion;
+
+    // 草稿：当前批次内已经私有化的目录、桶和企业可以直接修改
+    std::shared_ptr<SystemSnapshot> draft;
+    std::unordered_map<size_t, std::shared_ptr<Directory>> ownedDirectories;
+    std::unordered_map<size_t, std::shared_ptr<Bucket>> ownedBuckets;
+    std::unordered_map<std::string, std::shared_ptr<FirmVersion>> ownedFirms;
+    int batchDepth;
+    bool aborted; // 批内有人调用了 abortBatch，最外层结束时丢弃草稿
+
+    // 后台回收
+    std::mutex gcMtx;
+    std::condition_variable gcCv;
+    std::vector<std::shared_ptr<const SystemSnapshot>> retired;
+    std::atomic<size_t> retiredCount;
+    std::atomic<size_t> freedCount;
+    bool stopping;
+    std::thread collector;
+
+    void openDraft() {
+        if (draft) return;
+        draft = std::make_shared<SystemSnapshot>(*std::atomic_load(&current));
+    }
+
+    void discardDraft() {
+        draft.reset();
+        ownedDirectories.clear();
+        ownedBuckets.clear();
+        ownedFirms.clear();
+    }
+
+    Bucket& ownBucket(size_t b) {
+        auto owned = ownedBuckets.find(b);
+        if (owned != ownedBuckets.end()) return *owned->second;
+        size_t d = b / SystemSnapshot::kBucketsPerDirectory;
+        auto dir = ownedDirectories.find(d);
+        if (dir == ownedDirectories.end()) {
+            std::shared_ptr<Directory> copy = std::make_shared<Directory>(*draft->directories[d]);
+            draft->directories[d] = copy;
+            dir = ownedDirectories.emplace(d, copy).first;
+        }
+        std::shared_ptr<const Bucket>& slot = (*dir->second)[b % SystemSnapshot::kBucketsPerDirectory];
+        std::shared_ptr<Bucket> bucket = std::make_shared<Bucket>(*slot);
+        slot = bucket;
+        ownedBuckets.emplace(b, bucket);
+        return *bucket;
+    }
+
+    // 返回草稿里可修改的企业；create 为 false 且企业不存在时返回 nullptr
+    FirmVersion* ownFirm(const std::string& firmID, bool create) {
+        auto owned = ownedFirms.find(firmID);
+        if (owned != ownedFirms.end()) return owned->second.get();
+        Bucket& bucket = ownBucket(SystemSnapshot::bucketOf(firmID));
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), firmID, SystemSnapshot::firmLess);
+        std::shared_ptr<FirmVersion> copy;
+        if (it != bucket.end() && (*it)->firmID == firmID) {
+            copy = std::make_shared<FirmVersion>(**it);
+            *it = copy;
+        } else if (create) {
+            copy = std::make_shared<FirmVersion>();
+            copy->firmID = firmID;
+            bucket.insert(it, copy);
+            draft->firms++;
+        } else {
+            return nullptr;
+        }
+        ownedFirms[firmID] = copy;
+        return copy.get();
+    }
+
+    void eraseFirm(const std::string& firmID) {
+        Bucket& bucket = ownBucket(SystemSnapshot::bucketOf(firmID));
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), firmID, SystemSnapshot::firmLess);
+        if (it == bucket.end() || (*it)->firmID != firmID) return;
+        draft->patents -= (*it)->patents.size();
+        draft->firms--;
+        bucket.erase(it);
+        ownedFirms.erase(firmID);
+    }
+
+    // 从空版本开始按系统现状装载并发布
+    void loadFrom(const IFirmSystem& system) {
+        discardDraft();
+        draft = std::make_shared<SystemSnapshot>();
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            FirmVersion* version = ownFirm(firm->getFirmID(), true);
+            version->firmName = firm->getFirmName();
+            std::vector<PatentList::Ptr> patents;
+            patents.reserve(static_cast<size_t>(firm->getPatentCount()));
+            firm->forEachPatent([&](const Patent& p) {
+                patents.push_back(std::make_shared<const Patent>(p));
+            });
+            version->patents.assign(std::move(patents));
+            draft->patents += version->patents.size();
+        });
+        publish();
+    }
+
+    void publish() {
+        draft->versionNumber = nextVersion++;
+        std::shared_ptr<const SystemSnapshot> previous = std::atomic_load(&current);
+        std::atomic_store(&current, std::shared_ptr<const SystemSnapshot>(draft));
+        discardDraft();
+        {
+            std::lock_guard<std::mutex> lock(gcMtx);
+            retired.push_back(previous);
+        }
+        retiredCount++;
+        gcCv.notify_one();
+    }
+
+    // 每次 hook 调用前后：批内只改草稿，批外改完立即发布
+    void begin() {
+        openDraft();
+    }
+
+    void end() {
+        if (batchDepth == 0) publish();
+    }
+
+    // 只有回收线程自己还引用的旧版本才释放；已退休的版本不会再被新读者拿到
+    void collect() {
+        std::unique_lock<std::mutex> lock(gcMtx);
+        while (!stopping) {
+            gcCv.wait_for(lock, std::chrono::milliseconds(50));
+            std::vector<std::shared_ptr<const SystemSnapshot>> dead;
+            for (size_t i = 0; i < retired.size();) {
+                if (retired[i].use_count() == 1) {
+                    dead.push_back(std::move(retired[i]));
+                    retired[i] = std::move(retired.back());
+                    retired.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            lock.unlock();
+            freedCount += dead.size();
+            dead.clear();  // 在锁外析构，可能要释放不少内存
+            lock.lock();
+        }
+    }
+
+public:
+    // 用系统当前的内容建立初始版本；之后需要 addObserver 才能跟上变更
+    explicit SnapshotManager(const IFirmSystem& system)
+        : current(std::make_shared<const SystemSnapshot>()), nextVersion(1), batchDepth(0), aborted(false), retiredCount(0),
+          freedCount(0), stopping(false) {
+        loadFrom(system);
+        collector = std::thread(&SnapshotManager::collect, this);
+    }
+
+    SnapshotManager(const SnapshotManager&) = delete;
+    SnapshotManager& operator=(const SnapshotManager&) = delete;
+
+    ~SnapshotManager() {
+        {
+            std::lock_guard<std::mutex> lock(gcMtx);
+            stopping = true;
+        }
+        gcCv.notify_one();
+        collector.join();
+    }
+
+    // 固定当前已提交的版本，可以在任意线程调用
+    std::shared_ptr<const SystemSnapshot> snapshot() const {
+        return std::atomic_load(&current);
+    }
+
+    // 批可以嵌套，最外层 commitBatch 时一次发布
+    void beginBatch() {
+        openDraft();
+        batchDepth++;
+    }
+
+    // 批内任何一层调用过 abortBatch，最外层结束时就丢弃整个草稿而不是发布
+    uint64_t commitBatch() {
+        if (batchDepth > 0 && --batchDepth == 0) {
+            if (aborted) {
+                discardDraft();
+                aborted = false;
+            } else if (draft) {
+                publish();
+            }
+        }
+        return std::atomic_load(&current)->version();
+    }
+
+    void abortBatch() {
+        aborted = true;
+        commitBatch();
+    }
+
+    // 在一个批里执行 writes，返回发布的版本号
+    // writes 抛异常时丢弃这一批的草稿，读者不会看到执行到一半的状态；但企业系统本身不会回滚，
+    // 已经生效的那部分变更不在任何版本里，之后的版本会与系统对不上，调用方要自己撤销它们或者调用 reload
+    uint64_t atomically(const std::function<void()>& writes) {
+        beginBatch();
+        try {
+            writes();
+        } catch (...) {
+            abortBatch();
+            throw;
+        }
+        return commitBatch();
+    }
+
+    // 丢掉现有内容，按系统现状重新装载一个版本（例如 atomically 中途失败之后）；不能在批内调用
+    uint64_t reload(const IFirmSystem& system) {
+        loadFrom(system);
+        return std::atomic_load(&current)->version();
+    }
+
+    size_t versionsRetired() const {
+        return retiredCount;
+    }
+
+    size_t versionsFreed() const {
+        return freedCount;
+    }
+
+    void onFirmAdded(const std::string& firmID, const std::string& firmName) override {
+        begin();
+        ownFirm(firmID, true)->firmName = firmName;
+        end();
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        begin();
+        eraseFirm(firm.getFirmID());
+        end();
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        begin();
+        FirmVersion* firm = ownFirm(firmID, true);
+        firm->patents.insert(std::make_shared<const Patent>(patent));
+        draft->patents++;
+        end();
+    }
+
+    void onPatentRemoved(const std::string& firmID, const Patent& patent) override {
+        begin();
+        FirmVersion* firm = ownFirm(firmID, false);
+        if (firm && firm->patents.take(patent.getPatentID(), nullptr)) draft->patents--;
+        end();
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        begin();
+        FirmVersion* from = ownFirm(fromFirmID, false);
+        PatentList::Ptr taken;
+        if (from && from->patents.take(patentID, &taken)) {
+            std::shared_ptr<Patent> moved = std::make_shared<Patent>(*taken);
+            moved->setFirmID(toFirmID);
+            ownFirm(toFirmID, true)->patents.insert(moved);
+        }
+        end();
+    }
+
+    // 整个企业的专利一次搬过去并重新切块，不再逐个查找删除
+    void onFirmsMerged(const std::string& intoFirmID, const std::string& fromFirmID, const std::vector<std::string>&) override {
+        begin();
+        FirmVersion* from = ownFirm(fromFirmID, false);
+        if (from) {
+            FirmVersion* into = ownFirm(intoFirmID, true);
+            std::vector<PatentList::Ptr> merged(into->patents.begin(), into->patents.end());
+            merged.reserve(into->patents.size() + from->patents.size());
+            for (const auto& p : from->patents) {
+                std::shared_ptr<Patent> moved = std::make_shared<Patent>(*p);
+                moved->setFirmID(intoFirmID);
+                merged.push_back(moved);
+            }
+            into->patents.assign(std::move(merged));
+            from->patents.clear();
+        }
+        end();
+    }
+};
+
+#endif
@@ -0,0 +1,456 @@
+#ifndef NORMALIZE_HPP
+#define NORMALIZE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include "patent.hpp"
+#include "thread_pool.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 清洗结果统计：一行要么原样通过，要么被修正，要么被拒绝
+struct NormalizeReport {
+    size_t rows;
+    size_t clean;
+    size_t fixed;
+    size_t rejected;
+
+    // 修正原因（一行可能有多个）
+    size_t bomStripped;
+    size_t controlStripped;
+    size_t trimmed;
+    size_t caseFolded;
+    size_t quotesRepaired;
+    size_t datesReformatted;
+
+    // 拒绝原因
+    size_t missingField;
+    size_t badDate;
+
+    size_t unknownFirm;  // 清洗通过但所属企业不存在、插入时被跳过的行
+
+    // 读到的文本到最后一个换行为止的字节数，不是计数，不参与 +=；CsvTailer 从这里接着读之后追加的行
+    uint64_t completeBytes;
+
+    NormalizeReport()
+        : rows(0), clean(0), fixed(0), rejected(0), bomStripped(0), controlStripped(0), trimmed(0), caseFolded(0),
+          quotesRepaired(0), datesReformatted(0), missingField(0), badDate(0), unknownFirm(0), completeBytes(0) {}
+
+    NormalizeReport& operator+=(const NormalizeReport& other) {
+        rows += other.rows;
+        clean += other.clean;
+        fixed += other.fixed;
+        rejected += other.rejected;
+        bomStripped += other.bomStripped;
+        controlStripped += other.controlStripped;
+        trimmed += other.trimmed;
+        caseFolded += other.caseFolded;
+        quotesRepaired += other.quotesRepaired;
+        datesReformatted += other.datesReformatted;
+        missingField += other.missingField;
+        badDate += other.badDate;
+        unknownFirm += other.unknownFirm;
+        return *this;
+    }
+};
+
+inline void displayNormalizeReport(const NormalizeReport& r) {
+    std::cout << "Rows: " << r.rows << ", Clean: " << r.clean << ", Fixed: " << r.fixed
+              << ", Rejected: " << r.rejected << std::endl;
+    if (r.fixed > 0) {
+        std::cout << "  fixed: " << r.bomStripped << " BOM, " << r.controlStripped << " control chars, "
+                  << r.trimmed << " whitespace, " << r.caseFolded << " case, " << r.quotesRepaired << " quotes, "
+                  << r.datesReformatted << " date format" << std::endl;
+    }
+    if (r.rejected > 0) {
+        std::cout << "  rejected: " << r.missingField << " missing field, " << r.badDate << " bad date" << std::endl;
+    }
+    if (r.unknownFirm > 0) {
+        std::cout << "  skipped: " << r.unknownFirm << " rows for unknown firms" << std::endl;
+    }
+}
+
+// ---- 字节级内核：SSE2 每次处理 16 字节，其余平台退回逐字节 ----
+
+inline bool isControlByte(unsigned char c) {
+    return c < 0x20 || c == 0x7f;
+}
+
+// 第一个控制字符（< 0x20 或 DEL）的位置，没有则返回 n
+inline size_t findControlByte(const char* p, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        // 无符号比较 x <= 0x1f 等价于 max(x, 0x1f) == 0x1f
+        __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(x, limit), limit);
+        int mask = _mm_movemask_epi8(_mm_or_si128(low, _mm_cmpeq_epi8(x, del)));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (isControlByte(static_cast<unsigned char>(p[i]))) return i;
+    }
+    return n;
+}
+
+// 把 [from, from+26) 范围内的 ASCII 字母加上 delta（大小写互转），返回是否有改动
+inline bool shiftAsciiRange(char* p, size_t n, char from, int delta) {
+    bool changed = false;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i base = _mm_set1_epi8(from);
+    const __m128i span = _mm_set1_epi8(25);
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(delta));
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i t = _mm_sub_epi8(x, base);
+        __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(t, span), t);  // t <= 25（无符号）
+        if (_mm_movemask_epi8(inRange) != 0) {
+            changed = true;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_add_epi8(x, _mm_and_si128(inRange, shift)));
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (static_cast<unsigned char>(p[i] - from) <= 25) {
+            p[i] = static_cast<char>(p[i] + delta);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+inline bool foldLowerInPlace(std::string& s) {
+    return s.empty() ? false : shiftAsciiRange(&s[0], s.size(), 'A', 'a' - 'A');
+}
+
+inline bool foldUpperInPlace(std::string& s) {
+    return s.empty() ? false : shiftAsciiRange(&s[0], s.size(), 'a', 'A' - 'a');
+}
+
+// 原地删除控制字符，返回删除的个数；制表符换成空格而不删，免得把前后两个词粘在一起，之后的首尾裁剪会处理它
+// 没有控制字符时只做一次 SIMD 扫描
+inline size_t stripControlInPlace(std::string& s) {
+    size_t first = findControlByte(s.data(), s.size());
+    if (first == s.size()) return 0;
+    size_t out = first;
+    for (size_t i = first; i < s.size(); ++i) {
+        if (s[i] == '\t') {
+            s[out++] = ' ';
+        } else if (!isControlByte(static_cast<unsigned char>(s[i]))) {
+            s[out++] = s[i];
+        }
+    }
+    size_t removed = s.size() - out;
+    s.resize(out);
+    return removed;
+}
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// 从 [p, p+n) 去掉首尾空白后赋值给 out，不产生中间字符串；返回是否去掉了内容
+inline bool assignTrimmed(const char* p, size_t n, std::string& out) {
+    size_t b = 0, e = n;
+    while (b < e && isBlank(p[b])) ++b;
+    while (e > b && isBlank(p[e - 1])) --e;
+    out.assign(p + b, e - b);
+    return b != 0 || e != n;
+}
+
+inline bool isLeapYear(unsigned year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// 日期统一成 YYYYMMDD；也接受 YYYY-MM-DD / YYYY/MM/DD 并改写（reformatted 置为 true）
+// 格式不对或日期不存在时返回 false
+inline bool normalizeDate(std::string& s, bool& reformatted) {
+    reformatted = false;
+    if (s.size() == 10 && (s[4] == '-' || s[4] == '/') && s[7] == s[4]) {
+        s[4] = s[5];
+        s[5] = s[6];
+        s[6] = s[8];
+        s[7] = s[9];
+        s.resize(8);
+        reformatted = true;
+    }
+    if (s.size() != 8) return false;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+    }
+    unsigned year = static_cast<unsigned>((s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0'));
+    unsigned month = static_cast<unsigned>((s[4] - '0') * 10 + (s[5] - '0'));
+    unsigned day = static_cast<unsigned>((s[6] - '0') * 10 + (s[7] - '0'));
+    static const unsigned daysIn[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (year < 1790 || month < 1 || month > 12 || day < 1) return false;
+    unsigned limit = daysIn[month - 1] + (month == 2 && isLeapYear(year) ? 1 : 0);
+    return day <= limit;
+}
+
+// 标题字段：去掉包裹的双引号并把 "" 还原成 "；落单的引号保留为普通字符，算作一次修复
+inline bool normalizeTitle(std::string& title) {
+    bool wrapped = title.size() >= 2 && title.front() == '"' && title.back() == '"';
+    if (!wrapped && title.find('"') == std::string::npos) return false;
+
+    size_t begin = wrapped ? 1 : 0;
+    size_t end = wrapped ? title.size() - 1 : title.size();
+    std::string out;
+    out.reserve(end - begin);
+    bool stray = !wrapped;
+    for (size_t i = begin; i < end; ++i) {
+        if (title[i] == '"') {
+            if (wrapped && i + 1 < end && title[i + 1] == '"') {
+                ++i;
+            } else {
+                stray = true;
+            }
+        }
+        out += title[i];
+    }
+    title.swap(out);
+    return stray;
+}
+
+// 去掉 UTF-8 BOM、行尾 \r 和控制字符；[p, p+n) 被原地收窄，只有含控制字符时才复制到 scratch
+inline bool stripLineNoise(const char*& p, size_t& n, std::string& scratch, bool& fixed, NormalizeReport& report) {
+    if (n >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+        n -= 3;
+        report.bomStripped++;
+        fixed = true;
+    }
+    if (n > 0 && p[n - 1] == '\r') --n;
+    if (findControlByte(p, n) < n) {
+        scratch.assign(p, n);
+        stripControlInPlace(scratch);
+        p = scratch.data();
+        n = scratch.size();
+        report.controlStripped++;
+        fixed = true;
+    }
+    return n > 0;
+}
+
+inline size_t findByte(const char* p, size_t n, char c, size_t from) {
+    if (from >= n) return std::string::npos;
+    const void* hit = std::memchr(p + from, c, n - from);
+    return hit ? static_cast<size_t>(static_cast<const char*>(hit) - p) : std::string::npos;
+}
+
+inline size_t findByteReverse(const char* p, size_t n, char c) {
+    while (n > 0) {
+        if (p[--n] == c) return n;
+    }
+    return std::string::npos;
+}
+
+inline void countRow(bool accepted, bool fixed, NormalizeReport& report) {
+    report.rows++;
+    if (!accepted) {
+        report.rejected++;
+    } else if (fixed) {
+        report.fixed++;
+    } else {
+        report.clean++;
+    }
+}
+
+// 解析并清洗 PatentData.csv 的一行
+// 只有标题可能含逗号，所以左边取前三个字段、右边取后两个字段，中间剩下的就是标题
+// keepTitle 为 false 时标题照常清洗和计数，但写进线程内复用的缓冲区，不放进 out（懒加载模式）
+inline bool normalizePatentRow(const char* line, size_t len, Patent& out, NormalizeReport& report, bool keepTitle) {
+    static thread_local std::string discardedTitle;
+    std::string scratch;
+    bool fixed = false;
+    bool accepted = false;
+    std::string patentID, grantdate, appldate, ownTitle, country, firmID;
+    std::string& title = keepTitle ? ownTitle : discardedTitle;
+
+    if (stripLineNoise(line, len, scratch, fixed, report)) {
+        size_t c1 = findByte(line, len, ',', 0);
+        size_t c2 = c1 == std::string::npos ? c1 : findByte(line, len, ',', c1 + 1);
+        size_t c3 = c2 == std::string::npos ? c2 : findByte(line, len, ',', c2 + 1);
+        size_t c5 = findByteReverse(line, len, ',');
+        size_t c4 = c5 == std::string::npos ? c5 : findByteReverse(line, c5, ',');
+
+        if (c3 == std::string::npos || c4 == std::string::npos || c4 <= c3) {
+            report.missingField++;
+        } else {
+            bool trimmed = false;
+            trimmed |= assignTrimmed(line, c1, patentID);
+            trimmed |= assignTrimmed(line + c1 + 1, c2 - c1 - 1, grantdate);
+            trimmed |= assignTrimmed(line + c2 + 1, c3 - c2 - 1, appldate);
+            trimmed |= assignTrimmed(line + c3 + 1, c4 - c3 - 1, title);
+            trimmed |= assignTrimmed(line + c4 + 1, c5 - c4 - 1, country);
+            trimmed |= assignTrimmed(line + c5 + 1, len - c5 - 1, firmID);
+            if (trimmed) {
+                report.trimmed++;
+                fixed = true;
+            }
+            if (normalizeTitle(title)) {
+                report.quotesRepaired++;
+                fixed = true;
+            }
+            if (foldUpperInPlace(country)) {
+                report.caseFolded++;
+                fixed = true;
+            }
+
+            bool grantFormat = false, applFormat = false;
+            if (patentID.empty() || firmID.empty()) {
+                report.missingField++;
+            } else if (!normalizeDate(grantdate, grantFormat) || !normalizeDate(appldate, applFormat)) {
+                report.badDate++;
+            } else {
+                if (grantFormat || applFormat) {
+                    report.datesReformatted++;
+                    fixed = true;
+                }
+                accepted = true;
+            }
+        }
+    } else {
+        report.missingField++;
+    }
+
+    countRow(accepted, fixed, report);
+    if (accepted) {
+        out = Patent(std::move(patentID), std::move(grantdate), std::move(appldate), std::move(ownTitle),
+                     std::move(country), std::move(firmID));
+    }
+    return accepted;
+}
+
+inline bool normalizePatentLine(const char* line, size_t len, Patent& out, NormalizeReport& report) {
+    return normalizePatentRow(line, len, out, report, true);
+}
+
+// FirmData.csv 的一行：firmID,name（名称可能含逗号或被引号包裹）
+inline bool normalizeFirmLine(const char* line, size_t len, std::pair<std::string, std::string>& out,
+                              NormalizeReport& report) {
+    std::string scratch;
+    bool fixed = false;
+    bool accepted = false;
+
+    if (stripLineNoise(line, len, scratch, fixed, report)) {
+        size_t comma = findByte(line, len, ',', 0);
+        std::string firmID, firmName;
+        bool trimmed = assignTrimmed(line, comma == std::string::npos ? len : comma, firmID);
+        if (comma != std::string::npos) {
+            trimmed |= assignTrimmed(line + comma + 1, len - comma - 1, firmName);
+        }
+        if (trimmed) {
+            report.trimmed++;
+            fixed = true;
+        }
+        if (normalizeTitle(firmName)) {
+            report.quotesRepaired++;
+            fixed = true;
+        }
+        if (firmID.empty() || firmName.empty()) {
+            report.missingField++;
+        } else {
+            out.first.swap(firmID);
+            out.second.swap(firmName);
+            accepted = true;
+        }
+    } else {
+        report.missingField++;
+    }
+
+    countRow(accepted, fixed, report);
+    return accepted;
+}
+
+inline bool readWholeFile(const std::string& filename, std::string& contents) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+// 把文本按行切块分给多个线程清洗，结果按原始行序返回；跳过第一行表头
+// parse 是上面的 normalize*Line 之一，每个线程有自己的统计，最后合并
+// text 可以是任意一段内存（例如 mmap 的文件），parse 拿到的行指针就指在其中
+template <typename T>
+std::vector<T> normalizeLines(const char* text, size_t size, size_t threads,
+                              const std::function<bool(const char*, size_t, T&, NormalizeReport&)>& parse,
+                              NormalizeReport& report) {
+    auto lineEnd = [&](size_t from, size_t limit) -> size_t {
+        const void* hit = from < limit ? std::memchr(text + from, '\n', limit - from) : nullptr;
+        return hit ? static_cast<size_t>(static_cast<const char*>(hit) - text) : limit;
+    };
+    size_t start = lineEnd(0, size);
+    start = start == size ? size : start + 1;
+
+    // 每块的起点对齐到行首
+    size_t chunks = std::max<size_t>(1, std::min(threads * 4, (size - start) / 65536 + 1));
+    std::vector<size_t> bounds(1, start);
+    for (size_t c = 1; c < chunks; ++c) {
+        size_t pos = start + (size - start) * c / chunks;
+        pos = std::max(pos, bounds.back());
+        size_t eol = lineEnd(pos, size);
+        bounds.push_back(eol == size ? size : eol + 1);
+    }
+    bounds.push_back(size);
+
+    std::vector<std::vector<T>> parts(chunks);
+    std::vector<NormalizeReport> reports(chunks);
+    parallelFor(chunks, threads, [&](size_t b, size_t e, size_t) {
+        for (size_t c = b; c < e; ++c) {
+            size_t pos = bounds[c];
+            while (pos < bounds[c + 1]) {
+                size_t eol = lineEnd(pos, bounds[c + 1]);
+                size_t len = eol - pos;
+                if (len > 0 && !(len == 1 && text[pos] == '\r')) {
+                    T item;
+                    if (parse(text + pos, len, item, reports[c])) {
+                        parts[c].push_back(std::move(item));
+                    }
+                }
+                pos = eol + 1;
+            }
+        }
+    });
+
+    std::vector<T> result;
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    result.reserve(total);
+    for (size_t c = 0; c < chunks; ++c) {
+        report += reports[c];
+        for (auto& item : parts[c]) result.push_back(std::move(item));
+    }
+    size_t complete = size;
+    while (complete > 0 && text[complete - 1] != '\n') --complete;
+    report.completeBytes = complete;
+    return result;
+}
+
+template <typename T>
+std::vector<T> normalizeLines(const std::string& text, size_t threads,
+                              const std::function<bool(const char*, size_t, T&, NormalizeReport&)>& parse,
+                              NormalizeReport& report) {
+    return normalizeLines<T>(text.data(), text.size(), threads, parse, report);
+}
+
+#endif
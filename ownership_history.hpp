@@ -0,0 +1,360 @@
+#ifndef OWNERSHIP_HISTORY_HPP
+#define OWNERSHIP_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include "firmSys.hpp"
+
+// 日期统一编码为 YYYYMMDD 整数，接受 "20160101" 和 "2016-01-01" 两种写法
+inline uint32_t parseDate(const std::string& text) {
+    uint32_t value = 0;
+    int digits = 0;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + static_cast<uint32_t>(c - '0');
+            digits++;
+        } else if (c != '-' && c != '/') {
+            throw std::invalid_argument("Invalid date: " + text);
+        }
+    }
+    if (digits != 8) {
+        throw std::invalid_argument("Invalid date: " + text);
+    }
+    return value;
+}
+
+inline std::string formatDate(uint32_t date) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%04u-%02u-%02u", date / 10000, (date / 100) % 100, date % 100);
+    return buf;
+}
+
+inline uint32_t today() {
+    std::time_t now = std::time(nullptr);
+    std::tm local = *std::localtime(&now);
+    return static_cast<uint32_t>((local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday);
+}
+
+// 专利归属的历史记录，支持“某一天谁拥有这个专利”之类的时间点查询
+//
+// 两份只追加的日志：
+//   - 每个专利一份 (日期, 企业) 序列，查询某日的归属只需二分，O(log k)
+//   - 每个企业一份 (日期, 专利, +/-, 累计数量) 序列，某日的专利数量二分即得，O(log n)
+// 每个事件大约占 8 + 2*12 字节，不会为每个版本复制整个数据集
+//
+// 事件日期：专利第一次出现时取授权日期，之后的转让/删除取 clock()（默认今天）
+class OwnershipHistory : public IFirmSystemObserver {
+public:
+    struct Event {
+        uint32_t date;
+        std::string firmID; // 空字符串表示该专利在此日被删除
+    };
+
+private:
+    static const uint32_t kNoFirm = 0xffffffffu;
+    static const uint32_t kRemoveBit = 0x80000000u;
+
+    struct PatentEntry {
+        uint32_t date;
+        uint32_t firm;
+    };
+
+    struct FirmEntry {
+        uint32_t date;
+        uint32_t patent; // 最高位为 1 表示失去该专利
+        int32_t count;   // 该事件之后的专利数量（相对所在块的起点）
+    };
+
+    // 企业日志始终按日期有序（同日按到达顺序），切成不超过 2*kChunk 条的块：
+    // 乱序插入只需移动一个块并修正后面各块的 base，避免大企业按授权日期乱序加载时退化成 O(n^2)
+    static const size_t kChunk = 256;
+
+    struct FirmChunk {
+        std::vector<FirmEntry> entries;
+        int32_t base; // 该块之前的累计数量
+    };
+
+    struct FirmLog {
+        std::vector<FirmChunk> chunks;
+    };
+
+    std::unordered_map<std::string, uint32_t> patentIndex;
+    std::vector<std::string> patentIDs;
+    std::vector<std::vector<PatentEntry>> patentLogs;
+
+    std::unordered_map<std::string, uint32_t> firmIndex;
+    std::vector<std::string> firmIDs;
+    std::vector<FirmLog> firmLogs;
+
+    std::function<uint32_t()> clock;
+    size_t eventCount;
+
+    uint32_t internPatent(const std::string& patentID) {
+        auto it = patentIndex.find(patentID);
+        if (it != patentIndex.end()) return it->second;
+        uint32_t idx = static_cast<uint32_t>(patentIDs.size());
+        patentIndex.emplace(patentID, idx);
+        patentIDs.push_back(patentID);
+        patentLogs.emplace_back();
+        return idx;
+    }
+
+    uint32_t internFirm(const std::string& firmID) {
+        auto it = firmIndex.find(firmID);
+        if (it != firmIndex.end()) return it->second;
+        uint32_t idx = static_cast<uint32_t>(firmIDs.size());
+        firmIndex.emplace(firmID, idx);
+        firmIDs.push_back(firmID);
+        firmLogs.emplace_back();
+        return idx;
+    }
+
+    int32_t lookupPatent(const std::string& patentID) const {
+        auto it = patentIndex.find(patentID);
+        return it == patentIndex.end() ? -1 : static_cast<int32_t>(it->second);
+    }
+
+    int32_t lookupFirm(const std::string& firmID) const {
+        auto it = firmIndex.find(firmID);
+        return it == firmIndex.end() ? -1 : static_cast<int32_t>(it->second);
+    }
+
+    static bool dateBefore(uint32_t d, const FirmEntry& e) { return d < e.date; }
+
+    // 首条日期不晚于 date 的最后一个块；date 早于所有记录时返回 0
+    static size_t chunkFor(const FirmLog& log, uint32_t date) {
+        auto it = std::upper_bound(log.chunks.begin(), log.chunks.end(), date, [](uint32_t d, const FirmChunk& c) {
+            return d < c.entries.front().date;
+        });
+        return it == log.chunks.begin() ? 0 : static_cast<size_t>(it - log.chunks.begin()) - 1;
+    }
+
+    // 按日期插入一条企业事件并修正其后的累计数量；按时间顺序到达时就是追加
+    void insertFirmEntry(uint32_t firm, uint32_t date, uint32_t patent, bool gained) {
+        FirmLog& log = firmLogs[firm];
+        int32_t delta = gained ? 1 : -1;
+        FirmEntry entry{date, gained ? patent : (patent | kRemoveBit), 0};
+        size_t c;
+        if (log.chunks.empty() || (log.chunks.back().entries.size() >= kChunk && log.chunks.back().entries.back().date <= date)) {
+            int32_t base = log.chunks.empty() ? 0 : log.chunks.back().base + log.chunks.back().entries.back().count;
+            log.chunks.push_back(FirmChunk{std::vector<FirmEntry>(), base});
+            c = log.chunks.size() - 1;
+        } else {
+            c = chunkFor(log, date);
+        }
+        std::vector<FirmEntry>& entries = log.chunks[c].entries;
+        auto pos = std::upper_bound(entries.begin(), entries.end(), date, dateBefore);
+        entry.count = (pos == entries.begin() ? 0 : (pos - 1)->count) + delta;
+        pos = entries.insert(pos, entry);
+        for (++pos; pos != entries.end(); ++pos) pos->count += delta;
+        for (size_t i = c + 1; i < log.chunks.size(); ++i) log.chunks[i].base += delta;
+
+        if (entries.size() > 2 * kChunk) {
+            // 对半拆分，后半块的计数改为相对新块起点
+            size_t half = entries.size() / 2;
+            int32_t offset = entries[half - 1].count;
+            FirmChunk tail{std::vector<FirmEntry>(entries.begin() + half, entries.end()), log.chunks[c].base + offset};
+            for (auto& e : tail.entries) e.count -= offset;
+            entries.resize(half);
+            entries.shrink_to_fit();
+            log.chunks.insert(log.chunks.begin() + c + 1, std::move(tail));
+        }
+    }
+
+    // 撤销一条企业事件（后继记录的前任被改写时使用）
+    void eraseFirmEntry(uint32_t firm, uint32_t date, uint32_t patent, bool gained) {
+        FirmLog& log = firmLogs[firm];
+        int32_t delta = gained ? 1 : -1;
+        uint32_t key = gained ? patent : (patent | kRemoveBit);
+        // 同日的记录可能跨块，从第一个末条日期不早于 date 的块开始找
+        auto first = std::lower_bound(log.chunks.begin(), log.chunks.end(), date, [](const FirmChunk& c, uint32_t d) {
+            return c.entries.back().date < d;
+        });
+        for (size_t c = static_cast<size_t>(first - log.chunks.begin()); c < log.chunks.size(); ++c) {
+            std::vector<FirmEntry>& entries = log.chunks[c].entries;
+            if (entries.front().date > date) return;
+            auto it = std::lower_bound(entries.begin(), entries.end(), date, [](const FirmEntry& e, uint32_t d) {
+                return e.date < d;
+            });
+            for (; it != entries.end() && it->date == date; ++it) {
+                if (it->patent != key) continue;
+                for (auto later = entries.erase(it); later != entries.end(); ++later) later->count -= delta;
+                for (size_t i = c + 1; i < log.chunks.size(); ++i) log.chunks[i].base -= delta;
+                if (entries.empty()) log.chunks.erase(log.chunks.begin() + c);
+                return;
+            }
+        }
+    }
+
+    // 该日（含）之前最后一条记录的归属企业
+    uint32_t ownerIndexAt(uint32_t patent, uint32_t date) const {
+        const std::vector<PatentEntry>& log = patentLogs[patent];
+        auto it = std::upper_bound(log.begin(), log.end(), date, [](uint32_t d, const PatentEntry& e) {
+            return d < e.date;
+        });
+        if (it == log.begin()) return kNoFirm;
+        return (it - 1)->firm;
+    }
+
+public:
+    OwnershipHistory() : clock(today), eventCount(0) {}
+
+    // 替换事件时钟，便于回放历史数据时指定转让日期
+    void setClock(std::function<uint32_t()> fn) { clock = fn; }
+
+    // 显式记录一次归属变化；firmID 为空表示专利被删除
+    // 专利日志保留每一条记录（包括与前一条归属相同的），企业日志只记录相邻两条之间真正的归属变化；
+    // 日期早于已有记录时，前任取该日的实际归属，并把后继记录的前任改写为本次的企业
+    void record(const std::string& patentID, const std::string& firmID, uint32_t date) {
+        uint32_t patent = internPatent(patentID);
+        uint32_t firm = firmID.empty() ? kNoFirm : internFirm(firmID);
+
+        std::vector<PatentEntry>& log = patentLogs[patent];
+        auto pos = std::upper_bound(log.begin(), log.end(), date, [](uint32_t d, const PatentEntry& e) {
+            return d < e.date;
+        });
+        uint32_t previous = pos == log.begin() ? kNoFirm : (pos - 1)->firm;
+        if (pos != log.end()) {
+            // 后继记录原本是 previous -> next，现在变成 firm -> next
+            uint32_t nextDate = pos->date;
+            uint32_t next = pos->firm;
+            if (previous != next) {
+                if (previous != kNoFirm) eraseFirmEntry(previous, nextDate, patent, false);
+                if (next != kNoFirm) eraseFirmEntry(next, nextDate, patent, true);
+            }
+            if (firm != next) {
+                if (firm != kNoFirm) insertFirmEntry(firm, nextDate, patent, false);
+                if (next != kNoFirm) insertFirmEntry(next, nextDate, patent, true);
+            }
+        }
+        log.insert(pos, PatentEntry{date, firm});
+        eventCount++;
+
+        if (previous == firm) return;
+        if (previous != kNoFirm) insertFirmEntry(previous, date, patent, false);
+        if (firm != kNoFirm) insertFirmEntry(firm, date, patent, true);
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        uint32_t date;
+        int32_t known = lookupPatent(patent.getPatentID());
+        try {
+            date = (known < 0 || patentLogs[known].empty()) ? parseDate(patent.getGrantdate()) : clock();
+        } catch (const std::invalid_argument&) {
+            date = clock();
+        }
+        record(patent.getPatentID(), firmID, date);
+    }
+
+    void onPatentRemoved(const std::string& firmID, const Patent& patent) override {
+        record(patent.getPatentID(), "", clock());
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        record(patentID, toFirmID, clock());
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        uint32_t date = clock();
+        firm.forEachPatent([&](const Patent& p) {
+            record(p.getPatentID(), "", date);
+        });
+    }
+
+    // 某日该专利归谁所有；无记录时返回空字符串
+    std::string ownerAt(const std::string& patentID, uint32_t date) const {
+        int32_t patent = lookupPatent(patentID);
+        if (patent < 0) return "";
+        uint32_t firm = ownerIndexAt(static_cast<uint32_t>(patent), date);
+        return firm == kNoFirm ? "" : firmIDs[firm];
+    }
+
+    bool ownedAt(const std::string& firmID, const std::string& patentID, uint32_t date) const {
+        int32_t firm = lookupFirm(firmID);
+        int32_t patent = lookupPatent(patentID);
+        if (firm < 0 || patent < 0) return false;
+        return ownerIndexAt(static_cast<uint32_t>(patent), date) == static_cast<uint32_t>(firm);
+    }
+
+    // 某日企业持有的专利数量，O(log n)
+    size_t portfolioSizeAt(const std::string& firmID, uint32_t date) const {
+        int32_t firm = lookupFirm(firmID);
+        if (firm < 0) return 0;
+        const FirmLog& log = firmLogs[firm];
+        if (log.chunks.empty()) return 0;
+        const FirmChunk& chunk = log.chunks[chunkFor(log, date)];
+        auto it = std::upper_bound(chunk.entries.begin(), chunk.entries.end(), date, dateBefore);
+        if (it == chunk.entries.begin()) return 0; // 只会发生在第一个块
+        return static_cast<size_t>(chunk.base + (it - 1)->count);
+    }
+
+    // 某日企业持有的全部专利，只检查该企业在此日之前接触过的专利
+    std::vector<std::string> portfolioAt(const std::string& firmID, uint32_t date) const {
+        std::vector<std::string> result;
+        int32_t firm = lookupFirm(firmID);
+        if (firm < 0) return result;
+        std::vector<uint32_t> candidates;
+        for (const auto& chunk : firmLogs[firm].chunks) {
+            if (chunk.entries.front().date > date) break;
+            for (const auto& e : chunk.entries) {
+                if (e.date > date) break;
+                if (!(e.patent & kRemoveBit)) candidates.push_back(e.patent);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        for (uint32_t patent : candidates) {
+            if (ownerIndexAt(patent, date) == static_cast<uint32_t>(firm)) {
+                result.push_back(patentIDs[patent]);
+            }
+        }
+        return result;
+    }
+
+    std::vector<Event> history(const std::string& patentID) const {
+        std::vector<Event> result;
+        int32_t patent = lookupPatent(patentID);
+        if (patent < 0) return result;
+        uint32_t last = kNoFirm;
+        for (const auto& e : patentLogs[patent]) {
+            if (!result.empty() && e.firm == last) continue; // 归属未变的重复记录不展示
+            last = e.firm;
+            result.push_back(Event{e.date, e.firm == kNoFirm ? "" : firmIDs[e.firm]});
+        }
+        return result;
+    }
+
+    size_t getEventCount() const { return eventCount; }
+
+    // 日志本身占用的字节数（不含 ID 字符串和哈希表）
+    size_t logBytes() const {
+        size_t bytes = 0;
+        for (const auto& log : patentLogs) bytes += log.capacity() * sizeof(PatentEntry);
+        for (const auto& log : firmLogs) {
+            bytes += log.chunks.capacity() * sizeof(FirmChunk);
+            for (const auto& chunk : log.chunks) bytes += chunk.entries.capacity() * sizeof(FirmEntry);
+        }
+        return bytes;
+    }
+
+    // 粗略估计的总占用，包含 ID 字符串和索引
+    size_t memoryUsage() const {
+        size_t bytes = logBytes();
+        bytes += patentLogs.capacity() * sizeof(std::vector<PatentEntry>);
+        bytes += firmLogs.capacity() * sizeof(FirmLog);
+        for (const auto& id : patentIDs) bytes += sizeof(std::string) + (id.capacity() > 15 ? id.capacity() : 0);
+        for (const auto& id : firmIDs) bytes += sizeof(std::string) + (id.capacity() > 15 ? id.capacity() : 0);
+        bytes += (patentIndex.size() + firmIndex.size()) * (sizeof(std::string) + sizeof(uint32_t) + 2 * sizeof(void*));
+        bytes += (patentIndex.bucket_count() + firmIndex.bucket_count()) * sizeof(void*);
+        return bytes;
+    }
+};
+
+#endif
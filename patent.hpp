@@ -4,10 +4,22 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <utility>
 #include <unordered_map>
 #include <list>
 #include "linked_list_template.hpp"
 #include "vector_template.hpp"
+#include "memory_stats.hpp"
+#include "text_format.hpp"
+
+// 冷字段的来源（映射到内存的 CSV、压缩的标题块），按引用在需要时解码
+class ColdFieldSource {
+public:
+    virtual std::string loadTitle(uint64_t ref) const = 0;
+    virtual size_t memoryUsage() const = 0;  // 自身占用的堆内存
+    virtual ~ColdFieldSource() {}
+};
 
 class Patent {
 private:
@@ -17,34 +29,81 @@ private:
     std::string title;
     std::string country;
     std::string firmID;
+    // 懒加载模式下 title 为空，由 cold 按 coldRef 解码；cold 归企业系统所有，生命周期长于其中的专利
+    const ColdFieldSource* cold = nullptr;
+    uint64_t coldRef = 0;
 
 public:
     Patent() {}
 
     Patent(
         std::string patentID, std::string grantdate, std::string appldate, std::string title, std::string country, std::string firmID
-    ) : patentID(patentID), grantdate(grantdate), appldate(appldate), title(title), country(country), firmID(firmID) {}
+    ) : patentID(std::move(patentID)), grantdate(std::move(grantdate)), appldate(std::move(appldate)),
+        title(std::move(title)), country(std::move(country)), firmID(std::move(firmID)) {}
+
+    // 显式声明了析构函数，所以移动操作也要显式默认，否则容器扩容时会退化成复制
+    Patent(const Patent&) = default;
+    Patent(Patent&&) = default;
+    Patent& operator=(const Patent&) = default;
+    Patent& operator=(Patent&&) = default;
 
     std::string getPatentID() const { return patentID; }
     std::string getGrantdate() const { return grantdate; }
     std::string getAppldate() const { return appldate; }
-    std::string getTitle() const { return title; }
+    std::string getTitle() const { return cold ? cold->loadTitle(coldRef) : title; }
     std::string getCountry() const { return country; }
     std::string getFirmID() const { return firmID; }
 
+    // 导出等逐行写出的热路径用，免去按值返回的复制；冷标题解码到 scratch 里
+    const std::string& patentIDRef() const { return patentID; }
+    const std::string& grantdateRef() const { return grantdate; }
+    const std::string& appldateRef() const { return appldate; }
+    const std::string& countryRef() const { return country; }
+    const std::string& firmIDRef() const { return firmID; }
+    const std::string& titleRef(std::string& scratch) const {
+        if (!cold) return title;
+        scratch = cold->loadTitle(coldRef);
+        return scratch;
+    }
+
     void setFirmID(const std::string& firmID) {
         this->firmID = firmID;
     }
 
+    void setColdTitle(const ColdFieldSource* source, uint64_t ref) {
+        title.clear();
+        title.shrink_to_fit();
+        cold = source;
+        coldRef = ref;
+    }
+
+    bool hasColdTitle() const {
+        return cold != nullptr;
+    }
+
+    // 各字段在对象之外占用的堆内存
+    size_t stringHeapBytes() const {
+        return ::stringHeapBytes(patentID) + ::stringHeapBytes(grantdate) + ::stringHeapBytes(appldate)
+             + ::stringHeapBytes(title) + ::stringHeapBytes(country) + ::stringHeapBytes(firmID);
+    }
+
+    // 表格里的一行（含换行），列宽和 displayTitle 一致
+    void formatRow(std::string& out) const {
+        std::string shown = getTitle();
+        appendPadded(out, patentID, 10);
+        appendPadded(out, grantdate, 13);
+        appendPadded(out, appldate, 13);
+        appendPadded(out, shown.size() > 30 ? shown.substr(0, 25) + "..." : shown, 30);
+        appendPadded(out, country, 10);
+        appendPadded(out, firmID, 10);
+        out.push_back('\n');
+    }
+
+    // 整行拼好后一次写出，不再每行 std::endl 刷新
     void display() const {
-        std::cout << std::left
-                << std::setw(10) << patentID
-                << std::setw(13) << grantdate
-                << std::setw(13) << appldate
-                << std::setw(30) << (title.size() > 30 ? title.substr(0, 25) + "..." : title)
-                << std::setw(10) << country
-                << std::setw(10) << firmID
-                << std::endl;
+        std::string line;
+        formatRow(line);
+        std::cout << line;
     }
 
     bool operator==(const Patent& other) const {
@@ -65,30 +124,24 @@ std::ostream& operator<<(std::ostream& os, const Patent& patent) {
     return os;
 }
 
+void displayTableRow(const char* const (&cells)[6]) {
+    static const size_t widths[6] = {10, 13, 13, 30, 10, 10};
+    std::string line;
+    for (int i = 0; i < 6; ++i) appendPadded(line, cells[i], widths[i]);
+    line.push_back('\n');
+    line.append(80, '-');
+    line.push_back('\n');
+    std::cout << line;
+}
+
 void displayTitle() {
-    std::cout << std::left
-            << std::setw(10) << "PatentID"
-            << std::setw(13) << "Grant Date"
-            << std::setw(13) << "Appl Date"
-            << std::setw(30) << "Title"
-            << std::setw(10) << "Country"
-            << std::setw(10) << "FirmID"
-            << std::endl;
-
-    std::cout << std::string(80, '-') << std::endl;
+    static const char* const header[6] = {"PatentID", "Grant Date", "Appl Date", "Title", "Country", "FirmID"};
+    displayTableRow(header);
 }
 
 void displayDots() {
-    std::cout << std::left
-            << std::setw(10) << "..."
-            << std::setw(13) << "..."
-            << std::setw(13) << "..."
-            << std::setw(30) << "..."
-            << std::setw(10) << "..."
-            << std::setw(10) << "..."
-            << std::endl;
-
-    std::cout << std::string(80, '-') << std::endl;
+    static const char* const dots[6] = {"...", "...", "...", "...", "...", "..."};
+    displayTableRow(dots);
 }
 
 #endif
\ No newline at end of file
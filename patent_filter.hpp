@@ -0,0 +1,304 @@
+#ifndef PATENT_FILTER_HPP
+#define PATENT_FILTER_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 布谷鸟过滤器：每个键只存一个指纹，可以删除，没有假阴性
+// 指纹位数按目标假阳性率选取（误判率约为 8 * 装载率 / 2^bits），每个桶 4 个 bits 位的槽紧凑地排在位数组里，
+// 一个桶最多 64 位，读出来后用字内比较一次判完 4 个槽
+// 桶数不必是 2 的幂：另一个桶取 (tag(fp) - i) mod n，两次映射回到原桶，所以可以按约 90% 的装载率分配
+class CuckooFilter {
+private:
+    enum { kSlots = 4, kMaxKicks = 500 };
+
+    std::vector<uint64_t> words; // 紧凑存放的桶，末尾多一个字，跨字读写不必判边界
+    size_t bucketCount;
+    unsigned bits;
+    unsigned bucketBits;
+    uint16_t fpMask;
+    uint64_t bucketMask;
+    uint64_t laneLow;  // 每个槽的最低位
+    uint64_t laneHigh; // 每个槽的最高位
+    size_t count;
+    bool hasVictim;
+    uint16_t victimFp;
+    size_t victimIndex;
+    std::mt19937 rng;
+
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static uint64_t hashKey(const std::string& key) {
+        return mix(std::hash<std::string>()(key));
+    }
+
+    size_t altIndex(size_t index, uint16_t fp) const {
+        size_t tag = static_cast<size_t>(fp * 0x5bd1e995u) % bucketCount;
+        return tag >= index ? tag - index : tag + bucketCount - index;
+    }
+
+    uint64_t readBucket(size_t b) const {
+        size_t pos = b * bucketBits;
+        size_t w = pos >> 6;
+        unsigned off = static_cast<unsigned>(pos & 63);
+        uint64_t v = words[w] >> off;
+        if (off + bucketBits > 64) v |= words[w + 1] << (64 - off);
+        return v & bucketMask;
+    }
+
+    void writeBucket(size_t b, uint64_t v) {
+        size_t pos = b * bucketBits;
+        size_t w = pos >> 6;
+        unsigned off = static_cast<unsigned>(pos & 63);
+        words[w] = (words[w] & ~(bucketMask << off)) | (v << off);
+        if (off + bucketBits > 64) {
+            unsigned spill = 64 - off;
+            words[w + 1] = (words[w + 1] & ~(bucketMask >> spill)) | (v >> spill);
+        }
+    }
+
+    uint16_t slotOf(uint64_t bucket, int s) const {
+        return static_cast<uint16_t>((bucket >> (bits * s)) & fpMask);
+    }
+
+    uint64_t withSlot(uint64_t bucket, int s, uint16_t fp) const {
+        unsigned shift = bits * s;
+        return (bucket & ~(static_cast<uint64_t>(fpMask) << shift)) | (static_cast<uint64_t>(fp) << shift);
+    }
+
+    // 4 个槽里有没有等于 fp 的：异或后找全零的槽
+    bool bucketHas(uint64_t bucket, uint16_t fp) const {
+        uint64_t x = bucket ^ (laneLow * fp);
+        return ((x - laneLow) & ~x & laneHigh) != 0;
+    }
+
+    bool placeIn(size_t b, uint16_t fp) {
+        uint64_t bucket = readBucket(b);
+        for (int s = 0; s < kSlots; ++s) {
+            if (slotOf(bucket, s) == 0) {
+                writeBucket(b, withSlot(bucket, s, fp));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool removeFrom(size_t b, uint16_t fp) {
+        uint64_t bucket = readBucket(b);
+        for (int s = 0; s < kSlots; ++s) {
+            if (slotOf(bucket, s) == fp) {
+                writeBucket(b, withSlot(bucket, s, 0));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void locate(const std::string& key, size_t& i1, size_t& i2, uint16_t& fp) const {
+        uint64_t h = hashKey(key);
+        fp = static_cast<uint16_t>((h >> 32) & fpMask);
+        if (fp == 0) fp = 1;  // 0 表示空槽
+        i1 = static_cast<size_t>(static_cast<uint32_t>(h)) % bucketCount;
+        i2 = altIndex(i1, fp);
+    }
+
+    // 两个桶都满时随机踢出一个指纹搬到它的另一个桶，搬不动就把最后一个放进 victim
+    void place(size_t index, uint16_t fp) {
+        for (int kick = 0; kick < kMaxKicks; ++kick) {
+            if (placeIn(index, fp)) return;
+            int s = static_cast<int>(rng() % kSlots);
+            uint64_t bucket = readBucket(index);
+            uint16_t evicted = slotOf(bucket, s);
+            writeBucket(index, withSlot(bucket, s, fp));
+            fp = evicted;
+            index = altIndex(index, fp);
+        }
+        hasVictim = true;
+        victimFp = fp;
+        victimIndex = index;
+    }
+
+public:
+    // capacity 为预计的键数，装到 capacity 时装载率约 90%；falsePositiveRate 为满载时的目标误判率
+    explicit CuckooFilter(size_t capacity = 1 << 20, double falsePositiveRate = 0.001)
+        : bucketCount(1), bits(16), bucketBits(64), fpMask(0xffff), bucketMask(~0ULL), laneLow(0), laneHigh(0),
+          count(0), hasVictim(false), victimFp(0), victimIndex(0), rng(7) {
+        double wanted = std::ceil(static_cast<double>(capacity == 0 ? 1 : capacity) / (kSlots * 0.9));
+        bucketCount = std::max<size_t>(1, static_cast<size_t>(wanted));
+        double rate = falsePositiveRate > 0 ? falsePositiveRate : 1e-9;
+        double needed = std::ceil(std::log2(2.0 * kSlots / rate));
+        bits = static_cast<unsigned>(needed < 4 ? 4 : (needed > 16 ? 16 : needed));
+        fpMask = static_cast<uint16_t>((1u << bits) - 1);
+        bucketBits = bits * kSlots;
+        bucketMask = bucketBits == 64 ? ~0ULL : ((1ULL << bucketBits) - 1);
+        for (int s = 0; s < kSlots; ++s) laneLow |= 1ULL << (bits * s);
+        laneHigh = laneLow << (bits - 1);
+        words.assign((bucketCount * bucketBits + 63) / 64 + 1, 0);
+    }
+
+    // 失败（表满、victim 已被占用）时返回 false，过滤器内容不变
+    bool insert(const std::string& key) {
+        if (hasVictim) return false;
+        size_t i1, i2;
+        uint16_t fp;
+        locate(key, i1, i2, fp);
+        if (placeIn(i1, fp) || placeIn(i2, fp)) {
+            count++;
+            return true;
+        }
+        place((rng() & 1) ? i1 : i2, fp);
+        count++;
+        return true;
+    }
+
+    bool mayContain(const std::string& key) const {
+        size_t i1, i2;
+        uint16_t fp;
+        locate(key, i1, i2, fp);
+        if (bucketHas(readBucket(i1), fp) || bucketHas(readBucket(i2), fp)) return true;
+        return hasVictim && victimFp == fp && (victimIndex == i1 || victimIndex == i2);
+    }
+
+    // 只能删除插入过的键，否则可能删掉别人的同名指纹
+    bool erase(const std::string& key) {
+        size_t i1, i2;
+        uint16_t fp;
+        locate(key, i1, i2, fp);
+        if (removeFrom(i1, fp) || removeFrom(i2, fp)) {
+            count--;
+            if (hasVictim) {
+                hasVictim = false;
+                place(victimIndex, victimFp);
+            }
+            return true;
+        }
+        if (hasVictim && victimFp == fp && (victimIndex == i1 || victimIndex == i2)) {
+            hasVictim = false;
+            count--;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        std::fill(words.begin(), words.end(), 0);
+        count = 0;
+        hasVictim = false;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t slotCount() const {
+        return bucketCount * kSlots;
+    }
+
+    unsigned fingerprintBits() const {
+        return bits;
+    }
+
+    double loadFactor() const {
+        return static_cast<double>(count) / slotCount();
+    }
+
+    // 当前装载率下的理论误判率
+    double expectedFalsePositiveRate() const {
+        double perSlot = 1.0 / static_cast<double>(fpMask);
+        return 1.0 - std::pow(1.0 - perSlot, 2.0 * kSlots * loadFactor());
+    }
+
+    size_t memoryUsage() const {
+        return words.capacity() * sizeof(uint64_t);
+    }
+};
+
+// 全系统的专利存在性过滤器，作为观察者随增删维护；转让不改变存在性
+// 插入失败（容量不够）后进入饱和状态：mayContain 一律返回 true，保证不出假阴性，直到 rebuild
+class PatentExistenceFilter : public IFirmSystemObserver {
+private:
+    CuckooFilter filter;
+    double targetRate;
+    bool saturated;
+
+public:
+    explicit PatentExistenceFilter(size_t capacity = 1 << 20, double falsePositiveRate = 0.001)
+        : filter(capacity, falsePositiveRate), targetRate(falsePositiveRate), saturated(false) {}
+
+    void onFirmRemoved(const IFirm& firm) override {
+        if (saturated) return;
+        firm.forEachPatent([&](const Patent& p) {
+            filter.erase(p.getPatentID());
+        });
+    }
+
+    void onPatentAdded(const std::string&, const Patent& patent) override {
+        if (!saturated && !filter.insert(patent.getPatentID())) {
+            saturated = true;
+        }
+    }
+
+    void onPatentRemoved(const std::string&, const Patent& patent) override {
+        if (!saturated) filter.erase(patent.getPatentID());
+    }
+
+    // false 表示一定不存在；true 表示可能存在，需要再查一遍
+    bool mayContain(const std::string& patentID) const {
+        return saturated || filter.mayContain(patentID);
+    }
+
+    bool needsRebuild() const {
+        return saturated;
+    }
+
+    // 按现有专利数的 1.5 倍重新分配（装载率约 60%，留出继续增加的余地）并全部重新插入
+    void rebuild(const IFirmSystem& system) {
+        size_t patents = 0;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            patents += static_cast<size_t>(firm->getPatentCount());
+        });
+        filter = CuckooFilter(patents + patents / 2, targetRate);
+        saturated = false;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            firm->forEachPatent([&](const Patent& p) {
+                if (!saturated && !filter.insert(p.getPatentID())) saturated = true;
+            });
+        });
+    }
+
+    const CuckooFilter& stats() const {
+        return filter;
+    }
+};
+
+// 逐个企业遍历专利，不依赖各实现 getPatent 找不到时的不同行为（抛异常或返回空专利）
+inline bool scanForPatent(const IFirmSystem& system, const std::string& patentID) {
+    bool found = false;
+    system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+        if (found) return;
+        firm->forEachPatent([&](const Patent& p) {
+            if (!found && p.getPatentID() == patentID) found = true;
+        });
+    });
+    return found;
+}
+
+// 先问过滤器，只有“可能存在”时才做全量扫描
+inline bool patentExists(const IFirmSystem& system, const PatentExistenceFilter& filter, const std::string& patentID) {
+    return filter.mayContain(patentID) && scanForPatent(system, patentID);
+}
+
+#endif
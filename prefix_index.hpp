@@ -0,0 +1,751 @@
+#ifndef PREFIX_INDEX_HPP
+#define PREFIX_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "firmSys.hpp"
+
+inline std::string foldCase(const std::string& s) {
+    std::string folded(s);
+    foldLowerInPlace(folded);
+    return folded;
+}
+
+// 可原地增删的压缩前缀树（radix trie），节点和条目放在数组里，删掉的槽位进空闲表复用
+//
+// 每个节点的子节点按边标签首字符排成有序数组，首字符和子节点下标放在一起，找子节点不用逐个读子节点；
+// 和兄弟不共享首字符的键不单独建叶子节点，条目直接挂在父节点的子数组里，键的其余部分就是它的边标签，
+// 第二个键走到同一个首字符时才建节点。节点的边标签都指向同一个 labels 缓冲区，拆分节点只改偏移
+// 子树条目多于 kCached 个的节点缓存其中得分最高的 kCached 个，增删或改分只沿条目到根的路径维护缓存，
+// 所以 top-k 补全只需沿前缀走到节点再读缓存
+// 不带得分（ranked = false）时补全按键的字典序，子树的前 k 个就是按序遍历的前 k 个，不维护缓存
+// 模糊匹配允许前缀有 maxEdits 次编辑（增、删、改），用逐字符的 Levenshtein 行在树上剪枝搜索
+class PrefixIndex {
+public:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Completion {
+        std::string text;
+        std::string value;
+        uint32_t score;
+        int edits;
+    };
+
+private:
+    enum { kCached = 16 };
+
+    struct Entry {
+        std::string data;   // 小写的键、值（例如 firmID）、原始文本依次拼接；原始文本和键相同时省略
+        uint32_t keyLen;
+        uint32_t valueLen;
+        uint32_t score;
+        uint32_t node;      // 键在这个节点结束，或作为子数组里的条目挂在这个节点下；kNone 表示在空闲表里
+        uint32_t next;      // 同一节点结束的下一个条目，或空闲表的下一个
+    };
+
+    static const uint32_t kTail = 0x80000000u;
+
+    struct Child {
+        unsigned char first;  // 边标签的首字符；按无符号比较，和 std::string 的字典序一致
+        uint32_t ref;  // 子节点下标；带 kTail 位时是直接挂着的条目
+    };
+
+    struct Node {
+        uint32_t labelStart;  // 边标签在 labels 中的位置
+        uint32_t labelLen;
+        uint32_t parent;      // kNone 表示根或在空闲表里
+        uint32_t firstEntry;  // 在这个节点结束的条目；空闲节点借用它串起空闲表
+        uint32_t size;        // 子树中的条目数，含直接挂着的条目
+        uint32_t cache;       // size > kCached 时缓存在 caches 中的位置，否则 kNone
+        std::vector<Child> children;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Node> nodes;
+    std::string labels;
+    std::vector<std::vector<uint32_t>> caches;
+    std::vector<uint32_t> freeCaches;
+    bool ranked;
+    uint32_t freeEntry;
+    uint32_t freeNode;
+    size_t liveEntries;
+    size_t liveLabelBytes;
+
+    bool better(uint32_t a, uint32_t b) const {
+        const Entry& x = entries[a];
+        const Entry& y = entries[b];
+        if (x.score != y.score) return x.score > y.score;
+        int order = x.data.compare(0, x.keyLen, y.data, 0, y.keyLen);
+        if (order != 0) return order < 0;
+        return a < b;
+    }
+
+    uint32_t newNode(uint32_t parent, uint32_t labelStart, uint32_t labelLen) {
+        uint32_t index;
+        if (freeNode != kNone) {
+            index = freeNode;
+            freeNode = nodes[index].firstEntry;
+        } else {
+            index = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(Node());
+        }
+        Node& node = nodes[index];
+        node.labelStart = labelStart;
+        node.labelLen = labelLen;
+        node.parent = parent;
+        node.firstEntry = kNone;
+        node.size = 0;
+        node.cache = kNone;
+        node.children.clear();
+        liveLabelBytes += labelLen;
+        return index;
+    }
+
+    std::vector<Child>::iterator childSlot(uint32_t parent, unsigned char c) {
+        std::vector<Child>& children = nodes[parent].children;
+        return std::lower_bound(children.begin(), children.end(), c,
+                                [](const Child& child, unsigned char value) { return child.first < value; });
+    }
+
+    uint32_t findChild(uint32_t parent, unsigned char c) const {
+        for (const Child& child : nodes[parent].children) {
+            if (child.first == c) return child.ref;
+            if (child.first > c) break;
+        }
+        return kNone;
+    }
+
+    void releaseCache(uint32_t index) {
+        Node& node = nodes[index];
+        if (node.cache == kNone) return;
+        caches[node.cache].clear();
+        freeCaches.push_back(node.cache);
+        node.cache = kNone;
+    }
+
+    void collectAll(uint32_t index, std::vector<uint32_t>& out) const {
+        for (uint32_t e = nodes[index].firstEntry; e != kNone; e = entries[e].next) out.push_back(e);
+        for (const Child& child : nodes[index].children) {
+            if (child.ref & kTail) {
+                out.push_back(child.ref & ~kTail);
+            } else {
+                collectAll(child.ref, out);
+            }
+        }
+    }
+
+    // 由本节点的条目和子节点的缓存（小子树直接取全部条目）重新算出缓存
+    void recompute(uint32_t index) {
+        std::vector<uint32_t> candidates;
+        for (uint32_t e = nodes[index].firstEntry; e != kNone; e = entries[e].next) candidates.push_back(e);
+        for (const Child& child : nodes[index].children) {
+            if (child.ref & kTail) {
+                candidates.push_back(child.ref & ~kTail);
+            } else if (nodes[child.ref].cache != kNone) {
+                const std::vector<uint32_t>& top = caches[nodes[child.ref].cache];
+                candidates.insert(candidates.end(), top.begin(), top.end());
+            } else {
+                collectAll(child.ref, candidates);
+            }
+        }
+        size_t keep = std::min<size_t>(candidates.size(), kCached);
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                          [this](uint32_t a, uint32_t b) { return better(a, b); });
+        candidates.resize(keep);
+        if (nodes[index].cache == kNone) {
+            if (freeCaches.empty()) {
+                nodes[index].cache = static_cast<uint32_t>(caches.size());
+                caches.push_back(std::vector<uint32_t>());
+            } else {
+                nodes[index].cache = freeCaches.back();
+                freeCaches.pop_back();
+            }
+        }
+        caches[nodes[index].cache].swap(candidates);
+    }
+
+    // 把 id 放到已排序缓存里的位置上，超出 kCached 的最后一个丢掉
+    void placeInCache(std::vector<uint32_t>& top, uint32_t id) {
+        top.insert(std::upper_bound(top.begin(), top.end(), id,
+                                    [this](uint32_t a, uint32_t b) { return better(a, b); }), id);
+        if (top.size() > kCached) top.pop_back();
+    }
+
+    // id 刚插入或得分变高：路径上的缓存只可能收进它或把它往前挪
+    void promote(uint32_t index, uint32_t id) {
+        if (!ranked) return;
+        for (; index != kNone; index = nodes[index].parent) {
+            Node& node = nodes[index];
+            if (node.size <= kCached) continue;
+            if (node.cache == kNone) {
+                recompute(index);
+                continue;
+            }
+            std::vector<uint32_t>& top = caches[node.cache];
+            auto it = std::find(top.begin(), top.end(), id);
+            if (it != top.end()) {
+                top.erase(it);
+            } else if (top.size() >= kCached && !better(id, top.back())) {
+                continue;
+            }
+            placeInCache(top, id);
+        }
+    }
+
+    // 缓存里少了一个：剩下的仍是最好的那些，从本节点的条目和每个子节点里各取不在缓存中的最好一个，补上其中最好的；
+    // 子节点的缓存是排好序的，第一个不在本节点缓存里的就是它能给的最好的
+    void refill(uint32_t index, std::vector<uint32_t>& top) {
+        uint32_t best = kNone;
+        auto consider = [&](uint32_t e) {
+            if (std::find(top.begin(), top.end(), e) != top.end()) return;
+            if (best == kNone || better(e, best)) best = e;
+        };
+        for (uint32_t e = nodes[index].firstEntry; e != kNone; e = entries[e].next) consider(e);
+        std::vector<uint32_t> small;
+        for (const Child& child : nodes[index].children) {
+            if (child.ref & kTail) {
+                consider(child.ref & ~kTail);
+            } else if (nodes[child.ref].cache != kNone) {
+                for (uint32_t e : caches[nodes[child.ref].cache]) {
+                    if (std::find(top.begin(), top.end(), e) == top.end()) {
+                        consider(e);
+                        break;
+                    }
+                }
+            } else {
+                small.clear();
+                collectAll(child.ref, small);
+                for (uint32_t e : small) consider(e);
+            }
+        }
+        if (best != kNone) placeInCache(top, best);
+    }
+
+    // id 已经摘掉或得分变低：只有缓存里有它的节点要处理；降分后仍胜过缓存里最后一个的，只挪位置
+    void demote(uint32_t index, uint32_t id, bool erased) {
+        if (!ranked) return;
+        for (; index != kNone; index = nodes[index].parent) {
+            Node& node = nodes[index];
+            if (node.cache == kNone) continue;
+            if (node.size <= kCached) {
+                releaseCache(index);
+                continue;
+            }
+            std::vector<uint32_t>& top = caches[node.cache];
+            auto it = std::find(top.begin(), top.end(), id);
+            if (it == top.end()) continue;
+            bool keep = !erased && it + 1 != top.end() && better(id, top.back());
+            top.erase(it);
+            if (keep) {
+                placeInCache(top, id);
+            } else {
+                refill(index, top);
+            }
+        }
+    }
+
+    // 删掉没有条目的叶子链；只剩一个子节点的内部节点不再合并，匹配照常进行
+    void prune(uint32_t index) {
+        while (index != 0 && nodes[index].size == 0) {
+            uint32_t parent = nodes[index].parent;
+            std::vector<Child>& siblings = nodes[parent].children;
+            for (auto it = siblings.begin(); it != siblings.end(); ++it) {
+                if (it->ref == index) {
+                    siblings.erase(it);
+                    break;
+                }
+            }
+            releaseCache(index);
+            liveLabelBytes -= nodes[index].labelLen;
+            std::vector<Child>().swap(nodes[index].children);
+            nodes[index].parent = kNone;
+            nodes[index].firstEntry = freeNode;
+            freeNode = index;
+            index = parent;
+        }
+        if (labels.size() > 4096 && labels.size() > 2 * liveLabelBytes) compactLabels();
+    }
+
+    // 删除留下的标签字节超过一半时，按节点重新拷一遍
+    void compactLabels() {
+        std::string packed;
+        packed.reserve(liveLabelBytes);
+        std::vector<uint32_t> stack(1, 0);
+        while (!stack.empty()) {
+            Node& node = nodes[stack.back()];
+            stack.pop_back();
+            uint32_t start = static_cast<uint32_t>(packed.size());
+            packed.append(labels, node.labelStart, node.labelLen);
+            node.labelStart = start;
+            for (const Child& child : node.children) {
+                if (!(child.ref & kTail)) stack.push_back(child.ref);
+            }
+        }
+        labels.swap(packed);
+    }
+
+    // 按字典序遍历子树，凑够 k 个为止；同一个键的条目按编号
+    void collectInOrder(uint32_t index, size_t k, std::vector<uint32_t>& out) const {
+        size_t first = out.size();
+        for (uint32_t e = nodes[index].firstEntry; e != kNone; e = entries[e].next) out.push_back(e);
+        std::sort(out.begin() + first, out.end());
+        if (out.size() > k) out.resize(k);
+        for (const Child& child : nodes[index].children) {
+            if (out.size() >= k) return;
+            if (child.ref & kTail) {
+                out.push_back(child.ref & ~kTail);
+            } else {
+                collectInOrder(child.ref, k, out);
+            }
+        }
+    }
+
+    // ref 子树的前 k 个条目；ref 带 kTail 位时就是那一个条目
+    void collectTop(uint32_t ref, size_t k, std::vector<uint32_t>& out) const {
+        if (ref & kTail) {
+            out.push_back(ref & ~kTail);
+            return;
+        }
+        if (!ranked) {
+            collectInOrder(ref, k, out);
+            return;
+        }
+        const Node& node = nodes[ref];
+        if (node.cache != kNone && k <= kCached) {
+            const std::vector<uint32_t>& top = caches[node.cache];
+            out.insert(out.end(), top.begin(), top.begin() + std::min(k, top.size()));
+            return;
+        }
+        std::vector<uint32_t> range;
+        collectAll(ref, range);
+        size_t keep = std::min(k, range.size());
+        std::partial_sort(range.begin(), range.begin() + keep, range.end(),
+                          [this](uint32_t a, uint32_t b) { return better(a, b); });
+        out.insert(out.end(), range.begin(), range.begin() + keep);
+    }
+
+    struct Match {
+        uint32_t ref;  // 同 Child::ref
+        int edits;
+    };
+
+    // 沿着 ref 的边标签（直接挂着的条目是键从 depth 起的其余部分）逐字符推进 DP 行；前缀在编辑距离内匹配完就记录整棵子树
+    // bound 是祖先上已记录的最小编辑次数，只有还能更少时才继续往下走，嵌套的结果在 complete 中去重
+    void fuzzySearch(uint32_t ref, size_t depth, const std::string& prefix, std::vector<int> row, int maxEdits, int bound,
+                     std::vector<Match>& matches) const {
+        const char* label;
+        size_t labelLen;
+        if (ref & kTail) {
+            const Entry& e = entries[ref & ~kTail];
+            label = e.data.data() + depth;
+            labelLen = e.keyLen - depth;
+        } else {
+            label = labels.data() + nodes[ref].labelStart;
+            labelLen = nodes[ref].labelLen;
+        }
+        size_t m = prefix.size();
+        std::vector<int> next(m + 1);
+        for (size_t i = 0; i < labelLen; ++i) {
+            char c = label[i];
+            next[0] = row[0] + 1;
+            int best = next[0];
+            for (size_t j = 1; j <= m; ++j) {
+                int cost = prefix[j - 1] == c ? 0 : 1;
+                next[j] = std::min(std::min(row[j] + 1, next[j - 1] + 1), row[j - 1] + cost);
+                best = std::min(best, next[j]);
+            }
+            row.swap(next);
+            if (row[m] <= maxEdits && row[m] < bound) {
+                matches.push_back(Match{ref, row[m]});
+                bound = row[m];
+            }
+            if (best > maxEdits || best >= bound) return;
+        }
+        if (ref & kTail) return;
+        for (const Child& child : nodes[ref].children) {
+            fuzzySearch(child.ref, depth + labelLen, prefix, row, maxEdits, bound, matches);
+        }
+    }
+
+public:
+    explicit PrefixIndex(bool ranked = true) : ranked(ranked) {
+        clear();
+    }
+
+    void clear() {
+        entries.clear();
+        nodes.clear();
+        labels.clear();
+        caches.clear();
+        freeCaches.clear();
+        freeEntry = kNone;
+        freeNode = kNone;
+        liveEntries = 0;
+        liveLabelBytes = 0;
+        newNode(kNone, 0, 0);
+    }
+
+    // 插入一个条目，返回之后改分、删除用的编号
+    uint32_t insert(const std::string& text, const std::string& value, uint32_t score) {
+        std::string key = foldCase(text);
+        uint32_t id;
+        if (freeEntry != kNone) {
+            id = freeEntry;
+            freeEntry = entries[id].next;
+        } else {
+            id = static_cast<uint32_t>(entries.size());
+            entries.push_back(Entry());
+        }
+        Entry& entry = entries[id];
+        entry.data = key;
+        entry.data += value;
+        if (text != key) entry.data += text;
+        entry.keyLen = static_cast<uint32_t>(key.size());
+        entry.valueLen = static_cast<uint32_t>(value.size());
+        entry.score = ranked ? score : 0;
+        entry.next = kNone;
+
+        uint32_t index = 0;
+        size_t depth = 0;
+        while (true) {
+            if (depth == key.size()) {
+                entry.next = nodes[index].firstEntry;
+                nodes[index].firstEntry = id;
+                break;
+            }
+            unsigned char c = static_cast<unsigned char>(key[depth]);
+            auto slot = childSlot(index, c);
+            size_t at = slot - nodes[index].children.begin();
+            if (slot == nodes[index].children.end() || slot->first != c) {
+                nodes[index].children.insert(slot, Child{c, id | kTail});
+                break;
+            }
+            uint32_t child = slot->ref;
+            if (child & kTail) {
+                // 同一首字符上已经挂着一个条目：为两个键的公共部分建节点，原来的条目挂到它下面，再继续往下走
+                uint32_t other = child & ~kTail;
+                const Entry& o = entries[other];
+                size_t common = 1;
+                while (depth + common < key.size() && depth + common < o.keyLen &&
+                       o.data[depth + common] == key[depth + common]) {
+                    ++common;
+                }
+                uint32_t mid = newNode(index, static_cast<uint32_t>(labels.size()), static_cast<uint32_t>(common));
+                labels.append(key, depth, common);
+                nodes[index].children[at].ref = mid;
+                nodes[mid].size = 1;
+                entries[other].node = mid;
+                if (o.keyLen == depth + common) {
+                    nodes[mid].firstEntry = other;
+                } else {
+                    nodes[mid].children.push_back(Child{static_cast<unsigned char>(o.data[depth + common]), other | kTail});
+                }
+                index = mid;
+                depth += common;
+                continue;
+            }
+            uint32_t matched = 1;
+            const Node& node = nodes[child];
+            while (matched < node.labelLen && depth + matched < key.size() &&
+                   labels[node.labelStart + matched] == key[depth + matched]) {
+                ++matched;
+            }
+            if (matched < node.labelLen) {
+                // 在 matched 处拆开：新的中间节点接管 child 的位置、子树大小和缓存，child 成为它唯一的子节点
+                uint32_t mid = newNode(index, node.labelStart, matched);
+                liveLabelBytes -= matched;
+                Node& old = nodes[child];
+                old.parent = mid;
+                old.labelStart += matched;
+                old.labelLen -= matched;
+                nodes[mid].size = old.size;
+                nodes[mid].children.push_back(Child{static_cast<unsigned char>(labels[old.labelStart]), child});
+                nodes[index].children[at].ref = mid;
+                if (old.cache != kNone) recompute(mid);
+                child = mid;
+            }
+            index = child;
+            depth += matched;
+        }
+
+        entry.node = index;
+        ++liveEntries;
+        for (uint32_t n = index; n != kNone; n = nodes[n].parent) ++nodes[n].size;
+        promote(index, id);
+        return id;
+    }
+
+    void erase(uint32_t id) {
+        uint32_t index = entries[id].node;
+        uint32_t* link = &nodes[index].firstEntry;
+        while (*link != kNone && *link != id) link = &entries[*link].next;
+        if (*link == id) {
+            *link = entries[id].next;
+        } else {
+            std::vector<Child>& children = nodes[index].children;
+            for (auto it = children.begin(); it != children.end(); ++it) {
+                if (it->ref == (id | kTail)) {
+                    children.erase(it);
+                    break;
+                }
+            }
+        }
+        for (uint32_t n = index; n != kNone; n = nodes[n].parent) --nodes[n].size;
+        demote(index, id, true);
+        prune(index);
+        Entry& entry = entries[id];
+        std::string().swap(entry.data);
+        entry.node = kNone;
+        entry.next = freeEntry;
+        freeEntry = id;
+        --liveEntries;
+    }
+
+    // 不带得分的索引忽略得分
+    void setScore(uint32_t id, uint32_t score) {
+        if (!ranked) return;
+        uint32_t old = entries[id].score;
+        if (old == score) return;
+        entries[id].score = score;
+        if (score > old) {
+            promote(entries[id].node, id);
+        } else {
+            demote(entries[id].node, id, false);
+        }
+    }
+
+    void setValue(uint32_t id, const std::string& value) {
+        Entry& entry = entries[id];
+        entry.data.replace(entry.keyLen, entry.valueLen, value);
+        entry.valueLen = static_cast<uint32_t>(value.size());
+    }
+
+    // 键（忽略大小写）等于 text 的一个条目，没有返回 kNone
+    uint32_t find(const std::string& text) const {
+        std::string key = foldCase(text);
+        uint32_t index = 0;
+        size_t depth = 0;
+        while (depth < key.size()) {
+            index = findChild(index, key[depth]);
+            if (index == kNone) return kNone;
+            if (index & kTail) {
+                const Entry& e = entries[index & ~kTail];
+                bool same = e.keyLen == key.size() && e.data.compare(depth, key.size() - depth, key, depth, std::string::npos) == 0;
+                return same ? (index & ~kTail) : kNone;
+            }
+            // 首字符在子数组里已经比过
+            const Node& node = nodes[index];
+            if (node.labelLen > 1 &&
+                key.compare(depth + 1, node.labelLen - 1, labels, node.labelStart + 1, node.labelLen - 1) != 0) {
+                return kNone;
+            }
+            depth += node.labelLen;
+        }
+        return nodes[index].firstEntry;
+    }
+
+    std::string textOf(uint32_t id) const {
+        const Entry& e = entries[id];
+        size_t textStart = e.keyLen + e.valueLen;
+        return textStart < e.data.size() ? e.data.substr(textStart) : e.data.substr(0, e.keyLen);
+    }
+
+    std::string valueOf(uint32_t id) const {
+        return entries[id].data.substr(entries[id].keyLen, entries[id].valueLen);
+    }
+
+    size_t size() const { return liveEntries; }
+
+    // 得分最高的 k 个补全；maxEdits > 0 时允许前缀有拼写错误，编辑次数少的排在前面
+    std::vector<Completion> complete(const std::string& prefix, size_t k, int maxEdits = 0) const {
+        std::vector<Completion> result;
+        if (liveEntries == 0 || k == 0) return result;
+        std::string p = foldCase(prefix);
+
+        std::vector<Match> matches;
+        std::vector<int> row(p.size() + 1);
+        for (size_t j = 0; j <= p.size(); ++j) row[j] = static_cast<int>(j);
+        int bound = maxEdits + 1;
+        if (row[p.size()] <= maxEdits) {
+            matches.push_back(Match{0, row[p.size()]});
+            bound = row[p.size()];
+        }
+        if (bound > 0) {
+            fuzzySearch(0, 0, p, row, maxEdits, bound, matches);
+        }
+
+        std::vector<std::pair<int, uint32_t>> candidates;
+        for (const auto& match : matches) {
+            std::vector<uint32_t> found;
+            collectTop(match.ref, k, found);
+            for (uint32_t e : found) candidates.push_back(std::make_pair(match.edits, e));
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [this](const std::pair<int, uint32_t>& a, const std::pair<int, uint32_t>& b) {
+                      if (a.first != b.first) return a.first < b.first;
+                      return better(a.second, b.second);
+                  });
+        std::vector<uint32_t> emitted;
+        for (size_t i = 0; i < candidates.size() && result.size() < k; ++i) {
+            uint32_t id = candidates[i].second;
+            if (std::find(emitted.begin(), emitted.end(), id) != emitted.end()) continue;
+            emitted.push_back(id);
+            result.push_back(Completion{textOf(id), valueOf(id), entries[id].score, candidates[i].first});
+        }
+        return result;
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = nodes.capacity() * sizeof(Node) + labels.capacity() + entries.capacity() * sizeof(Entry);
+        for (const auto& node : nodes) bytes += node.children.capacity() * sizeof(Child);
+        for (const auto& top : caches) bytes += sizeof(top) + top.capacity() * sizeof(uint32_t);
+        for (const auto& e : entries) bytes += stringHeapBytes(e.data);
+        return bytes;
+    }
+};
+
+// 企业名称、企业 ID 和专利 ID 三个前缀索引，作为观察者随每次变更原地更新，加载时就随之建好
+// 企业按专利数量排序，数量变了只改两个企业条目的得分；专利 ID 按 ID 排序，和企业的数量无关，
+// 所以数量变化从不碰专利 ID 索引，补全结果里的得分在查询时取所属企业当前的数量
+class AutocompleteIndex : public IFirmSystemObserver {
+public:
+    enum class Field {
+        FirmName,
+        FirmID,
+        PatentID
+    };
+
+private:
+    struct FirmInfo {
+        uint32_t nameEntry;
+        uint32_t idEntry;
+        uint32_t patentCount;
+    };
+
+    std::unordered_map<std::string, FirmInfo> firms;
+    PrefixIndex names;
+    PrefixIndex firmIDs;
+    PrefixIndex patentIDs;
+
+    void adjustCount(const std::string& firmID, int64_t delta) {
+        auto it = firms.find(firmID);
+        if (it == firms.end()) return;
+        FirmInfo& info = it->second;
+        info.patentCount = static_cast<uint32_t>(std::max<int64_t>(0, static_cast<int64_t>(info.patentCount) + delta));
+        names.setScore(info.nameEntry, info.patentCount);
+        firmIDs.setScore(info.idEntry, info.patentCount);
+    }
+
+    void setOwner(const std::string& patentID, const std::string& firmID) {
+        uint32_t id = patentIDs.find(patentID);
+        if (id == PrefixIndex::kNone) {
+            patentIDs.insert(patentID, firmID, 0);
+        } else {
+            patentIDs.setValue(id, firmID);
+        }
+    }
+
+    const PrefixIndex& indexFor(Field field) const {
+        switch (field) {
+            case Field::FirmName: return names;
+            case Field::FirmID: return firmIDs;
+            case Field::PatentID: return patentIDs;
+        }
+        return names;
+    }
+
+public:
+    AutocompleteIndex() : patentIDs(false) {}
+
+    void onFirmAdded(const std::string& firmID, const std::string& firmName) override {
+        auto it = firms.find(firmID);
+        if (it == firms.end()) {
+            firms[firmID] = FirmInfo{names.insert(firmName, firmID, 0), firmIDs.insert(firmID, firmID, 0), 0};
+        } else if (names.textOf(it->second.nameEntry) != firmName) {
+            names.erase(it->second.nameEntry);
+            it->second.nameEntry = names.insert(firmName, firmID, it->second.patentCount);
+        }
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        firm.forEachPatent([&](const Patent& p) {
+            uint32_t id = patentIDs.find(p.patentIDRef());
+            if (id != PrefixIndex::kNone) patentIDs.erase(id);
+        });
+        auto it = firms.find(firm.getFirmID());
+        if (it == firms.end()) return;
+        names.erase(it->second.nameEntry);
+        firmIDs.erase(it->second.idEntry);
+        firms.erase(it);
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        setOwner(patent.patentIDRef(), firmID);
+        adjustCount(firmID, 1);
+    }
+
+    void onPatentRemoved(const std::string& firmID, const Patent& patent) override {
+        uint32_t id = patentIDs.find(patent.patentIDRef());
+        if (id != PrefixIndex::kNone) patentIDs.erase(id);
+        adjustCount(firmID, -1);
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        setOwner(patentID, toFirmID);
+        adjustCount(fromFirmID, -1);
+        adjustCount(toFirmID, 1);
+    }
+
+    // 整体并入：专利只改所属企业，两个企业的得分各改一次
+    void onFirmsMerged(const std::string& intoFirmID, const std::string& fromFirmID,
+                       const std::vector<std::string>& patentIDs) override {
+        for (const auto& patentID : patentIDs) setOwner(patentID, intoFirmID);
+        adjustCount(intoFirmID, static_cast<int64_t>(patentIDs.size()));
+        adjustCount(fromFirmID, -static_cast<int64_t>(patentIDs.size()));
+    }
+
+    std::vector<PrefixIndex::Completion> complete(Field field, const std::string& prefix, size_t k, int maxEdits = 0) const {
+        std::vector<PrefixIndex::Completion> result = indexFor(field).complete(prefix, k, maxEdits);
+        if (field == Field::PatentID) {
+            for (auto& c : result) {
+                auto it = firms.find(c.value);
+                c.score = it == firms.end() ? 0 : it->second.patentCount;
+            }
+        }
+        return result;
+    }
+
+    // 同时按名称和 ID 查找企业，按 firmID 去重
+    std::vector<PrefixIndex::Completion> suggestFirms(const std::string& prefix, size_t k, int maxEdits = 0) const {
+        std::vector<PrefixIndex::Completion> result = firmIDs.complete(prefix, k, maxEdits);
+        std::vector<PrefixIndex::Completion> byName = names.complete(prefix, k, maxEdits);
+        result.insert(result.end(), byName.begin(), byName.end());
+        std::stable_sort(result.begin(), result.end(),
+                         [](const PrefixIndex::Completion& a, const PrefixIndex::Completion& b) {
+                             if (a.edits != b.edits) return a.edits < b.edits;
+                             return a.score > b.score;
+                         });
+        std::vector<PrefixIndex::Completion> unique;
+        for (const auto& c : result) {
+            bool seen = false;
+            for (const auto& u : unique) {
+                if (u.value == c.value) {
+                    seen = true;
+                    break;
+                }
+            }
+            if (!seen) unique.push_back(c);
+            if (unique.size() == k) break;
+        }
+        return unique;
+    }
+
+    size_t memoryUsage() const {
+        return names.memoryUsage() + firmIDs.memoryUsage() + patentIDs.memoryUsage();
+    }
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// 守护进程与客户端之间的二进制协议（小端序）
+//
+// 帧:    [u32 body长度][body]
+// 请求:  [u32 requestID][u8 opcode][u16 参数个数]{[u16 长度][字节]}...
+// 响应:  [u32 requestID][u8 status][u32 字段个数]{[u16 长度][字节]}...
+//
+// 客户端可以连续发送多个请求而不必等待响应（pipelining），
+// 响应通过 requestID 与请求对应，耗时的查询可能乱序返回。
+namespace protocol {
+
+enum class OpCode : uint8_t {
+    Ping = 0,
+    GetFirm = 1,        // firmID -> firmID, firmName, patentCount
+    GetPatent = 2,      // firmID, patentID -> patentID, grantdate, appldate, title, country, firmID
+    SearchTitle = 3,    // keyword, limit -> {patentID, firmID, title}...
+    AddFirm = 4,        // firmID, firmName
+    RemoveFirm = 5,     // firmID
+    AddPatent = 6,      // firmID, patentID, grantdate, appldate, title, country
+    RemovePatent = 7,   // firmID, patentID
+    TransferPatent = 8,  // fromFirmID, toFirmID, patentID
+
+    // 分片之间的两阶段转让，只由协调进程发给分片进程
+    PrepareTransferOut = 9,   // txID, fromFirmID, patentID -> patentID, grantdate, appldate, title, country, firmID
+    PrepareTransferIn = 10,   // txID, toFirmID, patentID, grantdate, appldate, title, country
+    CommitTransfer = 11,      // txID
+    AbortTransfer = 12        // txID
+};
+
+enum class Status : uint8_t {
+    Ok = 0,
+    NotFound = 1,
+    BadRequest = 2,
+    Error = 3
+};
+
+const uint32_t kMaxFrameSize = 16 * 1024 * 1024;
+
+struct Request {
+    uint32_t id;
+    OpCode op;
+    std::vector<std::string> args;
+
+    Request() : id(0), op(OpCode::Ping) {}
+    Request(uint32_t id, OpCode op, std::vector<std::string> args) : id(id), op(op), args(std::move(args)) {}
+};
+
+struct Response {
+    uint32_t id;
+    Status status;
+    std::vector<std::string> fields;
+
+    Response() : id(0), status(Status::Ok) {}
+    Response(uint32_t id, Status status) : id(id), status(status) {}
+};
+
+inline void putU16(std::string& out, uint16_t v) {
+    out.push_back(static_cast<char>(v & 0xff));
+    out.push_back(static_cast<char>((v >> 8) & 0xff));
+}
+
+inline void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+inline uint16_t getU16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(u[0] | (u[1] << 8));
+}
+
+inline uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8)
+         | (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+inline void putString(std::string& out, const std::string& s) {
+    size_t len = s.size() > 0xffff ? 0xffff : s.size();
+    putU16(out, static_cast<uint16_t>(len));
+    out.append(s.data(), len);
+}
+
+// 读取一个 u16 长度前缀的字符串，越界时返回 false
+inline bool getString(const char*& p, const char* end, std::string& s) {
+    if (end - p < 2) return false;
+    uint16_t len = getU16(p);
+    p += 2;
+    if (end - p < len) return false;
+    s.assign(p, len);
+    p += len;
+    return true;
+}
+
+inline void encodeRequest(const Request& req, std::string& out) {
+    size_t start = out.size();
+    putU32(out, 0);
+    putU32(out, req.id);
+    out.push_back(static_cast<char>(req.op));
+    putU16(out, static_cast<uint16_t>(req.args.size()));
+    for (const auto& arg : req.args) {
+        putString(out, arg);
+    }
+    uint32_t bodyLen = static_cast<uint32_t>(out.size() - start - 4);
+    std::string len;
+    putU32(len, bodyLen);
+    std::memcpy(&out[start], len.data(), 4);
+}
+
+inline void encodeResponse(const Response& resp, std::string& out) {
+    size_t start = out.size();
+    putU32(out, 0);
+    putU32(out, resp.id);
+    out.push_back(static_cast<char>(resp.status));
+    putU32(out, static_cast<uint32_t>(resp.fields.size()));
+    for (const auto& field : resp.fields) {
+        putString(out, field);
+    }
+    uint32_t bodyLen = static_cast<uint32_t>(out.size() - start - 4);
+    std::string len;
+    putU32(len, bodyLen);
+    std::memcpy(&out[start], len.data(), 4);
+}
+
+inline bool decodeRequest(const char* p, size_t len, Request& req) {
+    const char* end = p + len;
+    if (len < 7) return false;
+    req.id = getU32(p);
+    req.op = static_cast<OpCode>(static_cast<unsigned char>(p[4]));
+    uint16_t argc = getU16(p + 5);
+    p += 7;
+    req.args.clear();
+    req.args.reserve(argc);
+    for (uint16_t i = 0; i < argc; ++i) {
+        std::string arg;
+        if (!getString(p, end, arg)) return false;
+        req.args.push_back(std::move(arg));
+    }
+    return p == end;
+}
+
+inline bool decodeResponse(const char* p, size_t len, Response& resp) {
+    const char* end = p + len;
+    if (len < 9) return false;
+    resp.id = getU32(p);
+    resp.status = static_cast<Status>(static_cast<unsigned char>(p[4]));
+    uint32_t count = getU32(p + 5);
+    p += 9;
+    resp.fields.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string field;
+        if (!getString(p, end, field)) return false;
+        resp.fields.push_back(std::move(field));
+    }
+    return p == end;
+}
+
+// 从缓冲区 offset 处取出一个完整帧的 body；帧不完整时返回 false
+// 帧长度超过上限时把 oversized 置为 true，调用者应断开连接
+inline bool nextFrame(const std::string& buf, size_t& offset, const char*& body, size_t& bodyLen, bool& oversized) {
+    oversized = false;
+    if (buf.size() - offset < 4) return false;
+    uint32_t len = getU32(buf.data() + offset);
+    if (len > kMaxFrameSize) {
+        oversized = true;
+        return false;
+    }
+    if (buf.size() - offset - 4 < len) return false;
+    body = buf.data() + offset + 4;
+    bodyLen = len;
+    offset += 4 + len;
+    return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,961 @@
+#ifndef QUERY_HPP
+#define QUERY_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cctype>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 专利的即席查询：条件之间是 AND，由规划器按代价选一条访问路径（企业、patentID 索引、日期索引、标题词索引或并行全表扫描），
+// 其余条件作为过滤；编译好的查询按文本缓存
+//
+// 查询语言：
+//   query     := condition (AND condition)* [LIMIT n]
+//   condition := firm = V | patent = V | country = V | title CONTAINS V
+//              | appldate|grantdate (= D | BETWEEN D AND D | >= D | <= D | > D | < D)
+//   V 是不含空格的词或带引号的字符串；D 是 YYYY、YYYYMM 或 YYYYMMDD，前两种表示整年、整月
+//   title CONTAINS 按整词匹配，不区分大小写，多个词要全部出现
+
+enum class QueryField { Firm, Patent, Country, Appldate, Grantdate, Title };
+
+struct QueryCondition {
+    QueryField field;
+    std::string value;               // 企业、专利、国家的取值；标题条件的原文
+    uint32_t low = 0;                // 日期范围，两端都包含
+    uint32_t high = 0xffffffffu;
+    std::vector<std::string> words;  // 标题条件拆出的小写词
+};
+
+namespace query_detail {
+
+// 标题里的每个词（连续的字母数字，转成小写）依次放进 word 调用 fn
+template <class Fn>
+inline void forEachWord(const std::string& text, std::string& word, Fn fn) {
+    size_t i = 0, n = text.size();
+    while (i < n) {
+        while (i < n && !std::isalnum(static_cast<unsigned char>(text[i]))) ++i;
+        if (i == n) break;
+        word.clear();
+        while (i < n && std::isalnum(static_cast<unsigned char>(text[i]))) {
+            word.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(text[i]))));
+            ++i;
+        }
+        fn(word);
+    }
+}
+
+// YYYYMMDD 转成整数，格式不对返回 0
+inline uint32_t dateValue(const std::string& date) {
+    if (date.size() != 8) return 0;
+    uint32_t v = 0;
+    for (char c : date) {
+        if (c < '0' || c > '9') return 0;
+        v = v * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return v;
+}
+
+// YYYY / YYYYMM / YYYYMMDD 展开成闭区间
+inline bool dateSpan(const std::string& text, uint32_t& low, uint32_t& high) {
+    if (text.size() != 4 && text.size() != 6 && text.size() != 8) return false;
+    uint32_t v = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + static_cast<uint32_t>(c - '0');
+    }
+    if (text.size() == 4) {
+        low = v * 10000 + 101;
+        high = v * 10000 + 1231;
+    } else if (text.size() == 6) {
+        low = v * 100 + 1;
+        high = v * 100 + 31;
+    } else {
+        low = high = v;
+    }
+    return true;
+}
+
+inline std::string upper(std::string s) {
+    for (auto& c : s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return s;
+}
+
+}  // namespace query_detail
+
+// 链式构造查询：PatentQuery().firm("6066").country("US").appldate(20120101, 20121231).titleContains("processor")
+class PatentQuery {
+private:
+    std::vector<QueryCondition> conds;
+    size_t maxRows = 0;
+
+    PatentQuery& equals(QueryField field, const std::string& value) {
+        QueryCondition c;
+        c.field = field;
+        c.value = value;
+        conds.push_back(c);
+        return *this;
+    }
+
+    PatentQuery& dates(QueryField field, uint32_t low, uint32_t high) {
+        QueryCondition c;
+        c.field = field;
+        c.low = low;
+        c.high = high;
+        conds.push_back(c);
+        return *this;
+    }
+
+    static void appendDates(std::ostringstream& out, const char* name, const QueryCondition& c) {
+        out << name;
+        if (c.low == c.high) {
+            out << " = " << c.low;
+        } else if (c.low == 0) {
+            out << " <= " << c.high;
+        } else if (c.high == 0xffffffffu) {
+            out << " >= " << c.low;
+        } else {
+            out << " BETWEEN " << c.low << " AND " << c.high;
+        }
+    }
+
+public:
+    PatentQuery& firm(const std::string& firmID) { return equals(QueryField::Firm, firmID); }
+    PatentQuery& patent(const std::string& patentID) { return equals(QueryField::Patent, patentID); }
+    PatentQuery& country(const std::string& country) { return equals(QueryField::Country, country); }
+    PatentQuery& appldate(uint32_t low, uint32_t high) { return dates(QueryField::Appldate, low, high); }
+    PatentQuery& grantdate(uint32_t low, uint32_t high) { return dates(QueryField::Grantdate, low, high); }
+
+    PatentQuery& titleContains(const std::string& words) {
+        QueryCondition c;
+        c.field = QueryField::Title;
+        c.value = words;
+        std::string word;
+        query_detail::forEachWord(words, word, [&](const std::string& w) {
+            if (std::find(c.words.begin(), c.words.end(), w) == c.words.end()) c.words.push_back(w);
+        });
+        conds.push_back(c);
+        return *this;
+    }
+
+    // 最多返回多少行，0 表示不限
+    PatentQuery& limit(size_t n) {
+        maxRows = n;
+        return *this;
+    }
+
+    const std::vector<QueryCondition>& conditions() const {
+        return conds;
+    }
+
+    size_t rowLimit() const {
+        return maxRows;
+    }
+
+    // 规范形式，可以被 parseQuery 重新读入，也用作缓存的键
+    std::string text() const {
+        std::ostringstream out;
+        for (size_t i = 0; i < conds.size(); ++i) {
+            const QueryCondition& c = conds[i];
+            if (i) out << " AND ";
+            switch (c.field) {
+                case QueryField::Firm: out << "firm = '" << c.value << "'"; break;
+                case QueryField::Patent: out << "patent = '" << c.value << "'"; break;
+                case QueryField::Country: out << "country = '" << c.value << "'"; break;
+                case QueryField::Appldate: appendDates(out, "appldate", c); break;
+                case QueryField::Grantdate: appendDates(out, "grantdate", c); break;
+                case QueryField::Title: out << "title CONTAINS '" << c.value << "'"; break;
+            }
+        }
+        if (maxRows) out << " LIMIT " << maxRows;
+        return out.str();
+    }
+};
+
+// 解析查询文本；失败时返回 false，error 说明原因
+inline bool parseQuery(const std::string& text, PatentQuery& query, std::string& error) {
+    // 词法：带引号的字符串、比较运算符、其余按空白分开
+    std::vector<std::string> tokens;
+    std::vector<bool> quoted;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '\'' || c == '"') {
+            size_t end = text.find(c, i + 1);
+            if (end == std::string::npos) {
+                error = "Unterminated string";
+                return false;
+            }
+            tokens.push_back(text.substr(i + 1, end - i - 1));
+            quoted.push_back(true);
+            i = end + 1;
+        } else if (c == '=' || c == '<' || c == '>') {
+            size_t len = (c != '=' && i + 1 < text.size() && text[i + 1] == '=') ? 2 : 1;
+            tokens.push_back(text.substr(i, len));
+            quoted.push_back(false);
+            i += len;
+        } else {
+            size_t start = i;
+            while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i])) && text[i] != '=' &&
+                   text[i] != '<' && text[i] != '>' && text[i] != '\'' && text[i] != '"') {
+                ++i;
+            }
+            tokens.push_back(text.substr(start, i - start));
+            quoted.push_back(false);
+        }
+    }
+
+    PatentQuery parsed;
+    size_t pos = 0;
+    auto keyword = [&](const char* word) {
+        return pos < tokens.size() && !quoted[pos] && query_detail::upper(tokens[pos]) == word;
+    };
+    auto expectDate = [&](uint32_t& low, uint32_t& high) {
+        if (pos >= tokens.size() || !query_detail::dateSpan(tokens[pos], low, high)) {
+            error = "Expected a date (YYYY, YYYYMM or YYYYMMDD)";
+            return false;
+        }
+        ++pos;
+        return true;
+    };
+
+    while (pos < tokens.size()) {
+        if (keyword("LIMIT")) {
+            ++pos;
+            if (pos + 1 != tokens.size() || tokens[pos].find_first_not_of("0123456789") != std::string::npos ||
+                tokens[pos].empty()) {
+                error = "LIMIT expects a number at the end of the query";
+                return false;
+            }
+            parsed.limit(static_cast<size_t>(std::stoull(tokens[pos])));
+            ++pos;
+            break;
+        }
+        std::string field = quoted[pos] ? "" : query_detail::upper(tokens[pos]);
+        ++pos;
+        if (field == "TITLE") {
+            if (!keyword("CONTAINS") || pos + 1 >= tokens.size()) {
+                error = "Expected: title CONTAINS <words>";
+                return false;
+            }
+            ++pos;
+            parsed.titleContains(tokens[pos++]);
+        } else if (field == "FIRM" || field == "FIRMID" || field == "PATENT" || field == "PATENTID" || field == "COUNTRY") {
+            if (pos + 1 >= tokens.size() || tokens[pos] != "=") {
+                error = "Expected: " + tokens[pos - 1] + " = <value>";
+                return false;
+            }
+            const std::string& value = tokens[pos + 1];
+            pos += 2;
+            if (field == "FIRM" || field == "FIRMID") {
+                parsed.firm(value);
+            } else if (field == "COUNTRY") {
+                parsed.country(value);
+            } else {
+                parsed.patent(value);
+            }
+        } else if (field == "APPLDATE" || field == "GRANTDATE") {
+            uint32_t low = 0, high = 0xffffffffu, a, b;
+            if (keyword("BETWEEN")) {
+                ++pos;
+                if (!expectDate(low, a)) return false;
+                if (!keyword("AND")) {
+                    error = "Expected AND in BETWEEN";
+                    return false;
+                }
+                ++pos;
+                if (!expectDate(b, high)) return false;
+            } else if (pos < tokens.size() && !quoted[pos]) {
+                std::string op = tokens[pos++];
+                if (!expectDate(a, b)) return false;
+                if (op == "=") {
+                    low = a;
+                    high = b;
+                } else if (op == ">=") {
+                    low = a;
+                } else if (op == ">") {
+                    low = b + 1;
+                } else if (op == "<=") {
+                    high = b;
+                } else if (op == "<") {
+                    high = a - 1;
+                } else {
+                    error = "Unknown operator " + op;
+                    return false;
+                }
+            } else {
+                error = "Expected a comparison after " + field;
+                return false;
+            }
+            if (field == "APPLDATE") {
+                parsed.appldate(low, high);
+            } else {
+                parsed.grantdate(low, high);
+            }
+        } else {
+            error = "Unknown field " + tokens[pos - 1];
+            return false;
+        }
+        if (pos < tokens.size() && keyword("AND")) {
+            ++pos;
+            if (pos == tokens.size()) {
+                error = "Query ends with AND";
+                return false;
+            }
+        } else if (pos < tokens.size() && !keyword("LIMIT")) {
+            error = "Expected AND before " + tokens[pos];
+            return false;
+        }
+    }
+    if (parsed.conditions().empty()) {
+        error = "Empty query";
+        return false;
+    }
+    query = parsed;
+    return true;
+}
+
+// 给规划器用的二级索引和统计：patentID -> 条目，申请/授权日期的有序索引，标题词倒排表，按月、按国家的计数
+// 作为观察者随增删和转让维护；删除的条目先留在倒排表里，积累多了再一起清理
+class QueryIndex : public IFirmSystemObserver {
+public:
+    struct Entry {
+        std::string patentID;
+        std::string firmID;
+        std::string country;
+        uint32_t appldate = 0;
+        uint32_t grantdate = 0;
+        bool live = false;
+    };
+
+private:
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, uint32_t> byPatent;
+    std::multimap<uint32_t, uint32_t> byAppldate;
+    std::multimap<uint32_t, uint32_t> byGrantdate;
+    std::map<uint32_t, size_t> applMonths;   // YYYYMM -> 条目数
+    std::map<uint32_t, size_t> grantMonths;
+    std::unordered_map<std::string, size_t> countries;
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+    std::vector<uint32_t> freeIDs;   // 倒排表里已经没有引用的空闲条目
+    std::vector<uint32_t> staleIDs;  // 已删除但倒排表里还有引用
+    size_t liveCount = 0;
+    std::string word;
+
+    static void eraseDate(std::multimap<uint32_t, uint32_t>& index, uint32_t date, uint32_t id) {
+        auto range = index.equal_range(date);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == id) {
+                index.erase(it);
+                return;
+            }
+        }
+    }
+
+    static void count(std::map<uint32_t, size_t>& months, uint32_t date, int delta) {
+        if (date == 0) return;
+        size_t& n = months[date / 100];
+        n = delta > 0 ? n + 1 : n - 1;
+        if (n == 0) months.erase(date / 100);
+    }
+
+    // 月份计数按区间覆盖的天数比例折算
+    static double estimateMonths(const std::map<uint32_t, size_t>& months, uint32_t low, uint32_t high) {
+        double total = 0;
+        for (auto it = months.lower_bound(low / 100); it != months.end() && it->first <= high / 100; ++it) {
+            uint32_t first = std::max(low, it->first * 100 + 1);
+            uint32_t last = std::min(high, it->first * 100 + 31);
+            if (first > last) continue;
+            total += it->second * ((last % 100) - (first % 100) + 1) / 31.0;
+        }
+        return total;
+    }
+
+    // 倒排表里删掉已删除条目的引用，之后这些条目可以复用
+    void purge() {
+        for (auto it = postings.begin(); it != postings.end();) {
+            std::vector<uint32_t>& ids = it->second;
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [this](uint32_t id) { return !entries[id].live; }), ids.end());
+            if (ids.empty()) {
+                it = postings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        freeIDs.insert(freeIDs.end(), staleIDs.begin(), staleIDs.end());
+        staleIDs.clear();
+    }
+
+    void remove(const std::string& patentID) {
+        auto it = byPatent.find(patentID);
+        if (it == byPatent.end()) return;
+        uint32_t id = it->second;
+        Entry& e = entries[id];
+        eraseDate(byAppldate, e.appldate, id);
+        eraseDate(byGrantdate, e.grantdate, id);
+        count(applMonths, e.appldate, -1);
+        count(grantMonths, e.grantdate, -1);
+        if (--countries[e.country] == 0) countries.erase(e.country);
+        byPatent.erase(it);
+        e = Entry();
+        staleIDs.push_back(id);
+        liveCount--;
+        if (staleIDs.size() > 1024 && staleIDs.size() > liveCount / 4) purge();
+    }
+
+public:
+    void onFirmRemoved(const IFirm& firm) override {
+        firm.forEachPatent([this](const Patent& p) { remove(p.patentIDRef()); });
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        if (byPatent.count(patent.patentIDRef())) remove(patent.patentIDRef());
+        uint32_t id;
+        if (!freeIDs.empty()) {
+            id = freeIDs.back();
+            freeIDs.pop_back();
+        } else {
+            id = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+        }
+        Entry& e = entries[id];
+        e.patentID = patent.patentIDRef();
+        e.firmID = firmID;
+        e.country = patent.countryRef();
+        e.appldate = query_detail::dateValue(patent.appldateRef());
+        e.grantdate = query_detail::dateValue(patent.grantdateRef());
+        e.live = true;
+        byPatent[e.patentID] = id;
+        if (e.appldate) byAppldate.emplace(e.appldate, id);
+        if (e.grantdate) byGrantdate.emplace(e.grantdate, id);
+        count(applMonths, e.appldate, 1);
+        count(grantMonths, e.grantdate, 1);
+        countries[e.country]++;
+        std::string scratch;
+        const std::string& title = patent.titleRef(scratch);
+        query_detail::forEachWord(title, word, [&](const std::string& w) {
+            std::vector<uint32_t>& ids = postings[w];
+            // 同一标题里重复的词只记一次
+            if (ids.empty() || ids.back() != id) ids.push_back(id);
+        });
+        liveCount++;
+    }
+
+    void onPatentRemoved(const std::string&, const Patent& patent) override {
+        remove(patent.patentIDRef());
+    }
+
+    void onPatentTransferred(const std::string&, const std::string& toFirmID, const std::string& patentID) override {
+        auto it = byPatent.find(patentID);
+        if (it != byPatent.end()) entries[it->second].firmID = toFirmID;
+    }
+
+    size_t size() const {
+        return liveCount;
+    }
+
+    const Entry& entry(uint32_t id) const {
+        return entries[id];
+    }
+
+    bool find(const std::string& patentID, uint32_t& id) const {
+        auto it = byPatent.find(patentID);
+        if (it == byPatent.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    // 倒排表长度，可能含有还没清理的已删除条目，是上界
+    size_t titleEstimate(const std::string& w) const {
+        auto it = postings.find(w);
+        return it == postings.end() ? 0 : it->second.size();
+    }
+
+    void titleEntries(const std::string& w, std::vector<uint32_t>& out) const {
+        out.clear();
+        auto it = postings.find(w);
+        if (it == postings.end()) return;
+        for (uint32_t id : it->second) {
+            if (entries[id].live) out.push_back(id);
+        }
+    }
+
+    double dateEstimate(QueryField field, uint32_t low, uint32_t high) const {
+        return estimateMonths(field == QueryField::Appldate ? applMonths : grantMonths, low, high);
+    }
+
+    void dateEntries(QueryField field, uint32_t low, uint32_t high, std::vector<uint32_t>& out) const {
+        out.clear();
+        const std::multimap<uint32_t, uint32_t>& index = field == QueryField::Appldate ? byAppldate : byGrantdate;
+        for (auto it = index.lower_bound(low); it != index.end() && it->first <= high; ++it) out.push_back(it->second);
+    }
+
+    size_t countryCount(const std::string& country) const {
+        auto it = countries.find(country);
+        return it == countries.end() ? 0 : it->second;
+    }
+};
+
+// 规划结果：选中的访问路径、所有考虑过的候选（给 EXPLAIN 用）和过滤条件的执行顺序
+struct QueryPlan {
+    enum class Path { PatentIndex, FirmLookup, TitleIndex, DateIndex, ParallelScan };
+
+    struct Candidate {
+        Path path;
+        size_t condition;  // 驱动条件的下标，全表扫描时无意义
+        std::string word;  // 标题索引用哪个词
+        double rows;       // 访问路径要产出的行数
+        double cost;
+    };
+
+    std::vector<Candidate> candidates;  // 按代价升序，第一个被选中
+    std::vector<size_t> filters;        // 过滤条件按代价/选择率排好的顺序
+    std::vector<double> selectivity;    // 各条件的估计选择率
+    double estimatedRows = 0;
+    size_t basis = 0;                   // 规划时的专利总数
+    std::string description;            // 选中路径的说明
+
+    const Candidate& chosen() const {
+        return candidates.front();
+    }
+};
+
+struct CompiledQuery {
+    PatentQuery query;
+    QueryPlan plan;
+};
+
+struct QueryResult {
+    std::vector<Patent> rows;  // 按 patentID 排序
+    std::string path;          // 实际使用的访问路径
+    double estimatedRows = 0;
+    size_t examined = 0;       // 实际读取并检查过的专利数
+    bool cached = false;       // 计划来自缓存
+};
+
+// 规划并执行查询；index 为空时只有企业查找和全表扫描两种路径
+// 系统和索引由调用方持有，执行查询期间不能修改系统
+class QueryEngine {
+private:
+    // 代价单位：顺序扫描时检查一条专利
+    static constexpr double kScanRow = 1.0;
+    static constexpr double kEntryRow = 2.0;   // 检查一条索引条目：走有序索引的节点再读条目，两次随机访存
+    static constexpr double kFetchRow = 4.0;   // 按键随机读取一条专利
+    static constexpr double kThreadStart = 2000.0;
+
+    const IFirmSystem& system;
+    std::shared_ptr<const QueryIndex> index;
+    size_t threads;
+    size_t capacity;
+    std::list<std::pair<std::string, std::shared_ptr<CompiledQuery>>> recent;  // 表头是最近用过的
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<CompiledQuery>>>::iterator> cache;
+    size_t hits = 0;
+    size_t misses = 0;
+
+    static const char* pathName(QueryPlan::Path path) {
+        switch (path) {
+            case QueryPlan::Path::PatentIndex: return "patent index";
+            case QueryPlan::Path::FirmLookup: return "firm lookup";
+            case QueryPlan::Path::TitleIndex: return "title index";
+            case QueryPlan::Path::DateIndex: return "date index";
+            case QueryPlan::Path::ParallelScan: return "parallel scan";
+        }
+        return "";
+    }
+
+    static std::string describe(const QueryPlan::Candidate& c, const PatentQuery& q) {
+        std::ostringstream out;
+        out << pathName(c.path);
+        if (c.path == QueryPlan::Path::TitleIndex) {
+            out << " '" << c.word << "'";
+        } else if (c.path == QueryPlan::Path::ParallelScan) {
+            return out.str();
+        } else {
+            const QueryCondition& cond = q.conditions()[c.condition];
+            if (c.path == QueryPlan::Path::DateIndex) {
+                out << (cond.field == QueryField::Appldate ? " appldate" : " grantdate") << " [" << cond.low << ", "
+                    << cond.high << "]";
+            } else {
+                out << " " << cond.value;
+            }
+        }
+        return out.str();
+    }
+
+    size_t scanThreads() const {
+        return threads ? threads : defaultThreadCount();
+    }
+
+    size_t totalPatents() const {
+        if (index) return index->size();
+        size_t total = 0;
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) { total += static_cast<size_t>(firm->getPatentCount()); });
+        return total;
+    }
+
+    std::shared_ptr<IFirm> findFirm(const std::string& firmID) const {
+        std::vector<std::shared_ptr<IFirm>> found;
+        system.lookupMany(std::vector<std::string>(1, firmID), found);
+        return found[0];
+    }
+
+    // 条件能否只凭索引条目判断（不用读取专利）
+    static bool entryField(QueryField field) {
+        return field != QueryField::Title;
+    }
+
+    static bool matchesEntry(const QueryCondition& c, const QueryIndex::Entry& e) {
+        switch (c.field) {
+            case QueryField::Firm: return e.firmID == c.value;
+            case QueryField::Patent: return e.patentID == c.value;
+            case QueryField::Country: return e.country == c.value;
+            case QueryField::Appldate: return e.appldate >= c.low && e.appldate <= c.high;
+            case QueryField::Grantdate: return e.grantdate >= c.low && e.grantdate <= c.high;
+            case QueryField::Title: return true;
+        }
+        return true;
+    }
+
+    static bool titleHas(const std::string& title, const std::vector<std::string>& words, std::string& word) {
+        if (words.empty()) return true;
+        uint64_t seen = 0;
+        size_t needed = std::min<size_t>(words.size(), 64);
+        size_t found = 0;
+        query_detail::forEachWord(title, word, [&](const std::string& w) {
+            for (size_t k = 0; k < needed; ++k) {
+                if (!(seen >> k & 1) && words[k] == w) {
+                    seen |= uint64_t(1) << k;
+                    found++;
+                }
+            }
+        });
+        return found == needed;
+    }
+
+    static bool matches(const QueryCondition& c, const Patent& p, std::string& scratch, std::string& word) {
+        switch (c.field) {
+            case QueryField::Firm: return p.firmIDRef() == c.value;
+            case QueryField::Patent: return p.patentIDRef() == c.value;
+            case QueryField::Country: return p.countryRef() == c.value;
+            case QueryField::Appldate: {
+                uint32_t d = query_detail::dateValue(p.appldateRef());
+                return d >= c.low && d <= c.high;
+            }
+            case QueryField::Grantdate: {
+                uint32_t d = query_detail::dateValue(p.grantdateRef());
+                return d >= c.low && d <= c.high;
+            }
+            case QueryField::Title: return titleHas(p.titleRef(scratch), c.words, word);
+        }
+        return true;
+    }
+
+    QueryPlan plan(const PatentQuery& query) const {
+        const std::vector<QueryCondition>& conds = query.conditions();
+        QueryPlan p;
+        p.basis = totalPatents();
+        double total = std::max<double>(1.0, static_cast<double>(p.basis));
+        p.selectivity.assign(conds.size(), 1.0);
+
+        // 各条件的选择率；没有索引时国家、日期、标题用经验值
+        std::vector<double> firmRows(conds.size(), 0);
+        for (size_t i = 0; i < conds.size(); ++i) {
+            const QueryCondition& c = conds[i];
+            double& sel = p.selectivity[i];
+            switch (c.field) {
+                case QueryField::Firm: {
+                    std::shared_ptr<IFirm> firm = findFirm(c.value);
+                    firmRows[i] = firm ? firm->getPatentCount() : 0;
+                    sel = firmRows[i] / total;
+                    break;
+                }
+                case QueryField::Patent:
+                    sel = 1.0 / total;
+                    break;
+                case QueryField::Country:
+                    sel = index ? index->countryCount(c.value) / total : 0.2;
+                    break;
+                case QueryField::Appldate:
+                case QueryField::Grantdate:
+                    sel = index ? index->dateEstimate(c.field, c.low, c.high) / total : 0.3;
+                    break;
+                case QueryField::Title: {
+                    sel = c.words.empty() || index ? 1.0 : 0.05;
+                    if (index) {
+                        for (const auto& w : c.words) sel = std::min(sel, index->titleEstimate(w) / total);
+                    }
+                    break;
+                }
+            }
+            sel = std::min(1.0, sel);
+        }
+        p.estimatedRows = total;
+        for (double s : p.selectivity) p.estimatedRows *= s;
+
+        // 走索引时，能凭索引条目判断的其余条件先过滤，剩下的才去读专利
+        auto entryPass = [&](size_t driver) {
+            double pass = 1.0;
+            for (size_t i = 0; i < conds.size(); ++i) {
+                if (i != driver && entryField(conds[i].field)) pass *= p.selectivity[i];
+            }
+            return pass;
+        };
+        auto indexCandidate = [&](QueryPlan::Path path, size_t i, const std::string& w, double rows) {
+            QueryPlan::Candidate c{path, i, w, rows, rows * kEntryRow + rows * entryPass(i) * kFetchRow};
+            p.candidates.push_back(c);
+        };
+        for (size_t i = 0; i < conds.size(); ++i) {
+            const QueryCondition& c = conds[i];
+            if (c.field == QueryField::Firm) {
+                p.candidates.push_back(QueryPlan::Candidate{QueryPlan::Path::FirmLookup, i, "", firmRows[i],
+                                                            kFetchRow + firmRows[i] * kScanRow});
+            } else if (!index) {
+                continue;
+            } else if (c.field == QueryField::Patent) {
+                indexCandidate(QueryPlan::Path::PatentIndex, i, "", 1.0);
+            } else if (c.field == QueryField::Appldate || c.field == QueryField::Grantdate) {
+                indexCandidate(QueryPlan::Path::DateIndex, i, "", index->dateEstimate(c.field, c.low, c.high));
+            } else if (c.field == QueryField::Title) {
+                // 用倒排表最短的词
+                for (const auto& w : c.words) {
+                    indexCandidate(QueryPlan::Path::TitleIndex, i, w, static_cast<double>(index->titleEstimate(w)));
+                }
+            }
+        }
+        size_t n = scanThreads();
+        p.candidates.push_back(QueryPlan::Candidate{QueryPlan::Path::ParallelScan, 0, "", total,
+                                                    total * kScanRow / n + (n > 1 ? kThreadStart * n : 0)});
+        std::stable_sort(p.candidates.begin(), p.candidates.end(),
+                         [](const QueryPlan::Candidate& a, const QueryPlan::Candidate& b) { return a.cost < b.cost; });
+
+        // 过滤顺序：每个条件按 代价 / (1 - 选择率) 升序，先跑便宜又能刷掉多数行的；标题要切词，代价按 8 算
+        for (size_t i = 0; i < conds.size(); ++i) p.filters.push_back(i);
+        auto rank = [&](size_t i) {
+            double cost = conds[i].field == QueryField::Title ? 8.0 : 1.0;
+            return cost / std::max(1e-9, 1.0 - p.selectivity[i]);
+        };
+        std::stable_sort(p.filters.begin(), p.filters.end(), [&](size_t a, size_t b) { return rank(a) < rank(b); });
+        p.description = describe(p.chosen(), query);
+        return p;
+    }
+
+    // 专利总数和规划时相差超过四分之一就重新规划；没有索引时只在企业查找和全表扫描之间选，不必重新规划
+    bool stale(const QueryPlan& p) const {
+        if (!index) return false;
+        size_t now = index->size();
+        size_t diff = now > p.basis ? now - p.basis : p.basis - now;
+        return diff > p.basis / 4 + 1000;
+    }
+
+    std::shared_ptr<CompiledQuery> compileCached(const std::string& key, const PatentQuery* query, std::string& error,
+                                                 bool& cached) {
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            recent.splice(recent.begin(), recent, it->second);
+            std::shared_ptr<CompiledQuery> compiled = it->second->second;
+            if (stale(compiled->plan)) {
+                compiled->plan = plan(compiled->query);
+                cached = false;
+            } else {
+                cached = true;
+            }
+            hits++;
+            return compiled;
+        }
+        misses++;
+        cached = false;
+        std::shared_ptr<CompiledQuery> compiled = std::make_shared<CompiledQuery>();
+        if (query) {
+            compiled->query = *query;
+        } else if (!parseQuery(key, compiled->query, error)) {
+            return nullptr;
+        }
+        compiled->plan = plan(compiled->query);
+        recent.emplace_front(key, compiled);
+        cache[key] = recent.begin();
+        if (cache.size() > capacity) {
+            cache.erase(recent.back().first);
+            recent.pop_back();
+        }
+        return compiled;
+    }
+
+    // 按规划好的过滤顺序检查，skipEntryFields 表示索引条目已经判断过的条件不再检查
+    bool passes(const CompiledQuery& q, const Patent& p, bool skipEntryFields, std::string& scratch, std::string& word) const {
+        const std::vector<QueryCondition>& conds = q.query.conditions();
+        for (size_t i : q.plan.filters) {
+            if (skipEntryFields && entryField(conds[i].field)) continue;
+            if (!matches(conds[i], p, scratch, word)) return false;
+        }
+        return true;
+    }
+
+    void execute(const CompiledQuery& q, QueryResult& result) const {
+        const QueryPlan::Candidate& c = q.plan.chosen();
+        const std::vector<QueryCondition>& conds = q.query.conditions();
+        result.path = q.plan.description;
+        result.estimatedRows = q.plan.estimatedRows;
+        std::string scratch, word;
+
+        if (c.path == QueryPlan::Path::FirmLookup) {
+            std::shared_ptr<IFirm> firm = findFirm(conds[c.condition].value);
+            if (firm) {
+                firm->forEachPatent([&](const Patent& p) {
+                    result.examined++;
+                    if (passes(q, p, false, scratch, word)) result.rows.push_back(p);
+                });
+            }
+        } else if (c.path == QueryPlan::Path::ParallelScan) {
+            size_t n = scanThreads();
+            struct Partial {
+                std::vector<Patent> rows;
+                size_t examined = 0;
+                std::string scratch, word;
+            };
+            std::vector<Partial> partial(n);
+            system.parallelForEachPatent([&](const Patent& p, size_t worker) {
+                Partial& part = partial[worker];
+                part.examined++;
+                if (passes(q, p, false, part.scratch, part.word)) part.rows.push_back(p);
+            }, n);
+            for (auto& part : partial) {
+                result.examined += part.examined;
+                for (auto& p : part.rows) result.rows.push_back(std::move(p));
+            }
+        } else {
+            std::vector<uint32_t> ids;
+            if (c.path == QueryPlan::Path::PatentIndex) {
+                uint32_t id;
+                if (index->find(conds[c.condition].value, id)) ids.push_back(id);
+            } else if (c.path == QueryPlan::Path::DateIndex) {
+                index->dateEntries(conds[c.condition].field, conds[c.condition].low, conds[c.condition].high, ids);
+            } else {
+                index->titleEntries(c.word, ids);
+            }
+            // 先用索引条目上的字段过滤，再成批读取剩下的专利
+            std::vector<std::pair<std::string, std::string>> keys;
+            for (uint32_t id : ids) {
+                const QueryIndex::Entry& e = index->entry(id);
+                bool pass = true;
+                for (size_t i : q.plan.filters) {
+                    if (!matchesEntry(conds[i], e)) {
+                        pass = false;
+                        break;
+                    }
+                }
+                if (pass) keys.push_back(std::make_pair(e.firmID, e.patentID));
+            }
+            std::vector<const Patent*> found;
+            system.lookupMany(keys, found);
+            for (const Patent* p : found) {
+                if (!p) continue;
+                result.examined++;
+                if (passes(q, *p, true, scratch, word)) result.rows.push_back(*p);
+            }
+        }
+
+        // patentID 是数字串，先比长度再比字典序就是数值顺序
+        std::sort(result.rows.begin(), result.rows.end(), [](const Patent& a, const Patent& b) {
+            const std::string& x = a.patentIDRef();
+            const std::string& y = b.patentIDRef();
+            return x.size() != y.size() ? x.size() < y.size() : x < y;
+        });
+        if (q.query.rowLimit() && result.rows.size() > q.query.rowLimit()) result.rows.resize(q.query.rowLimit());
+    }
+
+    std::string explainPlan(const CompiledQuery& q, bool cached) const {
+        const std::vector<QueryCondition>& conds = q.query.conditions();
+        std::ostringstream out;
+        out << "QUERY  " << q.query.text() << (cached ? "  (cached plan)" : "") << "\n";
+        out << "BASIS  " << q.plan.basis << " patents" << (index ? "" : ", no secondary index") << "\n";
+        out << "  " << std::left << std::setw(40) << "access path" << std::right << std::setw(14) << "est. rows"
+            << std::setw(16) << "cost" << "\n";
+        for (size_t i = 0; i < q.plan.candidates.size(); ++i) {
+            const QueryPlan::Candidate& c = q.plan.candidates[i];
+            std::string name = describe(c, q.query);
+            if (c.path == QueryPlan::Path::ParallelScan) name += " (" + std::to_string(scanThreads()) + " threads)";
+            out << (i == 0 ? "* " : "  ") << std::left << std::setw(40) << name << std::right << std::fixed
+                << std::setprecision(0) << std::setw(14) << c.rows << std::setw(16) << c.cost << "\n";
+        }
+        out << "FILTER";
+        for (size_t k = 0; k < q.plan.filters.size(); ++k) {
+            size_t i = q.plan.filters[k];
+            PatentQuery single;
+            const QueryCondition& c = conds[i];
+            switch (c.field) {
+                case QueryField::Firm: single.firm(c.value); break;
+                case QueryField::Patent: single.patent(c.value); break;
+                case QueryField::Country: single.country(c.value); break;
+                case QueryField::Appldate: single.appldate(c.low, c.high); break;
+                case QueryField::Grantdate: single.grantdate(c.low, c.high); break;
+                case QueryField::Title: single.titleContains(c.value); break;
+            }
+            out << (k ? ",\n       " : " ") << single.text() << "  (sel " << std::setprecision(4)
+                << q.plan.selectivity[i] << ")";
+        }
+        out << "\nESTIMATED ROWS  " << std::setprecision(1) << q.plan.estimatedRows << "\n";
+        return out.str();
+    }
+
+public:
+    explicit QueryEngine(const IFirmSystem& system, std::shared_ptr<const QueryIndex> index = nullptr, size_t threads = 0,
+                         size_t cacheCapacity = 128)
+        : system(system), index(std::move(index)), threads(threads), capacity(cacheCapacity ? cacheCapacity : 1) {}
+
+    bool run(const std::string& text, QueryResult& result, std::string& error) {
+        std::shared_ptr<CompiledQuery> compiled = compileCached(text, nullptr, error, result.cached);
+        if (!compiled) return false;
+        execute(*compiled, result);
+        return true;
+    }
+
+    QueryResult run(const PatentQuery& query) {
+        QueryResult result;
+        std::string error;
+        std::shared_ptr<CompiledQuery> compiled = compileCached(query.text(), &query, error, result.cached);
+        execute(*compiled, result);
+        return result;
+    }
+
+    bool explain(const std::string& text, std::string& out, std::string& error) {
+        bool cached;
+        std::shared_ptr<CompiledQuery> compiled = compileCached(text, nullptr, error, cached);
+        if (!compiled) return false;
+        out = explainPlan(*compiled, cached);
+        return true;
+    }
+
+    std::string explain(const PatentQuery& query) {
+        bool cached;
+        std::string error;
+        return explainPlan(*compileCached(query.text(), &query, error, cached), cached);
+    }
+
+    // 不经过缓存，每次重新解析和规划，用来对比缓存的效果
+    bool runUncached(const std::string& text, QueryResult& result, std::string& error) const {
+        CompiledQuery compiled;
+        if (!parseQuery(text, compiled.query, error)) return false;
+        compiled.plan = plan(compiled.query);
+        execute(compiled, result);
+        return true;
+    }
+
+    size_t cacheHits() const {
+        return hits;
+    }
+
+    size_t cacheMisses() const {
+        return misses;
+    }
+};
+
+#endif
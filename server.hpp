@@ -0,0 +1,672 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "firmSys.hpp"
+#include "protocol.hpp"
+#include "thread_pool.hpp"
+#include "mvcc.hpp"
+
+// 读写锁：查询可以并发，修改独占
+class RWLock {
+private:
+    pthread_rwlock_t lock_;
+
+public:
+    RWLock() { pthread_rwlock_init(&lock_, nullptr); }
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    void lockShared() { pthread_rwlock_rdlock(&lock_); }
+    void lockExclusive() { pthread_rwlock_wrlock(&lock_); }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+
+    ~RWLock() { pthread_rwlock_destroy(&lock_); }
+};
+
+class SharedGuard {
+private:
+    RWLock& lock;
+public:
+    explicit SharedGuard(RWLock& l) : lock(l) { lock.lockShared(); }
+    ~SharedGuard() { lock.unlock(); }
+};
+
+class ExclusiveGuard {
+private:
+    RWLock& lock;
+public:
+    explicit ExclusiveGuard(RWLock& l) : lock(l) { lock.lockExclusive(); }
+    ~ExclusiveGuard() { lock.unlock(); }
+};
+
+inline bool isMutation(protocol::OpCode op) {
+    return op == protocol::OpCode::AddFirm || op == protocol::OpCode::RemoveFirm
+        || op == protocol::OpCode::AddPatent || op == protocol::OpCode::RemovePatent
+        || op == protocol::OpCode::TransferPatent || op == protocol::OpCode::PrepareTransferOut
+        || op == protocol::OpCode::PrepareTransferIn || op == protocol::OpCode::CommitTransfer
+        || op == protocol::OpCode::AbortTransfer;
+}
+
+// 需要扫描全部专利的请求交给工作线程，避免阻塞事件循环
+inline bool isHeavy(protocol::OpCode op) {
+    return op == protocol::OpCode::SearchTitle;
+}
+
+inline size_t expectedArgs(protocol::OpCode op) {
+    switch (op) {
+        case protocol::OpCode::Ping: return 0;
+        case protocol::OpCode::GetFirm: return 1;
+        case protocol::OpCode::GetPatent: return 2;
+        case protocol::OpCode::SearchTitle: return 2;
+        case protocol::OpCode::AddFirm: return 2;
+        case protocol::OpCode::RemoveFirm: return 1;
+        case protocol::OpCode::AddPatent: return 6;
+        case protocol::OpCode::RemovePatent: return 2;
+        case protocol::OpCode::TransferPatent: return 3;
+        case protocol::OpCode::PrepareTransferOut: return 3;
+        case protocol::OpCode::PrepareTransferIn: return 7;
+        case protocol::OpCode::CommitTransfer: return 1;
+        case protocol::OpCode::AbortTransfer: return 1;
+    }
+    return static_cast<size_t>(-1);
+}
+
+// 在调用者已持有相应锁的前提下执行一个请求
+inline protocol::Response handleRequest(IFirmSystem& system, const protocol::Request& req) {
+    using protocol::OpCode;
+    using protocol::Status;
+
+    protocol::Response resp(req.id, Status::Ok);
+    if (req.args.size() != expectedArgs(req.op)) {
+        resp.status = Status::BadRequest;
+        return resp;
+    }
+    const std::vector<std::string>& a = req.args;
+
+    try {
+        switch (req.op) {
+            case OpCode::Ping:
+                break;
+            case OpCode::GetFirm: {
+                auto firm = system.getFirm(a[0]);
+                if (!firm) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                resp.fields.push_back(firm->getFirmID());
+                resp.fields.push_back(firm->getFirmName());
+                resp.fields.push_back(std::to_string(firm->getPatentCount()));
+                break;
+            }
+            case OpCode::GetPatent: {
+                auto firm = system.getFirm(a[0]);
+                if (!firm) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                Patent p = firm->getPatent(a[1]);
+                if (p.getPatentID().empty()) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                resp.fields.push_back(p.getPatentID());
+                resp.fields.push_back(p.getGrantdate());
+                resp.fields.push_back(p.getAppldate());
+                resp.fields.push_back(p.getTitle());
+                resp.fields.push_back(p.getCountry());
+                resp.fields.push_back(p.getFirmID());
+                break;
+            }
+            case OpCode::SearchTitle: {
+                const std::string& keyword = a[0];
+                size_t limit = static_cast<size_t>(std::stoul(a[1]));
+                size_t hits = 0;
+                system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                    if (hits >= limit) return;
+                    firm->forEachPatent([&](const Patent& p) {
+                        if (hits >= limit) return;
+                        if (p.getTitle().find(keyword) != std::string::npos) {
+                            resp.fields.push_back(p.getPatentID());
+                            resp.fields.push_back(p.getFirmID());
+                            resp.fields.push_back(p.getTitle());
+                            hits++;
+                        }
+                    });
+                });
+                break;
+            }
+            case OpCode::AddFirm:
+                system.addFirm(a[0], a[1]);
+                break;
+            case OpCode::RemoveFirm:
+                system.removeFirm(a[0]);
+                break;
+            case OpCode::AddPatent: {
+                if (!system.getFirm(a[0])) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                Patent p(a[1], a[2], a[3], a[4], a[5], a[0]);
+                system.addPatentFirm(a[0], p);
+                break;
+            }
+            case OpCode::RemovePatent:
+                system.removePatentFirm(a[0], a[1]);
+                break;
+            case OpCode::TransferPatent:
+                system.transferPatent(a[0], a[1], a[2]);
+                break;
+            default:
+                resp.status = Status::BadRequest;
+        }
+    } catch (const std::invalid_argument& e) {
+        resp.status = Status::NotFound;
+        resp.fields.clear();
+    } catch (const std::exception& e) {
+        resp.status = Status::Error;
+        resp.fields.clear();
+        resp.fields.push_back(e.what());
+    }
+    return resp;
+}
+
+// 在一个固定的快照上执行只读请求，不需要任何锁；修改请求返回 BadRequest
+inline protocol::Response handleSnapshotRequest(const SystemSnapshot& snapshot, const protocol::Request& req) {
+    using protocol::OpCode;
+    using protocol::Status;
+
+    protocol::Response resp(req.id, Status::Ok);
+    if (req.args.size() != expectedArgs(req.op)) {
+        resp.status = Status::BadRequest;
+        return resp;
+    }
+    const std::vector<std::string>& a = req.args;
+
+    try {
+        switch (req.op) {
+            case OpCode::Ping:
+                break;
+            case OpCode::GetFirm: {
+                const FirmVersion* firm = snapshot.findFirm(a[0]);
+                if (!firm) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                resp.fields.push_back(firm->firmID);
+                resp.fields.push_back(firm->firmName);
+                resp.fields.push_back(std::to_string(firm->patents.size()));
+                break;
+            }
+            case OpCode::GetPatent: {
+                const FirmVersion* firm = snapshot.findFirm(a[0]);
+                const Patent* found = firm ? firm->patents.find(a[1]) : nullptr;
+                if (!found) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                resp.fields.push_back(found->getPatentID());
+                resp.fields.push_back(found->getGrantdate());
+                resp.fields.push_back(found->getAppldate());
+                resp.fields.push_back(found->getTitle());
+                resp.fields.push_back(found->getCountry());
+                resp.fields.push_back(found->getFirmID());
+                break;
+            }
+            case OpCode::SearchTitle: {
+                const std::string& keyword = a[0];
+                size_t limit = static_cast<size_t>(std::stoul(a[1]));
+                size_t hits = 0;
+                snapshot.forEachPatent([&](const Patent& p) {
+                    if (hits >= limit) return;
+                    std::string title = p.getTitle();
+                    if (title.find(keyword) != std::string::npos) {
+                        resp.fields.push_back(p.getPatentID());
+                        resp.fields.push_back(p.getFirmID());
+                        resp.fields.push_back(title);
+                        hits++;
+                    }
+                });
+                break;
+            }
+            default:
+                resp.status = Status::BadRequest;
+        }
+    } catch (const std::invalid_argument& e) {
+        resp.status = Status::NotFound;
+        resp.fields.clear();
+    } catch (const std::exception& e) {
+        resp.status = Status::Error;
+        resp.fields.clear();
+        resp.fields.push_back(e.what());
+    }
+    return resp;
+}
+
+// 基于 epoll 的单线程事件循环 + 工作线程池
+// 事件循环负责收发和轻量请求，SearchTitle 等重请求投递到线程池，
+// 完成后通过 eventfd 唤醒事件循环写回响应
+class PatentServer {
+public:
+    // 替换默认的 handleRequest；仍在对应的读/写锁下调用
+    typedef std::function<protocol::Response(const protocol::Request&)> Handler;
+    // 一次读到的全部请求交给它，在事件循环线程上执行且不加锁；
+    // 处理器可以先返回，之后再用 deliver() 把这批请求的响应按顺序写回
+    typedef std::function<void(uint64_t, std::vector<protocol::Request>&)> BatchHandler;
+
+private:
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t outOffset;
+        bool wantWrite;
+
+        Connection() : fd(-1), outOffset(0), wantWrite(false) {}
+    };
+
+    static const uint64_t kListenID = 0;
+    static const uint64_t kWakeID = 1;
+    static const uint64_t kTimerID = 2;
+    static const uint64_t kSourceID = 3;
+
+    std::shared_ptr<IFirmSystem> system;
+    std::string socketPath;
+    std::unique_ptr<ThreadPool> pool;
+    RWLock systemLock;
+
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    int timerFd;
+    std::atomic<bool> running;
+
+    int periodMs;
+    std::function<void()> periodicTask;
+    Handler handler;
+    BatchHandler batchHandler;
+    int sourceFd;
+    std::function<void()> sourceReady;
+    std::shared_ptr<SnapshotManager> snapshots;
+
+    uint64_t nextConnID;
+    std::unordered_map<uint64_t, Connection> connections;
+
+    std::mutex completedMtx;
+    std::vector<std::pair<uint64_t, std::string>> completed;
+
+    static void setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    void addToEpoll(int fd, uint64_t id, uint32_t events) {
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            throw std::runtime_error(std::string("epoll_ctl: ") + std::strerror(errno));
+        }
+    }
+
+    void updateEvents(uint64_t id, Connection& conn) {
+        bool pending = conn.outOffset < conn.out.size();
+        if (pending == conn.wantWrite) return;
+        conn.wantWrite = pending;
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | (pending ? EPOLLOUT : 0);
+        ev.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+
+    void closeConnection(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        connections.erase(it);
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "Error: accept failed: " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+            setNonBlocking(fd);
+            uint64_t id = nextConnID++;
+            Connection& conn = connections[id];
+            conn.fd = fd;
+            addToEpoll(fd, id, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    // 尽量把输出缓冲写完；返回 false 表示连接已断开
+    bool flush(uint64_t id, Connection& conn) {
+        while (conn.outOffset < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.outOffset, conn.out.size() - conn.outOffset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            conn.outOffset += static_cast<size_t>(n);
+        }
+        if (conn.outOffset == conn.out.size()) {
+            conn.out.clear();
+            conn.outOffset = 0;
+        }
+        updateEvents(id, conn);
+        return true;
+    }
+
+    protocol::Response execute(const protocol::Request& req) {
+        return handler ? handler(req) : handleRequest(*system, req);
+    }
+
+    void dispatch(uint64_t id, Connection& conn, protocol::Request req) {
+        if (isHeavy(req.op)) {
+            std::shared_ptr<protocol::Request> shared = std::make_shared<protocol::Request>(std::move(req));
+            pool->submit([this, id, shared]() {
+                protocol::Response resp;
+                if (snapshots && !handler) {
+                    // 在快照上执行，长时间的扫描不再挡住写请求
+                    resp = handleSnapshotRequest(*snapshots->snapshot(), *shared);
+                } else {
+                    SharedGuard guard(systemLock);
+                    resp = execute(*shared);
+                }
+                std::string frame;
+                protocol::encodeResponse(resp, frame);
+                {
+                    std::lock_guard<std::mutex> lock(completedMtx);
+                    completed.push_back(std::make_pair(id, std::move(frame)));
+                }
+                uint64_t one = 1;
+                ssize_t ignored = write(wakeFd, &one, sizeof(one));
+                (void)ignored;
+            });
+            return;
+        }
+
+        protocol::Response resp;
+        if (isMutation(req.op)) {
+            ExclusiveGuard guard(systemLock);
+            resp = execute(req);
+        } else {
+            SharedGuard guard(systemLock);
+            resp = execute(req);
+        }
+        protocol::encodeResponse(resp, conn.out);
+    }
+
+    void readConnection(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        Connection& conn = it->second;
+
+        char buf[64 * 1024];
+        bool closed = false;
+        while (true) {
+            ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                conn.in.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                closed = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closed = true;
+            }
+            break;
+        }
+
+        // 一次读入的多个请求依次处理，响应合并后一起写出
+        size_t offset = 0;
+        const char* body;
+        size_t bodyLen;
+        bool oversized;
+        std::vector<protocol::Request> batch;
+        while (protocol::nextFrame(conn.in, offset, body, bodyLen, oversized)) {
+            protocol::Request req;
+            if (!protocol::decodeRequest(body, bodyLen, req)) {
+                protocol::encodeResponse(protocol::Response(req.id, protocol::Status::BadRequest), conn.out);
+                continue;
+            }
+            if (batchHandler) {
+                batch.push_back(std::move(req));
+            } else {
+                dispatch(id, conn, std::move(req));
+            }
+        }
+        conn.in.erase(0, offset);
+        if (!batch.empty()) {
+            batchHandler(id, batch);
+            if (connections.find(id) == connections.end()) return;  // deliver() 写出时发现连接已断开
+        }
+
+        if (oversized) {
+            std::cerr << "Error: frame too large, closing connection." << std::endl;
+            closed = true;
+        }
+        if (!flush(id, conn) || closed) {
+            closeConnection(id);
+        }
+    }
+
+    void drainCompleted() {
+        uint64_t counter;
+        ssize_t ignored = read(wakeFd, &counter, sizeof(counter));
+        (void)ignored;
+
+        std::vector<std::pair<uint64_t, std::string>> ready;
+        {
+            std::lock_guard<std::mutex> lock(completedMtx);
+            ready.swap(completed);
+        }
+        for (auto& item : ready) {
+            auto it = connections.find(item.first);
+            if (it == connections.end()) continue; // 连接已关闭，丢弃响应
+            it->second.out.append(item.second);
+        }
+        for (auto& item : ready) {
+            auto it = connections.find(item.first);
+            if (it != connections.end() && !flush(item.first, it->second)) {
+                closeConnection(item.first);
+            }
+        }
+    }
+
+public:
+    PatentServer(std::shared_ptr<IFirmSystem> system, const std::string& socketPath, size_t workers)
+        : system(system), socketPath(socketPath), pool(new ThreadPool(workers)), listenFd(-1), epollFd(-1), wakeFd(-1),
+          timerFd(-1), running(false), periodMs(0), sourceFd(-1), nextConnID(4) {}
+
+    PatentServer(const PatentServer&) = delete;
+    PatentServer& operator=(const PatentServer&) = delete;
+
+    // 在事件循环线程上周期性执行的任务（持有写锁），例如增量加载 CSV；需在 run() 之前设置
+    void setPeriodicTask(int intervalMs, std::function<void()> task) {
+        periodMs = intervalMs;
+        periodicTask = task;
+    }
+
+    // 需在 run() 之前设置
+    void setHandler(Handler h) {
+        handler = h;
+    }
+
+    void setBatchHandler(BatchHandler h) {
+        batchHandler = h;
+    }
+
+    // 额外监听一个 fd（例如另一个 epoll fd），可读时在事件循环线程上调用 onReady；需在 run() 之前设置
+    void setEventSource(int fd, std::function<void()> onReady) {
+        sourceFd = fd;
+        sourceReady = onReady;
+    }
+
+    // 只能在事件循环线程上调用（批处理器或 setEventSource 的回调里）；连接已关闭时丢弃响应
+    void deliver(uint64_t id, const std::vector<protocol::Response>& responses) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        for (const auto& resp : responses) {
+            protocol::encodeResponse(resp, it->second.out);
+        }
+        if (!flush(id, it->second)) {
+            closeConnection(id);
+        }
+    }
+
+    // 设置后重请求改在最新提交的快照上执行，不再持有读锁；manager 需已注册为 system 的观察者
+    void setSnapshots(std::shared_ptr<SnapshotManager> manager) {
+        snapshots = manager;
+    }
+
+    void run() {
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("Socket path too long");
+        }
+        std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socketPath.c_str());
+
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throw std::runtime_error(std::string("bind: ") + std::strerror(errno));
+        }
+        if (listen(listenFd, 128) < 0) {
+            throw std::runtime_error(std::string("listen: ") + std::strerror(errno));
+        }
+        setNonBlocking(listenFd);
+
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (epollFd < 0 || wakeFd < 0) {
+            throw std::runtime_error(std::string("epoll/eventfd: ") + std::strerror(errno));
+        }
+        addToEpoll(listenFd, kListenID, EPOLLIN);
+        addToEpoll(wakeFd, kWakeID, EPOLLIN);
+
+        if (periodicTask && periodMs > 0) {
+            timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+            if (timerFd < 0) {
+                throw std::runtime_error(std::string("timerfd: ") + std::strerror(errno));
+            }
+            itimerspec spec;
+            std::memset(&spec, 0, sizeof(spec));
+            spec.it_interval.tv_sec = periodMs / 1000;
+            spec.it_interval.tv_nsec = (periodMs % 1000) * 1000000L;
+            spec.it_value = spec.it_interval;
+            timerfd_settime(timerFd, 0, &spec, nullptr);
+            addToEpoll(timerFd, kTimerID, EPOLLIN);
+        }
+
+        if (sourceFd >= 0) {
+            addToEpoll(sourceFd, kSourceID, EPOLLIN);
+        }
+
+        running = true;
+        std::cout << "Listening on " << socketPath << " with " << pool->size() << " workers." << std::endl;
+
+        epoll_event events[128];
+        while (running) {
+            int n = epoll_wait(epollFd, events, 128, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            }
+            for (int i = 0; i < n; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == kListenID) {
+                    acceptConnections();
+                } else if (id == kWakeID) {
+                    drainCompleted();
+                } else if (id == kSourceID) {
+                    sourceReady();
+                } else if (id == kTimerID) {
+                    uint64_t expirations;
+                    ssize_t ignored = read(timerFd, &expirations, sizeof(expirations));
+                    (void)ignored;
+                    ExclusiveGuard guard(systemLock);
+                    if (snapshots) {
+                        // 一次增量加载作为一个版本发布，快照读者不会看到加载到一半的状态
+                        snapshots->atomically(periodicTask);
+                    } else {
+                        periodicTask();
+                    }
+                } else {
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        closeConnection(id);
+                        continue;
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                        readConnection(id);
+                    }
+                    if (events[i].events & EPOLLOUT) {
+                        auto it = connections.find(id);
+                        if (it != connections.end() && !flush(id, it->second)) {
+                            closeConnection(id);
+                        }
+                    }
+                }
+            }
+        }
+
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->first);
+        }
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+
+    // 可在信号处理函数中调用（只用到 write）
+    void stop() {
+        running = false;
+        if (wakeFd >= 0) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    ~PatentServer() {
+        pool.reset(); // 先等工作线程结束，它们会访问 wakeFd 和 completed
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
+        if (timerFd >= 0) close(timerFd);
+    }
+};
+
+#endif
@@ -0,0 +1,926 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include "firmSys.hpp"
+#include "protocol.hpp"
+#include "server.hpp"
+
+// 按 firmID 哈希分片：一个企业的全部专利都在同一个分片进程里
+// 用 FNV-1a 而不是 std::hash，保证协调进程和各分片算出的结果一致
+inline uint32_t shardOf(const std::string& firmID, uint32_t shards) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : firmID) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return static_cast<uint32_t>(h % shards);
+}
+
+inline std::string shardSocketPath(const std::string& base, uint32_t index) {
+    return base + ".shard" + std::to_string(index);
+}
+
+// 只加载属于第 index 个分片的企业和专利
+inline void loadShard(IFirmSystem& system, const std::string& dataDir, uint32_t index, uint32_t shards,
+                      NormalizeReport& report) {
+    std::string text;
+    if (!readWholeFile(dataDir + "/FirmData.csv", text)) {
+        std::cerr << "Error: Could not open FirmData.csv" << std::endl;
+        return;
+    }
+    std::vector<std::pair<std::string, std::string>> firms = normalizeLines<std::pair<std::string, std::string>>(
+        text, defaultThreadCount(), normalizeFirmLine, report);
+    for (const auto& firm : firms) {
+        if (shardOf(firm.first, shards) == index) {
+            system.addFirm(firm.first, firm.second);
+        }
+    }
+
+    if (!readWholeFile(dataDir + "/PatentData.csv", text)) {
+        std::cerr << "Error: Could not open PatentData.csv" << std::endl;
+        return;
+    }
+    std::vector<Patent> patents = normalizeLines<Patent>(text, defaultThreadCount(), normalizePatentLine, report);
+    std::unordered_map<std::string, std::vector<Patent>> byFirm;
+    for (auto& p : patents) {
+        if (shardOf(p.getFirmID(), shards) == index) {
+            byFirm[p.getFirmID()].push_back(std::move(p));
+        }
+    }
+    for (auto& group : byFirm) {
+        system.addPatentsFirm(group.first, group.second);
+    }
+}
+
+// 分片进程一侧：普通请求交给 handleRequest，另外处理两阶段转让
+//
+// prepare 阶段只做检查并锁住专利，commit 时才真正删除/插入；
+// 被锁住的专利不能被添加、删除或再次转让，有未完成事务的企业不能删除。
+// 最近提交的 kRememberCommitted 个事务会被记住，协调进程重发的 commit 仍然返回 Ok；
+// 其他未知事务返回 NotFound，协调进程不会把它当成已经提交。
+// 这些状态只在内存里：分片重启后从 CSV 重新装载，进行中和已提交的转让都不保留
+class ShardParticipant {
+private:
+    struct Pending {
+        bool outgoing;
+        std::string firmID;
+        Patent patent;
+    };
+
+    std::shared_ptr<IFirmSystem> system;
+    std::unordered_map<std::string, Pending> pending;  // txID -> 事务
+    std::unordered_set<std::string> locked;             // 参与未完成事务的 patentID
+    std::unordered_set<std::string> committed;          // 最近提交的 txID
+    std::deque<std::string> commitOrder;
+
+    static const size_t kRememberCommitted = 65536;
+
+    void rememberCommitted(const std::string& tx) {
+        committed.insert(tx);
+        commitOrder.push_back(tx);
+        if (commitOrder.size() > kRememberCommitted) {
+            committed.erase(commitOrder.front());
+            commitOrder.pop_front();
+        }
+    }
+
+    bool firmBusy(const std::string& firmID) const {
+        for (const auto& tx : pending) {
+            if (tx.second.firmID == firmID) return true;
+        }
+        return false;
+    }
+
+    static void putPatent(const Patent& p, protocol::Response& resp) {
+        resp.fields.push_back(p.getPatentID());
+        resp.fields.push_back(p.getGrantdate());
+        resp.fields.push_back(p.getAppldate());
+        resp.fields.push_back(p.getTitle());
+        resp.fields.push_back(p.getCountry());
+        resp.fields.push_back(p.getFirmID());
+    }
+
+public:
+    explicit ShardParticipant(std::shared_ptr<IFirmSystem> system) : system(system) {}
+
+    size_t pendingCount() const {
+        return pending.size();
+    }
+
+    // 由 PatentServer 在读/写锁下调用；两阶段请求都算修改，持有写锁
+    protocol::Response handle(const protocol::Request& req) {
+        using protocol::OpCode;
+        using protocol::Status;
+
+        protocol::Response resp(req.id, Status::Ok);
+        if (req.args.size() != expectedArgs(req.op)) {
+            resp.status = Status::BadRequest;
+            return resp;
+        }
+        const std::vector<std::string>& a = req.args;
+
+        switch (req.op) {
+            case OpCode::PrepareTransferOut: {
+                if (pending.count(a[0]) || locked.count(a[2])) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                auto firm = system->getFirm(a[1]);
+                Patent p;
+                try {
+                    if (firm) p = firm->getPatent(a[2]);
+                } catch (const std::invalid_argument&) {
+                }
+                if (p.getPatentID().empty()) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                pending[a[0]] = Pending{true, a[1], p};
+                locked.insert(a[2]);
+                putPatent(p, resp);
+                break;
+            }
+            case OpCode::PrepareTransferIn: {
+                if (pending.count(a[0]) || locked.count(a[2])) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                auto firm = system->getFirm(a[1]);
+                if (!firm) {
+                    resp.status = Status::NotFound;
+                    break;
+                }
+                // 目标企业已有同号专利时拒绝，否则提交后会出现两份
+                bool held = false;
+                try {
+                    held = !firm->getPatent(a[2]).getPatentID().empty();
+                } catch (const std::invalid_argument&) {
+                }
+                if (held) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                pending[a[0]] = Pending{false, a[1], Patent(a[2], a[3], a[4], a[5], a[6], a[1])};
+                locked.insert(a[2]);
+                break;
+            }
+            case OpCode::CommitTransfer: {
+                auto it = pending.find(a[0]);
+                if (it == pending.end()) {
+                    resp.status = committed.count(a[0]) ? Status::Ok : Status::NotFound;
+                    break;
+                }
+                // removePatentFirm / addPatentFirm 失败时只打印错误，按专利数是否变化判断有没有生效；
+                // 没生效就保留事务返回 Error，协调进程稍后重试
+                Pending& tx = it->second;
+                auto firm = system->getFirm(tx.firmID);
+                if (!firm) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                int before = firm->getPatentCount();
+                try {
+                    if (tx.outgoing) {
+                        system->removePatentFirm(tx.firmID, tx.patent.getPatentID());
+                    } else {
+                        system->addPatentFirm(tx.firmID, tx.patent);
+                    }
+                } catch (const std::exception&) {
+                }
+                if (firm->getPatentCount() != before + (tx.outgoing ? -1 : 1)) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                locked.erase(tx.patent.getPatentID());
+                rememberCommitted(a[0]);
+                pending.erase(it);
+                break;
+            }
+            case OpCode::AbortTransfer: {
+                // 幂等：事务不存在也返回 Ok
+                auto it = pending.find(a[0]);
+                if (it != pending.end()) {
+                    locked.erase(it->second.patent.getPatentID());
+                    pending.erase(it);
+                }
+                break;
+            }
+            case OpCode::AddPatent:
+            case OpCode::RemovePatent:
+                if (locked.count(a[1])) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                return handleRequest(*system, req);
+            case OpCode::TransferPatent:
+                if (locked.count(a[2])) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                return handleRequest(*system, req);
+            case OpCode::RemoveFirm:
+                if (firmBusy(a[0])) {
+                    resp.status = Status::Error;
+                    break;
+                }
+                return handleRequest(*system, req);
+            default:
+                return handleRequest(*system, req);
+        }
+        return resp;
+    }
+};
+
+// 到协调进程或某个分片的阻塞连接，供基准测试等简单客户端使用；
+// 请求可以成批发送，响应按 requestID 对回原顺序
+class ShardConnection {
+private:
+    std::string path;
+    int fd;
+    uint32_t nextID;
+    std::string in;
+
+    bool sendAll(const std::string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            off += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+public:
+    explicit ShardConnection(const std::string& path) : path(path), fd(-1), nextID(1) {}
+
+    ShardConnection(const ShardConnection&) = delete;
+    ShardConnection& operator=(const ShardConnection&) = delete;
+
+    ~ShardConnection() {
+        if (fd >= 0) close(fd);
+    }
+
+    // 服务进程启动需要时间，按 retryMs 间隔重试
+    bool connectTo(int attempts, int retryMs) {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        for (int i = 0; i < attempts; ++i) {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                return true;
+            }
+            if (fd >= 0) close(fd);
+            fd = -1;
+            usleep(static_cast<useconds_t>(retryMs) * 1000);
+        }
+        return false;
+    }
+
+    // 第一步：编码并发送，返回这批请求的 ID 起点
+    bool sendBatch(const std::vector<protocol::Request>& batch, uint32_t& firstID) {
+        std::string out;
+        firstID = nextID;
+        for (const auto& req : batch) {
+            protocol::Request copy(nextID++, req.op, req.args);
+            protocol::encodeRequest(copy, out);
+        }
+        return fd >= 0 && sendAll(out);
+    }
+
+    // 第二步：读回 count 个响应，按发送顺序放入 out
+    bool receiveBatch(uint32_t firstID, size_t count, std::vector<protocol::Response>& out) {
+        out.assign(count, protocol::Response());
+        size_t got = 0;
+        char buf[64 * 1024];
+        while (got < count) {
+            size_t offset = 0;
+            const char* body;
+            size_t bodyLen;
+            bool oversized;
+            while (got < count && protocol::nextFrame(in, offset, body, bodyLen, oversized)) {
+                protocol::Response resp;
+                if (!protocol::decodeResponse(body, bodyLen, resp)) return false;
+                uint32_t slot = resp.id - firstID;
+                if (slot < count) {
+                    out[slot] = std::move(resp);
+                    got++;
+                }
+            }
+            in.erase(0, offset);
+            if (got == count) break;
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            in.append(buf, static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    bool call(const protocol::Request& req, protocol::Response& resp) {
+        uint32_t firstID;
+        std::vector<protocol::Response> out;
+        if (!sendBatch(std::vector<protocol::Request>(1, req), firstID) || !receiveBatch(firstID, 1, out)) {
+            return false;
+        }
+        resp = std::move(out[0]);
+        return true;
+    }
+};
+
+// 协调进程：把客户端请求按 firmID 转发给分片，全部在 PatentServer 的事件循环线程上异步完成
+//
+// 每个分片一条非阻塞连接，登记在路由器自己的 epoll 上，这个 epoll fd 再作为事件源交给 PatentServer。
+// 发往分片的请求先攒在输出缓冲里，一轮事件处理结束时一起写出；分片的响应按 requestID 找回回调。
+// 同一客户端连接上的批次依次执行，不同连接之间互不等待；批次内的普通请求立即派发，
+// 跨分片转让和全量标题搜索是屏障：等本批之前的请求都完成后才开始，完成后才派发后面的请求。
+//
+// 跨分片转让用两阶段提交。commit/abort 发送失败或分片返回 Error 时按 kRetryMs 间隔重发，直到两边都确认；
+// commit 返回 NotFound 说明分片不知道这个事务，转让以 Error 结束并打印到 stderr。
+// 协调状态只在内存里，分片也随协调进程一起退出：进行中的转让和已提交的修改都不会跨重启保留
+class ShardRouter {
+public:
+    // 一批请求全部完成后调用，响应与请求一一对应
+    typedef std::function<void(uint64_t, const std::vector<protocol::Response>&)> Deliver;
+
+private:
+    typedef std::function<void(protocol::Response&)> Callback;
+
+    struct Link {
+        uint32_t index;
+        std::string path;
+        int fd;
+        std::string in;
+        std::string out;
+        size_t outOffset;
+        bool wantWrite;
+        uint32_t nextID;
+        std::unordered_map<uint32_t, Callback> waiting;  // 分片上的 requestID -> 回调
+
+        Link() : index(0), fd(-1), outOffset(0), wantWrite(false), nextID(1) {}
+    };
+
+    // 客户端一次发来的一批请求
+    struct Job {
+        uint64_t conn;
+        std::vector<protocol::Request> requests;
+        std::vector<protocol::Response> responses;
+        size_t next;         // 下一个待派发的请求
+        size_t outstanding;  // 已派发、未完成的请求
+    };
+
+    struct Transfer {
+        std::string tx;
+        uint32_t source;
+        uint32_t target;
+        Job* job;
+        size_t pos;
+        protocol::Status result;
+        int waitingAcks;
+    };
+
+    struct Retry {
+        uint32_t shard;
+        protocol::OpCode op;
+        std::string tx;
+    };
+
+    struct Search {
+        Job* job;
+        size_t pos;
+        size_t limit;
+        size_t remaining;
+        bool failed;
+        std::vector<protocol::Response> parts;
+    };
+
+    static const uint64_t kRetryTimerID = UINT64_MAX;  // 其余事件 ID 是分片下标
+    static const int kRetryMs = 100;
+
+    Deliver deliver;
+    std::vector<std::unique_ptr<Link>> links;
+    int epollFd;
+    int timerFd;
+    bool timerArmed;
+    uint64_t nextTx;
+
+    std::unordered_map<uint64_t, std::deque<std::unique_ptr<Job>>> clients;
+    std::unordered_map<std::string, std::unique_ptr<Transfer>> transfers;
+    std::vector<Callback> deferred;   // 发送失败的请求，在 settle() 里以 Error 回调
+    std::vector<Retry> retries;
+
+    uint32_t shardCount() const {
+        return static_cast<uint32_t>(links.size());
+    }
+
+    static void setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    bool openLink(Link& link) {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, link.path.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(fd);
+            return false;
+        }
+        setNonBlocking(fd);
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = link.index;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            return false;
+        }
+        link.fd = fd;
+        link.wantWrite = false;
+        return true;
+    }
+
+    // 连接断开：等待中的请求都以 Error 回调，下次发送时重连
+    void failLink(Link& link) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, link.fd, nullptr);
+        close(link.fd);
+        link.fd = -1;
+        link.in.clear();
+        link.out.clear();
+        link.outOffset = 0;
+        link.wantWrite = false;
+        for (auto& item : link.waiting) {
+            deferred.push_back(std::move(item.second));
+        }
+        link.waiting.clear();
+    }
+
+    bool flushLink(Link& link) {
+        while (link.outOffset < link.out.size()) {
+            ssize_t n = ::send(link.fd, link.out.data() + link.outOffset, link.out.size() - link.outOffset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            link.outOffset += static_cast<size_t>(n);
+        }
+        if (link.outOffset == link.out.size()) {
+            link.out.clear();
+            link.outOffset = 0;
+        }
+        bool pending = !link.out.empty();
+        if (pending != link.wantWrite) {
+            link.wantWrite = pending;
+            epoll_event ev;
+            std::memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLRDHUP | (pending ? EPOLLOUT : 0);
+            ev.data.u64 = link.index;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, link.fd, &ev);
+        }
+        return true;
+    }
+
+    void readLink(Link& link) {
+        char buf[64 * 1024];
+        bool closed = false;
+        while (true) {
+            ssize_t n = ::recv(link.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                link.in.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+
+        size_t offset = 0;
+        const char* body;
+        size_t bodyLen;
+        bool oversized;
+        std::vector<protocol::Response> ready;
+        while (protocol::nextFrame(link.in, offset, body, bodyLen, oversized)) {
+            protocol::Response resp;
+            if (!protocol::decodeResponse(body, bodyLen, resp)) {
+                closed = true;
+                break;
+            }
+            ready.push_back(std::move(resp));
+        }
+        link.in.erase(0, offset);
+        for (auto& resp : ready) {
+            auto it = link.waiting.find(resp.id);
+            if (it == link.waiting.end()) continue;
+            Callback cb = std::move(it->second);
+            link.waiting.erase(it);
+            cb(resp);
+        }
+        if ((closed || oversized) && link.fd >= 0) {
+            failLink(link);
+        }
+    }
+
+    // 只入队不回调；写出和失败回调都在 settle() 里进行，调用者不会被重入
+    void send(uint32_t shard, protocol::OpCode op, std::vector<std::string> args, Callback cb) {
+        Link& link = *links[shard];
+        if (link.fd < 0 && !openLink(link)) {
+            deferred.push_back(std::move(cb));
+            return;
+        }
+        uint32_t id = link.nextID++;
+        protocol::encodeRequest(protocol::Request(id, op, std::move(args)), link.out);
+        link.waiting[id] = std::move(cb);
+    }
+
+    void armRetryTimer() {
+        itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_nsec = kRetryMs * 1000000L;
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+        timerArmed = true;
+    }
+
+    void complete(Job* job) {
+        if (--job->outstanding == 0) advance(job);
+    }
+
+    // 派发请求直到遇到屏障或派发完；全部完成时写回响应并开始同一连接的下一批
+    void advance(Job* job) {
+        using protocol::OpCode;
+        while (job->next < job->requests.size()) {
+            size_t i = job->next;
+            const protocol::Request& req = job->requests[i];
+            if (req.args.size() != expectedArgs(req.op) || static_cast<uint8_t>(req.op) > static_cast<uint8_t>(OpCode::TransferPatent)) {
+                // 两阶段请求不对客户端开放
+                job->responses[i] = protocol::Response(req.id, protocol::Status::BadRequest);
+                job->next++;
+                continue;
+            }
+            if (req.op == OpCode::Ping) {
+                job->responses[i] = protocol::Response(req.id, protocol::Status::Ok);
+                job->next++;
+                continue;
+            }
+            bool crossShard = req.op == OpCode::TransferPatent
+                           && shardOf(req.args[0], shardCount()) != shardOf(req.args[1], shardCount());
+            if (crossShard || req.op == OpCode::SearchTitle) {
+                size_t limit = 0;
+                if (!crossShard) {
+                    try {
+                        limit = static_cast<size_t>(std::stoul(req.args[1]));
+                    } catch (const std::exception&) {
+                        job->responses[i] = protocol::Response(req.id, protocol::Status::BadRequest);
+                        job->next++;
+                        continue;
+                    }
+                }
+                if (job->outstanding > 0) return;  // 等前面的请求完成后再由 complete() 继续
+                job->next++;
+                job->outstanding++;
+                if (crossShard) {
+                    startTransfer(job, i);
+                } else {
+                    startSearch(job, i, limit);
+                }
+                return;
+            }
+            job->next++;
+            job->outstanding++;
+            send(shardOf(req.args[0], shardCount()), req.op, req.args, [this, job, i](protocol::Response& resp) {
+                resp.id = job->requests[i].id;
+                job->responses[i] = std::move(resp);
+                complete(job);
+            });
+        }
+        if (job->outstanding > 0) return;
+
+        uint64_t conn = job->conn;
+        deliver(conn, job->responses);
+        auto it = clients.find(conn);
+        it->second.pop_front();
+        if (it->second.empty()) {
+            clients.erase(it);
+        } else {
+            advance(it->second.front().get());
+        }
+    }
+
+    void startSearch(Job* job, size_t pos, size_t limit) {
+        std::shared_ptr<Search> search = std::make_shared<Search>();
+        search->job = job;
+        search->pos = pos;
+        search->limit = limit;
+        search->remaining = links.size();
+        search->failed = false;
+        search->parts.resize(links.size());
+        for (uint32_t s = 0; s < shardCount(); ++s) {
+            send(s, protocol::OpCode::SearchTitle, job->requests[pos].args, [this, search, s](protocol::Response& part) {
+                search->failed = search->failed || part.status != protocol::Status::Ok;
+                search->parts[s] = std::move(part);
+                if (--search->remaining > 0) return;
+
+                // 按分片顺序合并，总数不超过 limit
+                Job* job = search->job;
+                protocol::Response resp(job->requests[search->pos].id,
+                                        search->failed ? protocol::Status::Error : protocol::Status::Ok);
+                for (size_t p = 0; p < search->parts.size() && !search->failed; ++p) {
+                    const std::vector<std::string>& f = search->parts[p].fields;
+                    for (size_t i = 0; i + 2 < f.size() && resp.fields.size() / 3 < search->limit; i += 3) {
+                        resp.fields.insert(resp.fields.end(), f.begin() + i, f.begin() + i + 3);
+                    }
+                }
+                job->responses[search->pos] = std::move(resp);
+                complete(job);
+            });
+        }
+    }
+
+    // 第一阶段：源分片锁住专利并返回内容，目标分片检查企业和专利并暂存
+    void startTransfer(Job* job, size_t pos) {
+        using protocol::OpCode;
+        using protocol::Status;
+        const protocol::Request& req = job->requests[pos];
+        std::unique_ptr<Transfer> owned(new Transfer());
+        Transfer* t = owned.get();
+        t->tx = std::to_string(nextTx++);
+        t->source = shardOf(req.args[0], shardCount());
+        t->target = shardOf(req.args[1], shardCount());
+        t->job = job;
+        t->pos = pos;
+        t->result = Status::Ok;
+        t->waitingAcks = 0;
+        transfers[t->tx] = std::move(owned);
+
+        send(t->source, OpCode::PrepareTransferOut, {t->tx, req.args[0], req.args[2]}, [this, t](protocol::Response& out) {
+            if (out.status != Status::Ok || out.fields.size() != 6) {
+                // 源分片可能已经锁住了专利（例如响应在途中连接断开），同样要通知中止
+                decide(t, out.status == Status::Ok ? Status::Error : out.status, false);
+                return;
+            }
+            const protocol::Request& req = t->job->requests[t->pos];
+            send(t->target, OpCode::PrepareTransferIn,
+                 {t->tx, req.args[1], out.fields[0], out.fields[1], out.fields[2], out.fields[3], out.fields[4]},
+                 [this, t](protocol::Response& in) {
+                     if (in.status != Status::Ok) {
+                         decide(t, in.status, false);
+                     } else {
+                         decide(t, Status::Ok, true);
+                     }
+                 });
+        });
+    }
+
+    // 第二阶段：把决定发给两个分片，两边都确认后事务结束
+    void decide(Transfer* t, protocol::Status result, bool commit) {
+        protocol::OpCode op = commit ? protocol::OpCode::CommitTransfer : protocol::OpCode::AbortTransfer;
+        t->result = result;
+        t->waitingAcks = 2;
+        sendDecision(t->source, op, t->tx);
+        sendDecision(t->target, op, t->tx);
+    }
+
+    void sendDecision(uint32_t shard, protocol::OpCode op, const std::string& tx) {
+        send(shard, op, {tx}, [this, shard, op, tx](protocol::Response& resp) {
+            auto it = transfers.find(tx);
+            if (it == transfers.end()) return;
+            Transfer* t = it->second.get();
+            if (resp.status == protocol::Status::NotFound) {
+                // 重试也没用：分片上既没有这个事务，也不记得提交过它
+                std::cerr << "Error: shard " << shard << " has no record of transfer " << tx << std::endl;
+                t->result = protocol::Status::Error;
+            } else if (resp.status != protocol::Status::Ok) {
+                retries.push_back(Retry{shard, op, tx});
+                return;
+            }
+            if (--t->waitingAcks > 0) return;
+            Job* job = t->job;
+            job->responses[t->pos] = protocol::Response(job->requests[t->pos].id, t->result);
+            transfers.erase(it);
+            complete(job);
+        });
+    }
+
+    // 处理本轮积累的副作用，直到没有新的：失败回调、写出分片输出缓冲
+    void settle() {
+        while (true) {
+            if (!deferred.empty()) {
+                std::vector<Callback> failed;
+                failed.swap(deferred);
+                for (auto& cb : failed) {
+                    protocol::Response resp(0, protocol::Status::Error);
+                    cb(resp);
+                }
+                continue;
+            }
+            for (auto& link : links) {
+                if (link->fd >= 0 && !link->out.empty() && !flushLink(*link)) {
+                    failLink(*link);
+                }
+            }
+            if (deferred.empty()) break;
+        }
+        if (!retries.empty() && !timerArmed) {
+            armRetryTimer();
+        }
+    }
+
+    void retryDecisions() {
+        uint64_t expirations;
+        ssize_t ignored = read(timerFd, &expirations, sizeof(expirations));
+        (void)ignored;
+        timerArmed = false;
+        std::vector<Retry> due;
+        due.swap(retries);
+        for (const auto& r : due) {
+            if (transfers.count(r.tx)) sendDecision(r.shard, r.op, r.tx);
+        }
+    }
+
+public:
+    explicit ShardRouter(Deliver deliver)
+        : deliver(deliver), epollFd(-1), timerFd(-1), timerArmed(false), nextTx(1) {}
+
+    ShardRouter(const ShardRouter&) = delete;
+    ShardRouter& operator=(const ShardRouter&) = delete;
+
+    ~ShardRouter() {
+        for (auto& link : links) {
+            if (link->fd >= 0) close(link->fd);
+        }
+        if (epollFd >= 0) close(epollFd);
+        if (timerFd >= 0) close(timerFd);
+    }
+
+    // 连接所有分片；分片进程启动需要时间，会等待
+    bool connect(const std::string& basePath, uint32_t count) {
+        epollFd = epoll_create1(0);
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (epollFd < 0 || timerFd < 0) {
+            std::cerr << "Error: epoll/timerfd: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = kRetryTimerID;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+
+        for (uint32_t i = 0; i < count; ++i) {
+            std::unique_ptr<Link> link(new Link());
+            link->index = i;
+            link->path = shardSocketPath(basePath, i);
+            int attempts = 0;
+            while (!openLink(*link) && ++attempts < 600) {
+                usleep(50 * 1000);
+            }
+            if (link->fd < 0) {
+                std::cerr << "Error: could not reach shard " << i << std::endl;
+                return false;
+            }
+            links.push_back(std::move(link));
+        }
+        return true;
+    }
+
+    size_t size() const {
+        return links.size();
+    }
+
+    // 交给 PatentServer::setEventSource，可读时调用 poll()
+    int eventFd() const {
+        return epollFd;
+    }
+
+    // PatentServer 的批处理器；这批请求的响应全部就绪后通过 deliver 写回
+    void route(uint64_t conn, std::vector<protocol::Request>& batch) {
+        std::unique_ptr<Job> job(new Job());
+        job->conn = conn;
+        job->requests.swap(batch);
+        job->responses.resize(job->requests.size());
+        job->next = 0;
+        job->outstanding = 0;
+        Job* raw = job.get();
+        std::deque<std::unique_ptr<Job>>& queue = clients[conn];
+        queue.push_back(std::move(job));
+        if (queue.size() == 1) {
+            advance(raw);
+        }
+        settle();
+    }
+
+    void poll() {
+        epoll_event events[64];
+        int n = epoll_wait(epollFd, events, 64, 0);
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == kRetryTimerID) {
+                retryDecisions();
+                continue;
+            }
+            Link& link = *links[id];
+            if (link.fd < 0) continue;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+                readLink(link);
+            }
+            if (link.fd >= 0 && (events[i].events & EPOLLOUT) && !flushLink(link)) {
+                failLink(link);
+            }
+        }
+        settle();
+    }
+};
+
+// 分片进程：只加载属于自己的企业，处理协调进程转发来的请求；serve 负责运行服务器直到退出
+inline int runShardProcess(const std::string& socketPath, const std::string& dataDir, uint32_t index, uint32_t shards,
+                           size_t workers, const std::function<int(PatentServer&)>& serve) {
+    std::shared_ptr<IFirmSystem> firmSystem = std::make_shared<FirmSystemUnorderedMap>(FirmType::UnorderedMap);
+    NormalizeReport report;
+    loadShard(*firmSystem, dataDir, index, shards, report);
+
+    ShardParticipant participant(firmSystem);
+    PatentServer server(firmSystem, shardSocketPath(socketPath, index), workers);
+    server.setHandler([&participant](const protocol::Request& req) {
+        return participant.handle(req);
+    });
+    return serve(server);
+}
+
+// 协调进程：fork 出 N 个分片进程，自己只负责路由，退出时结束所有分片
+inline int runShardCluster(const std::string& socketPath, const std::string& dataDir, uint32_t shards, size_t workers,
+                           const std::function<int(PatentServer&)>& serve) {
+    std::vector<pid_t> children;
+    size_t shardWorkers = std::max<size_t>(1, workers / shards);
+    std::cout.flush();
+    for (uint32_t i = 0; i < shards; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Error: fork failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);  // 协调进程意外退出时分片也随之退出
+            int code = runShardProcess(socketPath, dataDir, i, shards, shardWorkers, serve);
+            std::cout.flush();
+            _exit(code);
+        }
+        children.push_back(pid);
+    }
+
+    int code = 1;
+    if (children.size() == shards) {
+        PatentServer server(nullptr, socketPath, 1);
+        ShardRouter router([&server](uint64_t conn, const std::vector<protocol::Response>& responses) {
+            server.deliver(conn, responses);
+        });
+        if (router.connect(socketPath, shards)) {
+            server.setBatchHandler([&router](uint64_t conn, std::vector<protocol::Request>& batch) {
+                router.route(conn, batch);
+            });
+            server.setEventSource(router.eventFd(), [&router]() {
+                router.poll();
+            });
+            std::cout << "Routing to " << shards << " shard processes." << std::endl;
+            code = serve(server);
+        }
+    }
+
+    for (pid_t pid : children) {
+        kill(pid, SIGTERM);
+    }
+    for (pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+    return code;
+}
+
+#endif
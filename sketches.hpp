@@ -0,0 +1,727 @@
+#ifndef SKETCHES_HPP
+#define SKETCHES_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <memory>
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include "firmSys.hpp"
+
+// 看板用的近似统计：几个大小固定、可以合并的概率摘要（sketch）
+// 同样参数的摘要可以按线程或按分片分别建，再 merge 成一份，结果和整体建一份的误差保证相同
+
+namespace sketch_detail {
+
+inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t hashString(const std::string& s) {
+    return mix(std::hash<std::string>()(s));
+}
+
+}  // namespace sketch_detail
+
+// 基数估计：2^p 个 6 位以内的寄存器（每个占 1 字节），相对标准误差约 1.04/sqrt(2^p)，p=14 时 16 KB、0.81%
+// 只能加不能减，合并就是逐个寄存器取最大值
+class HyperLogLog {
+private:
+    unsigned precision;
+    std::vector<uint8_t> registers;
+    // 寄存器值稳定以后很少再变，估计值缓存到下一次有寄存器变大
+    mutable double cached;
+    mutable bool cacheValid;
+
+public:
+    explicit HyperLogLog(unsigned precision = 14)
+        : precision(precision), registers(size_t(1) << precision, 0), cached(0), cacheValid(false) {
+        if (precision < 4 || precision > 18) throw std::invalid_argument("HyperLogLog precision must be in [4, 18]");
+    }
+
+    // hash 要是均匀的 64 位哈希：高 p 位选寄存器，其余位里第一个 1 的位置决定寄存器的值
+    void add(uint64_t hash) {
+        size_t index = static_cast<size_t>(hash >> (64 - precision));
+        uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if (rank > registers[index]) {
+            registers[index] = rank;
+            cacheValid = false;
+        }
+    }
+
+    double estimate() const {
+        if (cacheValid) return cached;
+        double inverse[66];
+        for (int r = 0; r < 66; ++r) inverse[r] = std::ldexp(1.0, -r);
+        double m = static_cast<double>(registers.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += inverse[r];
+            zeros += r == 0;
+        }
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        cached = alpha * m * m / sum;
+        // 小基数时还有空寄存器，改用线性计数
+        if (cached <= 2.5 * m && zeros > 0) cached = m * std::log(m / static_cast<double>(zeros));
+        cacheValid = true;
+        return cached;
+    }
+
+    void merge(const HyperLogLog& other) {
+        if (other.precision != precision) throw std::invalid_argument("HyperLogLog precision mismatch");
+        for (size_t i = 0; i < registers.size(); ++i) registers[i] = std::max(registers[i], other.registers[i]);
+        cacheValid = false;
+    }
+
+    void clear() {
+        std::fill(registers.begin(), registers.end(), 0);
+        cacheValid = false;
+    }
+
+    double relativeError() const {
+        return 1.04 / std::sqrt(static_cast<double>(registers.size()));
+    }
+
+    size_t memoryUsage() const {
+        return sizeof(*this) + registers.capacity();
+    }
+};
+
+// Count-Min：depth 行、每行 width 个计数器，估计值取各行的最小值
+// width = ceil(e/epsilon)、depth = ceil(ln(1/delta)) 时，以 1-delta 的概率 真实值 <= 估计值 <= 真实值 + epsilon*N（N 为总数）
+// 允许减（删除），只要每个键的真实计数不为负；合并就是对应计数器相加，参数必须相同
+class CountMinSketch {
+private:
+    size_t width;
+    size_t depth;
+    std::vector<int64_t> counters;
+    int64_t total;
+
+    // 双重哈希：第 i 行的列是 h1 + i*h2
+    size_t column(uint64_t hash, size_t row) const {
+        uint64_t h1 = hash & 0xffffffffULL, h2 = (hash >> 32) | 1;
+        return static_cast<size_t>((h1 + row * h2) % width);
+    }
+
+public:
+    explicit CountMinSketch(double epsilon = 0.001, double delta = 0.01)
+        : width(static_cast<size_t>(std::ceil(std::exp(1.0) / epsilon))),
+          depth(static_cast<size_t>(std::ceil(std::log(1.0 / delta)))),
+          counters(width * std::max<size_t>(depth, 1), 0), total(0) {
+        if (depth == 0) depth = 1;
+    }
+
+    void add(uint64_t hash, int64_t delta = 1) {
+        for (size_t row = 0; row < depth; ++row) counters[row * width + column(hash, row)] += delta;
+        total += delta;
+    }
+
+    int64_t estimate(uint64_t hash) const {
+        int64_t best = INT64_MAX;
+        for (size_t row = 0; row < depth; ++row) best = std::min(best, counters[row * width + column(hash, row)]);
+        return std::max<int64_t>(best, 0);
+    }
+
+    void merge(const CountMinSketch& other) {
+        if (other.width != width || other.depth != depth) throw std::invalid_argument("CountMinSketch shape mismatch");
+        for (size_t i = 0; i < counters.size(); ++i) counters[i] += other.counters[i];
+        total += other.total;
+    }
+
+    void clear() {
+        std::fill(counters.begin(), counters.end(), 0);
+        total = 0;
+    }
+
+    int64_t totalCount() const {
+        return total;
+    }
+
+    // 当前总数下的加性误差上界 epsilon*N
+    double errorBound() const {
+        return std::exp(1.0) / static_cast<double>(width) * static_cast<double>(total);
+    }
+
+    size_t memoryUsage() const {
+        return sizeof(*this) + counters.capacity() * sizeof(int64_t);
+    }
+};
+
+// SpaceSaving：最多监视 capacity 个键。满了以后，新键顶替计数最小的那个，并继承它的计数作为误差
+// 出现次数超过 N/capacity 的键一定在监视中，每个计数偏大不超过 N/capacity；只能加
+class SpaceSaving {
+public:
+    struct Counter {
+        std::string key;
+        uint64_t count;
+        uint64_t error;  // count - error 是真实次数的下界
+    };
+
+private:
+    size_t capacity;
+    std::vector<Counter> counters;
+    std::unordered_map<std::string, size_t> index;
+    uint64_t total;
+
+    size_t minSlot() const {
+        size_t best = 0;
+        for (size_t i = 1; i < counters.size(); ++i) {
+            if (counters[i].count < counters[best].count) best = i;
+        }
+        return best;
+    }
+
+    // 不在监视中的键，真实次数最多是最小计数（没满时为 0）
+    uint64_t floorCount() const {
+        return counters.size() < capacity || counters.empty() ? 0 : counters[minSlot()].count;
+    }
+
+public:
+    // 找最小计数是线性扫描，capacity 取几十到几百
+    explicit SpaceSaving(size_t capacity = 64) : capacity(std::max<size_t>(capacity, 1)), total(0) {}
+
+    void add(const std::string& key, uint64_t weight = 1) {
+        total += weight;
+        auto it = index.find(key);
+        if (it != index.end()) {
+            counters[it->second].count += weight;
+            return;
+        }
+        if (counters.size() < capacity) {
+            index[key] = counters.size();
+            counters.push_back(Counter{key, weight, 0});
+            return;
+        }
+        size_t slot = minSlot();
+        Counter& victim = counters[slot];
+        index.erase(victim.key);
+        victim.error = victim.count;
+        victim.count += weight;
+        victim.key = key;
+        index[key] = slot;
+    }
+
+    // 两边各自不在监视中的键按对方的最小计数补上，合并后保留计数最大的 capacity 个，误差上界仍是 N/capacity
+    void merge(const SpaceSaving& other) {
+        if (other.capacity != capacity) throw std::invalid_argument("SpaceSaving capacity mismatch");
+        uint64_t floorA = floorCount(), floorB = other.floorCount();
+        std::unordered_map<std::string, Counter> combined;
+        for (const auto& c : counters) {
+            uint64_t missing = other.index.count(c.key) ? 0 : floorB;
+            combined[c.key] = Counter{c.key, c.count + missing, c.error + missing};
+        }
+        for (const auto& c : other.counters) {
+            auto it = combined.find(c.key);
+            if (it == combined.end()) {
+                combined[c.key] = Counter{c.key, c.count + floorA, c.error + floorA};
+            } else {
+                it->second.count += c.count;
+                it->second.error += c.error;
+            }
+        }
+        counters.clear();
+        for (auto& entry : combined) counters.push_back(std::move(entry.second));
+        std::sort(counters.begin(), counters.end(), [](const Counter& a, const Counter& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (counters.size() > capacity) counters.resize(capacity);
+        index.clear();
+        for (size_t i = 0; i < counters.size(); ++i) index[counters[i].key] = i;
+        total += other.total;
+    }
+
+    // 计数最大的 k 个，按计数从大到小
+    std::vector<Counter> top(size_t k) const {
+        std::vector<Counter> result(counters);
+        std::sort(result.begin(), result.end(), [](const Counter& a, const Counter& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (result.size() > k) result.resize(k);
+        return result;
+    }
+
+    uint64_t totalCount() const {
+        return total;
+    }
+
+    double errorBound() const {
+        return static_cast<double>(total) / static_cast<double>(capacity);
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this) + counters.capacity() * sizeof(Counter) + index.bucket_count() * sizeof(void*);
+        bytes += index.size() * (sizeof(std::pair<const std::string, size_t>) + 2 * sizeof(void*));
+        return bytes;
+    }
+};
+
+// KLL 分位数摘要：若干层压缩器，第 h 层每个元素代表 2^h 个原始值；某层满了就排序后随机留下奇数位或偶数位的一半，升到上一层
+// 层容量从顶层的 k 往下按 2/3 递减，总大小约 3k。归一化名次误差约 2.296/k^0.9723（k=200 时约 1.33%，99% 置信）
+// 只能加；合并时逐层拼接再压缩，误差保证不变
+class KllSketch {
+private:
+    size_t k;
+    std::vector<std::vector<double>> levels;
+    size_t stored;
+    size_t capacityTotal;  // 各层容量之和，层数变了才重算
+    uint64_t count;
+    std::mt19937_64 rng;
+    double minValue;
+    double maxValue;
+    // 查询用的（值, 权重）按值排序的列表，有更新时作废
+    mutable std::vector<std::pair<double, uint64_t>> sortedView;
+    mutable bool viewValid;
+
+    size_t levelCapacity(size_t h) const {
+        size_t depth = levels.size() - 1 - h;
+        return std::max<size_t>(2, static_cast<size_t>(std::ceil(k * std::pow(2.0 / 3.0, static_cast<double>(depth)))));
+    }
+
+    void updateCapacity() {
+        capacityTotal = 0;
+        for (size_t h = 0; h < levels.size(); ++h) capacityTotal += levelCapacity(h);
+    }
+
+    void compress() {
+        while (stored >= capacityTotal) {
+            for (size_t h = 0; h < levels.size(); ++h) {
+                if (levels[h].size() < levelCapacity(h)) continue;
+                if (h + 1 == levels.size()) {
+                    levels.emplace_back();
+                    updateCapacity();
+                }
+                std::vector<double>& level = levels[h];
+                std::sort(level.begin(), level.end());
+                // 元素数为奇数时留下最大的一个在本层
+                double leftover = 0;
+                bool odd = level.size() % 2 == 1;
+                if (odd) {
+                    leftover = level.back();
+                    level.pop_back();
+                }
+                size_t offset = rng() & 1;
+                for (size_t i = offset; i < level.size(); i += 2) levels[h + 1].push_back(level[i]);
+                stored -= level.size() / 2;
+                level.clear();
+                if (odd) level.push_back(leftover);
+                break;
+            }
+        }
+    }
+
+    void buildView() const {
+        if (viewValid) return;
+        sortedView.clear();
+        sortedView.reserve(stored);
+        for (size_t h = 0; h < levels.size(); ++h) {
+            for (double v : levels[h]) sortedView.push_back(std::make_pair(v, uint64_t(1) << h));
+        }
+        std::sort(sortedView.begin(), sortedView.end());
+        for (size_t i = 1; i < sortedView.size(); ++i) sortedView[i].second += sortedView[i - 1].second;
+        viewValid = true;
+    }
+
+public:
+    explicit KllSketch(size_t k = 200, uint64_t seed = 0x6b6c6c)
+        : k(std::max<size_t>(k, 8)), levels(1), stored(0), count(0), rng(seed), minValue(0), maxValue(0), viewValid(false) {
+        updateCapacity();
+    }
+
+    void add(double value) {
+        if (count == 0 || value < minValue) minValue = value;
+        if (count == 0 || value > maxValue) maxValue = value;
+        levels[0].push_back(value);
+        stored++;
+        count++;
+        viewValid = false;
+        if (stored >= capacityTotal) compress();
+    }
+
+    void merge(const KllSketch& other) {
+        if (other.k != k) throw std::invalid_argument("KllSketch k mismatch");
+        if (other.count == 0) return;
+        if (count == 0 || other.minValue < minValue) minValue = other.minValue;
+        if (count == 0 || other.maxValue > maxValue) maxValue = other.maxValue;
+        if (other.levels.size() > levels.size()) {
+            levels.resize(other.levels.size());
+            updateCapacity();
+        }
+        for (size_t h = 0; h < other.levels.size(); ++h) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        stored += other.stored;
+        count += other.count;
+        viewValid = false;
+        compress();
+    }
+
+    void clear() {
+        levels.assign(1, std::vector<double>());
+        updateCapacity();
+        stored = 0;
+        count = 0;
+        viewValid = false;
+    }
+
+    uint64_t size() const {
+        return count;
+    }
+
+    // 不大于 value 的值所占比例
+    double rank(double value) const {
+        if (count == 0) return 0;
+        buildView();
+        auto it = std::upper_bound(sortedView.begin(), sortedView.end(), std::make_pair(value, UINT64_MAX));
+        return it == sortedView.begin() ? 0 : static_cast<double>((it - 1)->second) / static_cast<double>(count);
+    }
+
+    // q 分位数（0 <= q <= 1），q=0 和 q=1 给出精确的最小、最大值
+    double quantile(double q) const {
+        if (count == 0) return 0;
+        if (q <= 0) return minValue;
+        if (q >= 1) return maxValue;
+        buildView();
+        uint64_t target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+        auto it = std::lower_bound(sortedView.begin(), sortedView.end(), target,
+            [](const std::pair<double, uint64_t>& entry, uint64_t t) { return entry.second < t; });
+        return it == sortedView.end() ? maxValue : it->first;
+    }
+
+    double rankError() const {
+        return 2.296 / std::pow(static_cast<double>(k), 0.9723);
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this) + levels.capacity() * sizeof(std::vector<double>);
+        for (const auto& level : levels) bytes += level.capacity() * sizeof(double);
+        return bytes + sortedView.capacity() * sizeof(std::pair<double, uint64_t>);
+    }
+};
+
+// 各摘要的参数；要合并的两份必须用同样的参数
+struct SketchConfig {
+    unsigned hllPrecision = 14;     // 标题去重：16 KB，相对误差 0.81%
+    double cmEpsilon = 0.0005;      // 国家×年份计数：加性误差 epsilon*N
+    double cmDelta = 0.01;
+    size_t heavyCapacity = 64;      // 每个年份监视的国家数
+    size_t kllK = 200;              // 企业专利数分位数
+};
+
+// 一组可合并的摘要：标题去重、按 (国家, 年份) 的 Count-Min、每年一个国家 SpaceSaving、企业专利数的 KLL
+struct SketchSet {
+    SketchConfig config;
+    HyperLogLog titles;
+    CountMinSketch countryYear;
+    std::unordered_map<uint16_t, SpaceSaving> countriesByYear;
+    std::unordered_map<uint16_t, uint64_t> patentsByYear;
+    KllSketch firmCounts;
+
+    explicit SketchSet(const SketchConfig& config = SketchConfig())
+        : config(config), titles(config.hllPrecision), countryYear(config.cmEpsilon, config.cmDelta), firmCounts(config.kllK) {}
+
+    static uint16_t yearOf(const std::string& grantdate) {
+        if (grantdate.size() < 4) return 0;
+        uint16_t year = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            char c = grantdate[i];
+            if (c < '0' || c > '9') return 0;
+            year = static_cast<uint16_t>(year * 10 + (c - '0'));
+        }
+        return year;
+    }
+
+    static uint64_t countryYearKey(const std::string& country, uint16_t year) {
+        return sketch_detail::mix(sketch_detail::hashString(country) ^ (uint64_t(year) * 0x9E3779B97F4A7C15ULL));
+    }
+
+    SpaceSaving& yearBoard(uint16_t year) {
+        auto it = countriesByYear.find(year);
+        if (it == countriesByYear.end()) it = countriesByYear.emplace(year, SpaceSaving(config.heavyCapacity)).first;
+        return it->second;
+    }
+
+    // 专利的标题和国家、年份；企业专利数另外加
+    void addPatent(const Patent& patent) {
+        std::string scratch;
+        titles.add(sketch_detail::hashString(patent.titleRef(scratch)));
+        uint16_t year = yearOf(patent.grantdateRef());
+        countryYear.add(countryYearKey(patent.countryRef(), year));
+        yearBoard(year).add(patent.countryRef());
+        patentsByYear[year]++;
+    }
+
+    void merge(const SketchSet& other) {
+        titles.merge(other.titles);
+        countryYear.merge(other.countryYear);
+        for (const auto& entry : other.countriesByYear) yearBoard(entry.first).merge(entry.second);
+        for (const auto& entry : other.patentsByYear) patentsByYear[entry.first] += entry.second;
+        firmCounts.merge(other.firmCounts);
+    }
+
+    // 从系统全量建一份：每个工作线程各建一份再合并
+    static SketchSet build(const IFirmSystem& system, const SketchConfig& config = SketchConfig(), size_t threads = 0) {
+        if (threads == 0) threads = defaultThreadCount();
+        std::vector<std::unique_ptr<SketchSet>> partial;
+        for (size_t t = 0; t < threads; ++t) partial.emplace_back(new SketchSet(config));
+        system.parallelForEachPatent([&](const Patent& p, size_t worker) {
+            partial[worker]->addPatent(p);
+        }, threads);
+        system.parallelForEachFirm([&](const std::shared_ptr<IFirm>& firm, size_t worker) {
+            partial[worker]->firmCounts.add(firm->getPatentCount());
+        }, threads);
+        for (size_t t = 1; t < threads; ++t) partial[0]->merge(*partial[t]);
+        return std::move(*partial[0]);
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = titles.memoryUsage() + countryYear.memoryUsage() + firmCounts.memoryUsage();
+        for (const auto& entry : countriesByYear) bytes += entry.second.memoryUsage();
+        return bytes + patentsByYear.size() * (sizeof(std::pair<const uint16_t, uint64_t>) + 2 * sizeof(void*));
+    }
+};
+
+// 随增删、转让增量维护的看板统计
+// 标题去重和每年的国家 SpaceSaving 只能加：删除的专利仍计在内，直到 rebuild；国家×年份计数会扣除删除，
+// 删除时的国家、年份直接取自 onPatentRemoved / onFirmRemoved 带来的专利，不按专利号另存一份
+// 分位数：KLL 只能加不能删，所以用两份——企业计数刷新时把旧值加进 retired、新值加进 sketches.firmCounts，
+// 不大于 x 的企业数取两者之差。同一企业在两次查询之间的多次变化只在查询时刷新一次。
+// 名次误差是 KLL 误差 × (两份摘要的总量 / 企业数)；总量将超过 kMaxVolumeFactor 倍企业数时，
+// 按观察者自己记的各企业计数重建 KLL（不遍历系统），所以误差不超过 kMaxVolumeFactor × KLL 误差。
+// 分位数查询会刷新内部状态，和观察者回调一样需要独占访问：调用方持有写锁，或与修改在同一线程上串行执行
+class PatentSketches : public IFirmSystemObserver {
+public:
+    struct HeavyHitter {
+        std::string country;
+        uint64_t estimate;  // Count-Min 估计，偏大不超过 countErrorBound()
+        double share;       // 占该年份专利的比例
+    };
+
+private:
+    struct FirmCount {
+        uint32_t count;    // 当前专利数
+        uint32_t flushed;  // 最近一次加进分位数摘要的值
+        bool inSketch;     // flushed 是否在摘要里（新企业第一次刷新前不在）
+        bool dirty;        // 已在 dirtyFirms 里等待刷新
+    };
+
+    // 两份摘要的总量上限（相对企业数），超过就按当前计数重建
+    static const size_t kMaxVolumeFactor = 4;
+
+    SketchSet sketches;
+    KllSketch retired;  // 被新值替换掉、或企业已删除的旧计数
+    std::unordered_map<std::string, FirmCount> firmCounts;
+    std::vector<std::string> dirtyFirms;
+
+    void markDirty(const std::string& firmID, FirmCount& entry) {
+        if (entry.dirty) return;
+        entry.dirty = true;
+        dirtyFirms.push_back(firmID);
+    }
+
+    void adjustFirm(const std::string& firmID, int64_t delta) {
+        FirmCount& entry = firmCounts.emplace(firmID, FirmCount{0, 0, false, false}).first->second;
+        entry.count = static_cast<uint32_t>(std::max<int64_t>(0, static_cast<int64_t>(entry.count) + delta));
+        markDirty(firmID, entry);
+    }
+
+    void removeTag(const Patent& patent) {
+        uint16_t year = SketchSet::yearOf(patent.grantdateRef());
+        sketches.countryYear.add(SketchSet::countryYearKey(patent.countryRef(), year), -1);
+        sketches.patentsByYear[year]--;
+    }
+
+    // 按当前计数重建分位数摘要：O(企业数)，但至少隔 (kMaxVolumeFactor - 1) × 企业数 次刷新才发生一次
+    void compactCounts() {
+        sketches.firmCounts.clear();
+        retired.clear();
+        for (auto& entry : firmCounts) {
+            sketches.firmCounts.add(entry.second.count);
+            entry.second.flushed = entry.second.count;
+            entry.second.inSketch = true;
+            entry.second.dirty = false;
+        }
+        dirtyFirms.clear();
+    }
+
+    // 把上次查询之后变过的企业计数送进 KLL：只处理变过的企业；每个最多往两份摘要里各加一个值，
+    // 加完会超过总量上限时改为重建
+    void flushCounts() {
+        size_t volume = sketches.firmCounts.size() + retired.size() + 2 * dirtyFirms.size();
+        if (volume > kMaxVolumeFactor * std::max<size_t>(1, firmCounts.size())) {
+            compactCounts();
+            return;
+        }
+        for (const auto& firmID : dirtyFirms) {
+            auto it = firmCounts.find(firmID);
+            if (it == firmCounts.end() || !it->second.dirty) continue;  // 之后被删除，或重复登记
+            FirmCount& entry = it->second;
+            entry.dirty = false;
+            if (entry.inSketch && entry.flushed == entry.count) continue;
+            if (entry.inSketch) retired.add(entry.flushed);
+            sketches.firmCounts.add(entry.count);
+            entry.flushed = entry.count;
+            entry.inSketch = true;
+        }
+        dirtyFirms.clear();
+    }
+
+    // 不大于 value 的企业数：两份摘要的名次之差
+    double countAtMost(double value) const {
+        double added = sketches.firmCounts.rank(value) * static_cast<double>(sketches.firmCounts.size());
+        double removed = retired.rank(value) * static_cast<double>(retired.size());
+        return std::max(0.0, added - removed);
+    }
+
+public:
+    explicit PatentSketches(const SketchConfig& config = SketchConfig()) : sketches(config), retired(config.kllK) {}
+
+    void onFirmAdded(const std::string& firmID, const std::string&) override {
+        auto inserted = firmCounts.emplace(firmID, FirmCount{0, 0, false, false});
+        if (inserted.second) markDirty(firmID, inserted.first->second);
+    }
+
+    void onFirmRemoved(const IFirm& firm) override {
+        firm.forEachPatent([&](const Patent& p) { removeTag(p); });
+        auto it = firmCounts.find(firm.getFirmID());
+        if (it == firmCounts.end()) return;
+        if (it->second.inSketch) retired.add(it->second.flushed);
+        firmCounts.erase(it);
+    }
+
+    void onPatentAdded(const std::string& firmID, const Patent& patent) override {
+        sketches.addPatent(patent);
+        adjustFirm(firmID, 1);
+    }
+
+    void onPatentRemoved(const std::string& firmID, const Patent& patent) override {
+        removeTag(patent);
+        adjustFirm(firmID, -1);
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string&) override {
+        adjustFirm(fromFirmID, -1);
+        adjustFirm(toFirmID, 1);
+    }
+
+    // 整体并入只改两个企业的计数
+    void onFirmsMerged(const std::string& intoFirmID, const std::string& fromFirmID,
+                       const std::vector<std::string>& patentIDs) override {
+        adjustFirm(intoFirmID, static_cast<int64_t>(patentIDs.size()));
+        adjustFirm(fromFirmID, -static_cast<int64_t>(patentIDs.size()));
+    }
+
+    // 从系统重新建全部摘要，清掉删除留下的偏差和分位数累积的误差；摘要并行建再合并
+    void rebuild(const IFirmSystem& system, size_t threads = 0) {
+        sketches = SketchSet::build(system, sketches.config, threads);
+        retired.clear();
+        firmCounts.clear();
+        dirtyFirms.clear();
+        system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+            uint32_t count = static_cast<uint32_t>(firm->getPatentCount());
+            firmCounts[firm->getFirmID()] = FirmCount{count, count, true, false};
+        });
+    }
+
+    double distinctTitles() const {
+        return sketches.titles.estimate();
+    }
+
+    // 某年（如 "2015"）专利数最多的 k 个国家：候选来自 SpaceSaving，数量用 Count-Min 估计，按估计值从大到小
+    std::vector<HeavyHitter> topCountries(const std::string& year, size_t k) const {
+        std::vector<HeavyHitter> result;
+        uint16_t y = SketchSet::yearOf(year);
+        auto board = sketches.countriesByYear.find(y);
+        if (board == sketches.countriesByYear.end()) return result;
+        auto totalIt = sketches.patentsByYear.find(y);
+        uint64_t total = totalIt == sketches.patentsByYear.end() ? 0 : totalIt->second;
+        for (const auto& c : board->second.top(SIZE_MAX)) {
+            uint64_t estimate = static_cast<uint64_t>(sketches.countryYear.estimate(SketchSet::countryYearKey(c.key, y)));
+            if (estimate == 0) continue;
+            result.push_back(HeavyHitter{c.key, estimate, total ? static_cast<double>(estimate) / total : 0});
+        }
+        std::sort(result.begin(), result.end(), [](const HeavyHitter& a, const HeavyHitter& b) {
+            return a.estimate != b.estimate ? a.estimate > b.estimate : a.country < b.country;
+        });
+        if (result.size() > k) result.resize(k);
+        return result;
+    }
+
+    uint64_t countryYearCount(const std::string& country, const std::string& year) const {
+        return static_cast<uint64_t>(sketches.countryYear.estimate(SketchSet::countryYearKey(country, SketchSet::yearOf(year))));
+    }
+
+    // 企业专利数的 q 分位数：计数是整数，在摘要见过的最小、最大值之间二分找第一个名次达到 q 的值。
+    // 会先刷新变过的企业计数，调用方需要独占访问（见类注释）
+    double firmCountQuantile(double q) {
+        flushCounts();
+        size_t firms = firmCounts.size();
+        if (firms == 0 || sketches.firmCounts.size() == 0) return 0;
+        double target = std::min(std::max(q, 0.0), 1.0) * static_cast<double>(firms);
+        int64_t lo = static_cast<int64_t>(sketches.firmCounts.quantile(0));
+        int64_t hi = static_cast<int64_t>(sketches.firmCounts.quantile(1));
+        while (lo < hi) {
+            int64_t mid = lo + (hi - lo) / 2;
+            if (countAtMost(static_cast<double>(mid)) >= target) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return static_cast<double>(lo);
+    }
+
+    // 专利数不超过 count 的企业比例；同样会刷新，需要独占访问
+    double firmCountRank(uint32_t count) {
+        flushCounts();
+        if (firmCounts.empty()) return 0;
+        return std::min(1.0, countAtMost(count) / static_cast<double>(firmCounts.size()));
+    }
+
+    // 可以和其他线程或分片的摘要合并的副本；KLL 要能合并就必须是当前计数本身，所以这里按企业计数另建一份
+    SketchSet summary() const {
+        SketchSet copy = sketches;
+        copy.firmCounts.clear();
+        for (const auto& entry : firmCounts) copy.firmCounts.add(entry.second.count);
+        return copy;
+    }
+
+    double titleRelativeError() const {
+        return sketches.titles.relativeError();
+    }
+
+    double countErrorBound() const {
+        return sketches.countryYear.errorBound();
+    }
+
+    // 两份摘要各自的名次误差按其总量计，换算到当前企业数上；还没刷新的变化在下次查询时才计入。
+    // 查询后总量不超过 kMaxVolumeFactor 倍企业数，这个值也就不超过 kMaxVolumeFactor × KLL 误差
+    double quantileRankError() const {
+        if (firmCounts.empty()) return sketches.firmCounts.rankError();
+        double volume = static_cast<double>(sketches.firmCounts.size() + retired.size());
+        return sketches.firmCounts.rankError() * volume / static_cast<double>(firmCounts.size());
+    }
+
+    // 摘要本身的大小是固定的；企业计数随企业数增长（与专利数无关），单独报
+    size_t sketchBytes() const {
+        return sketches.memoryUsage() + retired.memoryUsage();
+    }
+
+    size_t trackingBytes() const {
+        size_t bytes = firmCounts.size() * (sizeof(std::pair<const std::string, FirmCount>) + 2 * sizeof(void*));
+        bytes += firmCounts.bucket_count() * sizeof(void*);
+        return bytes + dirtyFirms.capacity() * sizeof(std::string);
+    }
+};
+
+#endif
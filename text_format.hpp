@@ -0,0 +1,65 @@
+#ifndef TEXT_FORMAT_HPP
+#define TEXT_FORMAT_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 不经过 iostream 的文本格式化；Sink 只需要 append(const char*, size_t) 和 append(size_t, char)，
+// std::string 和 OutputBuffer 都可以直接用
+
+// 左对齐并用空格补到 width，相当于 std::left << std::setw(width)
+template <class Sink>
+inline void appendPadded(Sink& out, const std::string& s, size_t width) {
+    out.append(s.data(), s.size());
+    if (s.size() < width) out.append(width - s.size(), ' ');
+}
+
+// 每次写两位，用查表代替一半的除法
+template <class Sink>
+inline void appendUnsigned(Sink& out, uint64_t v) {
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char buf[20];
+    char* p = buf + sizeof(buf);
+    while (v >= 100) {
+        size_t i = static_cast<size_t>(v % 100) * 2;
+        v /= 100;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    }
+    if (v >= 10) {
+        size_t i = static_cast<size_t>(v) * 2;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    } else {
+        *--p = static_cast<char>('0' + v);
+    }
+    out.append(p, static_cast<size_t>(buf + sizeof(buf) - p));
+}
+
+template <class Sink>
+inline void appendSigned(Sink& out, int64_t v) {
+    if (v < 0) {
+        out.append(1, '-');
+        appendUnsigned(out, static_cast<uint64_t>(0) - static_cast<uint64_t>(v));
+    } else {
+        appendUnsigned(out, static_cast<uint64_t>(v));
+    }
+}
+
+// 清洗后的日期是 YYYYMMDD，写成 YYYY-MM-DD；不是 8 位的原样输出
+template <class Sink>
+inline void appendIsoDate(Sink& out, const std::string& yyyymmdd) {
+    if (yyyymmdd.size() != 8) {
+        out.append(yyyymmdd.data(), yyyymmdd.size());
+        return;
+    }
+    char buf[10] = {yyyymmdd[0], yyyymmdd[1], yyyymmdd[2], yyyymmdd[3], '-', yyyymmdd[4], yyyymmdd[5], '-',
+                    yyyymmdd[6], yyyymmdd[7]};
+    out.append(buf, sizeof(buf));
+}
+
+#endif
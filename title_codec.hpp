@@ -0,0 +1,297 @@
+#ifndef TITLE_CODEC_HPP
+#define TITLE_CODEC_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "patent.hpp"
+#include "thread_pool.hpp"
+
+// 仿 FSST 的标题编码：最多 255 个 1~8 字节的符号各占一个字节码，码 255 表示后面跟一个原样字节
+// 符号表从样本训练：反复用当前表编码样本，统计单个符号和相邻两个符号拼接后的收益（出现次数 × 长度），取收益最高的 255 个
+// 解码时每个码直接拷贝 8 字节再按符号长度前进，没有分支查表
+class TitleCodec {
+public:
+    enum { kEscape = 255, kMaxSymbols = 255, kMaxSymbolLen = 8 };
+
+private:
+    uint64_t symbols[kMaxSymbols];
+    uint8_t lengths[kMaxSymbols];
+    size_t symbolCount;
+    // 两字节及以上的符号按前两个字节分组，组内按长度从长到短，编码时贪心取最长匹配；单字节符号直接查表
+    std::vector<uint32_t> pairStart;
+    std::vector<uint8_t> byPair;
+    int16_t single[256];
+
+    static uint64_t load(const char* s, size_t n) {
+        uint64_t word = 0;
+        std::memcpy(&word, s, n < 8 ? n : 8);
+        return word;
+    }
+
+    static uint64_t lengthMask(size_t len) {
+        return len >= 8 ? ~0ULL : ((1ULL << (8 * len)) - 1);
+    }
+
+    void buildIndex() {
+        std::vector<std::vector<uint8_t>> groups(65536);
+        std::fill(single, single + 256, -1);
+        for (size_t c = 0; c < symbolCount; ++c) {
+            if (lengths[c] == 1) {
+                single[symbols[c] & 0xff] = static_cast<int16_t>(c);
+            } else {
+                groups[symbols[c] & 0xffff].push_back(static_cast<uint8_t>(c));
+            }
+        }
+        pairStart.assign(65537, 0);
+        byPair.clear();
+        for (size_t k = 0; k < 65536; ++k) {
+            std::sort(groups[k].begin(), groups[k].end(), [this](uint8_t x, uint8_t y) {
+                return lengths[x] > lengths[y];
+            });
+            pairStart[k] = static_cast<uint32_t>(byPair.size());
+            byPair.insert(byPair.end(), groups[k].begin(), groups[k].end());
+        }
+        pairStart[65536] = static_cast<uint32_t>(byPair.size());
+    }
+
+    // 在 s[i..n) 处找最长的符号，返回码；没有返回 -1
+    int match(const char* s, size_t i, size_t n) const {
+        size_t left = n - i;
+        uint64_t word = load(s + i, left);
+        if (left >= 2) {
+            size_t key = word & 0xffff;
+            for (uint32_t k = pairStart[key]; k < pairStart[key + 1]; ++k) {
+                uint8_t code = byPair[k];
+                size_t len = lengths[code];
+                if (len <= left && (word & lengthMask(len)) == symbols[code]) {
+                    return code;
+                }
+            }
+        }
+        return single[word & 0xff];
+    }
+
+    // 把一个字符串切成符号序列；没有匹配的字节记为 256 + 字节值（训练时的伪符号）
+    void tokenize(const std::string& s, std::vector<int>& tokens) const {
+        tokens.clear();
+        size_t i = 0;
+        while (i < s.size()) {
+            int code = match(s.data(), i, s.size());
+            if (code >= 0) {
+                tokens.push_back(code);
+                i += lengths[code];
+            } else {
+                tokens.push_back(256 + static_cast<unsigned char>(s[i]));
+                i++;
+            }
+        }
+    }
+
+    std::string tokenText(int token) const {
+        if (token >= 256) return std::string(1, static_cast<char>(token - 256));
+        uint64_t word = symbols[token];
+        return std::string(reinterpret_cast<const char*>(&word), lengths[token]);
+    }
+
+public:
+    TitleCodec() : symbolCount(0) {
+        buildIndex();
+    }
+
+    // 一般取几十 KB 的样本就够，多了只会拖慢训练
+    void train(const std::vector<std::string>& sample, int rounds = 5) {
+        symbolCount = 0;
+        buildIndex();
+        std::vector<int> tokens;
+        for (int round = 0; round < rounds; ++round) {
+            std::map<std::string, size_t> gain;
+            for (const auto& s : sample) {
+                tokenize(s, tokens);
+                for (size_t t = 0; t < tokens.size(); ++t) {
+                    std::string single = tokenText(tokens[t]);
+                    gain[single] += single.size();
+                    if (t + 1 < tokens.size()) {
+                        std::string pair = single + tokenText(tokens[t + 1]);
+                        if (pair.size() <= kMaxSymbolLen) gain[pair] += pair.size();
+                    }
+                }
+            }
+            std::vector<std::pair<size_t, std::string>> ranked;
+            ranked.reserve(gain.size());
+            for (const auto& g : gain) {
+                // 单字节符号只省掉转义字节，收益按一半算
+                ranked.push_back(std::make_pair(g.first.size() == 1 ? g.second / 2 : g.second, g.first));
+            }
+            size_t keep = std::min<size_t>(kMaxSymbols, ranked.size());
+            std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                              [](const std::pair<size_t, std::string>& a, const std::pair<size_t, std::string>& b) {
+                                  return a.first != b.first ? a.first > b.first : a.second < b.second;
+                              });
+            symbolCount = keep;
+            for (size_t c = 0; c < keep; ++c) {
+                lengths[c] = static_cast<uint8_t>(ranked[c].second.size());
+                symbols[c] = load(ranked[c].second.data(), ranked[c].second.size());
+            }
+            buildIndex();
+        }
+    }
+
+    size_t size() const {
+        return symbolCount;
+    }
+
+    void encode(const char* s, size_t n, std::vector<uint8_t>& out) const {
+        size_t i = 0;
+        while (i < n) {
+            int code = match(s, i, n);
+            if (code >= 0) {
+                out.push_back(static_cast<uint8_t>(code));
+                i += lengths[code];
+            } else {
+                out.push_back(kEscape);
+                out.push_back(static_cast<uint8_t>(s[i]));
+                i++;
+            }
+        }
+    }
+
+    // out 至少要有 n * 8 字节（每个码最多展开 8 字节，整字写入），返回实际长度
+    size_t decode(const uint8_t* in, size_t n, char* out) const {
+        char* start = out;
+        size_t i = 0;
+        while (i < n) {
+            uint8_t code = in[i++];
+            if (code != kEscape) {
+                std::memcpy(out, &symbols[code], 8);
+                out += lengths[code];
+            } else {
+                *out++ = static_cast<char>(in[i++]);
+            }
+        }
+        return static_cast<size_t>(out - start);
+    }
+
+    size_t memoryUsage() const {
+        return sizeof(*this) + pairStart.capacity() * sizeof(uint32_t) + byPair.capacity();
+    }
+};
+
+// 压缩后的标题连续存放在一块大内存里，ends[i] 是第 i 个标题的结束偏移
+// 按编号随机解码单个标题；scan 复用一个缓冲区顺序解码全部标题，供扫描和搜索使用
+// 只追加不回收：删掉的专利的标题仍留在块里
+class CompressedTitleStore : public ColdFieldSource {
+private:
+    TitleCodec codec;
+    std::vector<uint8_t> arena;
+    std::vector<uint32_t> ends;
+    size_t rawBytes;
+    size_t longest;
+
+    size_t startOf(uint32_t id) const {
+        return id == 0 ? 0 : ends[id - 1];
+    }
+
+public:
+    CompressedTitleStore() : rawBytes(0), longest(0) {}
+
+    // 等间隔抽取大约 sampleBytes 字节的标题训练符号表
+    void train(const std::vector<std::string>& titles, size_t sampleBytes = 65536) {
+        size_t total = 0;
+        for (const auto& t : titles) total += t.size();
+        size_t step = std::max<size_t>(1, total / std::max<size_t>(1, sampleBytes));
+        std::vector<std::string> sample;
+        for (size_t i = 0; i < titles.size(); i += step) sample.push_back(titles[i]);
+        codec.train(sample);
+    }
+
+    uint32_t append(const std::string& title) {
+        codec.encode(title.data(), title.size(), arena);
+        ends.push_back(static_cast<uint32_t>(arena.size()));
+        rawBytes += title.size();
+        longest = std::max(longest, ends.back() - startOf(static_cast<uint32_t>(ends.size() - 1)));
+        return static_cast<uint32_t>(ends.size() - 1);
+    }
+
+    // 装载时用：训练后分块并行编码，再按原顺序拼接；每个专利的标题改为引用这里
+    void compressTitles(std::vector<Patent>& patents, size_t threads) {
+        std::vector<std::string> titles(patents.size());
+        for (size_t i = 0; i < patents.size(); ++i) titles[i] = patents[i].getTitle();
+        if (codec.size() == 0) train(titles);
+
+        size_t chunks = std::max<size_t>(1, std::min(threads * 4, patents.size() / 4096 + 1));
+        std::vector<std::vector<uint8_t>> parts(chunks);
+        std::vector<std::vector<uint32_t>> partEnds(chunks);
+        parallelFor(chunks, threads, [&](size_t b, size_t e, size_t) {
+            for (size_t c = b; c < e; ++c) {
+                size_t from = patents.size() * c / chunks, to = patents.size() * (c + 1) / chunks;
+                for (size_t i = from; i < to; ++i) {
+                    codec.encode(titles[i].data(), titles[i].size(), parts[c]);
+                    partEnds[c].push_back(static_cast<uint32_t>(parts[c].size()));
+                }
+            }
+        });
+
+        uint32_t firstID = static_cast<uint32_t>(ends.size());
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t base = arena.size();
+            arena.insert(arena.end(), parts[c].begin(), parts[c].end());
+            size_t prev = 0;
+            for (uint32_t end : partEnds[c]) {
+                ends.push_back(static_cast<uint32_t>(base + end));
+                longest = std::max<size_t>(longest, end - prev);
+                prev = end;
+            }
+        }
+        for (size_t i = 0; i < patents.size(); ++i) {
+            rawBytes += titles[i].size();
+            patents[i].setColdTitle(this, firstID + i);
+        }
+    }
+
+    void decodeInto(uint32_t id, std::string& out) const {
+        size_t start = startOf(id);
+        size_t n = ends[id] - start;
+        out.resize(n * 8);
+        out.resize(codec.decode(arena.data() + start, n, &out[0]));
+    }
+
+    std::string loadTitle(uint64_t ref) const override {
+        std::string title;
+        if (ref < ends.size()) decodeInto(static_cast<uint32_t>(ref), title);
+        return title;
+    }
+
+    // 顺序解码所有标题，fn(id, text, len) 里的指针只在本次回调内有效
+    void scan(const std::function<void(uint32_t, const char*, size_t)>& fn) const {
+        std::vector<char> buffer(longest * 8 + 8);
+        size_t start = 0;
+        for (uint32_t id = 0; id < ends.size(); ++id) {
+            size_t len = codec.decode(arena.data() + start, ends[id] - start, buffer.data());
+            fn(id, buffer.data(), len);
+            start = ends[id];
+        }
+    }
+
+    size_t size() const {
+        return ends.size();
+    }
+
+    size_t uncompressedBytes() const {
+        return rawBytes;
+    }
+
+    size_t compressedBytes() const {
+        return arena.size() + ends.size() * sizeof(uint32_t);
+    }
+
+    size_t memoryUsage() const override {
+        return arena.capacity() + ends.capacity() * sizeof(uint32_t) + codec.memoryUsage();
+    }
+};
+
+#endif
@@ -0,0 +1,451 @@
+#ifndef TRANSFER_GRAPH_HPP
+#define TRANSFER_GRAPH_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cmath>
+#include <functional>
+#include <cstdint>
+#include "firmSys.hpp"
+#include "thread_pool.hpp"
+#include "work_stealing.hpp"
+
+enum class EdgeKind : uint8_t {
+    Transfer = 0,
+    Citation = 1
+};
+
+// 压缩邻接（CSR）快照：顶点 v 的邻居是 targets[offsets[v] .. offsets[v+1])，
+// 重复边合并为一条，weights 记录出现次数
+struct CsrGraph {
+    size_t vertexCount;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> weights;
+
+    CsrGraph() : vertexCount(0) {}
+
+    size_t edgeCount() const { return targets.size(); }
+    uint64_t begin(uint32_t v) const { return offsets[v]; }
+    uint64_t end(uint32_t v) const { return offsets[v + 1]; }
+
+    size_t memoryUsage() const {
+        return offsets.capacity() * sizeof(uint64_t) + targets.capacity() * sizeof(uint32_t)
+             + weights.capacity() * sizeof(uint32_t);
+    }
+};
+
+struct GraphEdge {
+    uint32_t from;
+    uint32_t to;
+};
+
+// 并行构建 CSR：原子计数出度 -> 前缀和 -> 散布 -> 每个顶点内排序去重，各步骤切成 threads 段交给执行器
+inline CsrGraph buildCsr(size_t vertexCount, const std::vector<GraphEdge>& edges, bool reverse,
+                         WorkStealingExecutor& ex, size_t threads) {
+    CsrGraph g;
+    g.vertexCount = vertexCount;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> cursor(new std::atomic<uint64_t>[vertexCount + 1]);
+    for (size_t v = 0; v <= vertexCount; ++v) cursor[v].store(0, std::memory_order_relaxed);
+
+    parallelFor(ex, edges.size(), threads, [&](size_t b, size_t e, size_t) {
+        for (size_t i = b; i < e; ++i) {
+            uint32_t src = reverse ? edges[i].to : edges[i].from;
+            cursor[src].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    std::vector<uint64_t> raw(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        raw[v + 1] = raw[v] + cursor[v].load(std::memory_order_relaxed);
+        cursor[v].store(raw[v], std::memory_order_relaxed);
+    }
+
+    std::vector<uint32_t> scattered(edges.size());
+    parallelFor(ex, edges.size(), threads, [&](size_t b, size_t e, size_t) {
+        for (size_t i = b; i < e; ++i) {
+            uint32_t src = reverse ? edges[i].to : edges[i].from;
+            uint32_t dst = reverse ? edges[i].from : edges[i].to;
+            scattered[cursor[src].fetch_add(1, std::memory_order_relaxed)] = dst;
+        }
+    });
+    cursor.reset();
+
+    // 每个顶点的邻居排序后统计去重后的数量
+    std::vector<uint64_t> unique(vertexCount + 1, 0);
+    parallelFor(ex, vertexCount, threads, [&](size_t b, size_t e, size_t) {
+        for (size_t v = b; v < e; ++v) {
+            auto first = scattered.begin() + raw[v];
+            auto last = scattered.begin() + raw[v + 1];
+            std::sort(first, last);
+            uint64_t count = 0;
+            for (auto it = first; it != last; ++it) {
+                if (it == first || *it != *(it - 1)) count++;
+            }
+            unique[v + 1] = count;
+        }
+    });
+
+    g.offsets.resize(vertexCount + 1);
+    g.offsets[0] = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        g.offsets[v + 1] = g.offsets[v] + unique[v + 1];
+    }
+    g.targets.resize(g.offsets[vertexCount]);
+    g.weights.resize(g.offsets[vertexCount]);
+
+    parallelFor(ex, vertexCount, threads, [&](size_t b, size_t e, size_t) {
+        for (size_t v = b; v < e; ++v) {
+            uint64_t out = g.offsets[v];
+            for (uint64_t i = raw[v]; i < raw[v + 1]; ++i) {
+                if (i > raw[v] && scattered[i] == scattered[i - 1]) {
+                    g.weights[out - 1]++;
+                } else {
+                    g.targets[out] = scattered[i];
+                    g.weights[out] = 1;
+                    out++;
+                }
+            }
+        }
+    });
+    return g;
+}
+
+// 企业间的专利转让图（以及之后的引用图）
+// 作为观察者记录每一次 transferPatent，边从转出方指向受让方；
+// PageRank、连通分量和 top-k 查询都在 CSR 快照上多线程执行；加边之后第一次分析时按上次 build() 的边类型重建快照，
+// 也可以显式调用 build() 切换边类型。并行循环交给图自己持有的工作窃取执行器，线程只创建一次
+class TransferGraph : public IFirmSystemObserver {
+public:
+    struct RankedFirm {
+        std::string firmID;
+        double score;
+    };
+
+    struct FirmPair {
+        std::string fromFirmID;
+        std::string toFirmID;
+        uint32_t count;
+    };
+
+private:
+    std::unordered_map<std::string, uint32_t> firmIndex;
+    std::vector<std::string> firmIDs;
+    std::vector<GraphEdge> edges[2];
+    std::mutex edgeMtx;
+
+    // 出边、入边两份 CSR；分析持有快照的 shared_ptr，重建时另换一份，进行中的分析不受影响
+    struct Snapshot {
+        CsrGraph out;
+        CsrGraph in;
+    };
+
+    std::shared_ptr<const Snapshot> snapshot;
+    EdgeKind builtKind;
+    bool dirty; // builtKind 类型的边在上次构建之后有变化
+
+    std::mutex executorMtx;
+    std::shared_ptr<WorkStealingExecutor> executor;
+
+    static uint32_t findRoot(std::vector<std::atomic<uint32_t>>& parent, uint32_t x) {
+        while (true) {
+            uint32_t p = parent[x].load(std::memory_order_relaxed);
+            if (p == x) return x;
+            uint32_t gp = parent[p].load(std::memory_order_relaxed);
+            if (gp != p) {
+                parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed); // 路径减半
+            }
+            x = gp;
+        }
+    }
+
+    // 总是把编号大的根挂到编号小的根下面，保证无环
+    static void unite(std::vector<std::atomic<uint32_t>>& parent, uint32_t a, uint32_t b) {
+        while (true) {
+            a = findRoot(parent, a);
+            b = findRoot(parent, b);
+            if (a == b) return;
+            if (a < b) std::swap(a, b);
+            uint32_t expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+        }
+    }
+
+    static size_t normalizeThreads(size_t threads) { return threads == 0 ? defaultThreadCount() : threads; }
+
+    std::shared_ptr<WorkStealingExecutor> executorFor(size_t threads) {
+        std::lock_guard<std::mutex> lock(executorMtx);
+        if (!executor || executor->size() != threads) executor = std::make_shared<WorkStealingExecutor>(threads);
+        return executor;
+    }
+
+    // 调用方持有 edgeMtx
+    void rebuildLocked(EdgeKind kind, size_t threads) {
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        const std::vector<GraphEdge>& list = edges[static_cast<int>(kind)];
+        std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>();
+        next->out = buildCsr(firmIDs.size(), list, false, *ex, threads);
+        next->in = buildCsr(firmIDs.size(), list, true, *ex, threads);
+        snapshot = next;
+        builtKind = kind;
+        dirty = false;
+    }
+
+    // 当前快照；有新边（或新顶点）时先按 builtKind 重建
+    std::shared_ptr<const Snapshot> current(size_t threads) {
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        if (dirty || !snapshot) rebuildLocked(builtKind, threads);
+        return snapshot;
+    }
+
+public:
+    TransferGraph() : builtKind(EdgeKind::Transfer), dirty(true) {}
+
+    uint32_t vertexOf(const std::string& firmID) {
+        auto it = firmIndex.find(firmID);
+        if (it != firmIndex.end()) return it->second;
+        uint32_t idx = static_cast<uint32_t>(firmIDs.size());
+        firmIndex.emplace(firmID, idx);
+        firmIDs.push_back(firmID);
+        dirty = true; // 新顶点也要进快照
+        return idx;
+    }
+
+    const std::string& firmOf(uint32_t vertex) const { return firmIDs[vertex]; }
+    size_t vertexCount() const { return firmIDs.size(); }
+    size_t rawEdgeCount(EdgeKind kind) const { return edges[static_cast<int>(kind)].size(); }
+
+    EdgeKind builtEdgeKind() const { return builtKind; }
+
+    void reserveEdges(EdgeKind kind, size_t n) { edges[static_cast<int>(kind)].reserve(n); }
+
+    // 按顶点编号追加边，供批量导入使用（不加锁）
+    void addEdge(uint32_t from, uint32_t to, EdgeKind kind) {
+        edges[static_cast<int>(kind)].push_back(GraphEdge{from, to});
+        if (kind == builtKind) dirty = true;
+    }
+
+    void addEdge(const std::string& fromFirmID, const std::string& toFirmID, EdgeKind kind) {
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        addEdge(vertexOf(fromFirmID), vertexOf(toFirmID), kind);
+    }
+
+    // 引用边：citingFirm 的专利引用了 citedFirm 的专利
+    void addCitation(const std::string& citingFirmID, const std::string& citedFirmID) {
+        addEdge(citingFirmID, citedFirmID, EdgeKind::Citation);
+    }
+
+    void onFirmAdded(const std::string& firmID, const std::string& firmName) override {
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        vertexOf(firmID);
+    }
+
+    void onPatentTransferred(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        addEdge(fromFirmID, toFirmID, EdgeKind::Transfer);
+    }
+
+    // 从某一类边生成出边和入边两份 CSR 快照，之后的自动重建也用这类边
+    void build(EdgeKind kind = EdgeKind::Transfer, size_t threads = defaultThreadCount()) {
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        rebuildLocked(kind, normalizeThreads(threads));
+    }
+
+    // 返回的引用在下一次重建之前有效
+    const CsrGraph& outEdges() { return current(defaultThreadCount())->out; }
+    const CsrGraph& inEdges() { return current(defaultThreadCount())->in; }
+
+    // 拉取式 PageRank，边权为转让次数；无出边的顶点的分数均分给所有顶点
+    std::vector<double> pageRank(double damping = 0.85, size_t maxIterations = 20, double tolerance = 1e-9,
+                                 size_t threads = defaultThreadCount()) {
+        threads = normalizeThreads(threads);
+        std::shared_ptr<const Snapshot> snap = current(threads);
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        const CsrGraph& out = snap->out;
+        const CsrGraph& in = snap->in;
+        size_t n = out.vertexCount;
+        std::vector<double> rank(n, n ? 1.0 / n : 0.0);
+        if (n == 0) return rank;
+        std::vector<double> next(n, 0.0);
+        std::vector<double> outWeight(n, 0.0);
+        parallelFor(*ex, n, threads, [&](size_t b, size_t e, size_t) {
+            for (size_t v = b; v < e; ++v) {
+                double w = 0;
+                for (uint64_t i = out.begin(v); i < out.end(v); ++i) w += out.weights[i];
+                outWeight[v] = w;
+            }
+        });
+
+        size_t slots = std::max<size_t>(threads, 1);
+        std::vector<double> partial(slots);
+        for (size_t iter = 0; iter < maxIterations; ++iter) {
+            std::fill(partial.begin(), partial.end(), 0.0);
+            parallelFor(*ex, n, threads, [&](size_t b, size_t e, size_t t) {
+                double d = 0;
+                for (size_t v = b; v < e; ++v) {
+                    if (outWeight[v] == 0) d += rank[v];
+                }
+                partial[t] = d;
+            });
+            double dangling = 0;
+            for (double d : partial) dangling += d;
+
+            double base = (1.0 - damping) / n + damping * dangling / n;
+            std::fill(partial.begin(), partial.end(), 0.0);
+            parallelFor(*ex, n, threads, [&](size_t b, size_t e, size_t t) {
+                double delta = 0;
+                for (size_t v = b; v < e; ++v) {
+                    double sum = 0;
+                    for (uint64_t i = in.begin(v); i < in.end(v); ++i) {
+                        uint32_t u = in.targets[i];
+                        sum += rank[u] * in.weights[i] / outWeight[u];
+                    }
+                    next[v] = base + damping * sum;
+                    delta += std::fabs(next[v] - rank[v]);
+                }
+                partial[t] = delta;
+            });
+            rank.swap(next);
+            double delta = 0;
+            for (double d : partial) delta += d;
+            if (delta < tolerance) break;
+        }
+        return rank;
+    }
+
+    // 弱连通分量：无锁并查集，返回每个顶点所在分量的代表顶点
+    std::vector<uint32_t> connectedComponents(size_t threads = defaultThreadCount()) {
+        threads = normalizeThreads(threads);
+        std::shared_ptr<const Snapshot> snap = current(threads);
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        const CsrGraph& out = snap->out;
+        size_t n = out.vertexCount;
+        std::vector<std::atomic<uint32_t>> parent(n);
+        for (size_t v = 0; v < n; ++v) parent[v].store(static_cast<uint32_t>(v), std::memory_order_relaxed);
+
+        parallelFor(*ex, n, threads, [&](size_t b, size_t e, size_t) {
+            for (size_t v = b; v < e; ++v) {
+                for (uint64_t i = out.begin(v); i < out.end(v); ++i) {
+                    unite(parent, static_cast<uint32_t>(v), out.targets[i]);
+                }
+            }
+        });
+
+        std::vector<uint32_t> label(n);
+        parallelFor(*ex, n, threads, [&](size_t b, size_t e, size_t) {
+            for (size_t v = b; v < e; ++v) label[v] = findRoot(parent, static_cast<uint32_t>(v));
+        });
+        return label;
+    }
+
+    static size_t componentCount(const std::vector<uint32_t>& label) {
+        size_t count = 0;
+        for (size_t v = 0; v < label.size(); ++v) {
+            if (label[v] == v) count++;
+        }
+        return count;
+    }
+
+    std::vector<RankedFirm> topByPageRank(size_t k, size_t threads = defaultThreadCount()) {
+        std::vector<double> rank = pageRank(0.85, 20, 1e-9, threads);
+        std::vector<uint32_t> order(rank.size());
+        for (size_t v = 0; v < order.size(); ++v) order[v] = static_cast<uint32_t>(v);
+        k = std::min(k, order.size());
+        std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](uint32_t a, uint32_t b) {
+            return rank[a] > rank[b];
+        });
+        std::vector<RankedFirm> result;
+        std::lock_guard<std::mutex> lock(edgeMtx); // 观察者回调可能同时在加顶点，firmIDs 会扩容
+        for (size_t i = 0; i < k; ++i) result.push_back(RankedFirm{firmIDs[order[i]], rank[order[i]]});
+        return result;
+    }
+
+    // 受让方 acquirer 最常从哪些企业获得专利；顶点编号在锁内查，快照之后才加的顶点没有入边
+    std::vector<FirmPair> topSources(const std::string& acquirerID, size_t k) {
+        std::vector<FirmPair> result;
+        uint32_t v;
+        {
+            std::lock_guard<std::mutex> lock(edgeMtx);
+            auto it = firmIndex.find(acquirerID);
+            if (it == firmIndex.end()) return result;
+            v = it->second;
+        }
+        std::shared_ptr<const Snapshot> snap = current(defaultThreadCount());
+        const CsrGraph& in = snap->in;
+        if (v >= in.vertexCount) return result;
+        std::vector<std::pair<uint32_t, uint32_t>> sources;
+        for (uint64_t i = in.begin(v); i < in.end(v); ++i) {
+            sources.push_back(std::make_pair(in.weights[i], in.targets[i]));
+        }
+        k = std::min(k, sources.size());
+        std::partial_sort(sources.begin(), sources.begin() + k, sources.end(),
+                          [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                              return a.first > b.first;
+                          });
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        for (size_t i = 0; i < k; ++i) {
+            result.push_back(FirmPair{firmIDs[sources[i].second], acquirerID, sources[i].first});
+        }
+        return result;
+    }
+
+    // 全图转让次数最多的 k 个 (转出方, 受让方) 组合；每个线程维护自己的小顶堆再合并
+    std::vector<FirmPair> topPairs(size_t k, size_t threads = defaultThreadCount()) {
+        threads = normalizeThreads(threads);
+        std::shared_ptr<const Snapshot> snap = current(threads);
+        std::shared_ptr<WorkStealingExecutor> ex = executorFor(threads);
+        const CsrGraph& out = snap->out;
+        typedef std::pair<uint32_t, uint64_t> Item; // (权重, 边下标)
+        size_t slots = std::max<size_t>(threads, 1);
+        std::vector<std::vector<Item>> heaps(slots);
+        std::greater<Item> cmp;
+
+        parallelFor(*ex, out.vertexCount, threads, [&](size_t b, size_t e, size_t t) {
+            std::vector<Item>& heap = heaps[t];
+            for (size_t v = b; v < e; ++v) {
+                for (uint64_t i = out.begin(v); i < out.end(v); ++i) {
+                    Item item(out.weights[i], i);
+                    if (heap.size() < k) {
+                        heap.push_back(item);
+                        std::push_heap(heap.begin(), heap.end(), cmp);
+                    } else if (k > 0 && item.first > heap.front().first) {
+                        std::pop_heap(heap.begin(), heap.end(), cmp);
+                        heap.back() = item;
+                        std::push_heap(heap.begin(), heap.end(), cmp);
+                    }
+                }
+            }
+        });
+
+        std::vector<Item> all;
+        for (const auto& heap : heaps) all.insert(all.end(), heap.begin(), heap.end());
+        k = std::min(k, all.size());
+        std::partial_sort(all.begin(), all.begin() + k, all.end(), [](const Item& a, const Item& b) {
+            return a.first > b.first;
+        });
+
+        std::vector<FirmPair> result;
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        for (size_t j = 0; j < k; ++j) {
+            uint64_t edge = all[j].second;
+            uint32_t from = static_cast<uint32_t>(std::upper_bound(out.offsets.begin(), out.offsets.end(), edge)
+                                                  - out.offsets.begin() - 1);
+            result.push_back(FirmPair{firmIDs[from], firmIDs[out.targets[edge]], all[j].first});
+        }
+        return result;
+    }
+
+    size_t memoryUsage() {
+        std::lock_guard<std::mutex> lock(edgeMtx);
+        size_t bytes = (edges[0].capacity() + edges[1].capacity()) * sizeof(GraphEdge);
+        if (snapshot) bytes += snapshot->out.memoryUsage() + snapshot->in.memoryUsage();
+        return bytes;
+    }
+};
+
+#endif
@@ -4,37 +4,75 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <memory>
+#include <utility>
+#include <initializer_list>
 
-template<typename T>
+// Alloc 默认是 std::allocator，需要统计内存时可以换成 TrackingAllocator
+// 只有 [0, size_) 内的元素是构造过的，其余容量是未初始化的内存
+template<typename T, typename Alloc = std::allocator<T>>
 class myVector {
 private:
+    typedef std::allocator_traits<Alloc> Traits;
+
+    Alloc alloc;
     T* data;
     size_t size_;
     size_t capacity_;
 
+    void reallocate(size_t newCapacity) {
+        T* newData = Traits::allocate(alloc, newCapacity);
+        for (size_t i = 0; i < size_; ++i) {
+            Traits::construct(alloc, newData + i, std::move(data[i])); // 把现有数据移动到新分配的内存
+            Traits::destroy(alloc, data + i);
+        }
+        if (data) {
+            Traits::deallocate(alloc, data, capacity_); // 释放旧内存
+        }
+        data = newData;
+        capacity_ = newCapacity;
+    }
+
     // 动态调整内存大小
     void resizeIfNeeded() {
         if (size_ >= capacity_) {
-            capacity_ = capacity_ == 0 ? 1 : capacity_ *2;
-            T* newData = new T[capacity_];
-            std::copy(data, data + size_, newData); // 复制现有数据到新分配的内存
-            delete[] data; // 释放旧内存
-            data = newData;
+            reallocate(capacity_ == 0 ? 1 : capacity_ * 2);
         }
     }
 
 public:
     myVector() : data(nullptr), size_(0), capacity_(0) {}
     // 支持通过数组初始化
-    myVector(const T arr[], size_t arr_size) : size_(arr_size), capacity_(arr_size) {
-        data = new T[capacity_];
-        std::copy(arr, arr + arr_size, data);
+    myVector(const T arr[], size_t arr_size) : data(nullptr), size_(0), capacity_(0) {
+        reserve(arr_size);
+        for (size_t i = 0; i < arr_size; ++i) {
+            push_back(arr[i]);
+        }
     }
 
     // 支持通过列表初始化
-    myVector(std::initializer_list<T> init_list) : size_(init_list.size()), capacity_(init_list.size()) {
-        data = new T[capacity_];
-        std::copy(init_list.begin(), init_list.end(), data);
+    myVector(std::initializer_list<T> init_list) : data(nullptr), size_(0), capacity_(0) {
+        reserve(init_list.size());
+        for (const auto& value : init_list) {
+            push_back(value);
+        }
+    }
+
+    myVector(const myVector& other) : data(nullptr), size_(0), capacity_(0) {
+        reserve(other.size_);
+        for (size_t i = 0; i < other.size_; ++i) {
+            push_back(other.data[i]);
+        }
+    }
+
+    myVector& operator=(const myVector& other) {
+        if (this != &other) {
+            myVector copy(other);
+            std::swap(data, copy.data);
+            std::swap(size_, copy.size_);
+            std::swap(capacity_, copy.capacity_);
+        }
+        return *this;
     }
 
     size_t size() const {
@@ -45,6 +83,13 @@ public:
         return capacity_;
     }
 
+    // 预先分配空间，批量插入时避免多次扩容
+    void reserve(size_t newCapacity) {
+        if (newCapacity > capacity_) {
+            reallocate(newCapacity);
+        }
+    }
+
     // 通过索引访问元素
     T& operator[](size_t index) {
         if (index >= size_) {
@@ -63,13 +108,28 @@ public:
     // 添加元素到末尾
     void push_back(const T& value) {
         resizeIfNeeded();
-        data[size_++] = value;
+        Traits::construct(alloc, data + size_, value);
+        ++size_;
+    }
+
+    void push_back(T&& value) {
+        resizeIfNeeded();
+        Traits::construct(alloc, data + size_, std::move(value));
+        ++size_;
+    }
+
+    // 交换两个数组的缓冲区，不移动元素；分配器需要是无状态的（TrackingAllocator 就是）
+    void swap(myVector& other) {
+        std::swap(data, other.data);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
     }
 
     // 移除最后一个元素（栈）
     void pop_back() {
         if (size_ > 0) {
             --size_;
+            Traits::destroy(alloc, data + size_);
         }
     }
 
@@ -79,7 +139,7 @@ public:
             throw std::out_of_range("Index out of range");
         }
         std::move(data + index + 1, data + size_, data + index);
-        --size_;
+        pop_back();
     }
 
     // 按值移除元素
@@ -120,14 +180,19 @@ public:
     const T* end() const {
         return data + size_;
     }
-    
+
     void clear() {
-        size_ = 0;
+        while (size_ > 0) {
+            pop_back();
+        }
     }
 
     ~myVector() {
-        delete[] data;
+        clear();
+        if (data) {
+            Traits::deallocate(alloc, data, capacity_);
+        }
     }
 };
 
-#endif
\ No newline at end of file
+#endif
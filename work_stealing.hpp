@@ -0,0 +1,229 @@
+#ifndef WORK_STEALING_HPP
+#define WORK_STEALING_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <random>
+#include <algorithm>
+
+// 工作窃取执行器：每个工作线程有自己的双端队列，自己从尾部取（后进先出，缓存热），
+// 闲下来的线程随机挑一个别人从头部偷（偷到的是最早放进去、通常也是最大的任务）
+// 任务里可以再 spawn 子任务，run 等到这一批连同所有子任务都执行完才返回
+// 同一时刻只执行一批：并发调用 run 会排队；任务里不能再调用 run
+class WorkStealingExecutor {
+public:
+    // 参数是执行它的工作线程编号，可以用来索引按线程分开的累加器
+    typedef std::function<void(size_t)> Task;
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex runMtx;  // 一次一批
+
+    std::mutex idleMtx;
+    std::condition_variable idleCv;
+    std::condition_variable doneCv;
+    std::atomic<size_t> pending;  // 已提交未完成的任务数
+    std::atomic<size_t> stolen;
+    uint64_t epoch;               // 每次入队加一，空闲线程据此判断睡下之后有没有新任务
+    std::exception_ptr failure;
+    bool stopping;
+
+    static size_t& currentWorker() {
+        static thread_local size_t index = static_cast<size_t>(-1);
+        return index;
+    }
+
+    bool popLocal(size_t self, Task& task) {
+        Queue& q = *queues[self];
+        std::lock_guard<std::mutex> lock(q.mtx);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t self, std::mt19937& rng, Task& task) {
+        size_t n = queues.size();
+        size_t start = rng() % n;
+        for (size_t k = 0; k < n; ++k) {
+            size_t victim = (start + k) % n;
+            if (victim == self) continue;
+            Queue& q = *queues[victim];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (q.tasks.empty()) continue;
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            stolen++;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Task& task, size_t self) {
+        try {
+            task(self);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(idleMtx);
+            if (!failure) failure = std::current_exception();
+        }
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> lock(idleMtx);
+            doneCv.notify_all();
+        }
+    }
+
+    void workerLoop(size_t self) {
+        currentWorker() = self;
+        std::mt19937 rng(static_cast<unsigned>(self * 7919 + 1));
+        while (true) {
+            uint64_t seen;
+            {
+                std::lock_guard<std::mutex> lock(idleMtx);
+                if (stopping) return;
+                seen = epoch;
+            }
+            Task task;
+            if (popLocal(self, task) || steal(self, rng, task)) {
+                execute(task, self);
+                continue;
+            }
+            // 扫描期间有人入队就再扫一遍，否则睡到下一次入队
+            std::unique_lock<std::mutex> lock(idleMtx);
+            idleCv.wait(lock, [&] { return stopping || epoch != seen; });
+        }
+    }
+
+    void push(size_t worker, Task task) {
+        pending++;
+        {
+            Queue& q = *queues[worker];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            q.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(idleMtx);
+            epoch++;
+        }
+        idleCv.notify_one();
+    }
+
+public:
+    explicit WorkStealingExecutor(size_t threads) : pending(0), stolen(0), epoch(0), stopping(false) {
+        if (threads == 0) threads = 1;
+        for (size_t i = 0; i < threads; ++i) queues.emplace_back(new Queue());
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back(&WorkStealingExecutor::workerLoop, this, i);
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    ~WorkStealingExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(idleMtx);
+            stopping = true;
+        }
+        idleCv.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // 累计被偷走执行的任务数
+    size_t steals() const {
+        return stolen;
+    }
+
+    // 只能在本执行器的任务里调用：子任务放进当前线程的队列尾部
+    void spawn(Task task) {
+        size_t self = currentWorker();
+        push(self < queues.size() ? self : 0, std::move(task));
+    }
+
+    // 初始任务轮流分给各个队列；任务抛出的第一个异常在全部结束后重新抛出
+    void run(std::vector<Task> roots) {
+        std::lock_guard<std::mutex> serial(runMtx);
+        failure = nullptr;
+        for (size_t i = 0; i < roots.size(); ++i) push(i % queues.size(), std::move(roots[i]));
+        std::unique_lock<std::mutex> lock(idleMtx);
+        doneCv.wait(lock, [this] { return pending == 0; });
+        if (failure) std::rethrow_exception(failure);
+    }
+};
+
+// 在当前任务里处理 [begin, end)：比 grain 长就把后一半 spawn 出去（可以被别的线程偷走），自己继续切前一半，
+// 最后对剩下的一段调用 fn(begin, end, worker)；fn 按值带进子任务，调用方不必让它活到 run 结束
+inline void splitRange(WorkStealingExecutor& ex, size_t begin, size_t end, size_t grain,
+                       std::function<void(size_t, size_t, size_t)> fn, size_t worker) {
+    if (grain == 0) grain = 1;
+    while (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        ex.spawn([&ex, mid, end, grain, fn](size_t w) { splitRange(ex, mid, end, grain, fn, w); });
+        end = mid;
+    }
+    fn(begin, end, worker);
+}
+
+// 与 thread_pool.hpp 的 parallelFor 相同的均分：[0, n) 切成 parts 段，fn(begin, end, part) 的 part 是段号（小于 parts），
+// 可以索引按段分开的累加器；区别是复用执行器里常驻的线程，不用每次调用都创建、回收线程
+inline void parallelFor(WorkStealingExecutor& ex, size_t n, size_t parts, const std::function<void(size_t, size_t, size_t)>& fn) {
+    if (parts <= 1 || n < parts * 2) {
+        fn(0, n, 0);
+        return;
+    }
+    size_t chunk = (n + parts - 1) / parts;
+    std::vector<WorkStealingExecutor::Task> roots;
+    for (size_t t = 0; t < parts; ++t) {
+        size_t begin = t * chunk;
+        size_t end = std::min(n, begin + chunk);
+        if (begin >= end) break;
+        roots.push_back([&fn, begin, end, t](size_t) { fn(begin, end, t); });
+    }
+    ex.run(std::move(roots));
+}
+
+namespace work_stealing_detail {
+
+inline void weightedRange(WorkStealingExecutor& ex, const std::vector<size_t>& prefix, size_t lo, size_t hi, size_t grain,
+                          const std::function<void(size_t, size_t)>& visit, size_t worker) {
+    // 按权重而不是项数对半分，重的项很快就会落到单独的任务里
+    while (hi - lo > 1 && prefix[hi] - prefix[lo] > grain) {
+        size_t half = prefix[lo] + (prefix[hi] - prefix[lo]) / 2;
+        size_t mid = static_cast<size_t>(std::upper_bound(prefix.begin() + lo + 1, prefix.begin() + hi, half) - prefix.begin());
+        mid = std::max(lo + 1, std::min(mid, hi - 1));
+        ex.spawn([&ex, &prefix, mid, hi, grain, &visit](size_t w) { weightedRange(ex, prefix, mid, hi, grain, visit, w); });
+        hi = mid;
+    }
+    for (size_t i = lo; i < hi; ++i) visit(i, worker);
+}
+
+}  // namespace work_stealing_detail
+
+// 对 n 项各调用一次 visit(i, worker)，prefix 是各项权重的前缀和（大小 n + 1）
+// 从整个区间出发按权重递归二分，直到区间总权重不超过 grain 或只剩一项；visit 里还可以用 splitRange 继续拆单个重项
+inline void parallelForWeighted(WorkStealingExecutor& ex, const std::vector<size_t>& prefix, size_t grain,
+                                const std::function<void(size_t, size_t)>& visit) {
+    if (prefix.size() < 2) return;
+    size_t n = prefix.size() - 1;
+    std::vector<WorkStealingExecutor::Task> roots;
+    roots.push_back([&ex, &prefix, n, grain, &visit](size_t w) {
+        work_stealing_detail::weightedRange(ex, prefix, 0, n, grain, visit, w);
+    });
+    ex.run(std::move(roots));
+}
+
+#endif
@@ -0,0 +1,681 @@
+#ifndef WORKLOAD_TRACE_HPP
+#define WORKLOAD_TRACE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "firmSys.hpp"
+
+// 工作负载的录制与回放：RecordingFirmSystem 包在任意 IFirmSystem 外面，把每次调用连同时间戳写进二进制 trace；
+// TraceReplayer 读回 trace，按原速或尽快驱动任意后端，统计每种操作的延迟分布，输出可以和上一个版本对比的报告
+enum class TraceOp : uint8_t {
+    AddFirm,
+    RemoveFirm,
+    GetFirm,
+    CleanString,
+    LoadFirms,
+    LoadPatents,
+    AddPatent,
+    AddPatents,
+    RemovePatent,
+    TransferPatent,
+    DisplayFirm,
+    DisplayFirms,
+    DisplayFirmsID,
+    ForEachFirm,
+    MemoryUsage,
+    SetLazyTitles,
+    SetCompressedTitles,
+    ParallelForEachFirm,
+    ParallelForEachPatent,
+    MergeFirms,
+    LookupFirms,
+    LookupPatents,
+    Count
+};
+
+inline const char* traceOpName(TraceOp op) {
+    static const char* names[] = {"addFirm",        "removeFirm",     "getFirm",         "cleanString",      "loadFirms",
+                                  "loadPatents",    "addPatent",      "addPatents",      "removePatent",     "transferPatent",
+                                  "displayFirm",    "displayFirms",   "displayFirmsID",  "forEachFirm",      "memoryUsage",
+                                  "setLazyTitles",  "setCompressedTitles", "parallelForEachFirm", "parallelForEachPatent",
+                                  "mergeFirms",     "lookupFirms",    "lookupPatents"};
+    return op < TraceOp::Count ? names[static_cast<size_t>(op)] : "?";
+}
+
+// 一次调用：时间是相对录制开始的纳秒；参数统一存成字符串，专利单独存
+struct TraceEvent {
+    TraceOp op;
+    uint64_t atNs;
+    std::vector<std::string> args;
+    std::vector<Patent> patents;
+};
+
+// 文件格式：魔数 "PTRC" + 版本号，之后每个事件依次是
+// 操作码(1 字节)、距上个事件的纳秒数、参数个数、各参数、专利个数、各专利的 6 个字段
+// 整数都用 LEB128 变长编码，字符串是长度 + 字节
+namespace trace_format {
+
+const char kMagic[4] = {'P', 'T', 'R', 'C'};
+const uint32_t kVersion = 1;
+
+inline void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline void putString(std::string& out, const std::string& s) {
+    putVarint(out, s.size());
+    out.append(s);
+}
+
+inline void putPatent(std::string& out, const Patent& p) {
+    putString(out, p.getPatentID());
+    putString(out, p.getGrantdate());
+    putString(out, p.getAppldate());
+    putString(out, p.getTitle());
+    putString(out, p.getCountry());
+    putString(out, p.getFirmID());
+}
+
+// 读指针越界或编码损坏时返回 false
+inline bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline bool getString(const char*& p, const char* end, std::string& s) {
+    uint64_t n;
+    if (!getVarint(p, end, n) || n > static_cast<uint64_t>(end - p)) return false;
+    s.assign(p, static_cast<size_t>(n));
+    p += n;
+    return true;
+}
+
+inline bool getPatent(const char*& p, const char* end, Patent& patent) {
+    std::string f[6];
+    for (auto& field : f) {
+        if (!getString(p, end, field)) return false;
+    }
+    patent = Patent(f[0], f[1], f[2], f[3], f[4], f[5]);
+    return true;
+}
+
+}  // namespace trace_format
+
+// 录制：先写 trace 再转发给被包装的系统，时间戳取调用开始的时刻
+// 可以多线程调用（内部加锁），缓冲攒到 1MB 写一次文件，析构时写完剩余部分
+// 观察者注册和 loadReport 不算工作负载，只转发不录制
+class RecordingFirmSystem : public IFirmSystem {
+private:
+    std::shared_ptr<IFirmSystem> inner;
+    // 只读的调用也要录制，所以这些都是 mutable
+    mutable std::ofstream out;
+    mutable std::string buffer;
+    mutable std::mutex mtx;
+    std::chrono::steady_clock::time_point start;
+    mutable uint64_t lastNs;
+    mutable size_t events;
+
+    void flushBuffer() const {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    void record(TraceOp op, std::initializer_list<std::string> args, const Patent* patents = nullptr,
+                size_t count = 0) const {
+        record(op, args.begin(), args.end(), patents, count);
+    }
+
+    void record(TraceOp op, const std::vector<std::string>& args) const {
+        record(op, args.data(), args.data() + args.size(), nullptr, 0);
+    }
+
+    void record(TraceOp op, const std::string* argsBegin, const std::string* argsEnd, const Patent* patents,
+                size_t count) const {
+        uint64_t now = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        std::lock_guard<std::mutex> lock(mtx);
+        // 多线程时取锁的顺序可能和取时间的顺序不同，保证时间单调
+        if (now < lastNs) now = lastNs;
+        buffer.push_back(static_cast<char>(op));
+        trace_format::putVarint(buffer, now - lastNs);
+        lastNs = now;
+        trace_format::putVarint(buffer, static_cast<uint64_t>(argsEnd - argsBegin));
+        for (const std::string* a = argsBegin; a != argsEnd; ++a) trace_format::putString(buffer, *a);
+        trace_format::putVarint(buffer, count);
+        for (size_t i = 0; i < count; ++i) trace_format::putPatent(buffer, patents[i]);
+        events++;
+        if (buffer.size() >= (1 << 20)) flushBuffer();
+    }
+
+public:
+    // 文件打不开时抛 std::runtime_error
+    RecordingFirmSystem(std::shared_ptr<IFirmSystem> inner, const std::string& tracePath)
+        : inner(inner), out(tracePath, std::ios::binary | std::ios::trunc), start(std::chrono::steady_clock::now()),
+          lastNs(0), events(0) {
+        if (!out) {
+            throw std::runtime_error("Cannot open trace file " + tracePath);
+        }
+        out.write(trace_format::kMagic, sizeof(trace_format::kMagic));
+        out.write(reinterpret_cast<const char*>(&trace_format::kVersion), sizeof(trace_format::kVersion));
+    }
+
+    ~RecordingFirmSystem() {
+        std::lock_guard<std::mutex> lock(mtx);
+        flushBuffer();
+    }
+
+    size_t recordedEvents() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return events;
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mtx);
+        flushBuffer();
+        out.flush();
+    }
+
+    void addFirm(const std::string& firmID, const std::string& firmName) override {
+        record(TraceOp::AddFirm, {firmID, firmName});
+        inner->addFirm(firmID, firmName);
+    }
+
+    void removeFirm(const std::string& firmID) override {
+        record(TraceOp::RemoveFirm, {firmID});
+        inner->removeFirm(firmID);
+    }
+
+    std::shared_ptr<IFirm> getFirm(const std::string& firmID) const override {
+        record(TraceOp::GetFirm, {firmID});
+        return inner->getFirm(firmID);
+    }
+
+    std::string cleanString(const std::string& input) override {
+        record(TraceOp::CleanString, {input});
+        return inner->cleanString(input);
+    }
+
+    void loadFirms(const std::string& filename) override {
+        record(TraceOp::LoadFirms, {filename});
+        inner->loadFirms(filename);
+    }
+
+    void loadPatentsFromCSV(const std::string& filename) override {
+        record(TraceOp::LoadPatents, {filename});
+        inner->loadPatentsFromCSV(filename);
+    }
+
+    void addPatentFirm(const std::string& firmID, Patent& patent) override {
+        record(TraceOp::AddPatent, {firmID}, &patent, 1);
+        inner->addPatentFirm(firmID, patent);
+    }
+
+    void addPatentsFirm(const std::string& firmID, std::vector<Patent>& patents) override {
+        record(TraceOp::AddPatents, {firmID}, patents.data(), patents.size());
+        inner->addPatentsFirm(firmID, patents);
+    }
+
+    void removePatentFirm(const std::string& firmID, const std::string& patentID) override {
+        record(TraceOp::RemovePatent, {firmID, patentID});
+        inner->removePatentFirm(firmID, patentID);
+    }
+
+    void transferPatent(const std::string& fromFirmID, const std::string& toFirmID, const std::string& patentID) override {
+        record(TraceOp::TransferPatent, {fromFirmID, toFirmID, patentID});
+        inner->transferPatent(fromFirmID, toFirmID, patentID);
+    }
+
+    void lookupMany(const std::vector<std::string>& firmIDs, std::vector<std::shared_ptr<IFirm>>& out) const override {
+        record(TraceOp::LookupFirms, firmIDs);
+        inner->lookupMany(firmIDs, out);
+    }
+
+    // 参数按 firmID、patentID 交替存放
+    void lookupMany(const std::vector<std::pair<std::string, std::string>>& keys,
+                    std::vector<const Patent*>& out) const override {
+        std::vector<std::string> args;
+        args.reserve(keys.size() * 2);
+        for (const auto& k : keys) {
+            args.push_back(k.first);
+            args.push_back(k.second);
+        }
+        record(TraceOp::LookupPatents, args);
+        inner->lookupMany(keys, out);
+    }
+
+    void mergeFirms(const std::string& intoFirmID, const std::string& fromFirmID) override {
+        record(TraceOp::MergeFirms, {intoFirmID, fromFirmID});
+        inner->mergeFirms(intoFirmID, fromFirmID);
+    }
+
+    void displayFirm(const std::string& firmID) const override {
+        record(TraceOp::DisplayFirm, {firmID});
+        inner->displayFirm(firmID);
+    }
+
+    void displayFirms() const override {
+        record(TraceOp::DisplayFirms, {});
+        inner->displayFirms();
+    }
+
+    void displayFirmsID() const override {
+        record(TraceOp::DisplayFirmsID, {});
+        inner->displayFirmsID();
+    }
+
+    void forEachFirm(const std::function<void(const std::shared_ptr<IFirm>&)>& fn) const override {
+        record(TraceOp::ForEachFirm, {});
+        inner->forEachFirm(fn);
+    }
+
+    void parallelForEachFirm(const std::function<void(const std::shared_ptr<IFirm>&, size_t)>& fn,
+                             size_t threads = 0) const override {
+        record(TraceOp::ParallelForEachFirm, {std::to_string(threads)});
+        inner->parallelForEachFirm(fn, threads);
+    }
+
+    void parallelForEachPatent(const std::function<void(const Patent&, size_t)>& fn, size_t threads = 0) const override {
+        record(TraceOp::ParallelForEachPatent, {std::to_string(threads)});
+        inner->parallelForEachPatent(fn, threads);
+    }
+
+    void addObserver(std::shared_ptr<IFirmSystemObserver> observer) override {
+        inner->addObserver(observer);
+    }
+
+    MemoryStats memoryUsage() const override {
+        record(TraceOp::MemoryUsage, {});
+        return inner->memoryUsage();
+    }
+
+    const NormalizeReport& loadReport() const override {
+        return inner->loadReport();
+    }
+
+    void setLazyTitles(bool lazy, size_t cacheEntries = 4096) override {
+        record(TraceOp::SetLazyTitles, {lazy ? "1" : "0", std::to_string(cacheEntries)});
+        inner->setLazyTitles(lazy, cacheEntries);
+    }
+
+    void setCompressedTitles(bool compressed) override {
+        record(TraceOp::SetCompressedTitles, {compressed ? "1" : "0"});
+        inner->setCompressedTitles(compressed);
+    }
+};
+
+// 读入整个 trace；文件不存在、魔数不对或内容截断时返回 false 并给出原因
+inline bool loadTrace(const std::string& path, std::vector<TraceEvent>& events, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 8 || std::memcmp(data.data(), trace_format::kMagic, 4) != 0) {
+        error = path + " is not a workload trace";
+        return false;
+    }
+    uint32_t version;
+    std::memcpy(&version, data.data() + 4, sizeof(version));
+    if (version != trace_format::kVersion) {
+        error = "unsupported trace version " + std::to_string(version);
+        return false;
+    }
+
+    events.clear();
+    const char* p = data.data() + 8;
+    const char* end = data.data() + data.size();
+    uint64_t at = 0;
+    while (p < end) {
+        TraceEvent e;
+        uint8_t op = static_cast<uint8_t>(*p++);
+        uint64_t delta, nargs, npatents;
+        bool ok = op < static_cast<uint8_t>(TraceOp::Count) && trace_format::getVarint(p, end, delta) &&
+                  trace_format::getVarint(p, end, nargs) && nargs <= static_cast<uint64_t>(end - p);
+        e.op = static_cast<TraceOp>(op);
+        at += ok ? delta : 0;
+        e.atNs = at;
+        e.args.resize(ok ? static_cast<size_t>(nargs) : 0);
+        for (size_t i = 0; ok && i < e.args.size(); ++i) ok = trace_format::getString(p, end, e.args[i]);
+        ok = ok && trace_format::getVarint(p, end, npatents) && npatents <= static_cast<uint64_t>(end - p);
+        if (ok) e.patents.resize(static_cast<size_t>(npatents));
+        for (size_t i = 0; ok && i < e.patents.size(); ++i) ok = trace_format::getPatent(p, end, e.patents[i]);
+        if (!ok) {
+            error = "corrupt event #" + std::to_string(events.size());
+            return false;
+        }
+        events.push_back(std::move(e));
+    }
+    return true;
+}
+
+// 对数-线性直方图：每个 2 的幂区间再等分 16 份，相对误差不超过 1/16，合并就是逐桶相加
+class LatencyHistogram {
+private:
+    enum { kSubBits = 4, kSub = 1 << kSubBits, kBuckets = 61 * kSub };
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t maxValue;
+
+    static size_t indexOf(uint64_t v) {
+        if (v < kSub) return static_cast<size_t>(v);
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        unsigned shift = msb - kSubBits;
+        return static_cast<size_t>(msb - kSubBits + 1) * kSub + static_cast<size_t>((v >> shift) & (kSub - 1));
+    }
+
+    // 桶的中点
+    static uint64_t valueOf(size_t index) {
+        if (index < kSub) return index;
+        size_t group = index / kSub;
+        uint64_t low = static_cast<uint64_t>(kSub + index % kSub) << (group - 1);
+        return low + ((1ULL << (group - 1)) >> 1);
+    }
+
+public:
+    LatencyHistogram() : counts(kBuckets, 0), total(0), sum(0), maxValue(0) {}
+
+    void record(uint64_t ns) {
+        counts[indexOf(ns)]++;
+        total++;
+        sum += ns;
+        if (ns > maxValue) maxValue = ns;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        if (other.maxValue > maxValue) maxValue = other.maxValue;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double mean() const {
+        return total ? static_cast<double>(sum) / total : 0.0;
+    }
+
+    uint64_t max() const {
+        return maxValue;
+    }
+
+    // q 取 0~1
+    uint64_t percentile(double q) const {
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(q * total));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(valueOf(i), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+// 每种操作一行的延迟统计
+struct ReplayReport {
+    struct Row {
+        LatencyHistogram latency;
+        uint64_t errors = 0;
+    };
+    std::map<std::string, Row> ops;
+    size_t replayers = 0;
+    double seconds = 0.0;
+    uint64_t events = 0;
+    // 读操作结果的累加值（命中数、长度等），让编译器不能把调用优化掉；同一 trace 回放结果应当一致
+    uint64_t checksum = 0;
+
+    void merge(const ReplayReport& other) {
+        for (const auto& entry : other.ops) {
+            ops[entry.first].latency.merge(entry.second.latency);
+            ops[entry.first].errors += entry.second.errors;
+        }
+        events += other.events;
+        checksum += other.checksum;
+    }
+
+    // 制表符分隔，第一行是列名，方便存档后用 compareReports 或别的工具对比
+    void write(std::ostream& os) const {
+        os << "op\tcount\terrors\tmean_ns\tp50_ns\tp90_ns\tp99_ns\tp999_ns\tmax_ns\n";
+        for (const auto& entry : ops) {
+            const LatencyHistogram& h = entry.second.latency;
+            os << entry.first << '\t' << h.count() << '\t' << entry.second.errors << '\t'
+               << static_cast<uint64_t>(h.mean()) << '\t' << h.percentile(0.5) << '\t' << h.percentile(0.9) << '\t'
+               << h.percentile(0.99) << '\t' << h.percentile(0.999) << '\t' << h.max() << '\n';
+        }
+    }
+};
+
+// 读回 write 写出的报告：op -> 各列数值（按列名）
+inline bool readReport(const std::string& path, std::map<std::string, std::map<std::string, double>>& rows) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    std::vector<std::string> header;
+    while (std::getline(in, line)) {
+        std::vector<std::string> cells;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, '\t')) cells.push_back(cell);
+        if (header.empty()) {
+            header = cells;
+            continue;
+        }
+        for (size_t i = 1; i < cells.size() && i < header.size(); ++i) {
+            rows[cells[0]][header[i]] = std::atof(cells[i].c_str());
+        }
+    }
+    return !header.empty();
+}
+
+// 和基线报告逐项比较 p50/p99，变慢超过 thresholdPercent 的记为回归，返回回归的项数
+inline size_t compareReports(const std::map<std::string, std::map<std::string, double>>& baseline, const ReplayReport& current,
+                             double thresholdPercent, std::ostream& os) {
+    size_t regressions = 0;
+    for (const auto& entry : current.ops) {
+        auto base = baseline.find(entry.first);
+        if (base == baseline.end()) {
+            os << entry.first << ": not in baseline" << std::endl;
+            continue;
+        }
+        const LatencyHistogram& h = entry.second.latency;
+        const char* columns[] = {"p50_ns", "p99_ns"};
+        double values[] = {static_cast<double>(h.percentile(0.5)), static_cast<double>(h.percentile(0.99))};
+        for (int c = 0; c < 2; ++c) {
+            auto it = base->second.find(columns[c]);
+            if (it == base->second.end() || it->second <= 0) continue;
+            double change = (values[c] - it->second) / it->second * 100.0;
+            bool regressed = change > thresholdPercent;
+            regressions += regressed ? 1 : 0;
+            os << entry.first << " " << columns[c] << ": " << static_cast<uint64_t>(it->second) << " -> "
+               << static_cast<uint64_t>(values[c]) << " ns (" << (change >= 0 ? "+" : "") << static_cast<int>(std::round(change))
+               << "%)" << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+    }
+    return regressions;
+}
+
+// 把输出丢掉的流缓冲，回放 display 类操作时替换 std::cout
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        return n;
+    }
+};
+
+// 回放：按事件顺序调用后端，只计每次调用本身的耗时
+// IFirmSystem 不是线程安全的，N 个回放者各自用 factory 建一个后端，同时开跑，争用的是 CPU、内存带宽和分配器
+class TraceReplayer {
+public:
+    enum class Pace { AsFastAsPossible, Recorded };
+
+    struct Options {
+        Pace pace = Pace::AsFastAsPossible;
+        double speed = 1.0;      // Recorded 时的倍速
+        size_t replayers = 1;
+        bool quiet = true;       // 回放期间丢弃 std::cout 的输出
+    };
+
+private:
+    const std::vector<TraceEvent>& events;
+
+    // 失败（抛异常）的调用计入 errors，不中断回放
+    static void apply(IFirmSystem& system, const TraceEvent& e, size_t& sink) {
+        const std::vector<std::string>& a = e.args;
+        switch (e.op) {
+            case TraceOp::AddFirm: system.addFirm(a.at(0), a.at(1)); break;
+            case TraceOp::RemoveFirm: system.removeFirm(a.at(0)); break;
+            case TraceOp::GetFirm: sink += system.getFirm(a.at(0)) ? 1 : 0; break;
+            case TraceOp::CleanString: sink += system.cleanString(a.at(0)).size(); break;
+            case TraceOp::LoadFirms: system.loadFirms(a.at(0)); break;
+            case TraceOp::LoadPatents: system.loadPatentsFromCSV(a.at(0)); break;
+            case TraceOp::AddPatent: {
+                Patent p = e.patents.at(0);
+                system.addPatentFirm(a.at(0), p);
+                break;
+            }
+            case TraceOp::AddPatents: {
+                std::vector<Patent> batch = e.patents;
+                system.addPatentsFirm(a.at(0), batch);
+                break;
+            }
+            case TraceOp::RemovePatent: system.removePatentFirm(a.at(0), a.at(1)); break;
+            case TraceOp::TransferPatent: system.transferPatent(a.at(0), a.at(1), a.at(2)); break;
+            case TraceOp::MergeFirms: system.mergeFirms(a.at(0), a.at(1)); break;
+            case TraceOp::LookupFirms: {
+                std::vector<std::shared_ptr<IFirm>> firms;
+                system.lookupMany(a, firms);
+                for (const auto& firm : firms) sink += firm ? 1 : 0;
+                break;
+            }
+            case TraceOp::LookupPatents: {
+                std::vector<std::pair<std::string, std::string>> keys;
+                for (size_t i = 0; i + 1 < a.size(); i += 2) keys.push_back(std::make_pair(a[i], a[i + 1]));
+                std::vector<const Patent*> patents;
+                system.lookupMany(keys, patents);
+                for (const Patent* p : patents) sink += p ? 1 : 0;
+                break;
+            }
+            case TraceOp::DisplayFirm: system.displayFirm(a.at(0)); break;
+            case TraceOp::DisplayFirms: system.displayFirms(); break;
+            case TraceOp::DisplayFirmsID: system.displayFirmsID(); break;
+            case TraceOp::ForEachFirm:
+                system.forEachFirm([&](const std::shared_ptr<IFirm>& firm) {
+                    sink += static_cast<size_t>(firm->getPatentCount());
+                });
+                break;
+            case TraceOp::MemoryUsage: sink += system.memoryUsage().total(); break;
+            case TraceOp::ParallelForEachFirm: {
+                std::atomic<size_t> patents(0);
+                system.parallelForEachFirm([&](const std::shared_ptr<IFirm>& firm, size_t) {
+                    patents += static_cast<size_t>(firm->getPatentCount());
+                }, std::stoul(a.at(0)));
+                sink += patents;
+                break;
+            }
+            case TraceOp::ParallelForEachPatent: {
+                std::atomic<size_t> patents(0);
+                system.parallelForEachPatent([&](const Patent&, size_t) { patents++; }, std::stoul(a.at(0)));
+                sink += patents;
+                break;
+            }
+            case TraceOp::SetLazyTitles: system.setLazyTitles(a.at(0) == "1", std::stoul(a.at(1))); break;
+            case TraceOp::SetCompressedTitles: system.setCompressedTitles(a.at(0) == "1"); break;
+            default: throw std::invalid_argument("unknown trace op");
+        }
+    }
+
+    ReplayReport replayOne(IFirmSystem& system, const Options& options, std::chrono::steady_clock::time_point start) const {
+        ReplayReport report;
+        std::vector<ReplayReport::Row*> rows(static_cast<size_t>(TraceOp::Count));
+        for (size_t op = 0; op < rows.size(); ++op) rows[op] = &report.ops[traceOpName(static_cast<TraceOp>(op))];
+        size_t sink = 0;
+        for (const auto& e : events) {
+            if (options.pace == Pace::Recorded) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<int64_t>(e.atNs / options.speed)));
+            }
+            ReplayReport::Row& row = *rows[static_cast<size_t>(e.op)];
+            auto begin = std::chrono::steady_clock::now();
+            try {
+                apply(system, e, sink);
+            } catch (const std::exception&) {
+                row.errors++;
+            }
+            auto end = std::chrono::steady_clock::now();
+            row.latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+        }
+        report.events = events.size();
+        // 去掉没出现过的操作
+        for (auto it = report.ops.begin(); it != report.ops.end();) {
+            if (it->second.latency.count() == 0) {
+                it = report.ops.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        report.checksum = sink;
+        return report;
+    }
+
+public:
+    explicit TraceReplayer(const std::vector<TraceEvent>& events) : events(events) {}
+
+    ReplayReport run(const std::function<std::shared_ptr<IFirmSystem>()>& factory, const Options& options) const {
+        size_t n = options.replayers == 0 ? 1 : options.replayers;
+        std::vector<std::shared_ptr<IFirmSystem>> systems;
+        for (size_t i = 0; i < n; ++i) systems.push_back(factory());
+
+        NullBuffer null;
+        std::streambuf* saved = options.quiet ? std::cout.rdbuf(&null) : nullptr;
+        std::vector<ReplayReport> reports(n);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n; ++i) {
+            threads.emplace_back([&, i]() {
+                reports[i] = replayOne(*systems[i], options, start);
+            });
+        }
+        for (auto& t : threads) t.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (saved) std::cout.rdbuf(saved);
+
+        ReplayReport merged;
+        for (const auto& r : reports) merged.merge(r);
+        merged.replayers = n;
+        merged.seconds = seconds;
+        return merged;
+    }
+};
+
+#endif